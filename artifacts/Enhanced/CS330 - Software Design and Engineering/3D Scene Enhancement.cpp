@@ -2,11 +2,57 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cctype>
+
+// SIMD paths are compiled in only when the target guarantees the instruction set
+#if defined(__AVX2__)
+#define SIMD_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#endif
+#if defined(SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+// Memory-mapped mesh caches (see MappedFile)
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/constants.hpp>
 
 // Define STB Image implementation
 #define STB_IMAGE_IMPLEMENTATION
@@ -43,8 +89,8 @@ bool perspective = false;
 // Camera setup
 Camera gCamera(glm::vec3(-5.0f, 4.0f, -0.3f), glm::vec3(0.0f, 1.0f, 0.0f), 10.0f, -30.0f);
 
-// Function to flip image vertically for texture loading
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
+// Original byte-at-a-time flip, kept as the reference for the flip benchmark
+void flipImageVerticallyScalar(unsigned char* image, int width, int height, int channels)
 {
     for (int j = 0; j < height / 2; ++j)
     {
@@ -62,863 +108,10258 @@ void flipImageVertically(unsigned char* image, int width, int height, int channe
     }
 }
 
-// ************** ENHANCEMENT: Shape Base Class **************
-// Base class for all 3D shapes
-class Shape {
-protected:
-    // Protected variables to store shape data
-    vector<float> vertices;
-    vector<unsigned int> indices;
-    
-    // Shape properties
-    glm::vec3 position;
-    glm::vec3 scale;
-    glm::vec3 color;
-    string texturePath;
-    glm::vec2 uvScale;
-    
-    // OpenGL objects
-    GLuint vao = 0;
-    GLuint vbo = 0;
-    GLuint ebo = 0;
-    GLuint textureId = 0;
-    
-public:
-    // Constructor with default values
-    Shape(
-        const glm::vec3& pos = glm::vec3(0.0f),
-        const glm::vec3& scl = glm::vec3(1.0f),
-        const glm::vec3& col = glm::vec3(1.0f),
-        const string& texPath = "",
-        const glm::vec2& uvScl = glm::vec2(1.0f)
-    ) : position(pos), scale(scl), color(col), texturePath(texPath), uvScale(uvScl) {
-        // Constructor initializes member variables
+// Swap two rows of bytes using the widest vector registers available, then a scalar tail
+inline void swapImageRows(unsigned char* rowA, unsigned char* rowB, size_t rowBytes)
+{
+    size_t i = 0;
+#ifdef SIMD_AVX2
+    for (; i + 32 <= rowBytes; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rowA + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rowB + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rowA + i), b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rowB + i), a);
     }
-    
-    // Virtual destructor for proper cleanup in derived classes
-    virtual ~Shape() {
-        // Cleanup OpenGL resources
-        if (vao != 0) {
-            glDeleteVertexArrays(1, &vao);
+#endif
+#ifdef SIMD_SSE2
+    for (; i + 16 <= rowBytes; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowA + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowB + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rowA + i), b);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rowB + i), a);
+    }
+#endif
+    for (; i < rowBytes; ++i) {
+        unsigned char tmp = rowA[i];
+        rowA[i] = rowB[i];
+        rowB[i] = tmp;
+    }
+}
+
+// Function to flip image vertically for texture loading
+void flipImageVertically(unsigned char* image, int width, int height, int channels)
+{
+    size_t rowBytes = static_cast<size_t>(width) * channels;
+    for (int j = 0; j < height / 2; ++j)
+    {
+        swapImageRows(image + j * rowBytes, image + (height - 1 - j) * rowBytes, rowBytes);
+    }
+}
+
+// ************** ENHANCEMENT: Profiler Class **************
+// Hierarchical frame profiler for the render thread. CPU scopes are timed with
+// steady_clock; GPU scopes with GL_TIMESTAMP query pairs (GL_TIME_ELAPSED queries
+// cannot nest). Query pairs are double-buffered by frame and read two frames
+// later, so the CPU does not normally wait for the GPU.
+class Profiler {
+public:
+    static const int HISTORY_FRAMES = 240;
+
+    struct Statistics {
+        double min = 0.0;
+        double average = 0.0;
+        double p99 = 0.0;
+        size_t samples = 0;
+    };
+
+private:
+    // Last HISTORY_FRAMES per-frame totals of one scope
+    struct RollingWindow {
+        vector<float> samples;
+        size_t next = 0;
+
+        void push(float value) {
+            if (samples.size() < HISTORY_FRAMES) {
+                samples.push_back(value);
+            } else {
+                samples[next] = value;
+                next = (next + 1) % HISTORY_FRAMES;
+            }
         }
-        if (vbo != 0) {
-            glDeleteBuffers(1, &vbo);
+
+        Statistics compute() const {
+            Statistics statistics;
+            if (samples.empty()) {
+                return statistics;
+            }
+            vector<float> sorted = samples;
+            sort(sorted.begin(), sorted.end());
+            double total = 0.0;
+            for (float value : sorted) {
+                total += value;
+            }
+            statistics.min = sorted.front();
+            statistics.average = total / sorted.size();
+            statistics.p99 = sorted[min(sorted.size() - 1, (size_t)(sorted.size() * 0.99))];
+            statistics.samples = sorted.size();
+            return statistics;
         }
-        if (ebo != 0) {
-            glDeleteBuffers(1, &ebo);
+    };
+
+    struct QueryPair {
+        GLuint begin;
+        GLuint end;
+    };
+
+    // One scope in the call tree; a scope entered several times per frame sums its entries
+    struct Node {
+        const char* name;
+        int parent;
+        int depth;
+        vector<int> children;
+        double cpuFrameMs = 0.0;
+        bool hitThisFrame = false;
+        RollingWindow cpu;
+        RollingWindow gpu;
+        vector<QueryPair> queries[2];
+        size_t queriesUsed[2] = { 0, 0 };
+    };
+
+    // Open scope on the stack
+    struct OpenScope {
+        int node;
+        chrono::steady_clock::time_point start;
+        int queryPair;  // -1 for CPU-only scopes
+    };
+
+    // Complete event for the Chrome trace ("ph": "X"); track 0 is CPU, 1 is GPU
+    struct TraceEvent {
+        const char* name;
+        double startUs;
+        double durationUs;
+        int track;
+    };
+
+    vector<Node> nodes;
+    vector<OpenScope> stack;
+    bool enabled = false;
+    uint64_t frameIndex = 0;
+
+    chrono::steady_clock::time_point cpuEpoch;
+    GLint64 gpuEpoch = 0;
+
+    vector<TraceEvent> traceEvents;
+    int traceFramesLeft = 0;
+    string tracePath;
+    bool bufferTraced[2] = { false, false };
+
+    Profiler() = default;
+
+    int findOrAddChild(int parent, const char* name) {
+        if (parent >= 0) {
+            for (int child : nodes[parent].children) {
+                if (nodes[child].name == name || strcmp(nodes[child].name, name) == 0) {
+                    return child;
+                }
+            }
+        } else if (!nodes.empty()) {
+            return 0;  // the only root is the frame scope
         }
-        if (textureId != 0) {
-            glDeleteTextures(1, &textureId);
+        Node node;
+        node.name = name;
+        node.parent = parent;
+        node.depth = parent >= 0 ? nodes[parent].depth + 1 : 0;
+        nodes.push_back(node);
+        int index = (int)nodes.size() - 1;
+        if (parent >= 0) {
+            nodes[parent].children.push_back(index);
         }
+        return index;
     }
-    
-    // Pure virtual functions to be implemented by derived classes
-    virtual void generateVertices() = 0;
-    virtual void generateIndices() = 0;
-    
-    // Setup buffers for OpenGL rendering
-    void setupBuffers() {
-        // Create and bind Vertex Array Object (VAO)
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
 
-        // Create and bind Vertex Buffer Object (VBO)
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    double toTraceMicroseconds(chrono::steady_clock::time_point time) const {
+        return chrono::duration<double, micro>(time - cpuEpoch).count();
+    }
 
-        // Create and bind Element Buffer Object (EBO) if indices are used
-        if (!indices.empty()) {
-            glGenBuffers(1, &ebo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    // Read the GPU timestamps written into one query buffer two frames ago
+    void resolveQueries(int buffer) {
+        for (Node& node : nodes) {
+            if (node.queriesUsed[buffer] == 0) {
+                continue;
+            }
+            double totalMs = 0.0;
+            for (size_t i = 0; i < node.queriesUsed[buffer]; ++i) {
+                GLuint64 begin = 0;
+                GLuint64 end = 0;
+                glGetQueryObjectui64v(node.queries[buffer][i].begin, GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(node.queries[buffer][i].end, GL_QUERY_RESULT, &end);
+                totalMs += (end - begin) / 1.0e6;
+                if (bufferTraced[buffer]) {
+                    traceEvents.push_back({ node.name, (GLint64)begin > gpuEpoch ? ((GLint64)begin - gpuEpoch) / 1.0e3 : 0.0,
+                                            (end - begin) / 1.0e3, 1 });
+                }
+            }
+            node.gpu.push((float)totalMs);
+            node.queriesUsed[buffer] = 0;
         }
+        bufferTraced[buffer] = false;
+    }
 
-        // Set vertex attribute pointers
-        // Position attribute (3 floats)
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-        
-        // Normal attribute (3 floats)
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-        
-        // Texture coordinates attribute (2 floats)
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(2);
+    // Push a scope as a child of the innermost open scope (or as the frame root)
+    void openScope(const char* name, bool gpu) {
+        int parent = stack.empty() ? -1 : stack.back().node;
+        int index = findOrAddChild(parent, name);
 
-        // Unbind VAO
-        glBindVertexArray(0);
+        int queryPair = -1;
+        if (gpu) {
+            Node& node = nodes[index];
+            int buffer = frameIndex % 2;
+            if (node.queriesUsed[buffer] == node.queries[buffer].size()) {
+                QueryPair pair;
+                glGenQueries(1, &pair.begin);
+                glGenQueries(1, &pair.end);
+                node.queries[buffer].push_back(pair);
+            }
+            queryPair = (int)node.queriesUsed[buffer]++;
+            glQueryCounter(node.queries[buffer][queryPair].begin, GL_TIMESTAMP);
+        }
+        stack.push_back({ index, chrono::steady_clock::now(), queryPair });
     }
-    
-    // Load texture from file
-    bool loadTexture() {
-        if (texturePath.empty()) {
-            return false;
+
+    void printNode(ostream& out, int index) const {
+        const Node& node = nodes[index];
+        Statistics cpu = node.cpu.compute();
+        Statistics gpu = node.gpu.compute();
+        string label = string(node.depth * 2, ' ') + node.name;
+        out << left << setw(28) << label << right << fixed << setprecision(3)
+            << setw(9) << cpu.min << setw(9) << cpu.average << setw(9) << cpu.p99;
+        if (gpu.samples > 0) {
+            out << setw(9) << gpu.min << setw(9) << gpu.average << setw(9) << gpu.p99;
         }
-        
-        int width, height, channels;
-        unsigned char* image = stbi_load(texturePath.c_str(), &width, &height, &channels, 0);
-        
-        if (!image) {
-            cerr << "Failed to load texture: " << texturePath << endl;
-            return false;
+        out << endl;
+        for (int child : node.children) {
+            printNode(out, child);
         }
-        
-        // Flip the image vertically for OpenGL coordinate system
-        flipImageVertically(image, width, height, channels);
-        
-        // Generate and bind texture
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-        
-        // Set texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        
-        // Set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        
-        // Upload texture data
-        if (channels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        } else if (channels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        } else {
-            cerr << "Not implemented to handle an image with " << channels << " channels" << endl;
-            stbi_image_free(image);
-            return false;
+    }
+
+public:
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    ~Profiler() {
+        for (Node& node : nodes) {
+            for (vector<QueryPair>& buffer : node.queries) {
+                for (QueryPair& pair : buffer) {
+                    glDeleteQueries(1, &pair.begin);
+                    glDeleteQueries(1, &pair.end);
+                }
+            }
         }
-        
-        // Generate mipmaps
-        glGenerateMipmap(GL_TEXTURE_2D);
-        
-        // Free image data
-        stbi_image_free(image);
-        
-        // Unbind texture
-        glBindTexture(GL_TEXTURE_2D, 0);
-        
-        return true;
     }
-    
-    // Draw the shape with specified shader program
-    void draw(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection) {
-        glUseProgram(shaderProgram);
-        
-        // Create model matrix (position and scale)
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, position);
-        model = glm::scale(model, scale);
-        
-        // Set shader uniforms
-        GLint modelLoc = glGetUniformLocation(shaderProgram, "model");
-        GLint viewLoc = glGetUniformLocation(shaderProgram, "view");
-        GLint projLoc = glGetUniformLocation(shaderProgram, "projection");
-        
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        
-        // Set color uniform
-        GLint colorLoc = glGetUniformLocation(shaderProgram, "objectColor");
-        glUniform3f(colorLoc, color.r, color.g, color.b);
-        
-        // Set UV scale uniform
-        GLint uvScaleLoc = glGetUniformLocation(shaderProgram, "uvScale");
-        glUniform2fv(uvScaleLoc, 1, glm::value_ptr(uvScale));
-        
-        // Bind texture if available
-        if (textureId != 0) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, textureId);
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // Profiling is off by default; disabled scopes cost one branch
+    void setEnabled(bool value) {
+        if (value && !enabled) {
+            cpuEpoch = chrono::steady_clock::now();
+            glGetInteger64v(GL_TIMESTAMP, &gpuEpoch);
         }
-        
-        // Bind VAO and draw
-        glBindVertexArray(vao);
-        
-        if (!indices.empty()) {
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        } else {
-            glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 8); // 8 floats per vertex
+        enabled = value;
+    }
+    bool isEnabled() const { return enabled; }
+
+    // Open the root "Frame" scope and collect GPU results from two frames ago
+    void beginFrame() {
+        if (!enabled) {
+            return;
         }
-        
-        // Unbind VAO
-        glBindVertexArray(0);
+        resolveQueries(frameIndex % 2);
+        bufferTraced[frameIndex % 2] = traceFramesLeft > 0;
+        openScope("Frame", true);
     }
-    
-    // Getters and setters
-    glm::vec3 getPosition() const { return position; }
-    void setPosition(const glm::vec3& pos) { position = pos; }
-    
-    glm::vec3 getScale() const { return scale; }
-    void setScale(const glm::vec3& scl) { scale = scl; }
-    
-    glm::vec3 getColor() const { return color; }
-    void setColor(const glm::vec3& col) { color = col; }
-    
-    string getTexturePath() const { return texturePath; }
-    void setTexturePath(const string& path) { texturePath = path; }
-    
-    glm::vec2 getUVScale() const { return uvScale; }
-    void setUVScale(const glm::vec2& uvScl) { uvScale = uvScl; }
-    
-    GLuint getVAO() const { return vao; }
-    GLuint getTextureId() const { return textureId; }
-    unsigned int getIndicesCount() const { return indices.size(); }
-};
 
-// ************** ENHANCEMENT: Cube Class **************
-// Cube shape derived from Shape base class
-class Cube : public Shape {
-private:
-    float size; // Size of the cube
+    // Close the root scope and push this frame's CPU totals into the rolling windows
+    void endFrame() {
+        if (!enabled) {
+            return;
+        }
+        endScope();
+        for (Node& node : nodes) {
+            if (node.hitThisFrame) {
+                node.cpu.push((float)node.cpuFrameMs);
+                node.cpuFrameMs = 0.0;
+                node.hitThisFrame = false;
+            }
+        }
+        ++frameIndex;
+        if (traceFramesLeft > 0 && --traceFramesLeft == 0) {
+            if (writeTrace(tracePath)) {
+                cout << "Wrote trace " << tracePath << endl;
+            }
+        }
+    }
 
-public:
-    // Constructor with size parameter and other properties
-    Cube(
-        float cubeSize = 1.0f,
-        const glm::vec3& pos = glm::vec3(0.0f),
-        const glm::vec3& scl = glm::vec3(1.0f),
-        const glm::vec3& col = glm::vec3(1.0f),
-        const string& texPath = "",
-        const glm::vec2& uvScl = glm::vec2(1.0f)
-    ) : Shape(pos, scl, col, texPath, uvScl), size(cubeSize) {
-        // Generate geometry (vertices and indices) for the cube
-        generateVertices();
-        generateIndices();
-        
-        // Setup VAO, VBO, and EBO
-        setupBuffers();
-        
-        // Load texture if path is provided
-        if (!texturePath.empty()) {
-            loadTexture();
+    // Scopes outside beginFrame()/endFrame() are ignored
+    void beginScope(const char* name, bool gpu = false) {
+        if (!enabled || stack.empty()) {
+            return;
         }
+        openScope(name, gpu);
     }
 
-    // Generate vertices for the cube
-    void generateVertices() override {
-        // Clear any existing vertices
-        vertices.clear();
-        
-        // Half size for easier calculations
-        float halfSize = size / 2.0f;
-        
-        // Cube vertices with normals and texture coordinates (8 components per vertex)
-        // Format: position (3), normal (3), texture coordinates (2)
-        
-        // Front face (positive Z)
-        vertices.push_back(-halfSize); vertices.push_back(-halfSize); vertices.push_back(halfSize);  // Position
-        vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(1.0f);               // Normal
-        vertices.push_back(0.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(-halfSize); vertices.push_back(halfSize);   // Position
-        vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(1.0f);               // Normal
-        vertices.push_back(1.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(halfSize); vertices.push_back(halfSize);    // Position
-        vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(1.0f);               // Normal
-        vertices.push_back(1.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        vertices.push_back(-halfSize); vertices.push_back(halfSize); vertices.push_back(halfSize);   // Position
-        vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(1.0f);               // Normal
-        vertices.push_back(0.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        // Back face (negative Z)
-        vertices.push_back(-halfSize); vertices.push_back(-halfSize); vertices.push_back(-halfSize); // Position
-        vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(-1.0f);              // Normal
-        vertices.push_back(1.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(-halfSize); vertices.push_back(-halfSize);  // Position
-        vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(-1.0f);              // Normal
-        vertices.push_back(0.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(halfSize); vertices.push_back(-halfSize);   // Position
-        vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(-1.0f);              // Normal
-        vertices.push_back(0.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        vertices.push_back(-halfSize); vertices.push_back(halfSize); vertices.push_back(-halfSize);  // Position
-        vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(-1.0f);              // Normal
-        vertices.push_back(1.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        // Left face (negative X)
-        vertices.push_back(-halfSize); vertices.push_back(-halfSize); vertices.push_back(-halfSize); // Position
-        vertices.push_back(-1.0f); vertices.push_back(0.0f); vertices.push_back(0.0f);              // Normal
-        vertices.push_back(0.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(-halfSize); vertices.push_back(-halfSize); vertices.push_back(halfSize);  // Position
-        vertices.push_back(-1.0f); vertices.push_back(0.0f); vertices.push_back(0.0f);              // Normal
-        vertices.push_back(1.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(-halfSize); vertices.push_back(halfSize); vertices.push_back(halfSize);   // Position
-        vertices.push_back(-1.0f); vertices.push_back(0.0f); vertices.push_back(0.0f);              // Normal
-        vertices.push_back(1.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        vertices.push_back(-halfSize); vertices.push_back(halfSize); vertices.push_back(-halfSize);  // Position
-        vertices.push_back(-1.0f); vertices.push_back(0.0f); vertices.push_back(0.0f);              // Normal
-        vertices.push_back(0.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        // Right face (positive X)
-        vertices.push_back(halfSize); vertices.push_back(-halfSize); vertices.push_back(-halfSize);  // Position
-        vertices.push_back(1.0f); vertices.push_back(0.0f); vertices.push_back(0.0f);               // Normal
-        vertices.push_back(1.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(-halfSize); vertices.push_back(halfSize);   // Position
-        vertices.push_back(1.0f); vertices.push_back(0.0f); vertices.push_back(0.0f);               // Normal
-        vertices.push_back(0.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(halfSize); vertices.push_back(halfSize);    // Position
-        vertices.push_back(1.0f); vertices.push_back(0.0f); vertices.push_back(0.0f);               // Normal
-        vertices.push_back(0.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(halfSize); vertices.push_back(-halfSize);   // Position
-        vertices.push_back(1.0f); vertices.push_back(0.0f); vertices.push_back(0.0f);               // Normal
-        vertices.push_back(1.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        // Bottom face (negative Y)
-        vertices.push_back(-halfSize); vertices.push_back(-halfSize); vertices.push_back(-halfSize); // Position
-        vertices.push_back(0.0f); vertices.push_back(-1.0f); vertices.push_back(0.0f);              // Normal
-        vertices.push_back(0.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(-halfSize); vertices.push_back(-halfSize);  // Position
-        vertices.push_back(0.0f); vertices.push_back(-1.0f); vertices.push_back(0.0f);              // Normal
-        vertices.push_back(1.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(-halfSize); vertices.push_back(halfSize);   // Position
-        vertices.push_back(0.0f); vertices.push_back(-1.0f); vertices.push_back(0.0f);              // Normal
-        vertices.push_back(1.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(-halfSize); vertices.push_back(-halfSize); vertices.push_back(halfSize);  // Position
-        vertices.push_back(0.0f); vertices.push_back(-1.0f); vertices.push_back(0.0f);              // Normal
-        vertices.push_back(0.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        // Top face (positive Y)
-        vertices.push_back(-halfSize); vertices.push_back(halfSize); vertices.push_back(-halfSize);  // Position
-        vertices.push_back(0.0f); vertices.push_back(1.0f); vertices.push_back(0.0f);               // Normal
-        vertices.push_back(0.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(halfSize); vertices.push_back(-halfSize);   // Position
-        vertices.push_back(0.0f); vertices.push_back(1.0f); vertices.push_back(0.0f);               // Normal
-        vertices.push_back(1.0f); vertices.push_back(0.0f);                                         // Texture coords
-        
-        vertices.push_back(halfSize); vertices.push_back(halfSize); vertices.push_back(halfSize);    // Position
-        vertices.push_back(0.0f); vertices.push_back(1.0f); vertices.push_back(0.0f);               // Normal
-        vertices.push_back(1.0f); vertices.push_back(1.0f);                                         // Texture coords
-        
-        vertices.push_back(-halfSize); vertices.push_back(halfSize); vertices.push_back(halfSize);   // Position
-        vertices.push_back(0.0f); vertices.push_back(1.0f); vertices.push_back(0.0f);               // Normal
-        vertices.push_back(0.0f); vertices.push_back(1.0f);                                         // Texture coords
+    void endScope() {
+        if (!enabled || stack.empty()) {
+            return;
+        }
+        OpenScope scope = stack.back();
+        stack.pop_back();
+        Node& node = nodes[scope.node];
+        if (scope.queryPair >= 0) {
+            glQueryCounter(node.queries[frameIndex % 2][scope.queryPair].end, GL_TIMESTAMP);
+        }
+
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        node.cpuFrameMs += chrono::duration<double, milli>(end - scope.start).count();
+        node.hitThisFrame = true;
+        if (traceFramesLeft > 0) {
+            traceEvents.push_back({ node.name, toTraceMicroseconds(scope.start),
+                                    chrono::duration<double, micro>(end - scope.start).count(), 0 });
+        }
     }
 
-    // Generate indices for the cube
-    void generateIndices() override {
-        // Clear any existing indices
-        indices.clear();
-        
-        // Define indices for each face (6 faces, 2 triangles per face, 3 indices per triangle)
-        // Front face
-        indices.push_back(0); indices.push_back(1); indices.push_back(2);
-        indices.push_back(2); indices.push_back(3); indices.push_back(0);
-        
-        // Back face
-        indices.push_back(4); indices.push_back(5); indices.push_back(6);
-        indices.push_back(6); indices.push_back(7); indices.push_back(4);
-        
-        // Left face
-        indices.push_back(8); indices.push_back(9); indices.push_back(10);
-        indices.push_back(10); indices.push_back(11); indices.push_back(8);
-        
-        // Right face
-        indices.push_back(12); indices.push_back(13); indices.push_back(14);
-        indices.push_back(14); indices.push_back(15); indices.push_back(12);
-        
-        // Bottom face
-        indices.push_back(16); indices.push_back(17); indices.push_back(18);
-        indices.push_back(18); indices.push_back(19); indices.push_back(16);
-        
-        // Top face
-        indices.push_back(20); indices.push_back(21); indices.push_back(22);
-        indices.push_back(22); indices.push_back(23); indices.push_back(20);
+    // Rolling statistics of a scope by name (first match), for overlays and tests
+    bool getStatistics(const char* name, Statistics& cpu, Statistics& gpu) const {
+        for (const Node& node : nodes) {
+            if (strcmp(node.name, name) == 0) {
+                cpu = node.cpu.compute();
+                gpu = node.gpu.compute();
+                return true;
+            }
+        }
+        return false;
     }
-    
-    // Getters and setters specific to Cube
-    float getSize() const { return size; }
-    
-    // Update size and regenerate geometry if needed
-    void setSize(float newSize) {
-        if (size != newSize) {
-            size = newSize;
-            generateVertices();
-            generateIndices();
-            
-            // Update buffers with new data
-            glBindBuffer(GL_ARRAY_BUFFER, vbo);
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-            
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+    // Print the scope tree with min/avg/p99 over the rolling window
+    void printReport(ostream& out) const {
+        out << left << setw(28) << "scope (ms)" << right
+            << setw(9) << "cpu_min" << setw(9) << "cpu_avg" << setw(9) << "cpu_p99"
+            << setw(9) << "gpu_min" << setw(9) << "gpu_avg" << setw(9) << "gpu_p99" << endl;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].parent < 0) {
+                printNode(out, (int)i);
+            }
         }
     }
-};
 
-// ************** ENHANCEMENT: Light Class **************
-// Light class derived from Cube
-class Light : public Cube {
-private:
-    glm::vec3 lightColor;
-    float intensity;
+    // Record CPU and GPU scope events for the next frameCount frames, then write them to path
+    void startTrace(int frameCount, const string& path) {
+        traceEvents.clear();
+        traceFramesLeft = frameCount;
+        tracePath = path;
+    }
+    bool isTracing() const { return traceFramesLeft > 0; }
 
+    // Write the recorded events in the Chrome trace event format (chrome://tracing, Perfetto)
+    bool writeTrace(const string& path) {
+        // Collect the GPU results still in flight
+        resolveQueries(0);
+        resolveQueries(1);
+
+        ofstream file(path);
+        if (!file) {
+            cerr << "Failed to open " << path << endl;
+            return false;
+        }
+        file << fixed << setprecision(3);
+        file << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+        for (const TraceEvent& event : traceEvents) {
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.track
+                 << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << "}";
+        }
+        file << "\n]}\n";
+        return true;
+    }
+};
+
+// Times the enclosing block as a child of the innermost open scope
+class ProfileScope {
 public:
-    // Constructor
-    Light(
-        const glm::vec3& pos = glm::vec3(0.0f),
-        const glm::vec3& col = glm::vec3(1.0f),
-        float size = 0.2f,
-        float lightIntensity = 1.0f
-    ) : Cube(size, pos, glm::vec3(1.0f), col), lightColor(col), intensity(lightIntensity) {
-        // The base Cube constructor handles geometry creation
+    explicit ProfileScope(const char* name, bool gpu = false) {
+        Profiler::instance().beginScope(name, gpu);
     }
-    
-    // Draw method specifically for lights, using a dedicated shader
-    void draw(GLuint lightShaderProgram, const glm::mat4& view, const glm::mat4& projection) {
-        glUseProgram(lightShaderProgram);
-        
-        // Create model matrix
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, position);
-        model = glm::scale(model, scale);
-        
-        // Set shader uniforms
-        GLint modelLoc = glGetUniformLocation(lightShaderProgram, "model");
-        GLint viewLoc = glGetUniformLocation(lightShaderProgram, "view");
-        GLint projLoc = glGetUniformLocation(lightShaderProgram, "projection");
-        
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        
-        // Bind VAO and draw
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    ~ProfileScope() {
+        Profiler::instance().endScope();
     }
-    
-    // Getters and setters for light properties
-    glm::vec3 getLightColor() const { return lightColor; }
-    void setLightColor(const glm::vec3& color) { lightColor = color; }
-    
-    float getIntensity() const { return intensity; }
-    void setIntensity(float value) { intensity = value; }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
 };
 
-// ************** ENHANCEMENT: Scene Class **************
-// Scene management class
-class Scene {
-private:
-    // Store shapes and lights using smart pointers
-    vector<shared_ptr<Shape>> shapes;
-    vector<shared_ptr<Light>> lights;
-    
-    // Shader program IDs
-    GLuint shaderProgram;
-    GLuint lightShaderProgram;
-    
+// ************** ENHANCEMENT: JobSystem Class **************
+// Fork-join job system for per-frame CPU work. Every thread owns a deque of jobs:
+// the owner pops from the back (most recently split, still in cache) while idle
+// threads steal from the front of other deques. The thread calling parallelFor()
+// is worker 0 and runs jobs until the whole range is done, so a pool of one
+// thread simply runs the loop inline.
+class JobSystem {
 public:
-    Scene() : shaderProgram(0), lightShaderProgram(0) {}
-    
-    ~Scene() {
-        // Cleanup shader programs
-        if (shaderProgram != 0) {
-            glDeleteProgram(shaderProgram);
+    // Body of a parallel loop: the half-open range [begin, end) and the worker running it
+    typedef function<void(size_t begin, size_t end, unsigned worker)> RangeFunction;
+
+private:
+    struct Job {
+        const RangeFunction* body;
+        size_t begin;
+        size_t end;
+        atomic<size_t>* remaining;  // jobs of the same parallelFor still to finish
+    };
+
+    struct WorkQueue {
+        mutex lock;
+        deque<Job> jobs;
+    };
+
+    vector<unique_ptr<WorkQueue>> queues;  // one per worker, index 0 is the calling thread
+    vector<thread> threads;
+    mutex wakeMutex;
+    condition_variable wakeCondition;
+    atomic<size_t> queuedJobs{ 0 };
+    bool stopping = false;
+
+    JobSystem() {
+        unsigned int threadCount = thread::hardware_concurrency();
+        start(threadCount > 0 ? threadCount : 1u);
+    }
+
+    void start(unsigned int threadCount) {
+        stopping = false;
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            queues.push_back(make_unique<WorkQueue>());
         }
-        if (lightShaderProgram != 0) {
-            glDeleteProgram(lightShaderProgram);
+        for (unsigned int i = 1; i < threadCount; ++i) {
+            threads.emplace_back(&JobSystem::workerLoop, this, i);
         }
     }
-    
-    // Initialize the scene and create shaders
-    bool initialize(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource, 
-                   const GLchar* lightVertexShaderSource, const GLchar* lightFragmentShaderSource) {
-        // Create shader programs
-        if (!createShaderProgram(vertexShaderSource, fragmentShaderSource, shaderProgram)) {
-            cerr << "Failed to create shader program for shapes" << endl;
-            return false;
+
+    void stop() {
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            stopping = true;
         }
-        
-        if (!createShaderProgram(lightVertexShaderSource, lightFragmentShaderSource, lightShaderProgram)) {
-            cerr << "Failed to create shader program for lights" << endl;
+        wakeCondition.notify_all();
+        for (thread& worker : threads) {
+            worker.join();
+        }
+        threads.clear();
+        queues.clear();
+    }
+
+    // Take a job from the back of our own deque, or steal one from the front of another
+    bool takeJob(unsigned worker, Job& job) {
+        {
+            WorkQueue& own = *queues[worker];
+            lock_guard<mutex> lock(own.lock);
+            if (!own.jobs.empty()) {
+                job = own.jobs.back();
+                own.jobs.pop_back();
+                --queuedJobs;
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            WorkQueue& victim = *queues[(worker + offset) % queues.size()];
+            lock_guard<mutex> lock(victim.lock);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                --queuedJobs;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool runJob(unsigned worker) {
+        Job job;
+        if (!takeJob(worker, job)) {
             return false;
         }
-        
-        // Set texture unit for fragment shader
-        glUseProgram(shaderProgram);
-        glUniform1i(glGetUniformLocation(shaderProgram, "uTexture"), 0);
-        
+        (*job.body)(job.begin, job.end, worker);
+        job.remaining->fetch_sub(1, memory_order_release);
         return true;
     }
-    
-    // Add shapes and lights to the scene
-    void addShape(shared_ptr<Shape> shape) {
-        shapes.push_back(shape);
+
+    void workerLoop(unsigned worker) {
+        for (;;) {
+            if (runJob(worker)) {
+                continue;
+            }
+            unique_lock<mutex> lock(wakeMutex);
+            wakeCondition.wait(lock, [this]() { return stopping || queuedJobs.load() > 0; });
+            if (stopping) {
+                return;
+            }
+        }
     }
-    
-    void addLight(shared_ptr<Light> light) {
-        lights.push_back(light);
+
+public:
+    static JobSystem& instance() {
+        static JobSystem jobs;
+        return jobs;
     }
-    
-    // Render the scene
-    void render(const glm::mat4& view, const glm::mat4& projection) {
-        // Enable depth testing
-        glEnable(GL_DEPTH_TEST);
-        
-        // Clear the color and depth buffers
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        // Get camera position from camera object
-        const glm::vec3 cameraPosition = gCamera.Position;
-        
-        // Only proceed if we have at least one light
-        if (!lights.empty()) {
-            // Use shader program for shapes
-            glUseProgram(shaderProgram);
-            
-            // Set light properties
-            glm::vec3 fillerLightPos = lights[0]->getPosition();
-            glm::vec3 fillerLightColor = lights[0]->getLightColor();
-            
-            glm::vec3 keyLightPos = (lights.size() > 1) ? lights[1]->getPosition() : glm::vec3(0.0f);
-            glm::vec3 keyLightColor = (lights.size() > 1) ? lights[1]->getLightColor() : glm::vec3(0.0f);
-            
-            GLint lightColorLoc = glGetUniformLocation(shaderProgram, "lightColor");
-            GLint lightPositionLoc = glGetUniformLocation(shaderProgram, "lightPos");
-            
-            GLint keyLightColorLoc = glGetUniformLocation(shaderProgram, "keyLightColor");
-            GLint keyLightPositionLoc = glGetUniformLocation(shaderProgram, "keyLightPos");
-            
-            GLint viewPositionLoc = glGetUniformLocation(shaderProgram, "viewPosition");
-            
-            glUniform3f(lightColorLoc, fillerLightColor.r, fillerLightColor.g, fillerLightColor.b);
-            glUniform3f(lightPositionLoc, fillerLightPos.x, fillerLightPos.y, fillerLightPos.z);
-            
-            glUniform3f(keyLightColorLoc, keyLightColor.r, keyLightColor.g, keyLightColor.b);
-            glUniform3f(keyLightPositionLoc, keyLightPos.x, keyLightPos.y, keyLightPos.z);
-            
-            glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-            
-            // Draw all shapes
-            for (auto& shape : shapes) {
-                shape->draw(shaderProgram, view, projection);
+
+    ~JobSystem() {
+        stop();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Resize the pool (including the calling thread); only call between frames
+    void setThreadCount(unsigned int threadCount) {
+        threadCount = max(threadCount, 1u);
+        if (threadCount == queues.size()) {
+            return;
+        }
+        stop();
+        start(threadCount);
+    }
+
+    unsigned int getThreadCount() const { return (unsigned int)queues.size(); }
+
+    // Run body over [0, count) in chunks of chunkSize, i.e. [k * chunkSize, (k + 1) * chunkSize),
+    // and return when every chunk has run. Chunks are dealt round-robin to the deques and
+    // rebalanced by stealing. Bodies must not call parallelFor themselves.
+    void parallelFor(size_t count, size_t chunkSize, const RangeFunction& body) {
+        chunkSize = max<size_t>(chunkSize, 1);
+        size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+        if (chunkCount <= 1 || queues.size() == 1) {
+            if (count > 0) {
+                body(0, count, 0);
             }
-            
-            // Draw all lights
-            for (auto& light : lights) {
-                light->draw(lightShaderProgram, view, projection);
+            return;
+        }
+
+        atomic<size_t> remaining{ chunkCount };
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            WorkQueue& queue = *queues[chunk % queues.size()];
+            lock_guard<mutex> lock(queue.lock);
+            queue.jobs.push_back({ &body, chunk * chunkSize, min(count, (chunk + 1) * chunkSize), &remaining });
+            ++queuedJobs;
+        }
+        {
+            lock_guard<mutex> lock(wakeMutex);
+        }
+        wakeCondition.notify_all();
+
+        // Help until the last chunk has finished, including chunks stolen by others
+        while (remaining.load(memory_order_acquire) > 0) {
+            if (!runJob(0)) {
+                this_thread::yield();
             }
         }
     }
-    
-    // Create a shader program
-    bool createShaderProgram(const char* vertexShaderSource, const char* fragmentShaderSource, GLuint& programId) {
-        // Error reporting variables
-        int success = 0;
-        char infoLog[512];
+};
 
-        // Create shader program object
-        programId = glCreateProgram();
+// ************** ENHANCEMENT: ShaderProgram Class **************
+// Upload helpers for each uniform type supported by the typed handles below
+inline void uploadUniform(GLint location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+inline void uploadUniform(GLint location, const glm::mat3& value) { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+inline void uploadUniform(GLint location, const glm::vec4& value) { glUniform4fv(location, 1, glm::value_ptr(value)); }
+inline void uploadUniform(GLint location, const glm::vec3& value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+inline void uploadUniform(GLint location, const glm::vec2& value) { glUniform2fv(location, 1, glm::value_ptr(value)); }
+inline void uploadUniform(GLint location, float value) { glUniform1f(location, value); }
+inline void uploadUniform(GLint location, int value) { glUniform1i(location, value); }
 
-        // Create vertex and fragment shader objects
-        GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-        GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+// GLSL type expected for each C++ uniform type (used to validate handles at lookup)
+inline bool uniformTypeMatches(GLenum glType, const glm::mat4*) { return glType == GL_FLOAT_MAT4; }
+inline bool uniformTypeMatches(GLenum glType, const glm::mat3*) { return glType == GL_FLOAT_MAT3; }
+inline bool uniformTypeMatches(GLenum glType, const glm::vec4*) { return glType == GL_FLOAT_VEC4; }
+inline bool uniformTypeMatches(GLenum glType, const glm::vec3*) { return glType == GL_FLOAT_VEC3; }
+inline bool uniformTypeMatches(GLenum glType, const glm::vec2*) { return glType == GL_FLOAT_VEC2; }
+inline bool uniformTypeMatches(GLenum glType, const float*) { return glType == GL_FLOAT; }
+inline bool uniformTypeMatches(GLenum glType, const int*) {
+    // Samplers are set through integer texture units
+    return glType == GL_INT || glType == GL_BOOL || glType == GL_SAMPLER_2D
+        || glType == GL_SAMPLER_2D_ARRAY_SHADOW || glType == GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW;
+}
 
-        // Set shader source code
-        glShaderSource(vertexShaderId, 1, &vertexShaderSource, NULL);
-        glShaderSource(fragmentShaderId, 1, &fragmentShaderSource, NULL);
+// Typed, pre-resolved uniform location
+template <typename T>
+class Uniform {
+private:
+    GLint location;
 
-        // Compile the vertex shader
-        glCompileShader(vertexShaderId);
+public:
+    Uniform() : location(-1) {}
+    explicit Uniform(GLint loc) : location(loc) {}
 
-        // Check for vertex shader compilation errors
-        glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-            cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
-            return false;
+    // Upload a value to the currently bound program (no-op if the uniform is inactive)
+    void set(const T& value) const {
+        if (location >= 0) {
+            uploadUniform(location, value);
         }
+    }
 
-        // Compile the fragment shader
-        glCompileShader(fragmentShaderId);
+    bool isValid() const { return location >= 0; }
+    GLint getLocation() const { return location; }
+};
 
-        // Check for fragment shader compilation errors
-        glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-            cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
-            return false;
+// Linked shader program that reflects all of its active uniforms once at link time
+class ShaderProgram {
+private:
+    // Reflected information for one active uniform
+    struct UniformInfo {
+        GLint location;
+        GLenum type;
+        GLint size;
+    };
+
+    GLuint programId = 0;
+    unordered_map<string, UniformInfo> uniforms;
+
+    // Debug counter of name-based uniform lookups across all programs
+    static unsigned int nameLookupCount;
+
+public:
+    ShaderProgram() = default;
+
+    ~ShaderProgram() {
+        if (programId != 0) {
+            glDeleteProgram(programId);
         }
+    }
 
-        // Shaders compiled, attach to shader program object
-        glAttachShader(programId, vertexShaderId);
-        glAttachShader(programId, fragmentShaderId);
+    // Programs own a GL object, so they are not copyable
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator=(const ShaderProgram&) = delete;
 
-        // Link the program object
-        glLinkProgram(programId);
+    // Take ownership of a linked program and reflect its active uniforms
+    void adopt(GLuint linkedProgramId) {
+        if (programId != 0 && programId != linkedProgramId) {
+            glDeleteProgram(programId);
+        }
+        programId = linkedProgramId;
+        uniforms.clear();
 
-        // Check for linking errors
-        glGetProgramiv(programId, GL_LINK_STATUS, &success);
-        if (!success)
-        {
-            glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-            cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+        vector<GLchar> nameBuffer(maxNameLength > 0 ? maxNameLength : 1);
+        for (GLint i = 0; i < uniformCount; ++i) {
+            GLsizei nameLength = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(programId, i, (GLsizei)nameBuffer.size(), &nameLength, &size, &type, nameBuffer.data());
+
+            // Uniforms inside blocks have no location and are skipped
+            string name(nameBuffer.data(), nameLength);
+            GLint location = glGetUniformLocation(programId, name.c_str());
+            if (location < 0) {
+                continue;
+            }
+
+            // Arrays are reported as "name[0]"; store them under their base name
+            size_t bracket = name.find('[');
+            if (bracket != string::npos) {
+                name.erase(bracket);
+            }
+            uniforms[name] = { location, type, size };
+        }
+    }
+
+    // Resolve a typed uniform handle by name (initialization only; counted for debugging)
+    template <typename T>
+    Uniform<T> getUniform(const string& name) const {
+        ++nameLookupCount;
+
+        auto it = uniforms.find(name);
+        if (it == uniforms.end()) {
+            // Inactive or optimized-out uniforms yield an invalid handle, like location -1 in GL
+            return Uniform<T>();
+        }
+        if (!uniformTypeMatches(it->second.type, static_cast<const T*>(nullptr))) {
+            cerr << "Uniform type mismatch for: " << name << endl;
+            return Uniform<T>();
+        }
+        return Uniform<T>(it->second.location);
+    }
+
+    void use() const { glUseProgram(programId); }
+
+    GLuint getId() const { return programId; }
+    bool hasUniform(const string& name) const { return uniforms.count(name) != 0; }
+    size_t getActiveUniformCount() const { return uniforms.size(); }
+
+    static unsigned int getNameLookupCount() { return nameLookupCount; }
+};
+
+unsigned int ShaderProgram::nameLookupCount = 0;
+
+// Pre-resolved per-object uniform handles used when drawing shapes and lamps
+struct ShapeUniforms {
+    Uniform<glm::mat4> model;
+    Uniform<glm::mat3> normalMatrix;  // invalid for programs without lighting (lamps)
+    Uniform<int> materialIndex;
+
+    // Resolve all handles for a program once after it is linked
+    void resolve(const ShaderProgram& program) {
+        model = program.getUniform<glm::mat4>("model");
+        normalMatrix = program.getUniform<glm::mat3>("normalMatrix");
+        materialIndex = program.getUniform<int>("materialIndex");
+    }
+};
+
+// ************** ENHANCEMENT: Frame Uniform Buffer **************
+// Uniform block binding points shared by the GLSL sources and the scene
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+const GLuint MATERIAL_STORAGE_BINDING = 1;
+
+// Array sizes; these must match the literal sizes declared in the GLSL blocks
+const int MAX_FRAME_LIGHTS = 8;
+
+// Materials the table's storage buffer holds before it first grows
+const size_t INITIAL_MATERIAL_CAPACITY = 256;
+
+// std140 light entry (w of position is unused, w of color holds intensity)
+struct FrameLight {
+    glm::vec4 position;
+    glm::vec4 color;
+};
+
+// CPU mirror of the std140 FrameUniforms block, written once per frame
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPosition;
+    FrameLight lights[MAX_FRAME_LIGHTS];
+    GLint lightCount;
+    GLint flipTextureV;  // nonzero when images were uploaded top row first (see TextureManager::setFlipOnLoad)
+    GLint padding[2];
+};
+
+// Material entry (same layout under std140 and std430) indexed by the per-object materialIndex
+struct Material {
+    glm::vec4 color;
+    glm::vec4 uvScale;
+};
+
+static_assert(sizeof(FrameUniforms) == 2 * 64 + 16 + MAX_FRAME_LIGHTS * 32 + 16, "FrameUniforms must follow std140 layout");
+static_assert(sizeof(Material) == 32, "Material must follow std140 layout");
+
+// Persistently mapped buffer split into ring regions, one written per frame.
+// Each region is fenced after use so the CPU never overwrites data the GPU is still reading.
+class StreamingBuffer {
+public:
+    static const int REGION_COUNT = 3;
+
+private:
+    GLuint buffer = 0;
+    GLenum target = GL_UNIFORM_BUFFER;
+    GLsizeiptr regionSize = 0;
+    unsigned char* mappedData = nullptr;
+    GLsync fences[REGION_COUNT] = {};
+    int currentRegion = 0;
+
+public:
+    StreamingBuffer() = default;
+
+    ~StreamingBuffer() {
+        for (GLsync& fence : fences) {
+            if (fence) {
+                glDeleteSync(fence);
+            }
+        }
+        if (buffer != 0) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+
+    StreamingBuffer(const StreamingBuffer&) = delete;
+    StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+
+    // Allocate REGION_COUNT regions of at least `size` bytes, respecting the target's offset alignment
+    bool create(GLenum bufferTarget, GLsizeiptr size) {
+        target = bufferTarget;
+
+        GLint alignment = 1;
+        if (target == GL_UNIFORM_BUFFER) {
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        } else if (target == GL_SHADER_STORAGE_BUFFER) {
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        }
+        if (alignment < 1) {
+            alignment = 1;
+        }
+        regionSize = ((size + alignment - 1) / alignment) * alignment;
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferStorage(target, regionSize * REGION_COUNT, nullptr, flags);
+        mappedData = static_cast<unsigned char*>(glMapBufferRange(target, 0, regionSize * REGION_COUNT, flags));
+        glBindBuffer(target, 0);
+
+        if (!mappedData) {
+            cerr << "Failed to persistently map streaming buffer" << endl;
             return false;
         }
+        return true;
+    }
+
+    // Wait until the GPU has finished with the current region and return it for writing
+    void* beginWrite() {
+        GLsync& fence = fences[currentRegion];
+        if (fence) {
+            GLenum result = glClientWaitSync(fence, 0, 0);
+            while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED) {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        return mappedData + regionSize * currentRegion;
+    }
+
+    // Bind the current region to an indexed binding point
+    void bindRange(GLuint index) const {
+        glBindBufferRange(target, index, buffer, getCurrentOffset(), regionSize);
+    }
+
+    // Fence the current region once all commands reading it are submitted, then advance
+    void endFrame() {
+        fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        currentRegion = (currentRegion + 1) % REGION_COUNT;
+    }
+
+    GLuint getId() const { return buffer; }
+    GLintptr getCurrentOffset() const { return regionSize * currentRegion; }
+    GLsizeiptr getRegionSize() const { return regionSize; }
+};
+
+// Deduplicated table of materials uploaded to the MaterialBuffer storage block when it
+// changes; the buffer doubles whenever the table outgrows it
+class MaterialTable {
+private:
+    // Lookup key; hashed by bit pattern, with -0 folded into +0 so equal keys hash equally
+    struct MaterialKey {
+        glm::vec3 color;
+        glm::vec2 uvScale;
+        bool operator==(const MaterialKey& other) const { return color == other.color && uvScale == other.uvScale; }
+    };
+    struct MaterialKeyHash {
+        size_t operator()(const MaterialKey& key) const {
+            const float components[5] = { key.color.x, key.color.y, key.color.z, key.uvScale.x, key.uvScale.y };
+            size_t hash = 0;
+            for (float component : components) {
+                uint32_t bits;
+                component += 0.0f;
+                memcpy(&bits, &component, sizeof(bits));
+                hash = hash * 31u ^ bits * 2654435761u;
+            }
+            return hash;
+        }
+    };
+
+    vector<Material> materials;  // GPU-side order, indexed by the shapes
+    unordered_map<MaterialKey, int, MaterialKeyHash> indexByKey;
+    GLuint buffer = 0;
+    size_t capacity = 0;
+    bool dirty = false;
+
+    void allocate(size_t materialCapacity) {
+        capacity = materialCapacity;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(Material), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_STORAGE_BINDING, buffer);
+    }
+
+public:
+    MaterialTable() = default;
+
+    ~MaterialTable() {
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+
+    MaterialTable(const MaterialTable&) = delete;
+    MaterialTable& operator=(const MaterialTable&) = delete;
+
+    void create() {
+        glGenBuffers(1, &buffer);
+        allocate(INITIAL_MATERIAL_CAPACITY);
+    }
+
+    // Return the index of a matching material, adding it if it is new
+    int acquire(const glm::vec3& color, const glm::vec2& uvScale) {
+        auto inserted = indexByKey.emplace(MaterialKey{ color, uvScale }, static_cast<int>(materials.size()));
+        if (inserted.second) {
+            materials.push_back({ glm::vec4(color, 1.0f), glm::vec4(uvScale, 0.0f, 0.0f) });
+            dirty = true;
+        }
+        return inserted.first->second;
+    }
+
+    // Upload the table if any material was added since the last upload
+    void upload() {
+        if (dirty && !materials.empty()) {
+            if (materials.size() > capacity) {
+                allocate(max(capacity * 2, materials.size()));
+            }
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, materials.size() * sizeof(Material), materials.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            dirty = false;
+        }
+    }
+
+    // Forget every material (the shapes holding their indices are gone); the buffer keeps its size
+    void clear() {
+        materials.clear();
+        indexByKey.clear();
+        dirty = false;
+    }
+
+    size_t size() const { return materials.size(); }
+};
+
+// ************** ENHANCEMENT: Bounding Volumes **************
+// Axis-aligned bounding box
+struct AABB {
+    glm::vec3 min = glm::vec3(numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-numeric_limits<float>::max());
+
+    void expand(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void expand(const AABB& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+    glm::vec3 getExtents() const { return (max - min) * 0.5f; }
+
+    // Bounds of this box after an affine transform (center moved, extents through |M|)
+    AABB transformed(const glm::mat4& matrix) const {
+        glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.0f));
+        glm::vec3 extents = getExtents();
+        glm::vec3 worldExtents;
+        for (int row = 0; row < 3; ++row) {
+            worldExtents[row] = fabs(matrix[0][row]) * extents.x
+                              + fabs(matrix[1][row]) * extents.y
+                              + fabs(matrix[2][row]) * extents.z;
+        }
+        AABB result;
+        result.min = center - worldExtents;
+        result.max = center + worldExtents;
+        return result;
+    }
+};
+
+// View frustum as six inward-facing planes (xyz = normal, w = distance)
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Extract the planes from a combined projection * view matrix (Gribb-Hartmann)
+    static Frustum fromMatrix(const glm::mat4& viewProjection) {
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; ++row) {
+            rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+        }
+
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0];  // left
+        frustum.planes[1] = rows[3] - rows[0];  // right
+        frustum.planes[2] = rows[3] + rows[1];  // bottom
+        frustum.planes[3] = rows[3] - rows[1];  // top
+        frustum.planes[4] = rows[3] + rows[2];  // near
+        frustum.planes[5] = rows[3] - rows[2];  // far
+        for (glm::vec4& plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    // True unless the box lies entirely behind one of the planes
+    bool intersects(const AABB& box) const {
+        for (const glm::vec4& plane : planes) {
+            // Corner furthest along the plane normal
+            glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+                             plane.y >= 0.0f ? box.max.y : box.min.y,
+                             plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// ************** ENHANCEMENT: Vertex Layouts **************
+// Shapes generate interleaved float vertices (position 3, normal 3, UV 2). A mesh is
+// uploaded either as those 32-byte floats or in a 16-byte compact encoding:
+//   position  3 x half float (+ 2 bytes padding)
+//   normal    snorm 10:10:10:2, read as a plain vec3 so the shaders need no decoding
+//   UV        2 x unorm16, only for coordinates inside [0, 1]
+enum VertexFormat {
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_COMPACT
+};
+
+const int FLOAT_VERTEX_COMPONENTS = 8;
+
+// Binding index every mesh's vertex buffer is attached to (per-instance data uses
+// glVertexAttribPointer, which binds each attribute to the binding of its location)
+const GLuint VERTEX_BUFFER_BINDING = 0;
+
+// One attribute of a layout, as passed to glVertexAttribFormat
+struct VertexAttribute {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+};
+
+class VertexLayout {
+private:
+    VertexFormat format;
+    GLsizei stride;
+    vector<VertexAttribute> attributes;
+
+    VertexLayout(VertexFormat layoutFormat, GLsizei layoutStride, const vector<VertexAttribute>& layoutAttributes)
+        : format(layoutFormat), stride(layoutStride), attributes(layoutAttributes) {}
+
+    // Sign-extended 10-bit snorm, converted the way GL does: max(c / 511, -1)
+    static float unpackSnorm10(uint32_t packed, int shift) {
+        int32_t value = (int32_t)(packed << (22 - shift)) >> 22;
+        return max(value / 511.0f, -1.0f);
+    }
+
+    static uint32_t packSnorm10(float value, int shift) {
+        int32_t quantized = (int32_t)round(glm::clamp(value, -1.0f, 1.0f) * 511.0f);
+        return ((uint32_t)quantized & 0x3FF) << shift;
+    }
+
+public:
+    static const VertexLayout& get(VertexFormat format) {
+        static const VertexLayout floatLayout(VERTEX_FORMAT_FLOAT, 8 * sizeof(float), {
+            { 0, 3, GL_FLOAT, GL_FALSE, 0 },
+            { 1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float) },
+            { 2, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float) }
+        });
+        static const VertexLayout compactLayout(VERTEX_FORMAT_COMPACT, 16, {
+            { 0, 3, GL_HALF_FLOAT, GL_FALSE, 0 },
+            { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 8 },
+            { 2, 2, GL_UNSIGNED_SHORT, GL_TRUE, 12 }
+        });
+        return format == VERTEX_FORMAT_COMPACT ? compactLayout : floatLayout;
+    }
+
+    VertexFormat getFormat() const { return format; }
+    GLsizei getStride() const { return stride; }
+
+    // Record the attribute formats in the bound VAO and attach the vertex buffer
+    void apply(GLuint buffer) const {
+        for (const VertexAttribute& attribute : attributes) {
+            glVertexAttribFormat(attribute.location, attribute.size, attribute.type, attribute.normalized, attribute.offset);
+            glVertexAttribBinding(attribute.location, VERTEX_BUFFER_BINDING);
+            glEnableVertexAttribArray(attribute.location);
+        }
+        glBindVertexBuffer(VERTEX_BUFFER_BINDING, buffer, 0, stride);
+    }
+
+    // Whether the float vertices can be encoded in this layout without clamping
+    bool canEncode(const vector<float>& vertices) const {
+        if (format == VERTEX_FORMAT_FLOAT) {
+            return true;
+        }
+        const float HALF_MAX = 65504.0f;
+        for (size_t i = 0; i + FLOAT_VERTEX_COMPONENTS <= vertices.size(); i += FLOAT_VERTEX_COMPONENTS) {
+            for (int k = 0; k < 3; ++k) {
+                if (!(fabs(vertices[i + k]) <= HALF_MAX)) {
+                    return false;
+                }
+            }
+            for (int k = 6; k < 8; ++k) {
+                if (!(vertices[i + k] >= 0.0f && vertices[i + k] <= 1.0f)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Encode float vertices into stride-sized records (see canEncode)
+    vector<uint8_t> encode(const vector<float>& vertices) const {
+        size_t vertexCount = vertices.size() / FLOAT_VERTEX_COMPONENTS;
+        vector<uint8_t> bytes(vertexCount * stride);
+        if (format == VERTEX_FORMAT_FLOAT) {
+            memcpy(bytes.data(), vertices.data(), bytes.size());
+            return bytes;
+        }
+
+        for (size_t v = 0; v < vertexCount; ++v) {
+            const float* source = &vertices[v * FLOAT_VERTEX_COMPONENTS];
+            uint8_t* record = &bytes[v * stride];
+
+            uint16_t position[4] = { glm::packHalf1x16(source[0]), glm::packHalf1x16(source[1]), glm::packHalf1x16(source[2]), 0 };
+            glm::vec3 normal(source[3], source[4], source[5]);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normal /= length;
+            }
+            uint32_t packedNormal = packSnorm10(normal.x, 0) | packSnorm10(normal.y, 10) | packSnorm10(normal.z, 20);
+            uint32_t packedUV = glm::packUnorm2x16(glm::vec2(source[6], source[7]));
+
+            memcpy(record, position, 8);
+            memcpy(record + 8, &packedNormal, 4);
+            memcpy(record + 12, &packedUV, 4);
+        }
+        return bytes;
+    }
+
+    // Expand stride-sized records back to float vertices, as the vertex fetch would
+    vector<float> decode(const uint8_t* bytes, size_t vertexCount) const {
+        vector<float> vertices(vertexCount * FLOAT_VERTEX_COMPONENTS);
+        if (format == VERTEX_FORMAT_FLOAT) {
+            memcpy(vertices.data(), bytes, vertices.size() * sizeof(float));
+            return vertices;
+        }
+
+        for (size_t v = 0; v < vertexCount; ++v) {
+            const uint8_t* record = &bytes[v * stride];
+            float* target = &vertices[v * FLOAT_VERTEX_COMPONENTS];
+
+            uint16_t position[4];
+            uint32_t packedNormal, packedUV;
+            memcpy(position, record, 8);
+            memcpy(&packedNormal, record + 8, 4);
+            memcpy(&packedUV, record + 12, 4);
+
+            for (int k = 0; k < 3; ++k) {
+                target[k] = glm::unpackHalf1x16(position[k]);
+                target[3 + k] = unpackSnorm10(packedNormal, 10 * k);
+            }
+            target[6] = (packedUV & 0xFFFF) / 65535.0f;
+            target[7] = (packedUV >> 16) / 65535.0f;
+        }
+        return vertices;
+    }
+};
+
+// ************** ENHANCEMENT: Index Ordering **************
+// Generated meshes list triangles in generation order. Before upload they are
+// reordered for the post-transform vertex cache (Forsyth's linear-speed optimizer), then
+// cache-coherent clusters are sorted so outward-facing ones draw first to cut overdraw
+// (Sander, Nehab and Barczak). ACMR, the vertices transformed per triangle, is measured
+// on the CPU with a simulated FIFO cache.
+const int FORSYTH_CACHE_SIZE = 32;  // LRU cache size modelled by the scoring function
+const int FIFO_CACHE_SIZE = 16;     // FIFO size used for ACMR and cluster boundaries
+
+// Result of optimizeIndexOrder
+struct IndexOrderReport {
+    double acmrBefore = 0.0;
+    double acmrVertexCache = 0.0;  // after the vertex cache pass
+    double acmrAfter = 0.0;        // after cluster sorting as well
+    size_t clusterCount = 0;
+};
+
+// Simulate a FIFO post-transform cache; missesPerTriangle (optional) receives each
+// triangle's miss count. Returns the total number of misses.
+size_t simulateVertexCache(const vector<unsigned int>& indices, size_t vertexCount, int cacheSize,
+                           vector<uint8_t>* missesPerTriangle = nullptr)
+{
+    // Insertion stamp + 1 per vertex; a vertex is cached while fewer than cacheSize
+    // vertices were inserted after it
+    vector<size_t> insertedAt(vertexCount, 0);
+    size_t clock = 0;
+    size_t misses = 0;
+    if (missesPerTriangle) {
+        missesPerTriangle->assign(indices.size() / 3, 0);
+    }
+    for (size_t i = 0; i < indices.size(); ++i) {
+        unsigned int index = indices[i];
+        if (insertedAt[index] == 0 || clock - insertedAt[index] >= (size_t)cacheSize) {
+            insertedAt[index] = ++clock;
+            ++misses;
+            if (missesPerTriangle) {
+                ++(*missesPerTriangle)[i / 3];
+            }
+        }
+    }
+    return misses;
+}
+
+// Average cache miss ratio: vertices transformed per triangle (0.5 is ideal for large
+// regular grids, 3 means no reuse)
+double computeACMR(const vector<unsigned int>& indices, size_t vertexCount, int cacheSize = FIFO_CACHE_SIZE)
+{
+    if (indices.size() < 3) {
+        return 0.0;
+    }
+    return (double)simulateVertexCache(indices, vertexCount, cacheSize) / (indices.size() / 3);
+}
+
+// Forsyth's greedy reordering: repeatedly emit the triangle whose vertices score highest,
+// favouring vertices in the modelled cache and vertices with few remaining triangles
+void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // Triangles adjacent to each vertex; the first remaining[v] entries are not yet emitted
+    vector<unsigned int> offsets(vertexCount + 1, 0);
+    vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices) {
+        ++remaining[index];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    vector<unsigned int> adjacency(indices.size());
+    vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> vertexScore(vertexCount);
+    auto scoreVertex = [&](unsigned int v) {
+        if (remaining[v] == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        int position = cachePosition[v];
+        if (position >= 0) {
+            // The last triangle's vertices score a fixed amount so it is not simply repeated
+            score = position < 3 ? 0.75f : pow(1.0f - (position - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+        }
+        return score + 2.0f / sqrt((float)remaining[v]);
+    };
+    for (size_t v = 0; v < vertexCount; ++v) {
+        vertexScore[v] = scoreVertex((unsigned int)v);
+    }
+
+    vector<uint8_t> emitted(triangleCount, 0);
+    vector<unsigned int> output;
+    output.reserve(indices.size());
+    vector<unsigned int> cache, updated;
+    size_t scanCursor = 0;
+    long best = -1;
+
+    for (size_t count = 0; count < triangleCount; ++count) {
+        // Nothing adjacent to the cache: continue with the next triangle in input order
+        if (best < 0) {
+            while (emitted[scanCursor]) {
+                ++scanCursor;
+            }
+            best = (long)scanCursor;
+        }
+
+        const unsigned int* corners = &indices[best * 3];
+        output.insert(output.end(), corners, corners + 3);
+        emitted[best] = 1;
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = corners[k];
+            unsigned int* list = &adjacency[offsets[v]];
+            for (unsigned int j = 0; j < remaining[v]; ++j) {
+                if (list[j] == (unsigned int)best) {
+                    swap(list[j], list[remaining[v] - 1]);
+                    --remaining[v];
+                    break;
+                }
+            }
+        }
+
+        // The emitted triangle moves to the front of the cache; entries past its end are evicted
+        updated.assign(corners, corners + 3);
+        for (unsigned int v : cache) {
+            if (v != corners[0] && v != corners[1] && v != corners[2]) {
+                updated.push_back(v);
+            }
+        }
+        for (size_t i = 0; i < updated.size(); ++i) {
+            cachePosition[updated[i]] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+            vertexScore[updated[i]] = scoreVertex(updated[i]);
+        }
+
+        // Only triangles touching cached or just evicted vertices changed score
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : updated) {
+            for (unsigned int j = 0; j < remaining[v]; ++j) {
+                unsigned int triangle = adjacency[offsets[v] + j];
+                const unsigned int* t = &indices[triangle * 3];
+                float score = vertexScore[t[0]] + vertexScore[t[1]] + vertexScore[t[2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = triangle;
+                }
+            }
+        }
+
+        if (updated.size() > (size_t)FORSYTH_CACHE_SIZE) {
+            updated.resize(FORSYTH_CACHE_SIZE);
+        }
+        cache.swap(updated);
+    }
+    indices.swap(output);
+}
+
+// Sort cache-coherent clusters of an optimized index list so clusters facing away from
+// the mesh center draw first. Returns the number of clusters.
+size_t optimizeOverdraw(vector<unsigned int>& indices, const vector<float>& vertices)
+{
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = vertices.size() / FLOAT_VERTEX_COMPONENTS;
+    if (triangleCount < 2) {
+        return triangleCount;
+    }
+
+    // Hard boundaries: triangles missing the FIFO on all three vertices, where the
+    // order restarts anyway
+    vector<uint8_t> misses;
+    double meshACMR = (double)simulateVertexCache(indices, vertexCount, FIFO_CACHE_SIZE, &misses) / triangleCount;
+    vector<size_t> hardStarts;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (t == 0 || misses[t] == 3) {
+            hardStarts.push_back(t);
+        }
+    }
+    hardStarts.push_back(triangleCount);
+
+    // Soft boundaries: cut a hard cluster as soon as the part since the last cut,
+    // simulated from a cold cache, is within 5% of the mesh ACMR, which bounds the misses
+    // the reordering can add
+    const double SOFT_BOUNDARY_THRESHOLD = 1.05;
+    vector<size_t> starts;
+    vector<size_t> insertedAt(vertexCount, 0);
+    size_t clock = 0;
+    for (size_t h = 0; h + 1 < hardStarts.size(); ++h) {
+        size_t clusterStart = hardStarts[h];
+        size_t clusterClock = clock;
+        size_t clusterMisses = 0;
+        starts.push_back(clusterStart);
+        for (size_t t = hardStarts[h]; t < hardStarts[h + 1]; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                unsigned int index = indices[t * 3 + k];
+                if (insertedAt[index] <= clusterClock || clock - insertedAt[index] >= (size_t)FIFO_CACHE_SIZE) {
+                    insertedAt[index] = ++clock;
+                    ++clusterMisses;
+                }
+            }
+            if (t + 1 < hardStarts[h + 1] && clusterMisses <= SOFT_BOUNDARY_THRESHOLD * meshACMR * (t + 1 - clusterStart)) {
+                clusterStart = t + 1;
+                clusterClock = clock;
+                clusterMisses = 0;
+                starts.push_back(clusterStart);
+            }
+        }
+    }
+    starts.push_back(triangleCount);
+
+    auto position = [&](unsigned int index) {
+        const float* p = &vertices[index * FLOAT_VERTEX_COMPONENTS];
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+    glm::vec3 meshCenter(0.0f);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        meshCenter += position((unsigned int)v);
+    }
+    meshCenter *= 1.0f / vertexCount;
+
+    // Area-weighted centroid and normal of each cluster
+    struct Cluster {
+        size_t begin;
+        size_t end;
+        float facing;
+    };
+    vector<Cluster> clusters;
+    for (size_t k = 0; k + 1 < starts.size(); ++k) {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = starts[k]; t < starts[k + 1]; ++t) {
+            glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), c = position(indices[t * 3 + 2]);
+            glm::vec3 cross = glm::cross(b - a, c - a);
+            float weight = glm::length(cross);
+            centroid += (a + b + c) * (weight / 3.0f);
+            normal += cross;
+            area += weight;
+        }
+        float facing = 0.0f;
+        if (area > 0.0f && glm::length(normal) > 0.0f) {
+            facing = glm::dot(centroid * (1.0f / area) - meshCenter, glm::normalize(normal));
+        }
+        clusters.push_back({ starts[k], starts[k + 1], facing });
+    }
+
+    stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.facing > b.facing; });
+    vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+        output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+    }
+    indices.swap(output);
+    return clusters.size();
+}
+
+// Run both passes over a generated mesh (float vertices, see VertexLayout)
+IndexOrderReport optimizeIndexOrder(vector<unsigned int>& indices, const vector<float>& vertices)
+{
+    IndexOrderReport report;
+    size_t vertexCount = vertices.size() / FLOAT_VERTEX_COMPONENTS;
+    report.acmrBefore = computeACMR(indices, vertexCount);
+    optimizeVertexCache(indices, vertexCount);
+    report.acmrVertexCache = computeACMR(indices, vertexCount);
+    report.clusterCount = optimizeOverdraw(indices, vertices);
+    report.acmrAfter = computeACMR(indices, vertexCount);
+    return report;
+}
+
+// ************** ENHANCEMENT: GeometryCache Class **************
+// GPU-resident mesh (interleaved position, normal, UV) shared by every shape with the same geometry
+struct GpuMesh {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLsizei vertexCount = 0;
+    GLsizei indexCount = 0;
+    size_t gpuBytes = 0;
+    AABB bounds;  // object-space bounds of the vertex positions
+    const VertexLayout* layout = nullptr;
+    GLenum indexType = GL_UNSIGNED_INT;  // GL_UNSIGNED_SHORT when every vertex fits 16 bits
+
+    // Bytes held by all live meshes, for memory reporting
+    static size_t liveBytes;
+
+    static size_t getIndexSize(GLenum type) { return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
+    // Index data as stored in a buffer of the given type
+    static vector<uint8_t> packIndices(const vector<unsigned int>& indices, GLenum type) {
+        vector<uint8_t> bytes(indices.size() * getIndexSize(type));
+        if (type == GL_UNSIGNED_SHORT) {
+            GLushort* target = reinterpret_cast<GLushort*>(bytes.data());
+            for (size_t i = 0; i < indices.size(); ++i) {
+                target[i] = (GLushort)indices[i];
+            }
+        } else {
+            memcpy(bytes.data(), indices.data(), bytes.size());
+        }
+        return bytes;
+    }
+
+    static GLenum getIndexType(size_t vertexCount) { return vertexCount <= 65535 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
+    // Layout float vertices are stored in: the requested one, or floats when they do not
+    // fit the compact format (UVs outside [0, 1], huge positions)
+    static const VertexLayout& getLayout(const vector<float>& vertices, VertexFormat format) {
+        const VertexLayout& requested = VertexLayout::get(format);
+        return requested.canEncode(vertices) ? requested : VertexLayout::get(VERTEX_FORMAT_FLOAT);
+    }
+
+    static AABB getBounds(const vector<float>& vertices) {
+        AABB result;
+        for (size_t i = 0; i + 2 < vertices.size(); i += FLOAT_VERTEX_COMPONENTS) {
+            result.expand(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+        }
+        return result;
+    }
+
+    // Upload generated vertex and index data into new buffers
+    GpuMesh(const vector<float>& vertices, const vector<unsigned int>& indices, VertexFormat format = VERTEX_FORMAT_FLOAT) {
+        const VertexLayout& vertexLayout = getLayout(vertices, format);
+        vector<uint8_t> vertexBytes = vertexLayout.encode(vertices);
+        GLsizei verticesInMesh = (GLsizei)(vertices.size() / FLOAT_VERTEX_COMPONENTS);
+        GLenum type = getIndexType(verticesInMesh);
+        vector<uint8_t> indexBytes = packIndices(indices, type);
+        upload(vertexLayout, vertexBytes.data(), vertexBytes.size(), verticesInMesh,
+               indexBytes.data(), (GLsizei)indices.size(), type, getBounds(vertices));
+    }
+
+    // Upload vertex records already in a layout's format and packed indices as they are
+    // (e.g. straight from a mapped mesh cache)
+    GpuMesh(const VertexLayout& vertexLayout, const void* vertexData, size_t vertexBytes, GLsizei verticesInMesh,
+            const void* indexData, GLsizei indicesInMesh, GLenum type, const AABB& meshBounds) {
+        upload(vertexLayout, vertexData, vertexBytes, verticesInMesh, indexData, indicesInMesh, type, meshBounds);
+    }
+
+private:
+    void upload(const VertexLayout& vertexLayout, const void* vertexData, size_t vertexBytes, GLsizei verticesInMesh,
+                const void* indexData, GLsizei indicesInMesh, GLenum type, const AABB& meshBounds) {
+        layout = &vertexLayout;
+        vertexCount = verticesInMesh;
+        indexCount = indicesInMesh;
+        indexType = type;
+        bounds = meshBounds;
+        size_t indexBytes = indexCount * getIndexSize(indexType);
+        gpuBytes = vertexBytes + indexBytes;
+        liveBytes += gpuBytes;
+
+        // Create and bind Vertex Array Object (VAO)
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        // Create and bind Vertex Buffer Object (VBO)
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
+
+        // Create and bind Element Buffer Object (EBO) if indices are used
+        if (indexCount > 0) {
+            glGenBuffers(1, &ebo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
+        }
+
+        // Position, normal and texture coordinate attributes in the layout's format
+        layout->apply(vbo);
+
+        // Unbind VAO
+        glBindVertexArray(0);
+    }
+
+public:
+    ~GpuMesh() {
+        liveBytes -= gpuBytes;
+        if (vao != 0) {
+            glDeleteVertexArrays(1, &vao);
+        }
+        if (vbo != 0) {
+            glDeleteBuffers(1, &vbo);
+        }
+        if (ebo != 0) {
+            glDeleteBuffers(1, &ebo);
+        }
+    }
+
+    GpuMesh(const GpuMesh&) = delete;
+    GpuMesh& operator=(const GpuMesh&) = delete;
+};
+
+size_t GpuMesh::liveBytes = 0;
+
+// Shared, reference-counted handle; the mesh is freed when its last shape releases it
+typedef shared_ptr<const GpuMesh> MeshHandle;
+
+// Content-keyed cache of GPU meshes. A key names a primitive type and its generation
+// parameters (scale is excluded, it belongs in the model matrix), so N identical
+// primitives cost one generation, one upload and one VBO.
+class GeometryCache {
+private:
+    unordered_map<string, weak_ptr<const GpuMesh>> meshes;
+    size_t sweepThreshold = 64;
+    bool enabled = true;
+    bool indexOrderOptimized = true;
+    VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT;
+
+    // Statistics for benchmarking
+    size_t hits = 0;
+    size_t uploads = 0;
+
+    // Drop entries whose meshes were released
+    void sweepExpired() {
+        for (auto it = meshes.begin(); it != meshes.end();) {
+            if (it->second.expired()) {
+                it = meshes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        sweepThreshold = max<size_t>(64, meshes.size() * 2);
+    }
+
+public:
+    static GeometryCache& instance() {
+        static GeometryCache cache;
+        return cache;
+    }
+
+    // Return the mesh for a key, calling generate() to build and upload it only on a miss
+    template <typename Generator>
+    MeshHandle acquire(const string& geometryKey, Generator generate) {
+        // Meshes uploaded in different vertex formats or index orders never share an entry
+        string key = vertexFormat == VERTEX_FORMAT_COMPACT ? geometryKey + "@compact" : geometryKey;
+        if (!indexOrderOptimized) {
+            key += "@unordered";
+        }
+        if (enabled) {
+            auto it = meshes.find(key);
+            if (it != meshes.end()) {
+                if (MeshHandle mesh = it->second.lock()) {
+                    ++hits;
+                    return mesh;
+                }
+            }
+        }
+
+        MeshHandle mesh = generate();
+        ++uploads;
+        if (enabled) {
+            meshes[key] = mesh;
+            if (meshes.size() > sweepThreshold) {
+                sweepExpired();
+            }
+        }
+        return mesh;
+    }
+
+    // Disabling restores one mesh per shape (used to measure the uncached baseline)
+    void setEnabled(bool value) { enabled = value; }
+    bool isEnabled() const { return enabled; }
+
+    // Format requested for meshes uploaded from now on (existing meshes keep theirs)
+    void setVertexFormat(VertexFormat format) { vertexFormat = format; }
+    VertexFormat getVertexFormat() const { return vertexFormat; }
+
+    // Whether generated meshes are reordered by optimizeIndexOrder before upload
+    void setIndexOrderOptimized(bool value) { indexOrderOptimized = value; }
+    bool isIndexOrderOptimized() const { return indexOrderOptimized; }
+
+    void resetStatistics() { hits = 0; uploads = 0; }
+    size_t getHitCount() const { return hits; }
+    size_t getUploadCount() const { return uploads; }
+};
+
+// ************** ENHANCEMENT: Mesh Files **************
+// Meshes can be imported from Wavefront OBJ files. The first import writes a binary
+// cache next to the source holding the vertex records and packed indices exactly as
+// uploaded; later runs map the cache and hand both blobs to glBufferData untouched.
+
+// Read-only memory mapping of a whole file (empty when the file cannot be mapped)
+class MappedFile {
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            return;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            size = data != nullptr ? (size_t)fileSize.QuadPart : 0;
+        }
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return;
+        }
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (view != MAP_FAILED) {
+                data = static_cast<const uint8_t*>(view);
+                size = (size_t)status.st_size;
+            }
+        }
+        close(descriptor);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (data != nullptr) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return data != nullptr; }
+    const uint8_t* getData() const { return data; }
+    size_t getSize() const { return size; }
+};
+
+// Cursor over OBJ text that never reads past the end of the (unterminated) mapping
+struct ObjCursor {
+    const char* position;
+    const char* end;
+
+    void skipSpaces() {
+        while (position < end && (*position == ' ' || *position == '\t' || *position == '\r')) {
+            ++position;
+        }
+    }
+
+    void skipLine() {
+        while (position < end && *position != '\n') {
+            ++position;
+        }
+        if (position < end) {
+            ++position;
+        }
+    }
+
+    bool atLineEnd() {
+        skipSpaces();
+        return position >= end || *position == '\n' || *position == '#';
+    }
+
+    bool readInt(int& value) {
+        bool negative = position < end && *position == '-';
+        if (negative || (position < end && *position == '+')) {
+            ++position;
+        }
+        if (position >= end || !isdigit((unsigned char)*position)) {
+            return false;
+        }
+        long long result = 0;
+        while (position < end && isdigit((unsigned char)*position)) {
+            result = min(result * 10 + (*position++ - '0'), (long long)numeric_limits<int>::max());
+        }
+        value = (int)(negative ? -result : result);
+        return true;
+    }
+
+    // Decimal float with optional fraction and exponent (all OBJ exporters write these)
+    bool readFloat(float& value) {
+        skipSpaces();
+        bool negative = position < end && *position == '-';
+        if (negative || (position < end && *position == '+')) {
+            ++position;
+        }
+        double mantissa = 0.0;
+        int exponent = 0;
+        bool digits = false;
+        while (position < end && isdigit((unsigned char)*position)) {
+            mantissa = mantissa * 10.0 + (*position++ - '0');
+            digits = true;
+        }
+        if (position < end && *position == '.') {
+            ++position;
+            while (position < end && isdigit((unsigned char)*position)) {
+                mantissa = mantissa * 10.0 + (*position++ - '0');
+                --exponent;
+                digits = true;
+            }
+        }
+        if (!digits) {
+            return false;
+        }
+        if (position < end && (*position == 'e' || *position == 'E')) {
+            ++position;
+            int power = 0;
+            if (!readInt(power)) {
+                return false;
+            }
+            exponent += power;
+        }
+        value = (float)((negative ? -mantissa : mantissa) * pow(10.0, exponent));
+        return true;
+    }
+};
+
+// Import the triangles of an OBJ file as interleaved float vertices and indices.
+// Polygons are fanned, negative (relative) indices resolved and each distinct
+// position/UV/normal combination becomes one vertex. Faces without normals get the
+// area-weighted normal of the faces around their position; missing UVs are 0.
+bool importObj(const string& path, vector<float>& vertices, vector<unsigned int>& indices, string& error)
+{
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        error = "cannot open file";
+        return false;
+    }
+
+    vector<glm::vec3> positions;
+    vector<glm::vec2> uvs;
+    vector<glm::vec3> normals;
+
+    // Corner of a face: zero-based position, UV and normal indices (-1 when absent)
+    struct Corner {
+        int position, uv, normal;
+        bool operator==(const Corner& other) const { return position == other.position && uv == other.uv && normal == other.normal; }
+    };
+    struct CornerHash {
+        size_t operator()(const Corner& corner) const {
+            return (size_t)corner.position * 73856093u ^ (size_t)corner.uv * 19349663u ^ (size_t)corner.normal * 83492791u;
+        }
+    };
+    unordered_map<Corner, unsigned int, CornerHash> vertexByCorner;
+    vector<Corner> corners;  // per output vertex
+    vector<Corner> polygon;
+
+    vertices.clear();
+    indices.clear();
+    ObjCursor cursor = { reinterpret_cast<const char*>(file.getData()), reinterpret_cast<const char*>(file.getData()) + file.getSize() };
+    size_t line = 0;
+    auto fail = [&error, &line](const string& message) {
+        error = "line " + to_string(line) + ": " + message;
+        return false;
+    };
+
+    while (cursor.position < cursor.end) {
+        ++line;
+        cursor.skipSpaces();
+        const char* keyword = cursor.position;
+        while (cursor.position < cursor.end && !isspace((unsigned char)*cursor.position)) {
+            ++cursor.position;
+        }
+        size_t keywordLength = cursor.position - keyword;
+
+        if (keywordLength == 1 && keyword[0] == 'v') {
+            glm::vec3 position;
+            if (!cursor.readFloat(position.x) || !cursor.readFloat(position.y) || !cursor.readFloat(position.z)) {
+                return fail("malformed vertex position");
+            }
+            positions.push_back(position);
+        } else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+            glm::vec2 uv;
+            if (!cursor.readFloat(uv.x) || !cursor.readFloat(uv.y)) {
+                return fail("malformed texture coordinate");
+            }
+            uvs.push_back(uv);
+        } else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+            glm::vec3 normal;
+            if (!cursor.readFloat(normal.x) || !cursor.readFloat(normal.y) || !cursor.readFloat(normal.z)) {
+                return fail("malformed vertex normal");
+            }
+            normals.push_back(normal);
+        } else if (keywordLength == 1 && keyword[0] == 'f') {
+            // v, v/vt, v//vn or v/vt/vn per corner; indices are 1-based or negative from the end
+            polygon.clear();
+            while (!cursor.atLineEnd()) {
+                int values[3] = { 0, 0, 0 };
+                const size_t counts[3] = { positions.size(), uvs.size(), normals.size() };
+                Corner corner = { -1, -1, -1 };
+                for (int k = 0; k < 3; ++k) {
+                    if (k > 0) {
+                        if (cursor.position >= cursor.end || *cursor.position != '/') {
+                            break;
+                        }
+                        ++cursor.position;
+                        if (cursor.position < cursor.end && *cursor.position == '/') {
+                            continue;
+                        }
+                    }
+                    if (!cursor.readInt(values[k])) {
+                        return fail("malformed face");
+                    }
+                    int resolved = values[k] < 0 ? (int)counts[k] + values[k] : values[k] - 1;
+                    if (resolved < 0 || resolved >= (int)counts[k]) {
+                        return fail("face index out of range");
+                    }
+                    (k == 0 ? corner.position : k == 1 ? corner.uv : corner.normal) = resolved;
+                }
+                polygon.push_back(corner);
+            }
+            if (polygon.size() < 3) {
+                return fail("face with fewer than three corners");
+            }
+
+            unsigned int polygonIndices[3] = { 0, 0, 0 };
+            for (size_t k = 0; k < polygon.size(); ++k) {
+                auto inserted = vertexByCorner.emplace(polygon[k], (unsigned int)corners.size());
+                if (inserted.second) {
+                    corners.push_back(polygon[k]);
+                }
+                unsigned int index = inserted.first->second;
+                if (k == 0) {
+                    polygonIndices[0] = index;
+                } else if (k == 1) {
+                    polygonIndices[2] = index;
+                } else {
+                    polygonIndices[1] = polygonIndices[2];
+                    polygonIndices[2] = index;
+                    indices.insert(indices.end(), { polygonIndices[0], polygonIndices[1], polygonIndices[2] });
+                }
+            }
+        }
+        cursor.skipLine();
+    }
+    if (indices.empty()) {
+        error = "no faces";
+        return false;
+    }
+
+    // Area-weighted face normals accumulated per position for corners without a normal
+    vector<glm::vec3> generatedNormals;
+    for (const Corner& corner : corners) {
+        if (corner.normal < 0) {
+            generatedNormals.assign(positions.size(), glm::vec3(0.0f));
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                int a = corners[indices[t]].position, b = corners[indices[t + 1]].position, c = corners[indices[t + 2]].position;
+                glm::vec3 face = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+                generatedNormals[a] += face;
+                generatedNormals[b] += face;
+                generatedNormals[c] += face;
+            }
+            break;
+        }
+    }
+
+    vertices.reserve(corners.size() * FLOAT_VERTEX_COMPONENTS);
+    for (const Corner& corner : corners) {
+        glm::vec3 normal = corner.normal >= 0 ? normals[corner.normal] : generatedNormals[corner.position];
+        float length = glm::length(normal);
+        normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec2 uv = corner.uv >= 0 ? uvs[corner.uv] : glm::vec2(0.0f);
+        const glm::vec3& position = positions[corner.position];
+        vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y });
+    }
+    return true;
+}
+
+// Binary mesh cache: a header, then the vertex records and the packed indices, each
+// starting on a MESH_CACHE_ALIGNMENT boundary. The header records the source file's
+// size and modification time; a cache that no longer matches is rebuilt.
+const uint32_t MESH_CACHE_MAGIC = 0x4853454D;  // "MESH"
+const uint32_t MESH_CACHE_VERSION = 1;
+const uint64_t MESH_CACHE_ALIGNMENT = 64;
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t vertexFormat;    // VertexFormat of the records
+    uint32_t indexType;       // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexOrderOptimized;
+    uint32_t padding;
+    uint64_t vertexOffset;
+    uint64_t vertexBytes;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+static_assert(sizeof(MeshCacheHeader) == 104, "MeshCacheHeader must have no implicit padding");
+
+// Time spent in each stage of the most recent loadMeshFile call
+struct MeshLoadReport {
+    bool fromCache = false;
+    double importMs = 0.0;
+    double optimizeMs = 0.0;
+    double cacheWriteMs = 0.0;  // encoding the vertices and writing the cache
+    double mapMs = 0.0;
+    double uploadMs = 0.0;
+    size_t cacheBytes = 0;
+};
+
+// Cache file for a source file and requested vertex format
+inline string getMeshCachePath(const string& path, VertexFormat format)
+{
+    return path + (format == VERTEX_FORMAT_COMPACT ? ".compact" : "") + ".meshcache";
+}
+
+// Whether every packed index refers to one of vertexCount vertices, so a corrupt cache
+// can never make the GPU read past the vertex buffer
+inline bool indicesInRange(const uint8_t* data, uint32_t indexCount, GLenum indexType, uint32_t vertexCount)
+{
+    uint32_t largest = 0;
+    if (indexType == GL_UNSIGNED_SHORT) {
+        const uint16_t* indices = reinterpret_cast<const uint16_t*>(data);
+        for (uint32_t i = 0; i < indexCount; ++i) {
+            largest = max(largest, (uint32_t)indices[i]);
+        }
+    } else {
+        const uint32_t* indices = reinterpret_cast<const uint32_t*>(data);
+        for (uint32_t i = 0; i < indexCount; ++i) {
+            largest = max(largest, indices[i]);
+        }
+    }
+    return indexCount == 0 || largest < vertexCount;
+}
+
+// Write the encoded blobs behind a header; written to a temporary file and renamed so a
+// crash never leaves a truncated cache behind
+inline bool writeMeshCache(const string& cachePath, MeshCacheHeader header, const vector<uint8_t>& vertexBytes,
+                           const vector<uint8_t>& indexBytes)
+{
+    auto align = [](uint64_t offset) { return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT; };
+    header.vertexOffset = align(sizeof(MeshCacheHeader));
+    header.vertexBytes = vertexBytes.size();
+    header.indexOffset = align(header.vertexOffset + header.vertexBytes);
+    header.indexBytes = indexBytes.size();
+
+    string temporaryPath = cachePath + ".tmp";
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        if (!file) {
+            return false;
+        }
+        vector<char> zeros(MESH_CACHE_ALIGNMENT, 0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(zeros.data(), header.vertexOffset - sizeof(header));
+        file.write(reinterpret_cast<const char*>(vertexBytes.data()), vertexBytes.size());
+        file.write(zeros.data(), header.indexOffset - header.vertexOffset - header.vertexBytes);
+        file.write(reinterpret_cast<const char*>(indexBytes.data()), indexBytes.size());
+        if (!file) {
+            return false;
+        }
+    }
+    remove(cachePath.c_str());
+    return rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+}
+
+// Load a mesh file through its binary cache. A cache matching the source is mapped and
+// its blobs uploaded with zero parsing; otherwise the OBJ is imported, reordered (see
+// optimizeIndexOrder), encoded, uploaded, and the cache written for the next run.
+// Returns nullptr (and reports why) when neither works.
+MeshHandle loadMeshFile(const string& path, VertexFormat format, bool optimizeOrder, MeshLoadReport* report = nullptr)
+{
+    MeshLoadReport timings;
+    auto elapsedSince = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    struct stat source;
+    if (stat(path.c_str(), &source) != 0) {
+        cerr << "Failed to load mesh: " << path << " (cannot open file)" << endl;
+        return nullptr;
+    }
+
+    // Warm start: validate the header, the blob ranges and the index values, then upload
+    // straight from the mapping; a cache failing any check is rebuilt below
+    string cachePath = getMeshCachePath(path, format);
+    auto start = chrono::steady_clock::now();
+    {
+        MappedFile cache(cachePath);
+        const MeshCacheHeader* header = cache.getSize() >= sizeof(MeshCacheHeader)
+            ? reinterpret_cast<const MeshCacheHeader*>(cache.getData()) : nullptr;
+        if (header && header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION
+            && header->sourceSize == (uint64_t)source.st_size && header->sourceTime == (int64_t)source.st_mtime
+            && header->indexOrderOptimized == (optimizeOrder ? 1u : 0u)
+            && (header->vertexFormat == VERTEX_FORMAT_FLOAT || header->vertexFormat == VERTEX_FORMAT_COMPACT)
+            && header->indexType == GpuMesh::getIndexType(header->vertexCount)
+            && header->vertexBytes == (uint64_t)header->vertexCount * VertexLayout::get((VertexFormat)header->vertexFormat).getStride()
+            && header->indexBytes == (uint64_t)header->indexCount * GpuMesh::getIndexSize(header->indexType)
+            && header->vertexOffset % MESH_CACHE_ALIGNMENT == 0
+            && header->vertexOffset <= cache.getSize() && header->vertexBytes <= cache.getSize() - header->vertexOffset
+            && header->indexOffset % MESH_CACHE_ALIGNMENT == 0
+            && header->indexOffset <= cache.getSize() && header->indexBytes <= cache.getSize() - header->indexOffset
+            && indicesInRange(cache.getData() + header->indexOffset, header->indexCount, header->indexType, header->vertexCount)) {
+            AABB bounds;
+            bounds.min = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+            bounds.max = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+            timings.fromCache = true;
+            timings.mapMs = elapsedSince(start);
+            timings.cacheBytes = cache.getSize();
+
+            start = chrono::steady_clock::now();
+            MeshHandle mesh = make_shared<const GpuMesh>(VertexLayout::get((VertexFormat)header->vertexFormat),
+                cache.getData() + header->vertexOffset, header->vertexBytes, (GLsizei)header->vertexCount,
+                cache.getData() + header->indexOffset, (GLsizei)header->indexCount, header->indexType, bounds);
+            timings.uploadMs = elapsedSince(start);
+            if (report) {
+                *report = timings;
+            }
+            return mesh;
+        }
+    }
+
+    // Cold start: import, reorder and encode
+    start = chrono::steady_clock::now();
+    vector<float> vertices;
+    vector<unsigned int> indices;
+    string error;
+    if (!importObj(path, vertices, indices, error)) {
+        cerr << "Failed to load mesh: " << path << " (" << error << ")" << endl;
+        return nullptr;
+    }
+    timings.importMs = elapsedSince(start);
+
+    start = chrono::steady_clock::now();
+    if (optimizeOrder) {
+        optimizeIndexOrder(indices, vertices);
+    }
+    timings.optimizeMs = elapsedSince(start);
+
+    start = chrono::steady_clock::now();
+    const VertexLayout& layout = GpuMesh::getLayout(vertices, format);
+    vector<uint8_t> vertexBytes = layout.encode(vertices);
+    GLsizei vertexCount = (GLsizei)(vertices.size() / FLOAT_VERTEX_COMPONENTS);
+    GLenum indexType = GpuMesh::getIndexType(vertexCount);
+    vector<uint8_t> indexBytes = GpuMesh::packIndices(indices, indexType);
+    AABB bounds = GpuMesh::getBounds(vertices);
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.sourceSize = (uint64_t)source.st_size;
+    header.sourceTime = (int64_t)source.st_mtime;
+    header.vertexFormat = layout.getFormat();
+    header.indexType = indexType;
+    header.vertexCount = (uint32_t)vertexCount;
+    header.indexCount = (uint32_t)indices.size();
+    header.indexOrderOptimized = optimizeOrder ? 1u : 0u;
+    for (int k = 0; k < 3; ++k) {
+        header.boundsMin[k] = bounds.min[k];
+        header.boundsMax[k] = bounds.max[k];
+    }
+    if (!writeMeshCache(cachePath, header, vertexBytes, indexBytes)) {
+        cerr << "Failed to write mesh cache: " << cachePath << endl;
+    }
+    timings.cacheWriteMs = elapsedSince(start);
+
+    start = chrono::steady_clock::now();
+    MeshHandle mesh = make_shared<const GpuMesh>(layout, vertexBytes.data(), vertexBytes.size(), vertexCount,
+                                                 indexBytes.data(), (GLsizei)indices.size(), indexType, bounds);
+    timings.uploadMs = elapsedSince(start);
+    if (report) {
+        *report = timings;
+    }
+    return mesh;
+}
+
+// ************** ENHANCEMENT: Texture Cooker **************
+// Images can be cooked into block-compressed mip chains: BC1 (DXT1, 4 bits per texel) for
+// opaque images and BC3 (DXT5, 8 bits per texel) when any texel is translucent. The first
+// load writes a cache next to the source holding every level exactly as uploaded; later
+// runs map the cache and upload the levels with glCompressedTexImage2D, so neither image
+// decoding nor glGenerateMipmap runs again.
+const uint32_t TEXTURE_CACHE_MAGIC = 0x58455443;  // "CTEX"
+const uint32_t TEXTURE_CACHE_VERSION = 1;
+const uint64_t TEXTURE_CACHE_ALIGNMENT = 64;
+const int MAX_TEXTURE_LEVELS = 16;  // enough for 32768 x 32768
+
+// The header records the source file's size and modification time like MeshCacheHeader;
+// level k holds levelBytes[k] bytes of 4x4 blocks at levelOffsets[k]
+struct TextureCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t format;      // GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    uint32_t flipped;     // rows stored bottom first (see TextureManager::setFlipOnLoad)
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t padding;
+    uint64_t levelOffsets[MAX_TEXTURE_LEVELS];
+    uint64_t levelBytes[MAX_TEXTURE_LEVELS];
+};
+
+static_assert(sizeof(TextureCacheHeader) == 48 + 16 * MAX_TEXTURE_LEVELS, "TextureCacheHeader must have no implicit padding");
+
+// Compressed mip chain ready for upload, either cooked in memory or mapped from a cache
+struct CookedTexture {
+    GLenum format = 0;
+    int width = 0;
+    int height = 0;
+    int levelCount = 0;
+    size_t levelOffsets[MAX_TEXTURE_LEVELS] = {};
+    size_t levelBytes[MAX_TEXTURE_LEVELS] = {};
+    vector<uint8_t> storage;
+    unique_ptr<MappedFile> mapping;
+    const uint8_t* data = nullptr;  // first level; offsets are relative to it
+
+    size_t getTotalBytes() const { return levelCount > 0 ? levelOffsets[levelCount - 1] + levelBytes[levelCount - 1] : 0; }
+};
+
+// Levels in a full mip chain down to 1x1
+inline int getMipLevelCount(int width, int height)
+{
+    int levels = 1;
+    while ((width > 1 || height > 1) && levels < MAX_TEXTURE_LEVELS) {
+        width = max(1, width / 2);
+        height = max(1, height / 2);
+        ++levels;
+    }
+    return levels;
+}
+
+// Bytes of one compressed level: 8 (BC1) or 16 (BC3) bytes per started 4x4 block
+inline size_t getCompressedLevelBytes(GLenum format, int width, int height)
+{
+    size_t blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+// Bytes of an uncompressed RGBA8 mip chain; drivers pad GL_RGB8 texels to four bytes too
+inline size_t getUncompressedChainBytes(int width, int height)
+{
+    size_t bytes = 0;
+    for (int level = 0; level < getMipLevelCount(width, height); ++level) {
+        bytes += (size_t)width * height * 4;
+        width = max(1, width / 2);
+        height = max(1, height / 2);
+    }
+    return bytes;
+}
+
+// Next mip level of an RGBA image with a 2x2 box filter (odd edges repeat the last texel)
+inline void downsampleRgba(const vector<uint8_t>& source, int width, int height, vector<uint8_t>& target)
+{
+    int targetWidth = max(1, width / 2), targetHeight = max(1, height / 2);
+    target.resize((size_t)targetWidth * targetHeight * 4);
+    for (int y = 0; y < targetHeight; ++y) {
+        int y0 = min(2 * y, height - 1), y1 = min(2 * y + 1, height - 1);
+        for (int x = 0; x < targetWidth; ++x) {
+            int x0 = min(2 * x, width - 1), x1 = min(2 * x + 1, width - 1);
+            const uint8_t* texels[4] = { &source[((size_t)y0 * width + x0) * 4], &source[((size_t)y0 * width + x1) * 4],
+                                         &source[((size_t)y1 * width + x0) * 4], &source[((size_t)y1 * width + x1) * 4] };
+            for (int c = 0; c < 4; ++c) {
+                target[((size_t)y * targetWidth + x) * 4 + c] = (uint8_t)((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+            }
+        }
+    }
+}
+
+// RGB565 endpoint and its expansion back to eight bits per channel
+inline uint16_t packRgb565(const glm::vec3& color)
+{
+    glm::vec3 clamped = glm::clamp(color, 0.0f, 255.0f);
+    return (uint16_t)(((int)(clamped.r * 31.0f / 255.0f + 0.5f) << 11) | ((int)(clamped.g * 63.0f / 255.0f + 0.5f) << 5)
+                      | (int)(clamped.b * 31.0f / 255.0f + 0.5f));
+}
+
+inline glm::vec3 unpackRgb565(uint16_t color)
+{
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    return glm::vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+}
+
+// BC1 color block for 16 RGBA texels: endpoints at the extremes of the colors projected on
+// their principal axis, always in four-color mode (color0 > color1) so BC3 can share it
+inline void encodeColorBlock(const uint8_t* texels, uint8_t* block)
+{
+    glm::vec3 colors[16];
+    glm::vec3 mean(0.0f);
+    for (int i = 0; i < 16; ++i) {
+        colors[i] = glm::vec3(texels[i * 4], texels[i * 4 + 1], texels[i * 4 + 2]);
+        mean += colors[i];
+    }
+    mean *= 1.0f / 16.0f;
+
+    // Principal axis of the covariance by power iteration, started on the largest spread
+    float covariance[6] = {};
+    glm::vec3 low(255.0f), high(0.0f);
+    for (const glm::vec3& color : colors) {
+        glm::vec3 d = color - mean;
+        covariance[0] += d.r * d.r; covariance[1] += d.r * d.g; covariance[2] += d.r * d.b;
+        covariance[3] += d.g * d.g; covariance[4] += d.g * d.b; covariance[5] += d.b * d.b;
+        low = glm::min(low, color);
+        high = glm::max(high, color);
+    }
+    glm::vec3 axis = high - low;
+    for (int iteration = 0; iteration < 4; ++iteration) {
+        axis = glm::vec3(covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+                         covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+                         covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b);
+        float length = max(max(fabs(axis.r), fabs(axis.g)), fabs(axis.b));
+        if (length > 0.0f) {
+            axis *= 1.0f / length;
+        }
+    }
+
+    float minimum = 0.0f, maximum = 0.0f;
+    if (glm::dot(axis, axis) > 0.0f) {
+        axis = glm::normalize(axis);
+        minimum = numeric_limits<float>::max();
+        maximum = -numeric_limits<float>::max();
+        for (const glm::vec3& color : colors) {
+            float t = glm::dot(color - mean, axis);
+            minimum = min(minimum, t);
+            maximum = max(maximum, t);
+        }
+    }
+    uint16_t color0 = packRgb565(mean + axis * maximum);
+    uint16_t color1 = packRgb565(mean + axis * minimum);
+    if (color0 < color1) {
+        swap(color0, color1);
+    }
+
+    // Nearest of the four palette entries per texel; equal endpoints leave every index 0
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        glm::vec3 palette[4] = { unpackRgb565(color0), unpackRgb565(color1) };
+        palette[2] = (2.0f * palette[0] + palette[1]) * (1.0f / 3.0f);
+        palette[3] = (palette[0] + 2.0f * palette[1]) * (1.0f / 3.0f);
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestDistance = numeric_limits<float>::max();
+            for (int entry = 0; entry < 4; ++entry) {
+                glm::vec3 d = colors[i] - palette[entry];
+                float distance = glm::dot(d, d);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = entry;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    block[0] = (uint8_t)(color0 & 0xFF);
+    block[1] = (uint8_t)(color0 >> 8);
+    block[2] = (uint8_t)(color1 & 0xFF);
+    block[3] = (uint8_t)(color1 >> 8);
+    for (int k = 0; k < 4; ++k) {
+        block[4 + k] = (uint8_t)(indices >> (8 * k));
+    }
+}
+
+// BC3 alpha block: the alpha range in eight-value mode with a 3-bit index per texel
+inline void encodeAlphaBlock(const uint8_t* texels, uint8_t* block)
+{
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        alpha0 = max(alpha0, (int)texels[i * 4 + 3]);
+        alpha1 = min(alpha1, (int)texels[i * 4 + 3]);
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1) {
+        int palette[8] = { alpha0, alpha1 };
+        for (int k = 1; k < 7; ++k) {
+            palette[k + 1] = ((7 - k) * alpha0 + k * alpha1) / 7;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int alpha = texels[i * 4 + 3];
+            int best = 0;
+            for (int entry = 1; entry < 8; ++entry) {
+                if (abs(palette[entry] - alpha) < abs(palette[best] - alpha)) {
+                    best = entry;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    block[0] = (uint8_t)alpha0;
+    block[1] = (uint8_t)alpha1;
+    for (int k = 0; k < 6; ++k) {
+        block[2 + k] = (uint8_t)(indices >> (8 * k));
+    }
+}
+
+// Compress one RGBA level into blocks; partial edge blocks repeat the last row and column
+inline void compressLevel(const vector<uint8_t>& rgba, int width, int height, GLenum format, uint8_t* target)
+{
+    uint8_t texels[64];
+    for (int blockY = 0; blockY < height; blockY += 4) {
+        for (int blockX = 0; blockX < width; blockX += 4) {
+            for (int i = 0; i < 16; ++i) {
+                int x = min(blockX + i % 4, width - 1), y = min(blockY + i / 4, height - 1);
+                memcpy(&texels[i * 4], &rgba[((size_t)y * width + x) * 4], 4);
+            }
+            if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                encodeAlphaBlock(texels, target);
+                target += 8;
+            }
+            encodeColorBlock(texels, target);
+            target += 8;
+        }
+    }
+}
+
+// Cook decoded pixels (3 or 4 channels) into a compressed mip chain
+inline unique_ptr<CookedTexture> cookTexture(const unsigned char* pixels, int width, int height, int channels)
+{
+    vector<uint8_t> level((size_t)width * height * 4);
+    bool opaque = true;
+    for (size_t i = 0; i < (size_t)width * height; ++i) {
+        level[i * 4] = pixels[i * channels];
+        level[i * 4 + 1] = pixels[i * channels + 1];
+        level[i * 4 + 2] = pixels[i * channels + 2];
+        level[i * 4 + 3] = channels == 4 ? pixels[i * channels + 3] : 255;
+        opaque = opaque && level[i * 4 + 3] == 255;
+    }
+
+    unique_ptr<CookedTexture> cooked(new CookedTexture());
+    cooked->format = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    cooked->width = width;
+    cooked->height = height;
+    cooked->levelCount = getMipLevelCount(width, height);
+
+    size_t offset = 0;
+    for (int k = 0, w = width, h = height; k < cooked->levelCount; ++k, w = max(1, w / 2), h = max(1, h / 2)) {
+        cooked->levelOffsets[k] = offset;
+        cooked->levelBytes[k] = getCompressedLevelBytes(cooked->format, w, h);
+        offset += cooked->levelBytes[k];
+    }
+    cooked->storage.resize(offset);
+
+    vector<uint8_t> next;
+    for (int k = 0, w = width, h = height; k < cooked->levelCount; ++k) {
+        compressLevel(level, w, h, cooked->format, &cooked->storage[cooked->levelOffsets[k]]);
+        if (k + 1 < cooked->levelCount) {
+            downsampleRgba(level, w, h, next);
+            level.swap(next);
+            w = max(1, w / 2);
+            h = max(1, h / 2);
+        }
+    }
+    cooked->data = cooked->storage.data();
+    return cooked;
+}
+
+// Cache file for a source image
+inline string getTextureCachePath(const string& path)
+{
+    return path + ".texcache";
+}
+
+// Write the levels behind a header, through a temporary file like writeMeshCache
+inline bool writeTextureCache(const string& cachePath, TextureCacheHeader header, const CookedTexture& cooked)
+{
+    uint64_t dataOffset = (sizeof(TextureCacheHeader) + TEXTURE_CACHE_ALIGNMENT - 1) / TEXTURE_CACHE_ALIGNMENT * TEXTURE_CACHE_ALIGNMENT;
+    for (int k = 0; k < cooked.levelCount; ++k) {
+        header.levelOffsets[k] = dataOffset + cooked.levelOffsets[k];
+        header.levelBytes[k] = cooked.levelBytes[k];
+    }
+
+    string temporaryPath = cachePath + ".tmp";
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        if (!file) {
+            return false;
+        }
+        vector<char> zeros(TEXTURE_CACHE_ALIGNMENT, 0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(zeros.data(), dataOffset - sizeof(header));
+        file.write(reinterpret_cast<const char*>(cooked.data), cooked.getTotalBytes());
+        if (!file) {
+            return false;
+        }
+    }
+    remove(cachePath.c_str());
+    return rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+}
+
+// Time spent loading textures from files so far, summed over the decode workers
+struct TextureLoadStatistics {
+    size_t decoded = 0;    // images decoded with stb_image
+    size_t cooked = 0;     // of those, compressed and written to a cache
+    size_t cacheHits = 0;  // compressed chains mapped from a cache
+    double decodeMs = 0.0;
+    double cookMs = 0.0;
+    double cacheMs = 0.0;  // mapping caches and writing new ones
+    double uploadMs = 0.0;  // render thread: PBO copies and texture specification
+};
+
+// Load an image as a compressed mip chain. A cache matching the source (and row order) is
+// mapped and returned as is; otherwise the image is decoded, cooked and the cache written
+// for the next run. Returns nullptr (and reports why) when the image cannot be loaded.
+unique_ptr<CookedTexture> loadCookedTexture(const string& path, bool flipped, TextureLoadStatistics& timings)
+{
+    auto elapsedSince = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    struct stat source;
+    if (stat(path.c_str(), &source) != 0) {
+        cerr << "Failed to load texture: " << path << endl;
+        return nullptr;
+    }
+
+    // Warm start: validate the header and every level range, then keep the mapping
+    string cachePath = getTextureCachePath(path);
+    auto start = chrono::steady_clock::now();
+    {
+        unique_ptr<MappedFile> cache(new MappedFile(cachePath));
+        const TextureCacheHeader* header = cache->getSize() >= sizeof(TextureCacheHeader)
+            ? reinterpret_cast<const TextureCacheHeader*>(cache->getData()) : nullptr;
+        bool valid = header && header->magic == TEXTURE_CACHE_MAGIC && header->version == TEXTURE_CACHE_VERSION
+            && header->sourceSize == (uint64_t)source.st_size && header->sourceTime == (int64_t)source.st_mtime
+            && header->flipped == (flipped ? 1u : 0u)
+            && (header->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header->format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            && header->width > 0 && header->height > 0 && header->width <= 32768 && header->height <= 32768
+            && header->levelCount == (uint32_t)getMipLevelCount(header->width, header->height);
+        for (uint32_t k = 0; valid && k < header->levelCount; ++k) {
+            int w = max(1, (int)header->width >> k), h = max(1, (int)header->height >> k);
+            valid = header->levelBytes[k] == getCompressedLevelBytes(header->format, w, h)
+                && (k == 0 || header->levelOffsets[k] == header->levelOffsets[k - 1] + header->levelBytes[k - 1])
+                && header->levelOffsets[k] <= cache->getSize() && header->levelBytes[k] <= cache->getSize() - header->levelOffsets[k];
+        }
+        if (valid) {
+            unique_ptr<CookedTexture> cooked(new CookedTexture());
+            cooked->format = header->format;
+            cooked->width = (int)header->width;
+            cooked->height = (int)header->height;
+            cooked->levelCount = (int)header->levelCount;
+            for (int k = 0; k < cooked->levelCount; ++k) {
+                cooked->levelOffsets[k] = header->levelOffsets[k] - header->levelOffsets[0];
+                cooked->levelBytes[k] = header->levelBytes[k];
+            }
+            cooked->data = cache->getData() + header->levelOffsets[0];
+            cooked->mapping = move(cache);
+            ++timings.cacheHits;
+            timings.cacheMs += elapsedSince(start);
+            return cooked;
+        }
+    }
+
+    // Cold start: decode, cook and cache
+    start = chrono::steady_clock::now();
+    int width = 0, height = 0, channels = 0;
+    unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+    if (!pixels) {
+        cerr << "Failed to load texture: " << path << endl;
+        return nullptr;
+    }
+    if (channels != 3 && channels != 4) {
+        cerr << "Not implemented to handle an image with " << channels << " channels" << endl;
+        stbi_image_free(pixels);
+        return nullptr;
+    }
+    if (flipped) {
+        flipImageVertically(pixels, width, height, channels);
+    }
+    ++timings.decoded;
+    timings.decodeMs += elapsedSince(start);
+
+    start = chrono::steady_clock::now();
+    unique_ptr<CookedTexture> cooked = cookTexture(pixels, width, height, channels);
+    stbi_image_free(pixels);
+    ++timings.cooked;
+    timings.cookMs += elapsedSince(start);
+
+    start = chrono::steady_clock::now();
+    TextureCacheHeader header = {};
+    header.magic = TEXTURE_CACHE_MAGIC;
+    header.version = TEXTURE_CACHE_VERSION;
+    header.sourceSize = (uint64_t)source.st_size;
+    header.sourceTime = (int64_t)source.st_mtime;
+    header.format = cooked->format;
+    header.flipped = flipped ? 1u : 0u;
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.levelCount = (uint32_t)cooked->levelCount;
+    if (!writeTextureCache(cachePath, header, *cooked)) {
+        cerr << "Failed to write texture cache: " << cachePath << endl;
+    }
+    timings.cacheMs += elapsedSince(start);
+    return cooked;
+}
+
+// ************** ENHANCEMENT: TextureManager Class **************
+// GL texture shared by every shape that uses the same image path. It holds a 1x1
+// placeholder until the decoded image has been uploaded into the same texture name.
+struct Texture {
+    GLuint id = 0;
+    string path;
+    int width = 1;
+    int height = 1;
+    bool ready = false;
+    bool failed = false;
+    size_t gpuBytes = 0;  // all levels
+
+    // Bytes held by all live textures, for memory reporting
+    static size_t liveBytes;
+
+    void setGpuBytes(size_t bytes) {
+        liveBytes = liveBytes - gpuBytes + bytes;
+        gpuBytes = bytes;
+    }
+
+    ~Texture() {
+        liveBytes -= gpuBytes;
+        if (id != 0) {
+            glDeleteTextures(1, &id);
+        }
+    }
+};
+
+size_t Texture::liveBytes = 0;
+
+typedef shared_ptr<Texture> TextureHandle;
+
+// Deduplicates textures by path, decodes images on worker threads and uploads
+// them on the render thread through a ring of pixel buffer objects (PBOs). With
+// compression enabled the workers load cooked mip chains instead (see loadCookedTexture).
+class TextureManager {
+private:
+    // Image decode request and result passed between the render thread and the workers
+    struct DecodeJob {
+        string path;
+        weak_ptr<Texture> texture;
+    };
+    struct DecodedImage {
+        weak_ptr<Texture> texture;
+        unsigned char* pixels;
+        int width;
+        int height;
+        int channels;
+        shared_ptr<CookedTexture> cooked;  // set instead of pixels when compression is enabled
+    };
+
+    // One PBO in the upload ring, fenced after the texture copy that reads it
+    struct UploadSlot {
+        GLuint pbo = 0;
+        GLsizeiptr capacity = 0;
+        GLsync fence = nullptr;
+    };
+
+    static const int UPLOAD_RING_SIZE = 4;
+
+    // Upload budget per frame so streaming textures never stall a frame for long
+    static const size_t UPLOAD_BYTES_PER_FRAME = 16 * 1024 * 1024;
+
+    unordered_map<string, weak_ptr<Texture>> textures;
+
+    vector<thread> workers;
+    mutex queueMutex;
+    condition_variable queueCondition;
+    deque<DecodeJob> pendingJobs;
+    deque<DecodedImage> decodedImages;
+    size_t inFlight = 0;  // jobs queued or being decoded, guarded by queueMutex
+    bool stopping = false;
+    bool flipOnLoad = true;
+    bool compression = false;
+    TextureLoadStatistics statistics;  // guarded by queueMutex
+
+    UploadSlot uploadRing[UPLOAD_RING_SIZE];
+    int nextSlot = 0;
+
+    TextureManager() = default;
+
+    // Worker loop: decode and flip images off the render thread
+    void workerLoop() {
+        for (;;) {
+            DecodeJob job;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this]() { return stopping || !pendingJobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = pendingJobs.front();
+                pendingJobs.pop_front();
+            }
+
+            // Skip images whose shapes were all released before decoding started
+            DecodedImage image = { job.texture, nullptr, 0, 0, 0, nullptr };
+            TextureLoadStatistics timings;
+            if (!job.texture.expired() && compression) {
+                image.cooked = loadCookedTexture(job.path, flipOnLoad, timings);
+            } else if (!job.texture.expired()) {
+                auto start = chrono::steady_clock::now();
+                image.pixels = stbi_load(job.path.c_str(), &image.width, &image.height, &image.channels, 0);
+                if (image.pixels) {
+                    // Flip the image vertically for OpenGL coordinate system
+                    if (flipOnLoad) {
+                        flipImageVertically(image.pixels, image.width, image.height, image.channels);
+                    }
+                    ++timings.decoded;
+                    timings.decodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                } else {
+                    cerr << "Failed to load texture: " << job.path << endl;
+                }
+            }
+
+            lock_guard<mutex> lock(queueMutex);
+            statistics.decoded += timings.decoded;
+            statistics.cooked += timings.cooked;
+            statistics.cacheHits += timings.cacheHits;
+            statistics.decodeMs += timings.decodeMs;
+            statistics.cookMs += timings.cookMs;
+            statistics.cacheMs += timings.cacheMs;
+            decodedImages.push_back(image);
+        }
+    }
+
+    void startWorkers() {
+        unsigned int threadCount = thread::hardware_concurrency();
+        threadCount = (threadCount > 1) ? min(threadCount - 1, 4u) : 1u;
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            workers.emplace_back(&TextureManager::workerLoop, this);
+        }
+    }
+
+    // Copy one decoded image into the next free PBO and from there into its texture.
+    // Returns false when the next PBO is still in use by the GPU.
+    bool upload(const DecodedImage& image, const TextureHandle& texture) {
+        auto start = chrono::steady_clock::now();
+        UploadSlot& slot = uploadRing[nextSlot];
+        if (slot.fence) {
+            GLenum status = glClientWaitSync(slot.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                return false;
+            }
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+
+        GLsizeiptr size = image.cooked ? (GLsizeiptr)image.cooked->getTotalBytes()
+                                       : (GLsizeiptr)image.width * image.height * image.channels;
+        if (slot.pbo == 0) {
+            glGenBuffers(1, &slot.pbo);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        if (size > slot.capacity) {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            slot.capacity = size;
+        }
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped) {
+            memcpy(mapped, image.cooked ? image.cooked->data : image.pixels, size);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // Rows of RGB images are not 4-byte aligned in general
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        if (image.cooked) {
+            // Every level was precomputed; upload each from its offset in the PBO
+            const CookedTexture& cooked = *image.cooked;
+            for (int level = 0; level < cooked.levelCount; ++level) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, cooked.format, max(1, cooked.width >> level), max(1, cooked.height >> level), 0,
+                                       (GLsizei)cooked.levelBytes[level], (void*)cooked.levelOffsets[level]);
+            }
+            texture->setGpuBytes(cooked.getTotalBytes());
+        } else {
+            GLenum internalFormat = (image.channels == 3) ? GL_RGB8 : GL_RGBA8;
+            GLenum format = (image.channels == 3) ? GL_RGB : GL_RGBA;
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+
+            // Generate mipmaps
+            glGenerateMipmap(GL_TEXTURE_2D);
+            texture->setGpuBytes(getUncompressedChainBytes(image.width, image.height));
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        nextSlot = (nextSlot + 1) % UPLOAD_RING_SIZE;
+
+        texture->width = image.cooked ? image.cooked->width : image.width;
+        texture->height = image.cooked ? image.cooked->height : image.height;
+        texture->ready = true;
+
+        lock_guard<mutex> lock(queueMutex);
+        statistics.uploadMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+public:
+    static TextureManager& instance() {
+        static TextureManager manager;
+        return manager;
+    }
+
+    ~TextureManager() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        for (DecodedImage& image : decodedImages) {
+            stbi_image_free(image.pixels);
+        }
+        for (UploadSlot& slot : uploadRing) {
+            if (slot.fence) {
+                glDeleteSync(slot.fence);
+            }
+            if (slot.pbo != 0) {
+                glDeleteBuffers(1, &slot.pbo);
+            }
+        }
+    }
+
+    TextureManager(const TextureManager&) = delete;
+    TextureManager& operator=(const TextureManager&) = delete;
+
+    // Return the shared texture for a path. A new path gets a placeholder texture
+    // immediately and is queued for decoding; the real image replaces it in update().
+    TextureHandle load(const string& path) {
+        auto it = textures.find(path);
+        if (it != textures.end()) {
+            if (TextureHandle existing = it->second.lock()) {
+                return existing;
+            }
+        }
+
+        TextureHandle texture = make_shared<Texture>();
+        texture->path = path;
+
+        // Placeholder: a single white texel, so lighting shows until the image arrives
+        const unsigned char white[4] = { 255, 255, 255, 255 };
+        glGenTextures(1, &texture->id);
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+
+        // Set texture wrapping parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        // Set texture filtering parameters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        texture->setGpuBytes(sizeof(white));
+
+        textures[path] = texture;
+
+        if (workers.empty()) {
+            // BC1/BC3 uploads need S3TC, an extension outside the core profile
+            if (compression && !GLEW_EXT_texture_compression_s3tc) {
+                cerr << "Failed to enable compressed textures: EXT_texture_compression_s3tc is not supported, loading raw images" << endl;
+                compression = false;
+            }
+            startWorkers();
+        }
+        {
+            lock_guard<mutex> lock(queueMutex);
+            pendingJobs.push_back({ path, texture });
+            ++inFlight;
+        }
+        queueCondition.notify_one();
+
+        return texture;
+    }
+
+    // Register a texture generated in memory (RGBA rows, bottom row first) under a key.
+    // Shapes whose texture path equals the key then share it through load().
+    TextureHandle create(const string& key, int width, int height, const vector<unsigned char>& rgba) {
+        TextureHandle texture = make_shared<Texture>();
+        texture->path = key;
+        texture->width = width;
+        texture->height = height;
+        texture->ready = true;
+
+        glGenTextures(1, &texture->id);
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        texture->setGpuBytes(getUncompressedChainBytes(width, height));
+
+        textures[key] = texture;
+        return texture;
+    }
+
+    // Upload decoded images within the per-frame budget (call once per frame on the render thread)
+    void update() {
+        size_t uploadedBytes = 0;
+        while (uploadedBytes < UPLOAD_BYTES_PER_FRAME) {
+            DecodedImage image;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if (decodedImages.empty()) {
+                    return;
+                }
+                image = decodedImages.front();
+            }
+
+            TextureHandle texture = image.texture.lock();
+            if (texture && image.cooked) {
+                if (!upload(image, texture)) {
+                    return;
+                }
+                uploadedBytes += image.cooked->getTotalBytes();
+            } else if (texture && image.pixels) {
+                if (image.channels != 3 && image.channels != 4) {
+                    cerr << "Not implemented to handle an image with " << image.channels << " channels" << endl;
+                    texture->failed = true;
+                } else if (!upload(image, texture)) {
+                    // Ring is busy; try again next frame
+                    return;
+                }
+                uploadedBytes += (size_t)image.width * image.height * image.channels;
+            } else if (texture) {
+                texture->failed = true;
+            }
+
+            stbi_image_free(image.pixels);
+            lock_guard<mutex> lock(queueMutex);
+            decodedImages.pop_front();
+            --inFlight;
+        }
+    }
+
+    // Block until every queued texture is decoded and uploaded (startup screens, benchmarks)
+    void finishPending() {
+        for (;;) {
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if (inFlight == 0) {
+                    return;
+                }
+            }
+            update();
+            this_thread::yield();
+        }
+    }
+
+    size_t getPendingCount() {
+        lock_guard<mutex> lock(queueMutex);
+        return inFlight;
+    }
+
+    // Choose whether decoded images are flipped for OpenGL's bottom-up rows, or left as
+    // decoded and flipped in the fragment shader instead. Set before loading any texture.
+    void setFlipOnLoad(bool enabled) { flipOnLoad = enabled; }
+    bool isFlipOnLoad() const { return flipOnLoad; }
+
+    // Choose whether image files load as cooked BC1/BC3 mip chains through their texture
+    // caches instead of raw RGB(A) with runtime mipmaps. Set before loading any texture;
+    // the first load turns it back off when the driver lacks S3TC.
+    void setCompressionEnabled(bool enabled) { compression = enabled; }
+    bool isCompressionEnabled() const { return compression; }
+
+    TextureLoadStatistics getStatistics() {
+        lock_guard<mutex> lock(queueMutex);
+        return statistics;
+    }
+};
+
+// ************** ENHANCEMENT: TransformStore Class **************
+// Index of one entry in the TransformStore
+typedef uint32_t TransformHandle;
+const TransformHandle NO_TRANSFORM = 0xFFFFFFFF;
+
+// Local position, rotation and scale of every scene node in contiguous
+// structure-of-arrays storage, plus the hierarchy links and the cached local, world
+// and normal matrices. Setters only mark an entry dirty; update() rebuilds the local
+// matrices of the dirty entries four at a time, one SIMD lane per entry, and then
+// recomputes world and normal matrices only below the entries that changed.
+class TransformStore {
+private:
+    enum : uint8_t {
+        FLAG_DIRTY = 1,  // local matrix is stale and the entry is in dirtyEntries
+        FLAG_MOVED = 2,  // world matrix changed since the owner last called consumeMoved()
+        FLAG_FREE = 4
+    };
+
+    static const size_t UPDATE_CHUNK_SIZE = 4096;
+    static const size_t SUBTREE_CHUNK_SIZE = 256;
+
+    vector<float> positionX, positionY, positionZ;
+    vector<float> rotationX, rotationY, rotationZ, rotationW;
+    vector<float> scaleX, scaleY, scaleZ;
+    vector<float> meshScaleX, meshScaleY, meshScaleZ;  // scale baked into the matrix, not the vertices
+    vector<uint8_t> flags;
+
+    // Hierarchy as intrusive child lists
+    vector<TransformHandle> parents;
+    vector<TransformHandle> firstChildren;
+    vector<TransformHandle> nextSiblings;
+
+    // Local matrices are only kept for entries with a parent; a root's local matrices
+    // are its world matrices
+    vector<glm::mat4> localMatrices;
+    vector<glm::mat3> localNormals;
+    vector<glm::mat4> worldMatrices;
+    vector<glm::mat3> normalMatrices;
+
+    vector<TransformHandle> dirtyEntries;
+    vector<TransformHandle> freeEntries;
+    vector<TransformHandle> changedRoots;  // dirty entries without a dirty ancestor
+    size_t lastUpdateCount = 0;
+
+    TransformStore() = default;
+
+    void markDirty(TransformHandle handle) {
+        if (!(flags[handle] & FLAG_DIRTY)) {
+            dirtyEntries.push_back(handle);
+        }
+        flags[handle] |= FLAG_DIRTY | FLAG_MOVED;
+    }
+
+    bool hasDirtyAncestor(TransformHandle handle) const {
+        for (TransformHandle parent = parents[handle]; parent != NO_TRANSFORM; parent = parents[parent]) {
+            if (flags[parent] & FLAG_DIRTY) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void unlink(TransformHandle handle) {
+        TransformHandle parent = parents[handle];
+        if (parent == NO_TRANSFORM) {
+            return;
+        }
+        TransformHandle* link = &firstChildren[parent];
+        while (*link != handle) {
+            link = &nextSiblings[*link];
+        }
+        *link = nextSiblings[handle];
+        parents[handle] = NO_TRANSFORM;
+        nextSiblings[handle] = NO_TRANSFORM;
+    }
+
+    // Translation * rotation * scale for one entry, and its normal matrix. The inverse
+    // transpose of rotation * scale is rotation * inverse scale, so no inverse is needed
+    // (scale components must be non-zero); uniform scale takes a single reciprocal.
+    void computeLocal(TransformHandle i, glm::mat4& model, glm::mat3& normal) const {
+        float x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+        glm::vec3 scale(scaleX[i] * meshScaleX[i], scaleY[i] * meshScaleY[i], scaleZ[i] * meshScaleZ[i]);
+
+        glm::vec3 rotation[3] = {
+            glm::vec3(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y)),
+            glm::vec3(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x)),
+            glm::vec3(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y))
+        };
+        glm::vec3 inverseScale = scale.x == scale.y && scale.y == scale.z ? glm::vec3(1.0f / scale.x) : glm::vec3(1.0f) / scale;
+        for (int column = 0; column < 3; ++column) {
+            model[column] = glm::vec4(rotation[column] * scale[column], 0.0f);
+            normal[column] = rotation[column] * inverseScale[column];
+        }
+        model[3] = glm::vec4(positionX[i], positionY[i], positionZ[i], 1.0f);
+    }
+
+    // Roots keep their local matrices directly in the world arrays
+    glm::mat4& localMatrixOf(TransformHandle handle) {
+        return parents[handle] == NO_TRANSFORM ? worldMatrices[handle] : localMatrices[handle];
+    }
+    glm::mat3& localNormalOf(TransformHandle handle) {
+        return parents[handle] == NO_TRANSFORM ? normalMatrices[handle] : localNormals[handle];
+    }
+
+    // Rebuild the local matrices of dirtyEntries[begin, end)
+    void rebuildLocal(size_t begin, size_t end) {
+        size_t k = begin;
+#ifdef SIMD_SSE2
+        for (; k + 4 <= end; k += 4) {
+            const TransformHandle* entry = &dirtyEntries[k];
+
+            // Runs of consecutive entries (the common case after bulk edits) load directly
+            bool consecutive = entry[3] == entry[0] + 3 && entry[1] == entry[0] + 1 && entry[2] == entry[0] + 2;
+            auto load = [entry, consecutive](const vector<float>& component) {
+                return consecutive ? _mm_loadu_ps(&component[entry[0]])
+                                   : _mm_setr_ps(component[entry[0]], component[entry[1]], component[entry[2]], component[entry[3]]);
+            };
+
+            __m128 x = load(rotationX), y = load(rotationY), z = load(rotationZ), w = load(rotationW);
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 two = _mm_set1_ps(2.0f);
+            __m128 scale[3] = { _mm_mul_ps(load(scaleX), load(meshScaleX)),
+                                _mm_mul_ps(load(scaleY), load(meshScaleY)),
+                                _mm_mul_ps(load(scaleZ), load(meshScaleZ)) };
+
+            __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+            __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+            __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+            // Rotation columns; row r of column c holds that element for all four entries
+            __m128 rotation[3][3] = {
+                { _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), _mm_mul_ps(two, _mm_add_ps(xy, wz)), _mm_mul_ps(two, _mm_sub_ps(xz, wy)) },
+                { _mm_mul_ps(two, _mm_sub_ps(xy, wz)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), _mm_mul_ps(two, _mm_add_ps(yz, wx)) },
+                { _mm_mul_ps(two, _mm_add_ps(xz, wy)), _mm_mul_ps(two, _mm_sub_ps(yz, wx)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))) }
+            };
+
+            // When all four entries are uniformly scaled one division serves every column
+            __m128 inverseScale[3];
+            __m128 uniform = _mm_and_ps(_mm_cmpeq_ps(scale[0], scale[1]), _mm_cmpeq_ps(scale[1], scale[2]));
+            if (_mm_movemask_ps(uniform) == 0xF) {
+                inverseScale[0] = inverseScale[1] = inverseScale[2] = _mm_div_ps(one, scale[0]);
+            } else {
+                for (int column = 0; column < 3; ++column) {
+                    inverseScale[column] = _mm_div_ps(one, scale[column]);
+                }
+            }
+
+            // Transpose each column from component-per-register to entry-per-register and store it
+            __m128 translation[4] = { load(positionX), load(positionY), load(positionZ), one };
+            _MM_TRANSPOSE4_PS(translation[0], translation[1], translation[2], translation[3]);
+            for (int lane = 0; lane < 4; ++lane) {
+                _mm_storeu_ps(&localMatrixOf(entry[lane])[3][0], translation[lane]);
+            }
+            for (int column = 0; column < 3; ++column) {
+                __m128 model[4] = { _mm_mul_ps(rotation[column][0], scale[column]), _mm_mul_ps(rotation[column][1], scale[column]),
+                                    _mm_mul_ps(rotation[column][2], scale[column]), _mm_setzero_ps() };
+                __m128 normal[4] = { _mm_mul_ps(rotation[column][0], inverseScale[column]), _mm_mul_ps(rotation[column][1], inverseScale[column]),
+                                     _mm_mul_ps(rotation[column][2], inverseScale[column]), _mm_setzero_ps() };
+                _MM_TRANSPOSE4_PS(model[0], model[1], model[2], model[3]);
+                _MM_TRANSPOSE4_PS(normal[0], normal[1], normal[2], normal[3]);
+                for (int lane = 0; lane < 4; ++lane) {
+                    _mm_storeu_ps(&localMatrixOf(entry[lane])[column][0], model[lane]);
+
+                    // mat3 columns are three floats: store x and y, then z alone
+                    float* normalColumn = &localNormalOf(entry[lane])[column][0];
+                    _mm_storel_pi((__m64*)normalColumn, normal[lane]);
+                    _mm_store_ss(normalColumn + 2, _mm_movehl_ps(normal[lane], normal[lane]));
+                }
+            }
+        }
+#endif
+        for (; k < end; ++k) {
+            computeLocal(dirtyEntries[k], localMatrixOf(dirtyEntries[k]), localNormalOf(dirtyEntries[k]));
+        }
+    }
+
+    void updateWorld(TransformHandle handle) {
+        TransformHandle parent = parents[handle];
+        worldMatrices[handle] = worldMatrices[parent] * localMatrices[handle];
+        normalMatrices[handle] = normalMatrices[parent] * localNormals[handle];
+        flags[handle] |= FLAG_MOVED;
+    }
+
+    // Recompute world and normal matrices below a changed entry (parents before children);
+    // a root's own matrices are already final. Returns the number of entries updated.
+    size_t updateSubtree(TransformHandle root, vector<TransformHandle>& stack) {
+        size_t count = 0;
+        if (parents[root] != NO_TRANSFORM) {
+            updateWorld(root);
+            ++count;
+        }
+        stack.clear();
+        if (firstChildren[root] != NO_TRANSFORM) {
+            stack.push_back(firstChildren[root]);
+        }
+        while (!stack.empty()) {
+            TransformHandle handle = stack.back();
+            stack.pop_back();
+            updateWorld(handle);
+            ++count;
+            if (nextSiblings[handle] != NO_TRANSFORM) {
+                stack.push_back(nextSiblings[handle]);
+            }
+            if (firstChildren[handle] != NO_TRANSFORM) {
+                stack.push_back(firstChildren[handle]);
+            }
+        }
+        return count;
+    }
+
+public:
+    // Never destroyed, so shapes in static scenes can still release their entries at exit
+    static TransformStore& instance() {
+        static TransformStore* store = new TransformStore();
+        return *store;
+    }
+
+    TransformStore(const TransformStore&) = delete;
+    TransformStore& operator=(const TransformStore&) = delete;
+
+    TransformHandle create(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+        TransformHandle handle;
+        if (!freeEntries.empty()) {
+            handle = freeEntries.back();
+            freeEntries.pop_back();
+            flags[handle] &= FLAG_DIRTY;  // a freed entry may still be queued for rebuild
+        } else {
+            handle = (TransformHandle)flags.size();
+            for (vector<float>* component : { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ,
+                                              &rotationW, &scaleX, &scaleY, &scaleZ, &meshScaleX, &meshScaleY, &meshScaleZ }) {
+                component->push_back(0.0f);
+            }
+            flags.push_back(0);
+            parents.push_back(NO_TRANSFORM);
+            firstChildren.push_back(NO_TRANSFORM);
+            nextSiblings.push_back(NO_TRANSFORM);
+            localMatrices.emplace_back(1.0f);
+            localNormals.emplace_back(1.0f);
+            worldMatrices.emplace_back(1.0f);
+            normalMatrices.emplace_back(1.0f);
+        }
+        setPosition(handle, position);
+        setRotation(handle, rotation);
+        setScale(handle, scale);
+        setMeshScale(handle, glm::vec3(1.0f));
+        return handle;
+    }
+
+    // Free an entry; its children become roots that keep their local transforms
+    void release(TransformHandle handle) {
+        unlink(handle);
+        while (firstChildren[handle] != NO_TRANSFORM) {
+            TransformHandle child = firstChildren[handle];
+            unlink(child);
+            markDirty(child);
+        }
+        flags[handle] |= FLAG_FREE;
+        freeEntries.push_back(handle);
+    }
+
+    // Attach an entry below parent (NO_TRANSFORM detaches it); fails if that would create a cycle
+    bool setParent(TransformHandle handle, TransformHandle parent) {
+        for (TransformHandle ancestor = parent; ancestor != NO_TRANSFORM; ancestor = parents[ancestor]) {
+            if (ancestor == handle) {
+                return false;
+            }
+        }
+        unlink(handle);
+        if (parent != NO_TRANSFORM) {
+            parents[handle] = parent;
+            nextSiblings[handle] = firstChildren[parent];
+            firstChildren[parent] = handle;
+        }
+        markDirty(handle);
+        return true;
+    }
+
+    TransformHandle getParent(TransformHandle handle) const { return parents[handle]; }
+
+    glm::vec3 getPosition(TransformHandle handle) const {
+        return glm::vec3(positionX[handle], positionY[handle], positionZ[handle]);
+    }
+    void setPosition(TransformHandle handle, const glm::vec3& position) {
+        positionX[handle] = position.x; positionY[handle] = position.y; positionZ[handle] = position.z;
+        markDirty(handle);
+    }
+
+    glm::quat getRotation(TransformHandle handle) const {
+        return glm::quat(rotationW[handle], rotationX[handle], rotationY[handle], rotationZ[handle]);
+    }
+    void setRotation(TransformHandle handle, const glm::quat& rotation) {
+        rotationX[handle] = rotation.x; rotationY[handle] = rotation.y; rotationZ[handle] = rotation.z; rotationW[handle] = rotation.w;
+        markDirty(handle);
+    }
+
+    glm::vec3 getScale(TransformHandle handle) const {
+        return glm::vec3(scaleX[handle], scaleY[handle], scaleZ[handle]);
+    }
+    void setScale(TransformHandle handle, const glm::vec3& scale) {
+        scaleX[handle] = scale.x; scaleY[handle] = scale.y; scaleZ[handle] = scale.z;
+        markDirty(handle);
+    }
+
+    void setMeshScale(TransformHandle handle, const glm::vec3& scale) {
+        meshScaleX[handle] = scale.x; meshScaleY[handle] = scale.y; meshScaleZ[handle] = scale.z;
+        markDirty(handle);
+    }
+
+    // Cached world matrix, or computed on the spot when the entry or an ancestor was
+    // edited since the last update()
+    glm::mat4 getWorldMatrix(TransformHandle handle) const {
+        if (!(flags[handle] & FLAG_DIRTY) && !hasDirtyAncestor(handle)) {
+            return worldMatrices[handle];
+        }
+        glm::mat4 model;
+        glm::mat3 normal;
+        computeLocal(handle, model, normal);
+        return parents[handle] == NO_TRANSFORM ? model : getWorldMatrix(parents[handle]) * model;
+    }
+
+    // Inverse transpose of the world matrix for transforming normals
+    glm::mat3 getNormalMatrix(TransformHandle handle) const {
+        if (!(flags[handle] & FLAG_DIRTY) && !hasDirtyAncestor(handle)) {
+            return normalMatrices[handle];
+        }
+        glm::mat4 model;
+        glm::mat3 normal;
+        computeLocal(handle, model, normal);
+        return parents[handle] == NO_TRANSFORM ? normal : getNormalMatrix(parents[handle]) * normal;
+    }
+
+    // Reports (once) that the world matrix changed since the last call; distinct entries
+    // may be consumed from different threads
+    bool consumeMoved(TransformHandle handle) {
+        bool moved = (flags[handle] & FLAG_MOVED) != 0;
+        flags[handle] &= ~FLAG_MOVED;
+        return moved;
+    }
+
+    // Rebuild the local matrices of every dirty entry, then the world and normal matrices
+    // of the subtrees below them; untouched entries cost nothing. Both passes run in
+    // parallel chunks (changed subtrees never overlap).
+    void update() {
+        JobSystem& jobs = JobSystem::instance();
+        jobs.parallelFor(dirtyEntries.size(), UPDATE_CHUNK_SIZE, [this](size_t begin, size_t end, unsigned) {
+            rebuildLocal(begin, end);
+        });
+
+        // Dirty roots without children are already final
+        size_t flatCount = 0;
+        changedRoots.clear();
+        for (TransformHandle handle : dirtyEntries) {
+            if (flags[handle] & FLAG_FREE) {
+                continue;
+            }
+            if (parents[handle] == NO_TRANSFORM && firstChildren[handle] == NO_TRANSFORM) {
+                ++flatCount;
+            } else if (!hasDirtyAncestor(handle)) {
+                changedRoots.push_back(handle);
+            }
+        }
+        atomic<size_t> updated{ flatCount };
+        jobs.parallelFor(changedRoots.size(), SUBTREE_CHUNK_SIZE, [this, &updated](size_t begin, size_t end, unsigned) {
+            vector<TransformHandle> stack;
+            size_t count = 0;
+            for (size_t i = begin; i < end; ++i) {
+                count += updateSubtree(changedRoots[i], stack);
+            }
+            updated += count;
+        });
+        lastUpdateCount = updated;
+
+        for (TransformHandle handle : dirtyEntries) {
+            flags[handle] &= ~FLAG_DIRTY;
+        }
+        dirtyEntries.clear();
+    }
+
+    // Entries whose world matrix was recomputed by the last update()
+    size_t getLastUpdateCount() const { return lastUpdateCount; }
+    size_t getDirtyCount() const { return dirtyEntries.size(); }
+    size_t size() const { return flags.size(); }
+};
+
+// Node of the transform hierarchy: an owned TransformStore entry holding a position,
+// rotation and scale relative to the parent node
+class SceneNode {
+private:
+    TransformHandle handle;
+
+public:
+    explicit SceneNode(const glm::vec3& position = glm::vec3(0.0f), const glm::quat& rotation = glm::quat(),
+                       const glm::vec3& scale = glm::vec3(1.0f))
+        : handle(TransformStore::instance().create(position, rotation, scale)) {}
+
+    ~SceneNode() {
+        TransformStore::instance().release(handle);
+    }
+
+    SceneNode(const SceneNode&) = delete;
+    SceneNode& operator=(const SceneNode&) = delete;
+
+    TransformHandle getHandle() const { return handle; }
+
+    // Attach below another node (nullptr makes this a root); the local transform is kept
+    bool setParent(const SceneNode* parent) {
+        return TransformStore::instance().setParent(handle, parent ? parent->handle : NO_TRANSFORM);
+    }
+
+    glm::vec3 getPosition() const { return TransformStore::instance().getPosition(handle); }
+    void setPosition(const glm::vec3& position) { TransformStore::instance().setPosition(handle, position); }
+
+    glm::quat getRotation() const { return TransformStore::instance().getRotation(handle); }
+    void setRotation(const glm::quat& rotation) { TransformStore::instance().setRotation(handle, rotation); }
+
+    glm::vec3 getScale() const { return TransformStore::instance().getScale(handle); }
+    void setScale(const glm::vec3& scale) { TransformStore::instance().setScale(handle, scale); }
+
+    glm::mat4 getWorldMatrix() const { return TransformStore::instance().getWorldMatrix(handle); }
+    glm::mat3 getNormalMatrix() const { return TransformStore::instance().getNormalMatrix(handle); }
+
+    bool consumeMoved() { return TransformStore::instance().consumeMoved(handle); }
+};
+
+// ************** ENHANCEMENT: Level of Detail **************
+// A shape may carry a chain of meshes, level 0 being the full tessellation and each
+// further level coarser. The level is chosen per frame from the projected screen size
+// of the shape's bounds: the coarsest level whose edges stay below
+// LOD_EDGE_SCREEN_FRACTION of the viewport height is drawn.
+const float LOD_EDGE_SCREEN_FRACTION = 0.02f;
+
+// A coarser level is only taken once the screen size drops this far below its
+// threshold, so shapes hovering at a threshold do not switch levels every frame
+const float LOD_HYSTERESIS = 0.9f;
+
+// Projected diameter of a bounding sphere as a fraction of the viewport height. Clip w is
+// the view depth under a perspective projection and 1 under an orthographic one.
+inline float getProjectedScreenSize(const glm::mat4& viewProjection, float projectionScaleY, const glm::vec3& center, float radius)
+{
+    float w = viewProjection[0][3] * center.x + viewProjection[1][3] * center.y
+            + viewProjection[2][3] * center.z + viewProjection[3][3];
+    return radius * projectionScaleY / max(w, 1e-4f);
+}
+
+// Segment counts of a chain that halves the full count down to a minimum
+inline vector<int> makeLodSegments(int segments, int minimumSegments)
+{
+    vector<int> chain = { max(segments, minimumSegments) };
+    while (chain.back() / 2 >= minimumSegments) {
+        chain.push_back(chain.back() / 2);
+    }
+    return chain;
+}
+
+// Smallest screen size drawn at each level, given how many edges span the shape's
+// diameter at each level: a level is used until the next coarser one would show edges
+// longer than LOD_EDGE_SCREEN_FRACTION. The last level has no lower bound.
+inline vector<float> makeLodScreenSizes(const vector<float>& edgesAcross)
+{
+    vector<float> screenSizes(edgesAcross.size(), 0.0f);
+    for (size_t level = 0; level + 1 < edgesAcross.size(); ++level) {
+        screenSizes[level] = LOD_EDGE_SCREEN_FRACTION * edgesAcross[level + 1];
+    }
+    return screenSizes;
+}
+
+// Level to draw at a screen size. Finer levels are taken at once; a coarser level only
+// once the size is below its threshold by the hysteresis margin.
+inline int selectLod(const vector<float>& minScreenSizes, float screenSize, int currentLod)
+{
+    int levelCount = (int)minScreenSizes.size();
+    int level = 0;
+    while (level + 1 < levelCount && screenSize < minScreenSizes[level]) {
+        ++level;
+    }
+    currentLod = min(max(currentLod, 0), levelCount - 1);
+    if (level <= currentLod) {
+        return level;
+    }
+
+    int coarser = currentLod;
+    while (coarser + 1 < levelCount && screenSize < minScreenSizes[coarser] * LOD_HYSTERESIS) {
+        ++coarser;
+    }
+    return coarser;
+}
+
+// ************** ENHANCEMENT: Shape Base Class **************
+// Base class for all 3D shapes
+class Shape {
+protected:
+    // Scratch geometry, filled by the generate functions only while building a new mesh
+    vector<float> vertices;
+    vector<unsigned int> indices;
+    
+    // Position, rotation and scale live in the TransformStore as a scene graph node
+    SceneNode node;
+
+    // Shape properties
+    glm::vec3 color;
+    string texturePath;
+    glm::vec2 uvScale;
+
+    // OpenGL objects: one mesh per level of detail, level 0 being the full tessellation
+    vector<MeshHandle> lodMeshes;
+    TextureHandle texture;
+
+    // Smallest screen size drawn at each level (see selectLod); one entry per level
+    vector<float> lodScreenSizes = { 0.0f };
+    int lod = 0;           // level drawn this frame
+    int generatedLod = 0;  // level the generate functions build
+
+    // Index into the scene's material table (-1 until the scene assigns one)
+    int materialIndex = -1;
+
+    // Set when the geometry key changes after construction, so batches are regrouped
+    bool geometryChanged = false;
+
+    // Drawn into the software occlusion buffer (see SoftwareOcclusion)
+    bool occluder = false;
+
+    // Scale baked into the model matrix instead of the vertex data (e.g. cube size)
+    void setMeshScale(const glm::vec3& scale) { TransformStore::instance().setMeshScale(node.getHandle(), scale); }
+
+public:
+    // Constructor with default values
+    Shape(
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& scl = glm::vec3(1.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        const string& texPath = "",
+        const glm::vec2& uvScl = glm::vec2(1.0f)
+    ) : node(pos, glm::quat(), scl), color(col), texturePath(texPath), uvScale(uvScl) {
+        // Constructor initializes member variables
+    }
+    
+    // Virtual destructor for proper cleanup in derived classes
+    virtual ~Shape() {
+        // OpenGL resources are shared: the mesh and texture release themselves
+        // when the last shape using them is destroyed
+    }
+    
+    // Pure virtual functions to be implemented by derived classes
+    virtual void generateVertices() = 0;
+    virtual void generateIndices() = 0;
+    
+    // Build and upload the mesh of generatedLod from the generate functions
+    virtual MeshHandle createMesh() {
+        generateVertices();
+        generateIndices();
+        if (GeometryCache::instance().isIndexOrderOptimized()) {
+            optimizeIndexOrder(indices, vertices);
+        }
+        MeshHandle uploaded = make_shared<const GpuMesh>(vertices, indices, GeometryCache::instance().getVertexFormat());
+
+        // The GPU copy is authoritative; release the CPU scratch data
+        vector<float>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+        return uploaded;
+    }
+
+    // Acquire the shared GPU mesh of every level for this shape's geometry key, creating
+    // and uploading it only when no live mesh with the same key exists
+    void setupBuffers() {
+        lodMeshes.clear();
+        for (generatedLod = 0; generatedLod < (int)lodScreenSizes.size(); ++generatedLod) {
+            string key = generatedLod == 0 ? getGeometryKey() : getGeometryKey() + "@lod" + to_string(generatedLod);
+            lodMeshes.push_back(GeometryCache::instance().acquire(key, [this]() { return createMesh(); }));
+        }
+        lod = 0;
+    }
+
+    // Level thresholds from the edges spanning the shape at each level (see makeLodScreenSizes);
+    // must be set before setupBuffers
+    void setLodEdgesAcross(const vector<float>& edgesAcross) {
+        lodScreenSizes = makeLodScreenSizes(edgesAcross);
+    }
+    
+    // Request the shared texture for this shape's path; it streams in asynchronously
+    // and shows a placeholder until TextureManager::update() uploads the decoded image
+    bool loadTexture() {
+        if (texturePath.empty()) {
+            return false;
+        }
+
+        texture = TextureManager::instance().load(texturePath);
+        return texture != nullptr;
+    }
+    
+    // World matrix: the parent's world matrix times position, rotation, then scale
+    // including the baked mesh scale
+    glm::mat4 getModelMatrix() const {
+        return node.getWorldMatrix();
+    }
+
+    glm::mat3 getNormalMatrix() const {
+        return node.getNormalMatrix();
+    }
+
+    // Key identifying the generated geometry; shapes with equal keys have identical
+    // vertex data and may be drawn as instances of one mesh. The default is unique per shape.
+    virtual string getGeometryKey() const {
+        return "shape:" + to_string(reinterpret_cast<uintptr_t>(this));
+    }
+
+    // Reports (once) that the vertex data was regenerated, so batches must be regrouped
+    bool consumeGeometryChanged() {
+        bool changed = geometryChanged;
+        geometryChanged = false;
+        return changed;
+    }
+
+    // World-space bounds of the generated vertices under the model matrix (of the full
+    // tessellation, so switching levels never moves the bounds)
+    AABB getWorldBounds() const {
+        return lodMeshes[0]->bounds.transformed(getModelMatrix());
+    }
+
+    // Bounds of the generated vertices before the model matrix
+    const AABB& getLocalBounds() const {
+        return lodMeshes[0]->bounds;
+    }
+
+    // Whether the geometry covers its local bounds completely when seen from outside; only
+    // such shapes can stand in for their bounds as occluders
+    virtual bool fillsBounds() const { return false; }
+
+    // Occluders hide the shapes behind them when software occlusion culling is enabled
+    bool isOccluder() const { return occluder && fillsBounds(); }
+    void setOccluder(bool value) { occluder = value; }
+
+    // Reports (once) that the world matrix changed since the last call (the shape
+    // or one of its ancestors moved)
+    bool consumeBoundsChanged() {
+        return node.consumeMoved();
+    }
+
+    // Scene graph node, e.g. to attach the shape below a group node
+    SceneNode& getNode() { return node; }
+
+    // Getters and setters (relative to the parent node, if any)
+    glm::vec3 getPosition() const { return node.getPosition(); }
+    void setPosition(const glm::vec3& pos) { node.setPosition(pos); }
+
+    glm::quat getRotation() const { return node.getRotation(); }
+    void setRotation(const glm::quat& rotation) { node.setRotation(rotation); }
+    
+    glm::vec3 getScale() const { return node.getScale(); }
+    void setScale(const glm::vec3& scl) { node.setScale(scl); }
+    
+    glm::vec3 getColor() const { return color; }
+    void setColor(const glm::vec3& col) { color = col; materialIndex = -1; }
+
+    string getTexturePath() const { return texturePath; }
+    void setTexturePath(const string& path) { texturePath = path; }
+
+    glm::vec2 getUVScale() const { return uvScale; }
+    void setUVScale(const glm::vec2& uvScl) { uvScale = uvScl; materialIndex = -1; }
+
+    // Changing color or UV scale clears the index so the scene re-resolves the material
+    int getMaterialIndex() const { return materialIndex; }
+    void setMaterialIndex(int index) { materialIndex = index; }
+
+    // Level of detail: the accessors below describe the mesh of the current level
+    int getLodCount() const { return (int)lodMeshes.size(); }
+    int getLod() const { return lod; }
+    void setLod(int level) { lod = min(max(level, 0), getLodCount() - 1); }
+    const vector<float>& getLodScreenSizes() const { return lodScreenSizes; }
+    const MeshHandle& getLodMesh(int level) const { return lodMeshes[level]; }
+
+    // Pick this frame's level from the projected screen size of the shape's bounds
+    void updateLod(float screenSize) { lod = selectLod(lodScreenSizes, screenSize, lod); }
+
+    const MeshHandle& getMesh() const { return lodMeshes[lod]; }
+    GLuint getVAO() const { return getMesh()->vao; }
+    GLuint getVBO() const { return getMesh()->vbo; }
+    GLuint getEBO() const { return getMesh()->ebo; }
+    GLuint getTextureId() const { return texture ? texture->id : 0; }
+    unsigned int getIndicesCount() const { return getMesh()->indexCount; }
+};
+
+// ************** ENHANCEMENT: Cube Class **************
+// Cube shape derived from Shape base class
+class Cube : public Shape {
+private:
+    float size; // Size of the cube
+    int subdivisions; // Quads along each edge of a face (1 is the plain 24-vertex cube)
+
+public:
+    // Constructor with size parameter and other properties
+    Cube(
+        float cubeSize = 1.0f,
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& scl = glm::vec3(1.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        const string& texPath = "",
+        const glm::vec2& uvScl = glm::vec2(1.0f),
+        int faceSubdivisions = 1
+    ) : Shape(pos, scl, col, texPath, uvScl), size(cubeSize), subdivisions(max(1, faceSubdivisions)) {
+        // Geometry is a unit cube; the size is applied through the model matrix
+        setMeshScale(glm::vec3(size));
+
+        // Acquire the shared cube mesh (generated and uploaded once per cache)
+        setupBuffers();
+        
+        // Load texture if path is provided
+        if (!texturePath.empty()) {
+            loadTexture();
+        }
+    }
+
+    bool fillsBounds() const override { return true; }
+
+    // Generate vertices for the unit cube
+    void generateVertices() override {
+        // Cube vertices with normals and texture coordinates (8 components per vertex)
+        // Format: position (3), normal (3), texture coordinates (2)
+        static const float unitCubeVertices[] = {
+            // Front face (positive Z)
+            -0.5f, -0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   0.0f, 0.0f,
+             0.5f, -0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   1.0f, 0.0f,
+             0.5f,  0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   1.0f, 1.0f,
+            -0.5f,  0.5f,  0.5f,   0.0f,  0.0f,  1.0f,   0.0f, 1.0f,
+
+            // Back face (negative Z)
+            -0.5f, -0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   1.0f, 0.0f,
+             0.5f, -0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   0.0f, 0.0f,
+             0.5f,  0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   0.0f, 1.0f,
+            -0.5f,  0.5f, -0.5f,   0.0f,  0.0f, -1.0f,   1.0f, 1.0f,
+
+            // Left face (negative X)
+            -0.5f, -0.5f, -0.5f,  -1.0f,  0.0f,  0.0f,   0.0f, 0.0f,
+            -0.5f, -0.5f,  0.5f,  -1.0f,  0.0f,  0.0f,   1.0f, 0.0f,
+            -0.5f,  0.5f,  0.5f,  -1.0f,  0.0f,  0.0f,   1.0f, 1.0f,
+            -0.5f,  0.5f, -0.5f,  -1.0f,  0.0f,  0.0f,   0.0f, 1.0f,
+
+            // Right face (positive X)
+             0.5f, -0.5f, -0.5f,   1.0f,  0.0f,  0.0f,   1.0f, 0.0f,
+             0.5f, -0.5f,  0.5f,   1.0f,  0.0f,  0.0f,   0.0f, 0.0f,
+             0.5f,  0.5f,  0.5f,   1.0f,  0.0f,  0.0f,   0.0f, 1.0f,
+             0.5f,  0.5f, -0.5f,   1.0f,  0.0f,  0.0f,   1.0f, 1.0f,
+
+            // Bottom face (negative Y)
+            -0.5f, -0.5f, -0.5f,   0.0f, -1.0f,  0.0f,   0.0f, 1.0f,
+             0.5f, -0.5f, -0.5f,   0.0f, -1.0f,  0.0f,   1.0f, 1.0f,
+             0.5f, -0.5f,  0.5f,   0.0f, -1.0f,  0.0f,   1.0f, 0.0f,
+            -0.5f, -0.5f,  0.5f,   0.0f, -1.0f,  0.0f,   0.0f, 0.0f,
+
+            // Top face (positive Y)
+            -0.5f,  0.5f, -0.5f,   0.0f,  1.0f,  0.0f,   0.0f, 0.0f,
+             0.5f,  0.5f, -0.5f,   0.0f,  1.0f,  0.0f,   1.0f, 0.0f,
+             0.5f,  0.5f,  0.5f,   0.0f,  1.0f,  0.0f,   1.0f, 1.0f,
+            -0.5f,  0.5f,  0.5f,   0.0f,  1.0f,  0.0f,   0.0f, 1.0f,
+        };
+
+        if (subdivisions == 1) {
+            vertices.assign(begin(unitCubeVertices), end(unitCubeVertices));
+            return;
+        }
+
+        // Tessellate each face into a grid spanned by its corners 0 -> 1 and 0 -> 3
+        const int stride = 8;
+        vertices.clear();
+        vertices.reserve(6 * (subdivisions + 1) * (subdivisions + 1) * stride);
+        for (int face = 0; face < 6; ++face) {
+            const float* corner = &unitCubeVertices[face * 4 * stride];
+            for (int row = 0; row <= subdivisions; ++row) {
+                for (int column = 0; column <= subdivisions; ++column) {
+                    float u = (float)column / subdivisions;
+                    float v = (float)row / subdivisions;
+                    for (int component = 0; component < stride; ++component) {
+                        float origin = corner[component];
+                        vertices.push_back(origin + (corner[stride + component] - origin) * u
+                                                  + (corner[3 * stride + component] - origin) * v);
+                    }
+                }
+            }
+        }
+    }
+
+    // Generate indices for the cube
+    void generateIndices() override {
+        indices.clear();
+        indices.reserve(36 * subdivisions * subdivisions);
+        if (subdivisions == 1) {
+            // Each face is a quad of 4 consecutive vertices split into 2 triangles
+            for (unsigned int face = 0; face < 6; ++face) {
+                unsigned int first = face * 4;
+                indices.insert(indices.end(), { first, first + 1, first + 2, first + 2, first + 3, first });
+            }
+            return;
+        }
+
+        // Grid quads keep the winding of the corner order 0, 1, 2, 3
+        unsigned int edge = subdivisions + 1;
+        for (unsigned int face = 0; face < 6; ++face) {
+            for (unsigned int row = 0; row < (unsigned int)subdivisions; ++row) {
+                for (unsigned int column = 0; column < (unsigned int)subdivisions; ++column) {
+                    unsigned int first = face * edge * edge + row * edge + column;
+                    indices.insert(indices.end(), { first, first + 1, first + edge + 1, first + edge + 1, first + edge, first });
+                }
+            }
+        }
+    }
+    
+    // Getters and setters specific to Cube
+    float getSize() const { return size; }
+    
+    // Update size; the shared unit mesh is unchanged, only the model matrix scale
+    void setSize(float newSize) {
+        size = newSize;
+        setMeshScale(glm::vec3(size));
+    }
+
+    // Every cube shares the unit cube mesh of its tessellation regardless of size
+    string getGeometryKey() const override {
+        return subdivisions == 1 ? "cube" : "cube_" + to_string(subdivisions);
+    }
+};
+
+// ************** ENHANCEMENT: Procedural Primitives **************
+// Round primitives are generated at unit size around the Y axis and sized through the
+// model matrix like the cube, so every instance of a tessellation shares its meshes.
+// Each level of detail halves the segment count, down to this minimum.
+const int MIN_ROUND_SEGMENTS = 8;
+
+// Direction around the Y axis at an angle; counter-clockwise seen from above
+inline glm::vec3 getRadialDirection(float angle)
+{
+    return glm::vec3(cos(angle), 0.0f, -sin(angle));
+}
+
+inline void appendVertex(vector<float>& vertices, const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv)
+{
+    vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y });
+}
+
+// Two triangles per cell of a (rows + 1) x (columns + 1) vertex grid stored row by row
+// from firstVertex. Counter-clockwise from the outside when rows run down the surface
+// and columns run counter-clockwise around it.
+inline void appendGridIndices(unsigned int firstVertex, unsigned int rows, unsigned int columns, vector<unsigned int>& indices)
+{
+    unsigned int rowLength = columns + 1;
+    for (unsigned int row = 0; row < rows; ++row) {
+        for (unsigned int column = 0; column < columns; ++column) {
+            unsigned int upper = firstVertex + row * rowLength + column;
+            unsigned int lower = upper + rowLength;
+            indices.insert(indices.end(), { upper, lower, upper + 1, upper + 1, lower, lower + 1 });
+        }
+    }
+}
+
+// Flat unit disc at height y facing +Y (facing > 0) or -Y: a center vertex and a ring
+inline void appendDiscVertices(int segments, float y, float facing, vector<float>& vertices)
+{
+    glm::vec3 normal(0.0f, facing > 0.0f ? 1.0f : -1.0f, 0.0f);
+    appendVertex(vertices, glm::vec3(0.0f, y, 0.0f), normal, glm::vec2(0.5f));
+    for (int segment = 0; segment < segments; ++segment) {
+        glm::vec3 direction = getRadialDirection(glm::two_pi<float>() * segment / segments);
+        appendVertex(vertices, direction + glm::vec3(0.0f, y, 0.0f), normal,
+                     glm::vec2(0.5f + 0.5f * direction.x, 0.5f - 0.5f * direction.z));
+    }
+}
+
+// Fan over a disc appended by appendDiscVertices at firstVertex
+inline void appendDiscIndices(unsigned int firstVertex, int segments, float facing, vector<unsigned int>& indices)
+{
+    for (int segment = 0; segment < segments; ++segment) {
+        unsigned int current = firstVertex + 1 + segment;
+        unsigned int next = firstVertex + 1 + (segment + 1) % segments;
+        if (facing > 0.0f) {
+            indices.insert(indices.end(), { firstVertex, current, next });
+        } else {
+            indices.insert(indices.end(), { firstVertex, next, current });
+        }
+    }
+}
+
+// ************** ENHANCEMENT: Sphere Class **************
+// UV sphere with a level of detail per halving of its slices
+class Sphere : public Shape {
+private:
+    float radius;
+    vector<int> lodSegments;  // slices per level; stacks are half as many
+
+public:
+    Sphere(
+        float sphereRadius = 0.5f,
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& scl = glm::vec3(1.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        const string& texPath = "",
+        const glm::vec2& uvScl = glm::vec2(1.0f),
+        int segments = 64
+    ) : Shape(pos, scl, col, texPath, uvScl), radius(sphereRadius), lodSegments(makeLodSegments(segments, MIN_ROUND_SEGMENTS)) {
+        // Geometry is a unit sphere; the radius is applied through the model matrix
+        setMeshScale(glm::vec3(radius));
+
+        // An edge at the equator spans pi / slices of the diameter
+        vector<float> edgesAcross;
+        for (int slices : lodSegments) {
+            edgesAcross.push_back(slices / glm::pi<float>());
+        }
+        setLodEdgesAcross(edgesAcross);
+        setupBuffers();
+
+        if (!texturePath.empty()) {
+            loadTexture();
+        }
+    }
+
+    // Rows of slices + 1 vertices (the seam is duplicated for the UVs) from pole to pole
+    static void buildVertices(int slices, int stacks, vector<float>& vertices) {
+        vertices.clear();
+        vertices.reserve((stacks + 1) * (slices + 1) * FLOAT_VERTEX_COMPONENTS);
+        for (int stack = 0; stack <= stacks; ++stack) {
+            float polar = glm::pi<float>() * stack / stacks;
+            for (int slice = 0; slice <= slices; ++slice) {
+                glm::vec3 normal = getRadialDirection(glm::two_pi<float>() * slice / slices) * sin(polar);
+                normal.y = cos(polar);
+                appendVertex(vertices, normal, normal, glm::vec2((float)slice / slices, 1.0f - (float)stack / stacks));
+            }
+        }
+    }
+
+    // The pole rows collapse to a point, so their cells keep one triangle each
+    static void buildIndices(int slices, int stacks, vector<unsigned int>& indices) {
+        indices.clear();
+        indices.reserve(slices * (stacks - 1) * 6);
+        unsigned int rowLength = slices + 1;
+        for (int stack = 0; stack < stacks; ++stack) {
+            for (int slice = 0; slice < slices; ++slice) {
+                unsigned int upper = stack * rowLength + slice;
+                unsigned int lower = upper + rowLength;
+                if (stack != 0) {
+                    indices.insert(indices.end(), { upper, lower, upper + 1 });
+                }
+                if (stack != stacks - 1) {
+                    indices.insert(indices.end(), { upper + 1, lower, lower + 1 });
+                }
+            }
+        }
+    }
+
+    void generateVertices() override {
+        buildVertices(lodSegments[generatedLod], lodSegments[generatedLod] / 2, vertices);
+    }
+
+    void generateIndices() override {
+        buildIndices(lodSegments[generatedLod], lodSegments[generatedLod] / 2, indices);
+    }
+
+    float getRadius() const { return radius; }
+
+    void setRadius(float newRadius) {
+        radius = newRadius;
+        setMeshScale(glm::vec3(radius));
+    }
+
+    string getGeometryKey() const override {
+        return "sphere_" + to_string(lodSegments[0]);
+    }
+};
+
+// ************** ENHANCEMENT: Cylinder Class **************
+// Capped cylinder along the Y axis with a level of detail per halving of its segments
+class Cylinder : public Shape {
+private:
+    float radius;
+    float height;
+    vector<int> lodSegments;
+
+public:
+    Cylinder(
+        float cylinderRadius = 0.5f,
+        float cylinderHeight = 1.0f,
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& scl = glm::vec3(1.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        const string& texPath = "",
+        const glm::vec2& uvScl = glm::vec2(1.0f),
+        int segments = 64
+    ) : Shape(pos, scl, col, texPath, uvScl), radius(cylinderRadius), height(cylinderHeight),
+        lodSegments(makeLodSegments(segments, MIN_ROUND_SEGMENTS)) {
+        // Geometry has unit radius and height; both are applied through the model matrix
+        setMeshScale(glm::vec3(radius, height, radius));
+
+        vector<float> edgesAcross;
+        for (int segmentCount : lodSegments) {
+            edgesAcross.push_back(segmentCount / glm::pi<float>());
+        }
+        setLodEdgesAcross(edgesAcross);
+        setupBuffers();
+
+        if (!texturePath.empty()) {
+            loadTexture();
+        }
+    }
+
+    // Side as two rows (top, bottom) of segments + 1 vertices, then the top and bottom caps
+    static void buildVertices(int segments, vector<float>& vertices) {
+        vertices.clear();
+        vertices.reserve((4 * segments + 4) * FLOAT_VERTEX_COMPONENTS);
+        for (int row = 0; row < 2; ++row) {
+            float y = row == 0 ? 0.5f : -0.5f;
+            for (int segment = 0; segment <= segments; ++segment) {
+                glm::vec3 normal = getRadialDirection(glm::two_pi<float>() * segment / segments);
+                appendVertex(vertices, normal + glm::vec3(0.0f, y, 0.0f), normal, glm::vec2((float)segment / segments, 1.0f - row));
+            }
+        }
+        appendDiscVertices(segments, 0.5f, 1.0f, vertices);
+        appendDiscVertices(segments, -0.5f, -1.0f, vertices);
+    }
+
+    static void buildIndices(int segments, vector<unsigned int>& indices) {
+        indices.clear();
+        indices.reserve(12 * segments);
+        appendGridIndices(0, 1, segments, indices);
+        unsigned int topCap = 2 * (segments + 1);
+        appendDiscIndices(topCap, segments, 1.0f, indices);
+        appendDiscIndices(topCap + segments + 1, segments, -1.0f, indices);
+    }
+
+    void generateVertices() override { buildVertices(lodSegments[generatedLod], vertices); }
+    void generateIndices() override { buildIndices(lodSegments[generatedLod], indices); }
+
+    float getRadius() const { return radius; }
+    float getHeight() const { return height; }
+
+    void setDimensions(float newRadius, float newHeight) {
+        radius = newRadius;
+        height = newHeight;
+        setMeshScale(glm::vec3(radius, height, radius));
+    }
+
+    string getGeometryKey() const override {
+        return "cylinder_" + to_string(lodSegments[0]);
+    }
+};
+
+// ************** ENHANCEMENT: Cone Class **************
+// Cone along the Y axis (apex up) with a level of detail per halving of its segments
+class Cone : public Shape {
+private:
+    float radius;
+    float height;
+    vector<int> lodSegments;
+
+public:
+    Cone(
+        float coneRadius = 0.5f,
+        float coneHeight = 1.0f,
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& scl = glm::vec3(1.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        const string& texPath = "",
+        const glm::vec2& uvScl = glm::vec2(1.0f),
+        int segments = 64
+    ) : Shape(pos, scl, col, texPath, uvScl), radius(coneRadius), height(coneHeight),
+        lodSegments(makeLodSegments(segments, MIN_ROUND_SEGMENTS)) {
+        // Geometry has unit radius and height; the normal matrix keeps the slope normals
+        // correct under any radius to height ratio
+        setMeshScale(glm::vec3(radius, height, radius));
+
+        vector<float> edgesAcross;
+        for (int segmentCount : lodSegments) {
+            edgesAcross.push_back(segmentCount / glm::pi<float>());
+        }
+        setLodEdgesAcross(edgesAcross);
+        setupBuffers();
+
+        if (!texturePath.empty()) {
+            loadTexture();
+        }
+    }
+
+    // One apex vertex per segment (its normal points halfway across the segment), the base
+    // ring of segments + 1 vertices, then the base cap
+    static void buildVertices(int segments, vector<float>& vertices) {
+        vertices.clear();
+        vertices.reserve((3 * segments + 2) * FLOAT_VERTEX_COMPONENTS);
+        const glm::vec3 up(0.0f, 1.0f, 0.0f);
+        for (int segment = 0; segment < segments; ++segment) {
+            float angle = glm::two_pi<float>() * (segment + 0.5f) / segments;
+            appendVertex(vertices, glm::vec3(0.0f, 0.5f, 0.0f), glm::normalize(getRadialDirection(angle) + up),
+                         glm::vec2((segment + 0.5f) / segments, 1.0f));
+        }
+        for (int segment = 0; segment <= segments; ++segment) {
+            glm::vec3 direction = getRadialDirection(glm::two_pi<float>() * segment / segments);
+            appendVertex(vertices, direction - 0.5f * up, glm::normalize(direction + up), glm::vec2((float)segment / segments, 0.0f));
+        }
+        appendDiscVertices(segments, -0.5f, -1.0f, vertices);
+    }
+
+    static void buildIndices(int segments, vector<unsigned int>& indices) {
+        indices.clear();
+        indices.reserve(6 * segments);
+        for (unsigned int segment = 0; segment < (unsigned int)segments; ++segment) {
+            unsigned int ring = segments + segment;
+            indices.insert(indices.end(), { segment, ring, ring + 1 });
+        }
+        appendDiscIndices(2 * segments + 1, segments, -1.0f, indices);
+    }
+
+    void generateVertices() override { buildVertices(lodSegments[generatedLod], vertices); }
+    void generateIndices() override { buildIndices(lodSegments[generatedLod], indices); }
+
+    float getRadius() const { return radius; }
+    float getHeight() const { return height; }
+
+    void setDimensions(float newRadius, float newHeight) {
+        radius = newRadius;
+        height = newHeight;
+        setMeshScale(glm::vec3(radius, height, radius));
+    }
+
+    string getGeometryKey() const override {
+        return "cone_" + to_string(lodSegments[0]);
+    }
+};
+
+// ************** ENHANCEMENT: Torus Class **************
+// Torus around the Y axis with a level of detail per halving of its rings (the tube
+// keeps half as many sides as there are rings)
+class Torus : public Shape {
+private:
+    float majorRadius;
+    float minorRadius;
+    vector<int> lodSegments;  // rings per level
+
+    // Tube radius relative to the ring radius: the one proportion the model matrix cannot scale
+    float getThickness() const { return minorRadius / majorRadius; }
+
+public:
+    Torus(
+        float ringRadius = 0.35f,
+        float tubeRadius = 0.15f,
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& scl = glm::vec3(1.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        const string& texPath = "",
+        const glm::vec2& uvScl = glm::vec2(1.0f),
+        int rings = 64
+    ) : Shape(pos, scl, col, texPath, uvScl), majorRadius(ringRadius), minorRadius(tubeRadius),
+        lodSegments(makeLodSegments(rings, MIN_ROUND_SEGMENTS)) {
+        // Geometry has a unit ring radius; the ring radius is applied through the model matrix
+        setMeshScale(glm::vec3(majorRadius));
+
+        // The longer of the outer ring edges and the tube edges decides
+        float thickness = getThickness();
+        vector<float> edgesAcross;
+        for (int ringCount : lodSegments) {
+            float ringEdges = ringCount / glm::pi<float>();
+            float tubeEdges = (ringCount / 2) * (1.0f + thickness) / (glm::pi<float>() * thickness);
+            edgesAcross.push_back(min(ringEdges, tubeEdges));
+        }
+        setLodEdgesAcross(edgesAcross);
+        setupBuffers();
+
+        if (!texturePath.empty()) {
+            loadTexture();
+        }
+    }
+
+    // One row of sides + 1 vertices per ring (rings + 1 rows), both seams duplicated for the UVs
+    static void buildVertices(int rings, int sides, float thickness, vector<float>& vertices) {
+        vertices.clear();
+        vertices.reserve((rings + 1) * (sides + 1) * FLOAT_VERTEX_COMPONENTS);
+        for (int ring = 0; ring <= rings; ++ring) {
+            glm::vec3 direction = getRadialDirection(glm::two_pi<float>() * ring / rings);
+            for (int side = 0; side <= sides; ++side) {
+                float angle = glm::two_pi<float>() * side / sides;
+                glm::vec3 normal = direction * cos(angle) + glm::vec3(0.0f, sin(angle), 0.0f);
+                appendVertex(vertices, direction + normal * thickness, normal, glm::vec2((float)ring / rings, (float)side / sides));
+            }
+        }
+    }
+
+    static void buildIndices(int rings, int sides, vector<unsigned int>& indices) {
+        indices.clear();
+        indices.reserve(6 * rings * sides);
+        appendGridIndices(0, rings, sides, indices);
+    }
+
+    void generateVertices() override {
+        buildVertices(lodSegments[generatedLod], lodSegments[generatedLod] / 2, getThickness(), vertices);
+    }
+
+    void generateIndices() override {
+        buildIndices(lodSegments[generatedLod], lodSegments[generatedLod] / 2, indices);
+    }
+
+    float getMajorRadius() const { return majorRadius; }
+    float getMinorRadius() const { return minorRadius; }
+
+    string getGeometryKey() const override {
+        return "torus_" + to_string(getThickness()) + "_" + to_string(lodSegments[0]);
+    }
+};
+
+// ************** ENHANCEMENT: Plane Class **************
+// Flat grid in the XZ plane facing +Y with a level of detail per halving of its cells
+class Plane : public Shape {
+private:
+    float width;
+    float depth;
+    vector<int> lodSegments;  // cells along each edge per level
+
+public:
+    Plane(
+        float planeWidth = 1.0f,
+        float planeDepth = 1.0f,
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& scl = glm::vec3(1.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        const string& texPath = "",
+        const glm::vec2& uvScl = glm::vec2(1.0f),
+        int subdivisions = 16
+    ) : Shape(pos, scl, col, texPath, uvScl), width(planeWidth), depth(planeDepth),
+        lodSegments(makeLodSegments(subdivisions, 1)) {
+        // Geometry is a unit square; width and depth are applied through the model matrix
+        setMeshScale(glm::vec3(width, 1.0f, depth));
+
+        vector<float> edgesAcross(lodSegments.begin(), lodSegments.end());
+        setLodEdgesAcross(edgesAcross);
+        setupBuffers();
+
+        if (!texturePath.empty()) {
+            loadTexture();
+        }
+    }
+
+    // Rows of cells + 1 vertices running towards +Z
+    static void buildVertices(int cells, vector<float>& vertices) {
+        vertices.clear();
+        vertices.reserve((cells + 1) * (cells + 1) * FLOAT_VERTEX_COMPONENTS);
+        for (int row = 0; row <= cells; ++row) {
+            for (int column = 0; column <= cells; ++column) {
+                glm::vec2 uv((float)column / cells, (float)row / cells);
+                appendVertex(vertices, glm::vec3(uv.x - 0.5f, 0.0f, uv.y - 0.5f), glm::vec3(0.0f, 1.0f, 0.0f),
+                             glm::vec2(uv.x, 1.0f - uv.y));
+            }
+        }
+    }
+
+    static void buildIndices(int cells, vector<unsigned int>& indices) {
+        indices.clear();
+        indices.reserve(6 * cells * cells);
+        appendGridIndices(0, cells, cells, indices);
+    }
+
+    void generateVertices() override { buildVertices(lodSegments[generatedLod], vertices); }
+    void generateIndices() override { buildIndices(lodSegments[generatedLod], indices); }
+
+    float getWidth() const { return width; }
+    float getDepth() const { return depth; }
+
+    void setDimensions(float newWidth, float newDepth) {
+        width = newWidth;
+        depth = newDepth;
+        setMeshScale(glm::vec3(width, 1.0f, depth));
+    }
+
+    string getGeometryKey() const override {
+        return "plane_" + to_string(lodSegments[0]);
+    }
+};
+
+// ************** ENHANCEMENT: MeshShape Class **************
+// Shape whose geometry is loaded from a mesh file through its binary cache (see loadMeshFile)
+class MeshShape : public Shape {
+private:
+    string meshPath;
+
+public:
+    MeshShape(
+        const string& path,
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& scl = glm::vec3(1.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        const string& texPath = "",
+        const glm::vec2& uvScl = glm::vec2(1.0f)
+    ) : Shape(pos, scl, col, texPath, uvScl), meshPath(path) {
+        // Every shape loading the same file shares its mesh
+        setupBuffers();
+
+        if (!texturePath.empty()) {
+            loadTexture();
+        }
+    }
+
+    // Load the file; a file that cannot be loaded shows the generated placeholder instead
+    MeshHandle createMesh() override {
+        MeshHandle loaded = loadMeshFile(meshPath, GeometryCache::instance().getVertexFormat(),
+                                         GeometryCache::instance().isIndexOrderOptimized());
+        return loaded ? loaded : Shape::createMesh();
+    }
+
+    // Placeholder geometry: a coarse unit sphere
+    void generateVertices() override { Sphere::buildVertices(16, 8, vertices); }
+    void generateIndices() override { Sphere::buildIndices(16, 8, indices); }
+
+    const string& getMeshPath() const { return meshPath; }
+
+    string getGeometryKey() const override {
+        return "file:" + meshPath;
+    }
+};
+
+// ************** ENHANCEMENT: Light Class **************
+// Light class derived from Cube. A light with a range is a point light shaded through the
+// cluster grid (see LightClusterGrid); without one it lights the whole scene, the first two
+// such lights as filler and key light.
+class Light : public Cube {
+private:
+    glm::vec3 lightColor;
+    float intensity;
+    float range;  // 0 for scene-wide lights
+
+public:
+    // Constructor
+    Light(
+        const glm::vec3& pos = glm::vec3(0.0f),
+        const glm::vec3& col = glm::vec3(1.0f),
+        float size = 0.2f,
+        float lightIntensity = 1.0f,
+        float lightRange = 0.0f
+    ) : Cube(size, pos, glm::vec3(1.0f), col), lightColor(col), intensity(lightIntensity), range(lightRange) {
+        // The base Cube constructor handles geometry creation
+    }
+    
+    // Getters and setters for light properties
+    glm::vec3 getLightColor() const { return lightColor; }
+    void setLightColor(const glm::vec3& color) { lightColor = color; }
+    
+    float getIntensity() const { return intensity; }
+    void setIntensity(float value) { intensity = value; }
+
+    float getRange() const { return range; }
+    void setRange(float value) { range = value; }
+};
+
+// ************** ENHANCEMENT: MeshInstanceBatch Class **************
+// Per-instance vertex data streamed to the instanced vertex shader (attributes 3-10)
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    GLint materialIndex;
+};
+
+// Attribute locations used by the instanced vertex shader
+const GLuint INSTANCE_MODEL_ATTRIBUTE = 3;    // mat4 uses locations 3, 4, 5 and 6
+const GLuint INSTANCE_MATERIAL_ATTRIBUTE = 7;
+const GLuint INSTANCE_NORMAL_ATTRIBUTE = 8;   // mat3 uses locations 8, 9 and 10
+
+// Group of shapes sharing one geometry, level of detail and texture, drawn with a single instanced call
+class MeshInstanceBatch {
+private:
+    // Shape whose texture is shared by every instance, and the level mesh whose VBO/EBO are
+    shared_ptr<Shape> prototype;
+    MeshHandle mesh;
+
+    GLuint vao = 0;
+    GLuint instanceBuffer = 0;
+    size_t instanceCapacity = 0;
+    vector<InstanceData> instances;
+
+public:
+    MeshInstanceBatch(shared_ptr<Shape> prototypeShape, MeshHandle levelMesh) : prototype(prototypeShape), mesh(levelMesh) {
+        // Per-vertex attributes come from the mesh's buffers, in the mesh's layout
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
+        mesh->layout->apply(mesh->vbo);
+
+        // Per-instance attributes advance once per instance
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (GLuint column = 0; column < 4; ++column) {
+            GLuint location = INSTANCE_MODEL_ATTRIBUTE + column;
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        for (GLuint column = 0; column < 3; ++column) {
+            GLuint location = INSTANCE_NORMAL_ATTRIBUTE + column;
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        glVertexAttribIPointer(INSTANCE_MATERIAL_ATTRIBUTE, 1, GL_INT, sizeof(InstanceData),
+                               (void*)offsetof(InstanceData, materialIndex));
+        glEnableVertexAttribArray(INSTANCE_MATERIAL_ATTRIBUTE);
+        glVertexAttribDivisor(INSTANCE_MATERIAL_ATTRIBUTE, 1);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    ~MeshInstanceBatch() {
+        if (vao != 0) {
+            glDeleteVertexArrays(1, &vao);
+        }
+        if (instanceBuffer != 0) {
+            glDeleteBuffers(1, &instanceBuffer);
+        }
+    }
+
+    MeshInstanceBatch(const MeshInstanceBatch&) = delete;
+    MeshInstanceBatch& operator=(const MeshInstanceBatch&) = delete;
+
+    // Start collecting instances for a new frame
+    void clear() { instances.clear(); }
+
+    void addInstance(const glm::mat4& model, const glm::mat3& normalMatrix, int materialIndex) {
+        instances.push_back({ model, normalMatrix, materialIndex });
+    }
+
+    // Upload this frame's instances; the render queue then issues one instanced draw
+    void upload() {
+        if (instances.empty()) {
+            return;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        if (instances.size() > instanceCapacity) {
+            // Grow geometrically so steady-state frames only orphan and refill
+            instanceCapacity = max(instances.size(), instanceCapacity * 2);
+        }
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    GLuint getVAO() const { return vao; }
+    GLuint getTextureId() const { return prototype->getTextureId(); }
+    const Shape& getPrototype() const { return *prototype; }
+    const GpuMesh& getMesh() const { return *mesh; }
+    size_t getInstanceCount() const { return instances.size(); }
+};
+
+// ************** ENHANCEMENT: Multi-Draw-Indirect **************
+// Shader storage binding of the per-object data read by the multi-draw vertex shader
+const GLuint OBJECT_STORAGE_BINDING = 2;
+
+// Attribute carrying the draw index (fed from baseInstance, see IndirectDrawList)
+const GLuint DRAW_INDEX_ATTRIBUTE = 3;
+
+// Command layout consumed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// std430 per-object entry indexed by the draw index; a std430 mat3 has vec4 columns
+struct ObjectData {
+    glm::mat4 model;
+    glm::vec4 normalMatrix[3];
+    GLint materialIndex;
+    GLint padding[3];
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand must match the GL layout");
+static_assert(sizeof(ObjectData) == 128, "ObjectData must follow std430 layout");
+
+// Location of one mesh inside the shared arena
+struct ArenaRange {
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint indexCount;
+};
+
+// Single vertex and index buffer holding a copy of every mesh in the scene, so that
+// any set of objects can be drawn from one VAO with per-command offsets
+class MeshArena {
+private:
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    size_t byteSize = 0;
+    const VertexLayout* layout = &VertexLayout::get(VERTEX_FORMAT_FLOAT);
+    GLenum indexType = GL_UNSIGNED_INT;
+    vector<MeshHandle> meshes;
+    unordered_map<const GpuMesh*, ArenaRange> ranges;
+
+public:
+    ~MeshArena() {
+        if (vbo != 0) {
+            glDeleteBuffers(1, &vbo);
+        }
+        if (ebo != 0) {
+            glDeleteBuffers(1, &ebo);
+        }
+    }
+
+    // Copy the given meshes (duplicates ignored) into freshly sized arena buffers on the GPU.
+    // The arena has a single vertex layout: the meshes' own when they all agree, otherwise
+    // floats, with compact meshes read back and expanded. Indices are mesh-relative (the
+    // commands carry baseVertex), so they stay 16-bit unless some mesh needs 32.
+    void build(const vector<MeshHandle>& sceneMeshes) {
+        meshes.clear();
+        ranges.clear();
+
+        layout = sceneMeshes.empty() ? &VertexLayout::get(VERTEX_FORMAT_FLOAT) : sceneMeshes[0]->layout;
+        indexType = GL_UNSIGNED_SHORT;
+        for (const MeshHandle& mesh : sceneMeshes) {
+            if (mesh->layout != layout) {
+                layout = &VertexLayout::get(VERTEX_FORMAT_FLOAT);
+            }
+            if (mesh->vertexCount > 65535) {
+                indexType = GL_UNSIGNED_INT;
+            }
+        }
+        const GLsizeiptr stride = layout->getStride();
+        const GLsizeiptr indexSize = GpuMesh::getIndexSize(indexType);
+
+        GLsizeiptr vertexBytes = 0;
+        GLsizeiptr indexBytes = 0;
+        for (const MeshHandle& mesh : sceneMeshes) {
+            if (ranges.count(mesh.get())) {
+                continue;
+            }
+            GLuint indexCount = mesh->indexCount > 0 ? mesh->indexCount : mesh->vertexCount;
+            ranges[mesh.get()] = { (GLuint)(indexBytes / indexSize), (GLint)(vertexBytes / stride), indexCount };
+            meshes.push_back(mesh);
+            vertexBytes += mesh->vertexCount * stride;
+            indexBytes += indexCount * indexSize;
+        }
+
+        if (vbo == 0) {
+            glGenBuffers(1, &vbo);
+            glGenBuffers(1, &ebo);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        glBufferData(GL_COPY_WRITE_BUFFER, max<GLsizeiptr>(vertexBytes, 1), nullptr, GL_STATIC_DRAW);
+        for (const MeshHandle& mesh : meshes) {
+            const ArenaRange& range = ranges[mesh.get()];
+            glBindBuffer(GL_COPY_READ_BUFFER, mesh->vbo);
+            if (mesh->layout == layout) {
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                                    range.baseVertex * stride, mesh->vertexCount * stride);
+            } else {
+                vector<uint8_t> source(mesh->vertexCount * mesh->layout->getStride());
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, source.size(), source.data());
+                vector<uint8_t> converted = layout->encode(mesh->layout->decode(source.data(), mesh->vertexCount));
+                glBufferSubData(GL_COPY_WRITE_BUFFER, range.baseVertex * stride, converted.size(), converted.data());
+            }
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferData(GL_COPY_WRITE_BUFFER, max<GLsizeiptr>(indexBytes, 1), nullptr, GL_STATIC_DRAW);
+        for (const MeshHandle& mesh : meshes) {
+            const ArenaRange& range = ranges[mesh.get()];
+            if (mesh->indexCount > 0 && mesh->indexType == indexType) {
+                glBindBuffer(GL_COPY_READ_BUFFER, mesh->ebo);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                                    range.firstIndex * indexSize, range.indexCount * indexSize);
+                continue;
+            }
+
+            // Non-indexed meshes get a trivial index list; 16-bit meshes in a 32-bit arena are widened
+            vector<unsigned int> indices(range.indexCount);
+            if (mesh->indexCount > 0) {
+                vector<GLushort> narrow(range.indexCount);
+                glBindBuffer(GL_COPY_READ_BUFFER, mesh->ebo);
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, narrow.size() * sizeof(GLushort), narrow.data());
+                copy(narrow.begin(), narrow.end(), indices.begin());
+            } else {
+                for (GLuint i = 0; i < range.indexCount; ++i) {
+                    indices[i] = i;
+                }
+            }
+            vector<uint8_t> packed = GpuMesh::packIndices(indices, indexType);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstIndex * indexSize, packed.size(), packed.data());
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        byteSize = vertexBytes + indexBytes;
+    }
+
+    const ArenaRange& getRange(const GpuMesh* mesh) const { return ranges.at(mesh); }
+    const VertexLayout& getLayout() const { return *layout; }
+    GLenum getIndexType() const { return indexType; }
+    GLuint getVBO() const { return vbo; }
+    GLuint getEBO() const { return ebo; }
+    size_t getMeshCount() const { return meshes.size(); }
+    size_t getByteSize() const { return byteSize; }
+};
+
+// Per-frame list of indirect commands and per-object data drawn from a MeshArena.
+// GL 4.4 core has no gl_DrawID, so each command's baseInstance is its draw index and a
+// per-instance attribute reading an identity buffer hands that index to the shader.
+class IndirectDrawList {
+private:
+    GLuint vao = 0;
+    GLuint commandBuffer = 0;
+    GLuint objectBuffer = 0;
+    GLuint drawIndexBuffer = 0;
+    size_t capacity = 0;
+    size_t drawIndexCapacity = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    vector<DrawElementsIndirectCommand> commands;
+    vector<ObjectData> objects;
+
+    static ObjectData makeObject(const glm::mat4& model, const glm::mat3& normalMatrix, int materialIndex) {
+        return { model, { glm::vec4(normalMatrix[0], 0.0f), glm::vec4(normalMatrix[1], 0.0f), glm::vec4(normalMatrix[2], 0.0f) },
+                 materialIndex, { 0, 0, 0 } };
+    }
+
+public:
+    IndirectDrawList() = default;
+
+    ~IndirectDrawList() {
+        if (vao != 0) {
+            glDeleteVertexArrays(1, &vao);
+        }
+        GLuint buffers[] = { commandBuffer, objectBuffer, drawIndexBuffer };
+        for (GLuint buffer : buffers) {
+            if (buffer != 0) {
+                glDeleteBuffers(1, &buffer);
+            }
+        }
+    }
+
+    IndirectDrawList(const IndirectDrawList&) = delete;
+    IndirectDrawList& operator=(const IndirectDrawList&) = delete;
+
+    // (Re)build the VAO over the arena buffers, e.g. after the arena was rebuilt
+    void attach(const MeshArena& arena) {
+        if (vao == 0) {
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &commandBuffer);
+            glGenBuffers(1, &objectBuffer);
+            glGenBuffers(1, &drawIndexBuffer);
+        }
+        glBindVertexArray(vao);
+
+        // The arena's interleaved layout and index type
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.getEBO());
+        arena.getLayout().apply(arena.getVBO());
+        indexType = arena.getIndexType();
+
+        glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+        glVertexAttribIPointer(DRAW_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glEnableVertexAttribArray(DRAW_INDEX_ATTRIBUTE);
+        glVertexAttribDivisor(DRAW_INDEX_ATTRIBUTE, 1);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void clear() {
+        commands.clear();
+        objects.clear();
+    }
+
+    // Resize to count objects that are then filled with set(), possibly from several threads
+    void resize(size_t count) {
+        commands.resize(count);
+        objects.resize(count);
+    }
+
+    void set(size_t drawIndex, const ArenaRange& range, const glm::mat4& model, const glm::mat3& normalMatrix, int materialIndex) {
+        commands[drawIndex] = { range.indexCount, 1, range.firstIndex, range.baseVertex, (GLuint)drawIndex };
+        objects[drawIndex] = makeObject(model, normalMatrix, materialIndex);
+    }
+
+    // Append one object; returns its draw index
+    size_t add(const ArenaRange& range, const glm::mat4& model, const glm::mat3& normalMatrix, int materialIndex) {
+        GLuint drawIndex = (GLuint)commands.size();
+        commands.push_back({ range.indexCount, 1, range.firstIndex, range.baseVertex, drawIndex });
+        objects.push_back(makeObject(model, normalMatrix, materialIndex));
+        return drawIndex;
+    }
+
+    // Upload commands and object data, and leave both bound for the multi-draw calls
+    void upload() {
+        if (commands.size() > capacity) {
+            capacity = max(commands.size(), capacity * 2);
+        }
+
+        // The identity buffer only changes when capacity grows
+        if (capacity > drawIndexCapacity) {
+            vector<GLuint> identity(capacity);
+            for (size_t i = 0; i < capacity; ++i) {
+                identity[i] = (GLuint)i;
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), identity.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            drawIndexCapacity = capacity;
+        }
+
+        // Orphan and refill, as MeshInstanceBatch does for its instance buffer
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(ObjectData), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, objects.size() * sizeof(ObjectData), objects.data());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_STORAGE_BINDING, objectBuffer);
+    }
+
+    GLuint getVAO() const { return vao; }
+    GLenum getIndexType() const { return indexType; }
+    size_t size() const { return commands.size(); }
+};
+
+// ************** ENHANCEMENT: RenderQueue Class **************
+// One draw with the GL state it needs. instanceCount 0 draws a single object using
+// the per-object uniforms; otherwise the VAO already holds uploaded instance data.
+struct DrawItem {
+    const ShaderProgram* program;
+    const ShapeUniforms* uniforms;
+    GLuint vao;
+    GLuint texture;  // 0 leaves the current binding untouched
+    const GpuMesh* mesh;  // index and vertex counts (the VAO may be a batch's own)
+    GLenum indexType;  // of the element buffer bound by the VAO
+    GLsizei instanceCount;
+    GLsizei drawCount;  // > 0: multi-draw of drawCount commands from the bound indirect buffer
+    size_t commandOffset;  // first command of the multi-draw
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    GLint materialIndex;
+};
+
+// Render passes in submission order (most significant bits of the sort key)
+enum RenderPass : uint64_t {
+    RENDER_PASS_DEPTH = 0,     // depth prepass only
+    RENDER_PASS_OPAQUE = 1,
+    RENDER_PASS_LIGHTING = 2,  // deferred mode only
+    RENDER_PASS_LAMPS = 3
+};
+
+// Per-frame counts of draw calls and GL state changes
+struct RenderStatistics {
+    size_t drawCalls = 0;
+    size_t programBinds = 0;
+    size_t textureBinds = 0;
+    size_t vaoBinds = 0;
+};
+
+// Draws collected for a frame, sorted by a 64-bit key so that consecutive draws share
+// program, texture and VAO, and executed with redundant binds skipped.
+//   bits 62-63 pass | 56-61 program | 44-55 texture | 32-43 VAO | 0-31 view depth
+// With front-to-back ordering the opaque pass is sorted by depth slice first, so early
+// depth testing rejects more hidden fragments while state is still shared in a slice:
+//   bits 62-63 pass | 50-61 depth slice | 44-49 program | 32-43 texture | 20-31 VAO | 0-19 depth
+// GL names are truncated to their field; a collision only affects ordering, never
+// correctness, because execute() compares the real names before skipping a bind.
+class RenderQueue {
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    vector<DrawItem> items;
+    vector<Entry> entries;
+    vector<Entry> scratch;
+    bool sortingEnabled = true;
+    bool frontToBack = false;
+
+    // LSD radix sort on 8-bit digits; digits that are equal across all keys are skipped
+    void radixSort() {
+        scratch.resize(entries.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {};
+            for (const Entry& entry : entries) {
+                ++counts[(entry.key >> shift) & 0xFF];
+            }
+            if (counts[(entries[0].key >> shift) & 0xFF] == entries.size()) {
+                continue;
+            }
+
+            size_t offset = 0;
+            for (size_t& count : counts) {
+                size_t next = offset + count;
+                count = offset;
+                offset = next;
+            }
+            for (const Entry& entry : entries) {
+                scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+            }
+            entries.swap(scratch);
+        }
+    }
+
+    uint64_t makeKey(RenderPass pass, const DrawItem& item, float viewDepth) const {
+        // Non-negative floats order the same as their bit patterns
+        float depth = max(viewDepth, 0.0f);
+        uint32_t depthBits;
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+
+        // The top 12 bits of a non-negative float (exponent and 4 mantissa bits) slice
+        // depth logarithmically, about 4% of the distance per slice
+        if (frontToBack && pass == RENDER_PASS_OPAQUE) {
+            return ((uint64_t)pass << 62)
+                 | ((uint64_t)(depthBits >> 19) << 50)
+                 | ((uint64_t)(item.program->getId() & 0x3F) << 44)
+                 | ((uint64_t)(item.texture & 0xFFF) << 32)
+                 | ((uint64_t)(item.vao & 0xFFF) << 20)
+                 | (depthBits >> 11);
+        }
+        return ((uint64_t)pass << 62)
+             | ((uint64_t)(item.program->getId() & 0x3F) << 56)
+             | ((uint64_t)(item.texture & 0xFFF) << 44)
+             | ((uint64_t)(item.vao & 0xFFF) << 32)
+             | depthBits;
+    }
+
+public:
+    void clear() {
+        items.clear();
+        entries.clear();
+    }
+
+    // Queue a draw; viewDepth is the distance along the view direction (front to back within a state group)
+    void submit(RenderPass pass, const DrawItem& item, float viewDepth) {
+        entries.push_back({ makeKey(pass, item, viewDepth), (uint32_t)items.size() });
+        items.push_back(item);
+    }
+
+    // Reserve count slots behind the queued draws and return the first. Each slot must
+    // then be filled once with set(); distinct slots may be filled from different threads.
+    size_t allocate(size_t count) {
+        size_t first = items.size();
+        items.resize(first + count);
+        entries.resize(first + count);
+        return first;
+    }
+
+    void set(size_t slot, RenderPass pass, const DrawItem& item, float viewDepth) {
+        entries[slot] = { makeKey(pass, item, viewDepth), (uint32_t)slot };
+        items[slot] = item;
+    }
+
+    // Sort the queue and issue every draw, binding state only when it changes. beginPass,
+    // when set, runs before the first draw of each pass (e.g. to switch render targets).
+    void execute(RenderStatistics& statistics, const function<void(RenderPass)>& beginPass = nullptr) {
+        statistics = RenderStatistics();
+        if (entries.empty()) {
+            return;
+        }
+        if (sortingEnabled) {
+            radixSort();
+        }
+
+        GLuint currentProgram = 0;
+        GLuint currentTexture = 0;
+        GLuint currentVAO = 0;
+        glActiveTexture(GL_TEXTURE0);
+
+        // Each pass is profiled as its own GPU scope
+        static const char* const passNames[] = { "DepthPrepass", "OpaquePass", "LightingPass", "LampPass" };
+        Profiler& profiler = Profiler::instance();
+        uint64_t currentPass = entries[0].key >> 62;
+        profiler.beginScope(passNames[currentPass], true);
+        if (beginPass) {
+            beginPass((RenderPass)currentPass);
+        }
+
+        for (const Entry& entry : entries) {
+            const DrawItem& item = items[entry.item];
+            if ((entry.key >> 62) != currentPass) {
+                profiler.endScope();
+                currentPass = entry.key >> 62;
+                profiler.beginScope(passNames[currentPass], true);
+                if (beginPass) {
+                    beginPass((RenderPass)currentPass);
+                }
+            }
+            if (item.program->getId() != currentProgram) {
+                item.program->use();
+                currentProgram = item.program->getId();
+                ++statistics.programBinds;
+            }
+            if (item.texture != 0 && item.texture != currentTexture) {
+                glBindTexture(GL_TEXTURE_2D, item.texture);
+                currentTexture = item.texture;
+                ++statistics.textureBinds;
+            }
+            if (item.vao != currentVAO) {
+                glBindVertexArray(item.vao);
+                currentVAO = item.vao;
+                ++statistics.vaoBinds;
+            }
+
+            if (item.drawCount > 0) {
+                glMultiDrawElementsIndirect(GL_TRIANGLES, item.indexType,
+                                            (void*)(item.commandOffset * sizeof(DrawElementsIndirectCommand)), item.drawCount, 0);
+            } else if (item.instanceCount > 0) {
+                glDrawElementsInstanced(GL_TRIANGLES, item.mesh->indexCount, item.indexType, 0, item.instanceCount);
+            } else {
+                // Per-object uniforms are the model and normal matrices and the material index
+                item.uniforms->model.set(item.model);
+                item.uniforms->normalMatrix.set(item.normalMatrix);
+                item.uniforms->materialIndex.set(item.materialIndex);
+                if (item.mesh->indexCount > 0) {
+                    glDrawElements(GL_TRIANGLES, item.mesh->indexCount, item.indexType, 0);
+                } else {
+                    glDrawArrays(GL_TRIANGLES, 0, item.mesh->vertexCount);
+                }
+            }
+            ++statistics.drawCalls;
+        }
+        profiler.endScope();
+
+        glBindVertexArray(0);
+    }
+
+    // Disabling keeps submission order (used to measure the unsorted baseline)
+    void setSortingEnabled(bool enabled) { sortingEnabled = enabled; }
+    bool isSortingEnabled() const { return sortingEnabled; }
+
+    // Order the opaque pass front to back ahead of state (set before queueing draws)
+    void setFrontToBack(bool enabled) { frontToBack = enabled; }
+    size_t size() const { return entries.size(); }
+};
+
+// Counts the fragments shaded by one span of a frame: fragment shader invocations where
+// pipeline statistics queries exist, otherwise samples that passed the depth test (the
+// same count when early depth testing rejects the hidden fragments). Results are read
+// LATENCY frames late so the CPU does not wait for the GPU.
+class FragmentCounter {
+private:
+    static const int LATENCY = 3;
+
+    GLuint queries[LATENCY + 1] = {};
+    bool issued[LATENCY + 1] = {};
+    GLenum target = GL_SAMPLES_PASSED;
+    size_t frame = 0;
+    bool active = false;
+    GLuint64 lastCount = 0;
+
+public:
+    FragmentCounter() = default;
+
+    ~FragmentCounter() {
+        if (queries[0] != 0) {
+            glDeleteQueries(LATENCY + 1, queries);
+        }
+    }
+
+    FragmentCounter(const FragmentCounter&) = delete;
+    FragmentCounter& operator=(const FragmentCounter&) = delete;
+
+    void create() {
+        target = (GLEW_VERSION_4_6 || GLEW_ARB_pipeline_statistics_query) ? GL_FRAGMENT_SHADER_INVOCATIONS : GL_SAMPLES_PASSED;
+        glGenQueries(LATENCY + 1, queries);
+    }
+
+    // Start counting; the slot reused here holds the result from LATENCY + 1 frames ago
+    void begin() {
+        if (active) {
+            return;
+        }
+        int slot = frame % (LATENCY + 1);
+        if (issued[slot]) {
+            glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &lastCount);
+        }
+        glBeginQuery(target, queries[slot]);
+        issued[slot] = true;
+        active = true;
+    }
+
+    void end() {
+        if (active) {
+            glEndQuery(target);
+            active = false;
+        }
+    }
+
+    // Close the frame's span (frames that never began leave their slot as it was)
+    void endFrame() {
+        end();
+        ++frame;
+    }
+
+    GLuint64 getLastCount() const { return lastCount; }
+    bool isCountingInvocations() const { return target == GL_FRAGMENT_SHADER_INVOCATIONS; }
+};
+
+// ************** ENHANCEMENT: BoundingVolumeHierarchy Class **************
+// Four-wide BVH over object bounds. Each node stores its four child boxes as
+// structure-of-arrays so one frustum plane is tested against all four at once.
+class BoundingVolumeHierarchy {
+private:
+    struct Node {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        int32_t child[4];  // >= 0: child node index, < 0: object index encoded as ~index
+        int count;
+    };
+
+    vector<Node> nodes;
+    vector<AABB> objectBounds;
+    vector<uint32_t> buildOrder;
+    vector<int32_t> traversalStack;
+    size_t boxTests = 0;
+
+    // Independent subtrees from partition(): root entry, end of its node range, and the nodes above
+    vector<int32_t> subtrees;
+    vector<int32_t> subtreeEnds;
+    vector<int32_t> upperNodes;
+
+    static void setSlot(Node& node, int slot, const AABB& box) {
+        node.minX[slot] = box.min.x; node.minY[slot] = box.min.y; node.minZ[slot] = box.min.z;
+        node.maxX[slot] = box.max.x; node.maxY[slot] = box.max.y; node.maxZ[slot] = box.max.z;
+    }
+
+    static AABB getNodeBounds(const Node& node) {
+        AABB box;
+        for (int slot = 0; slot < node.count; ++slot) {
+            box.expand(glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]));
+            box.expand(glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]));
+        }
+        return box;
+    }
+
+    // Recompute the child boxes of a node whose children are already up to date
+    void refitNode(Node& node) {
+        for (int slot = 0; slot < node.count; ++slot) {
+            int32_t child = node.child[slot];
+            setSlot(node, slot, child < 0 ? objectBounds[~child] : getNodeBounds(nodes[child]));
+        }
+    }
+
+    // Median split of buildOrder[begin, end) along the longest axis of the centroids
+    size_t split(size_t begin, size_t end) {
+        AABB centroids;
+        for (size_t i = begin; i < end; ++i) {
+            centroids.expand(objectBounds[buildOrder[i]].getCenter());
+        }
+        glm::vec3 size = centroids.max - centroids.min;
+        int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+
+        size_t middle = begin + (end - begin) / 2;
+        nth_element(buildOrder.begin() + begin, buildOrder.begin() + middle, buildOrder.begin() + end,
+            [this, axis](uint32_t a, uint32_t b) {
+                return objectBounds[a].getCenter()[axis] < objectBounds[b].getCenter()[axis];
+            });
+        return middle;
+    }
+
+    // Build the node for buildOrder[begin, end); children are always created after their parent
+    int32_t buildNode(size_t begin, size_t end) {
+        int32_t nodeIndex = (int32_t)nodes.size();
+        nodes.emplace_back();
+
+        size_t ranges[5];
+        int count = 0;
+        if (end - begin <= 4) {
+            for (size_t i = begin; i <= end; ++i) {
+                ranges[count++] = i;
+            }
+            --count;
+        } else {
+            size_t middle = split(begin, end);
+            ranges[0] = begin;
+            ranges[1] = split(begin, middle);
+            ranges[2] = middle;
+            ranges[3] = split(middle, end);
+            ranges[4] = end;
+            count = 4;
+        }
+
+        for (int slot = 0; slot < count; ++slot) {
+            int32_t child;
+            AABB box;
+            if (ranges[slot + 1] - ranges[slot] == 1) {
+                uint32_t object = buildOrder[ranges[slot]];
+                child = ~(int32_t)object;
+                box = objectBounds[object];
+            } else {
+                child = buildNode(ranges[slot], ranges[slot + 1]);
+                box = getNodeBounds(nodes[child]);
+            }
+            nodes[nodeIndex].child[slot] = child;
+            setSlot(nodes[nodeIndex], slot, box);
+        }
+        nodes[nodeIndex].count = count;
+        return nodeIndex;
+    }
+
+    // Classify the four child boxes against the frustum: bit i of outside is set when
+    // child i is fully outside, bit i of inside when it is fully inside every plane
+    void classify(const Node& node, const Frustum& frustum, int& outside, int& inside, size_t& tests) const {
+        tests += node.count;
+#ifdef SIMD_SSE2
+        __m128 outsideLanes = _mm_setzero_ps();
+        __m128 crossingLanes = _mm_setzero_ps();
+        const __m128 zero = _mm_setzero_ps();
+        for (const glm::vec4& plane : frustum.planes) {
+            // Per plane, the near and far corners come from min or max on each axis
+            const float* farX = plane.x >= 0.0f ? node.maxX : node.minX;
+            const float* farY = plane.y >= 0.0f ? node.maxY : node.minY;
+            const float* farZ = plane.z >= 0.0f ? node.maxZ : node.minZ;
+            const float* nearX = plane.x >= 0.0f ? node.minX : node.maxX;
+            const float* nearY = plane.y >= 0.0f ? node.minY : node.maxY;
+            const float* nearZ = plane.z >= 0.0f ? node.minZ : node.maxZ;
+
+            __m128 nx = _mm_set1_ps(plane.x);
+            __m128 ny = _mm_set1_ps(plane.y);
+            __m128 nz = _mm_set1_ps(plane.z);
+            __m128 w = _mm_set1_ps(plane.w);
+
+            __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(farX)), _mm_mul_ps(ny, _mm_loadu_ps(farY))),
+                                            _mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(farZ)), w));
+            __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(nearX)), _mm_mul_ps(ny, _mm_loadu_ps(nearY))),
+                                             _mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(nearZ)), w));
+            outsideLanes = _mm_or_ps(outsideLanes, _mm_cmplt_ps(farDistance, zero));
+            crossingLanes = _mm_or_ps(crossingLanes, _mm_cmplt_ps(nearDistance, zero));
+        }
+        outside = _mm_movemask_ps(outsideLanes);
+        inside = ~_mm_movemask_ps(crossingLanes) & 0xF;
+#else
+        outside = 0;
+        inside = 0;
+        for (int slot = 0; slot < node.count; ++slot) {
+            bool isOutside = false;
+            bool isInside = true;
+            for (const glm::vec4& plane : frustum.planes) {
+                float farDistance = plane.x * (plane.x >= 0.0f ? node.maxX[slot] : node.minX[slot])
+                                  + plane.y * (plane.y >= 0.0f ? node.maxY[slot] : node.minY[slot])
+                                  + plane.z * (plane.z >= 0.0f ? node.maxZ[slot] : node.minZ[slot]) + plane.w;
+                float nearDistance = plane.x * (plane.x >= 0.0f ? node.minX[slot] : node.maxX[slot])
+                                   + plane.y * (plane.y >= 0.0f ? node.minY[slot] : node.maxY[slot])
+                                   + plane.z * (plane.z >= 0.0f ? node.minZ[slot] : node.maxZ[slot]) + plane.w;
+                isOutside = isOutside || farDistance < 0.0f;
+                isInside = isInside && nearDistance >= 0.0f;
+            }
+            outside |= isOutside ? (1 << slot) : 0;
+            inside |= isInside ? (1 << slot) : 0;
+        }
+#endif
+    }
+
+    // Visit every object below a node without testing (the node is fully inside)
+    template <typename Visit>
+    void collectAll(int32_t child, const Visit& visit) const {
+        if (child < 0) {
+            visit((uint32_t)~child);
+            return;
+        }
+        const Node& node = nodes[child];
+        for (int slot = 0; slot < node.count; ++slot) {
+            collectAll(node.child[slot], visit);
+        }
+    }
+
+    // Depth-first traversal below one child entry, visiting each object that intersects the frustum
+    template <typename Visit>
+    void traverse(int32_t root, const Frustum& frustum, vector<int32_t>& stack, size_t& tests, const Visit& visit) const {
+        if (root < 0) {
+            ++tests;
+            if (frustum.intersects(objectBounds[~root])) {
+                visit((uint32_t)~root);
+            }
+            return;
+        }
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+
+            int outside, inside;
+            classify(node, frustum, outside, inside, tests);
+            for (int slot = 0; slot < node.count; ++slot) {
+                int32_t child = node.child[slot];
+                if (outside & (1 << slot)) {
+                    continue;
+                }
+                if (child < 0) {
+                    visit((uint32_t)~child);
+                } else if (inside & (1 << slot)) {
+                    collectAll(child, visit);
+                } else {
+                    stack.push_back(child);
+                }
+            }
+        }
+    }
+
+public:
+    // Rebuild the hierarchy from scratch (objects added or removed)
+    void build(const vector<AABB>& bounds) {
+        objectBounds = bounds;
+        nodes.clear();
+        subtrees.clear();
+        subtreeEnds.clear();
+        upperNodes.clear();
+        buildOrder.resize(bounds.size());
+        for (size_t i = 0; i < bounds.size(); ++i) {
+            buildOrder[i] = (uint32_t)i;
+        }
+        if (!bounds.empty()) {
+            buildNode(0, bounds.size());
+        }
+    }
+
+    // Update the node boxes for moved objects, keeping the tree topology
+    void refit(const vector<AABB>& bounds) {
+        objectBounds = bounds;
+        // Children follow their parent in the node array, so walk it backwards
+        for (size_t i = nodes.size(); i-- > 0;) {
+            refitNode(nodes[i]);
+        }
+    }
+
+    // Append the indices of objects whose boxes intersect the frustum
+    void cull(const Frustum& frustum, vector<uint32_t>& visible) {
+        if (nodes.empty()) {
+            return;
+        }
+        traverse(0, frustum, traversalStack, boxTests, [&visible](uint32_t object) { visible.push_back(object); });
+    }
+
+    // Split the hierarchy breadth-first into at least minimum independent subtrees (fewer
+    // when it runs out of nodes) for parallel refit and culling. Subtrees use the child
+    // encoding (>= 0 node, < 0 object); the nodes above them are kept for refitUpper().
+    void partition(size_t minimum) {
+        subtrees.clear();
+        subtreeEnds.clear();
+        upperNodes.clear();
+        if (nodes.empty()) {
+            return;
+        }
+        subtrees.push_back(0);
+        vector<int32_t> nextLevel;
+        bool hasNodes = true;
+        while (subtrees.size() < minimum && hasNodes) {
+            nextLevel.clear();
+            hasNodes = false;
+            for (int32_t entry : subtrees) {
+                if (entry < 0) {
+                    nextLevel.push_back(entry);
+                    continue;
+                }
+                upperNodes.push_back(entry);
+                const Node& node = nodes[entry];
+                for (int slot = 0; slot < node.count; ++slot) {
+                    nextLevel.push_back(node.child[slot]);
+                    hasNodes = hasNodes || node.child[slot] >= 0;
+                }
+            }
+            subtrees.swap(nextLevel);
+        }
+
+        // Nodes are created depth-first, so a subtree is the contiguous range from its root
+        // to the deepest last child
+        for (int32_t entry : subtrees) {
+            int32_t last = entry;
+            while (last >= 0) {
+                const Node& node = nodes[last];
+                int32_t next = -1;
+                for (int slot = node.count; slot-- > 0;) {
+                    if (node.child[slot] >= 0) {
+                        next = node.child[slot];
+                        break;
+                    }
+                }
+                if (next < 0) {
+                    break;
+                }
+                last = next;
+            }
+            subtreeEnds.push_back(entry < 0 ? entry : last + 1);
+        }
+    }
+
+    size_t getSubtreeCount() const { return subtrees.size(); }
+
+    // Parallel refit: replace the object bounds, refit every subtree (concurrently if
+    // desired, subtrees share no nodes), then refit the nodes above them
+    void setObjectBounds(const vector<AABB>& bounds) { objectBounds = bounds; }
+
+    void refitSubtree(size_t subtree) {
+        if (subtrees[subtree] < 0) {
+            return;
+        }
+        for (int32_t i = subtreeEnds[subtree]; i-- > subtrees[subtree];) {
+            refitNode(nodes[i]);
+        }
+    }
+
+    void refitUpper() {
+        for (size_t i = upperNodes.size(); i-- > 0;) {
+            refitNode(nodes[upperNodes[i]]);
+        }
+    }
+
+    // Set visible[object] for the objects of one subtree (see partition) that intersect the
+    // frustum and return the number of boxes tested. Const, so subtrees can be culled
+    // concurrently, each thread with its own stack.
+    size_t cullSubtree(size_t subtree, const Frustum& frustum, vector<int32_t>& stack, uint8_t* visible) const {
+        size_t tests = 0;
+        traverse(subtrees[subtree], frustum, stack, tests, [visible](uint32_t object) { visible[object] = 1; });
+        return tests;
+    }
+
+    void resetStatistics() { boxTests = 0; }
+    size_t getBoxTestCount() const { return boxTests; }
+    size_t getNodeCount() const { return nodes.size(); }
+};
+
+// Per-frame culling results
+struct CullingStatistics {
+    size_t visibleShapes = 0;
+    size_t culledShapes = 0;
+    size_t visibleLights = 0;
+    size_t culledLights = 0;
+    size_t boxTests = 0;
+    size_t visibleTriangles = 0;  // at the levels of detail drawn
+    size_t occludedShapes = 0;    // culled shapes inside the frustum but hidden (see OcclusionCuller)
+    size_t softwareOccludedShapes = 0;  // hidden behind the occluders (see SoftwareOcclusion)
+    size_t occluderTriangles = 0;       // occluder triangles rasterized
+    double cullMilliseconds = 0.0;
+};
+
+// ************** ENHANCEMENT: Clustered Lighting **************
+// Lights with a finite range are shaded through a grid of clusters over the view frustum:
+// screen tiles cut into depth slices spaced exponentially between the near and far planes.
+// Each frame the CPU lists the lights whose bounding sphere overlaps each cluster; a
+// fragment finds its cluster from its window position and view depth and shades only the
+// lights listed there.
+const GLuint POINT_LIGHT_STORAGE_BINDING = 3;
+const GLuint LIGHT_CLUSTER_STORAGE_BINDING = 4;
+
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+const int CLUSTER_SLICES = 24;
+const int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+const int MAX_POINT_LIGHTS = 1024;
+const int CLUSTER_BUFFER_ENTRIES = 256 * 1024;  // (offset, count) pairs and light lists together
+
+// std430 point light (w of position holds the range, w of color the intensity)
+struct PointLight {
+    glm::vec4 position;
+    glm::vec4 color;
+};
+
+// std430 header of the PointLightBuffer block; the lights follow it
+struct PointLightHeader {
+    GLint gridSize[4];        // tiles across, tiles up, depth slices, light count
+    glm::vec4 tileSize;       // window pixels per tile
+    glm::vec4 depthSlicing;   // slice = log(depth) * x + y, or depth * x + y when z is 0 (orthographic)
+};
+
+static_assert(sizeof(PointLightHeader) == 48 && sizeof(PointLight) == 32, "Point light data must follow std430 layout");
+
+// Per-frame cluster build results
+struct ClusterStatistics {
+    size_t pointLights = 0;       // lights with a finite range
+    size_t visibleLights = 0;     // of those, overlapping at least one cluster
+    size_t lightIndices = 0;      // entries in all cluster lists
+    size_t maxClusterLights = 0;  // longest cluster list
+    double buildMilliseconds = 0.0;
+};
+
+// Light lists per cluster, laid out as the LightClusterBuffer block reads them: an
+// (offset, count) pair per cluster followed by the light indices of every list
+class LightClusterGrid {
+private:
+    // Cluster range covered by one light, inclusive
+    struct LightExtent {
+        int x0, x1, y0, y1, z0, z1;
+    };
+
+    PointLightHeader header = {};
+    vector<uint32_t> data;
+    vector<uint32_t> counts;
+    vector<LightExtent> extents;
+    bool overflowReported = false;
+
+    int getSlice(float depth) const {
+        float slice = header.depthSlicing.z != 0.0f ? log(max(depth, 1.0e-4f)) * header.depthSlicing.x + header.depthSlicing.y
+                                                    : depth * header.depthSlicing.x + header.depthSlicing.y;
+        return glm::clamp((int)slice, 0, header.gridSize[2] - 1);
+    }
+
+    // Clusters overlapped by a light's view-space bounding box; false when it is off screen
+    bool getExtent(const PointLight& light, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+                   LightExtent& extent) const {
+        glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(light.position), 1.0f));
+        float radius = light.position.w;
+        float nearest = -center.z - radius, farthest = -center.z + radius;
+        if (farthest < nearPlane || nearest > farPlane) {
+            return false;
+        }
+        extent.z0 = getSlice(max(nearest, nearPlane));
+        extent.z1 = getSlice(min(farthest, farPlane));
+
+        // A box reaching behind the near plane projects unbounded, so it covers every tile
+        glm::vec2 low(-1.0f), high(1.0f);
+        if (nearest > nearPlane) {
+            low = glm::vec2(numeric_limits<float>::max());
+            high = glm::vec2(-numeric_limits<float>::max());
+            for (int corner = 0; corner < 8; ++corner) {
+                glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+                glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+                glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+                low = glm::min(low, ndc);
+                high = glm::max(high, ndc);
+            }
+            if (high.x < -1.0f || high.y < -1.0f || low.x > 1.0f || low.y > 1.0f) {
+                return false;
+            }
+        }
+        extent.x0 = glm::clamp((int)((low.x * 0.5f + 0.5f) * header.gridSize[0]), 0, header.gridSize[0] - 1);
+        extent.x1 = glm::clamp((int)((high.x * 0.5f + 0.5f) * header.gridSize[0]), 0, header.gridSize[0] - 1);
+        extent.y0 = glm::clamp((int)((low.y * 0.5f + 0.5f) * header.gridSize[1]), 0, header.gridSize[1] - 1);
+        extent.y1 = glm::clamp((int)((high.y * 0.5f + 0.5f) * header.gridSize[1]), 0, header.gridSize[1] - 1);
+        return true;
+    }
+
+public:
+    // Assign lights to the clusters of a width x height viewport. Unclustered, the grid is
+    // a single cluster listing every light (the brute-force comparison).
+    void build(const vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, int width, int height,
+               bool clustered, ClusterStatistics& statistics) {
+        auto start = chrono::steady_clock::now();
+        int tilesX = clustered ? CLUSTER_TILES_X : 1;
+        int tilesY = clustered ? CLUSTER_TILES_Y : 1;
+        int slices = clustered ? CLUSTER_SLICES : 1;
+        int clusterCount = tilesX * tilesY * slices;
+
+        // Near and far planes from the projection; a perspective matrix has -1 in [2][3]
+        bool orthographic = projection[2][3] == 0.0f;
+        float nearPlane = orthographic ? (projection[3][2] + 1.0f) / projection[2][2] : projection[3][2] / (projection[2][2] - 1.0f);
+        float farPlane = orthographic ? (projection[3][2] - 1.0f) / projection[2][2] : projection[3][2] / (projection[2][2] + 1.0f);
+
+        header.gridSize[0] = tilesX;
+        header.gridSize[1] = tilesY;
+        header.gridSize[2] = slices;
+        header.gridSize[3] = (GLint)lights.size();
+        header.tileSize = glm::vec4((float)max(width, 1) / tilesX, (float)max(height, 1) / tilesY, 0.0f, 0.0f);
+        if (orthographic) {
+            float scale = slices / (farPlane - nearPlane);
+            header.depthSlicing = glm::vec4(scale, -nearPlane * scale, 0.0f, 0.0f);
+        } else {
+            float scale = slices / log(farPlane / nearPlane);
+            header.depthSlicing = glm::vec4(scale, -log(nearPlane) * scale, 1.0f, 0.0f);
+        }
+
+        // Count the lights per cluster
+        counts.assign(clusterCount, 0);
+        extents.resize(lights.size());
+        size_t visible = 0;
+        for (size_t i = 0; i < lights.size(); ++i) {
+            LightExtent& extent = extents[i];
+            if (!clustered) {
+                extent = { 0, 0, 0, 0, 0, 0 };
+            } else if (!getExtent(lights[i], view, projection, nearPlane, farPlane, extent)) {
+                extent = { 0, -1, 0, -1, 0, -1 };
+                continue;
+            }
+            ++visible;
+            for (int z = extent.z0; z <= extent.z1; ++z) {
+                for (int y = extent.y0; y <= extent.y1; ++y) {
+                    for (int x = extent.x0; x <= extent.x1; ++x) {
+                        ++counts[(z * tilesY + y) * tilesX + x];
+                    }
+                }
+            }
+        }
+
+        // Lists start after the (offset, count) pairs; lists past the buffer's end are cut short
+        data.resize(clusterCount * 2);
+        size_t offset = data.size();
+        size_t maxCount = 0;
+        for (int cluster = 0; cluster < clusterCount; ++cluster) {
+            size_t available = offset < (size_t)CLUSTER_BUFFER_ENTRIES ? CLUSTER_BUFFER_ENTRIES - offset : 0;
+            if (counts[cluster] > available && !overflowReported) {
+                cerr << "Light cluster lists exceed " << CLUSTER_BUFFER_ENTRIES << " entries; dropping lights" << endl;
+                overflowReported = true;
+            }
+            uint32_t count = (uint32_t)min((size_t)counts[cluster], available);
+            data[cluster * 2] = (uint32_t)offset;
+            data[cluster * 2 + 1] = count;
+            offset += count;
+            maxCount = max(maxCount, (size_t)count);
+        }
+        data.resize(offset);
+
+        // Fill the lists in light order, reusing the counts as the entries written so far
+        counts.assign(clusterCount, 0);
+        for (size_t i = 0; i < lights.size(); ++i) {
+            const LightExtent& extent = extents[i];
+            for (int z = extent.z0; z <= extent.z1; ++z) {
+                for (int y = extent.y0; y <= extent.y1; ++y) {
+                    for (int x = extent.x0; x <= extent.x1; ++x) {
+                        int cluster = (z * tilesY + y) * tilesX + x;
+                        if (counts[cluster] < data[cluster * 2 + 1]) {
+                            data[data[cluster * 2] + counts[cluster]++] = (uint32_t)i;
+                        }
+                    }
+                }
+            }
+        }
+
+        statistics.pointLights = lights.size();
+        statistics.visibleLights = visible;
+        statistics.lightIndices = offset - clusterCount * 2;
+        statistics.maxClusterLights = maxCount;
+        statistics.buildMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    const PointLightHeader& getHeader() const { return header; }
+    const vector<uint32_t>& getData() const { return data; }
+};
+
+// ************** ENHANCEMENT: Deferred Shading **************
+// Deferred mode draws the opaque shapes once into a G-buffer of surface albedo (RGBA8),
+// normal folded onto an octahedron in two 16-bit channels (RG16) and 24-bit depth, 12
+// bytes per pixel. One full-screen pass then lights every covered pixel with the
+// scene-wide lights and the point lights of its cluster (see LightClusterGrid), so
+// lighting no longer runs again for each triangle covering the pixel.
+const GLuint GBUFFER_TEXTURE_UNIT = 1;  // albedo, normal and depth on units 1 to 3
+
+class GBuffer {
+private:
+    GLuint framebuffer = 0;
+    GLuint textures[3] = {};  // albedo, normal, depth
+    int width = 0;
+    int height = 0;
+
+    void destroy() {
+        if (framebuffer != 0) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(3, textures);
+            framebuffer = 0;
+        }
+    }
+
+public:
+    GBuffer() = default;
+
+    ~GBuffer() {
+        destroy();
+    }
+
+    GBuffer(const GBuffer&) = delete;
+    GBuffer& operator=(const GBuffer&) = delete;
+
+    // Create the targets, again whenever the viewport size changes. Leaves the G-buffer
+    // bound; false when the framebuffer is incomplete.
+    bool resize(int newWidth, int newHeight) {
+        if (framebuffer != 0 && newWidth == width && newHeight == height) {
+            bind();
+            return true;
+        }
+        destroy();
+        width = newWidth;
+        height = newHeight;
+
+        const GLenum formats[3] = { GL_RGBA8, GL_RG16, GL_DEPTH_COMPONENT24 };
+        glGenTextures(3, textures);
+        for (int i = 0; i < 3; ++i) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[0], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textures[1], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[2], 0);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            cerr << "Failed to create G-buffer" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    void bind() const { glBindFramebuffer(GL_FRAMEBUFFER, framebuffer); }
+
+    // Bind albedo, normal and depth for the lighting pass
+    void bindTextures() const {
+        for (int i = 0; i < 3; ++i) {
+            glActiveTexture(GL_TEXTURE0 + GBUFFER_TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    size_t getBytes() const { return framebuffer != 0 ? (size_t)width * height * 12 : 0; }
+};
+
+// ************** ENHANCEMENT: Shadow Mapping **************
+// The key light (the second scene-wide light) casts cascaded shadows: it is treated as
+// directional, shining from its position toward the origin, over MAX_SHADOW_CASCADES
+// splits of the view out to SHADOW_DISTANCE. The filler light and the first point lights
+// cast omnidirectional shadows through a cube map array. Every map is cached: it is
+// rendered again only when its light or cascade moves, or when a shadow caster changes
+// inside its volume; a static scene pays for its shadows once.
+const GLuint SHADOW_UNIFORMS_BINDING = 5;
+const GLuint SHADOW_TEXTURE_UNIT = 4;  // cascades on unit 4, cube maps on unit 5
+const int MAX_SHADOW_CASCADES = 3;     // must match the GLSL ShadowUniforms block
+const int MAX_SHADOW_CUBES = 4;        // filler light, then the first point lights
+const int CASCADE_RESOLUTION = 1024;
+const int CUBE_SHADOW_RESOLUTION = 256;
+const float SHADOW_DISTANCE = 40.0f;         // view depth covered by the cascades
+const float SHADOW_CASTER_DISTANCE = 50.0f;  // how far toward the light casters are kept
+const float FILLER_SHADOW_RANGE = 30.0f;     // cube map range of the unbounded filler light
+
+// CPU mirror of the std140 ShadowUniforms block
+struct ShadowUniforms {
+    glm::mat4 cascadeMatrices[MAX_SHADOW_CASCADES];
+    glm::vec4 cascadeSplits;  // view depth where each cascade ends, w = cascade count
+    glm::vec4 cubeLights[MAX_SHADOW_CUBES];  // xyz light position, w range (0 for an unused slot)
+    GLint enabled;
+    GLint padding[3];
+};
+
+// Per-frame shadow map counts; a cube map counts once for its six faces
+struct ShadowStatistics {
+    size_t shadowMaps = 0;
+    size_t rendered = 0;
+    size_t skipped = 0;
+    size_t casterDraws = 0;
+    double updateMilliseconds = 0.0;
+};
+
+class ShadowCache {
+private:
+    // One cached map: its view (cascade matrix, or light position and range for a cube)
+    // and whether it must be rendered again
+    struct CachedMap {
+        glm::mat4 matrix;
+        glm::vec4 light;
+        bool active = false;
+        bool dirty = true;
+    };
+
+    GLuint framebuffer = 0;
+    GLuint cascadeTexture = 0;
+    GLuint cubeTexture = 0;
+    CachedMap cascades[MAX_SHADOW_CASCADES];
+    CachedMap cubes[MAX_SHADOW_CUBES];
+    glm::vec4 cascadeSplits = glm::vec4(0.0f);
+    bool cachingEnabled = true;
+
+    static GLuint createDepthTexture(GLenum target, int size, int layers) {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(target, texture);
+        glTexStorage3D(target, 1, GL_DEPTH_COMPONENT24, size, size, layers);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        const float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+        glBindTexture(target, 0);
+        return texture;
+    }
+
+    // Standard cube face orientations, in layer order
+    static glm::mat4 getCubeFaceView(const glm::vec3& position, int face) {
+        static const glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                                 glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+        static const glm::vec3 ups[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+                                          glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+        return glm::lookAt(position, position + directions[face], ups[face]);
+    }
+
+    // Whether a box touches the cube around a light's range
+    static bool overlaps(const AABB& box, const glm::vec4& light) {
+        for (int axis = 0; axis < 3; ++axis) {
+            if (box.min[axis] > light[axis] + light.w || box.max[axis] < light[axis] - light.w) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    ShadowCache() = default;
+
+    ~ShadowCache() {
+        if (framebuffer != 0) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(1, &cascadeTexture);
+            glDeleteTextures(1, &cubeTexture);
+        }
+    }
+
+    ShadowCache(const ShadowCache&) = delete;
+    ShadowCache& operator=(const ShadowCache&) = delete;
+
+    bool create() {
+        cascadeTexture = createDepthTexture(GL_TEXTURE_2D_ARRAY, CASCADE_RESOLUTION, MAX_SHADOW_CASCADES);
+        cubeTexture = createDepthTexture(GL_TEXTURE_CUBE_MAP_ARRAY, CUBE_SHADOW_RESOLUTION, MAX_SHADOW_CUBES * 6);
+
+        // Depth only; the layer attached is switched per map
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascadeTexture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            cerr << "Failed to create shadow map framebuffer" << endl;
+        }
+        return complete;
+    }
+
+    // Fit one cascade around each split of the view frustum. Cascades are stabilized:
+    // a bounding sphere of fixed radius, snapped to whole texels in light space, so
+    // a cascade only moves (and is rendered again) when the view moves a full texel.
+    void setCascades(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& direction, bool active) {
+        glm::mat4 inverseProjection = glm::inverse(projection);
+        glm::mat4 inverseView = glm::inverse(view);
+        auto unprojectDepth = [&](float ndcZ) {
+            glm::vec4 point = inverseProjection * glm::vec4(0.0f, 0.0f, ndcZ, 1.0f);
+            return -point.z / point.w;
+        };
+        auto getNdcDepth = [&](float viewDepth) {
+            glm::vec4 clip = projection * glm::vec4(0.0f, 0.0f, -viewDepth, 1.0f);
+            return clip.z / clip.w;
+        };
+        float nearDepth = unprojectDepth(-1.0f);
+        float farDepth = min(unprojectDepth(1.0f), SHADOW_DISTANCE);
+
+        glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+        float splitStart = nearDepth;
+        for (int cascade = 0; cascade < MAX_SHADOW_CASCADES; ++cascade) {
+            // Split halfway between uniform and logarithmic spacing
+            float t = (cascade + 1.0f) / MAX_SHADOW_CASCADES;
+            float splitEnd = glm::mix(nearDepth + (farDepth - nearDepth) * t, nearDepth * pow(farDepth / nearDepth, t), 0.5f);
+            cascadeSplits[cascade] = splitEnd;
+
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for (int i = 0; i < 8; ++i) {
+                float ndcZ = getNdcDepth(i < 4 ? splitStart : splitEnd);
+                glm::vec4 point = inverseProjection * glm::vec4((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, ndcZ, 1.0f);
+                corners[i] = glm::vec3(inverseView * (point / point.w));
+                center += corners[i] / 8.0f;
+            }
+            float radius = 0.0f;
+            for (const glm::vec3& corner : corners) {
+                radius = max(radius, glm::length(corner - center));
+            }
+            radius = ceil(radius * 16.0f) / 16.0f;
+
+            float texel = 2.0f * radius / CASCADE_RESOLUTION;
+            glm::vec3 lightCenter = glm::floor(glm::vec3(lightRotation * glm::vec4(center, 1.0f)) / texel) * texel;
+            glm::mat4 lightProjection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+                                                   lightCenter.y - radius, lightCenter.y + radius,
+                                                   -lightCenter.z - radius - SHADOW_CASTER_DISTANCE, -lightCenter.z + radius);
+            glm::mat4 matrix = lightProjection * lightRotation;
+
+            CachedMap& map = cascades[cascade];
+            if (map.active != active || matrix != map.matrix || !cachingEnabled) {
+                map.dirty = true;
+            }
+            map.matrix = matrix;
+            map.active = active;
+            splitStart = splitEnd;
+        }
+        cascadeSplits.w = active ? (float)MAX_SHADOW_CASCADES : 0.0f;
+    }
+
+    // Assign a light to a cube slot (range 0 leaves the slot unused)
+    void setCubeLight(int slot, const glm::vec3& position, float range) {
+        CachedMap& map = cubes[slot];
+        glm::vec4 light(position, range);
+        bool active = range > 0.0f;
+        if (map.active != active || light != map.light || !cachingEnabled) {
+            map.dirty = true;
+        }
+        map.light = light;
+        map.active = active;
+    }
+
+    // A shadow caster changed inside box (the union of its old and new bounds)
+    void invalidate(const AABB& box) {
+        for (CachedMap& map : cascades) {
+            if (map.active && !map.dirty && Frustum::fromMatrix(map.matrix).intersects(box)) {
+                map.dirty = true;
+            }
+        }
+        for (CachedMap& map : cubes) {
+            if (map.active && !map.dirty && overlaps(box, map.light)) {
+                map.dirty = true;
+            }
+        }
+    }
+
+    void invalidateAll() {
+        for (CachedMap& map : cascades) {
+            map.dirty = true;
+        }
+        for (CachedMap& map : cubes) {
+            map.dirty = true;
+        }
+    }
+
+    // Render every dirty, active map. drawCasters(viewProjection, light) draws the casters
+    // inside viewProjection and returns the number of draws; light is the cube light
+    // (w = range) or zero for cascades. Leaves the shadow framebuffer bound.
+    template <typename DrawCasters>
+    void render(DrawCasters drawCasters, ShadowStatistics& statistics) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        glViewport(0, 0, CASCADE_RESOLUTION, CASCADE_RESOLUTION);
+        for (int cascade = 0; cascade < MAX_SHADOW_CASCADES; ++cascade) {
+            CachedMap& map = cascades[cascade];
+            if (!map.active) {
+                continue;
+            }
+            ++statistics.shadowMaps;
+            if (!map.dirty) {
+                ++statistics.skipped;
+                continue;
+            }
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascadeTexture, 0, cascade);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            statistics.casterDraws += drawCasters(map.matrix, glm::vec4(0.0f));
+            ++statistics.rendered;
+            map.dirty = false;
+        }
+
+        glViewport(0, 0, CUBE_SHADOW_RESOLUTION, CUBE_SHADOW_RESOLUTION);
+        for (int slot = 0; slot < MAX_SHADOW_CUBES; ++slot) {
+            CachedMap& map = cubes[slot];
+            if (!map.active) {
+                continue;
+            }
+            ++statistics.shadowMaps;
+            if (!map.dirty) {
+                ++statistics.skipped;
+                continue;
+            }
+            glm::mat4 faceProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, map.light.w);
+            for (int face = 0; face < 6; ++face) {
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubeTexture, 0, slot * 6 + face);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                statistics.casterDraws += drawCasters(faceProjection * getCubeFaceView(glm::vec3(map.light), face), map.light);
+            }
+            ++statistics.rendered;
+            map.dirty = false;
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+    }
+
+    void fillUniforms(ShadowUniforms& uniforms, bool enabled) const {
+        for (int cascade = 0; cascade < MAX_SHADOW_CASCADES; ++cascade) {
+            uniforms.cascadeMatrices[cascade] = cascades[cascade].matrix;
+        }
+        uniforms.cascadeSplits = cascadeSplits;
+        for (int slot = 0; slot < MAX_SHADOW_CUBES; ++slot) {
+            uniforms.cubeLights[slot] = cubes[slot].active ? cubes[slot].light : glm::vec4(0.0f);
+        }
+        uniforms.enabled = enabled ? 1 : 0;
+    }
+
+    void bindTextures() const {
+        glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cascadeTexture);
+        glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT + 1);
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, cubeTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Disabling renders every active map every frame (used to measure the uncached cost)
+    void setCachingEnabled(bool enabled) { cachingEnabled = enabled; }
+    bool isCachingEnabled() const { return cachingEnabled; }
+};
+
+// ************** ENHANCEMENT: Hierarchical-Z Occlusion Culling **************
+// Shapes that passed frustum culling are also tested against the depth of the previous
+// frame. At the end of a frame the depth buffer is copied and reduced on the GPU by
+// fragment passes that keep the farthest depth of each 2x2 block, down to at most
+// HIZ_READBACK_WIDTH texels across; that level is read back through a pixel buffer
+// object a frame later, so the CPU never waits for it. The CPU reprojects those depths
+// into the current view (camera movement), builds its own max pyramid and tests each
+// candidate's screen rectangle, at the level where it spans a few texels, against the
+// box's nearest depth. The tests err toward visible: texels keep their farthest depth,
+// texels with any pixel nothing reprojects onto go to the far plane, and boxes crossing
+// the near plane always pass. What remains approximate is reprojection within a texel and
+// occluders that moved since the previous frame (their depth is one frame stale).
+const GLuint HIZ_TEXTURE_UNIT = 6;
+const int HIZ_READBACK_WIDTH = 160;
+
+class OcclusionCuller {
+private:
+    // GPU reduction: copied depth, then one R32F texture per level
+    GLuint framebuffer = 0;
+    GLuint vao = 0;
+    GLuint depthTexture = 0;
+    vector<GLuint> levelTextures;
+    vector<glm::ivec2> levelSizes;
+    GLuint pixelBuffer = 0;
+    GLsync fence = nullptr;
+    glm::ivec4 viewport = glm::ivec4(0);
+    int texelScale = 1;  // viewport pixels per texel of the coarsest level
+
+    // A readback of the coarsest level and the view it was captured from
+    struct Capture {
+        glm::ivec2 size = glm::ivec2(0);
+        glm::mat4 viewProjection;
+        glm::ivec4 viewport = glm::ivec4(0);
+        int texelScale = 1;
+    };
+    Capture pending;  // in flight behind the fence
+    Capture captured;
+    vector<float> capturedDepth;
+    bool hasCapture = false;
+
+    // Reprojected depth pyramid used by this frame's tests
+    vector<vector<float>> pyramid;
+    vector<glm::ivec2> pyramidSizes;
+    vector<glm::vec4> reprojectedCorners;  // texel corners in this frame's NDC, w 0 when behind the eye
+    vector<uint8_t> coveredPixels;  // viewport pixel centers some reprojected texel lands on
+    glm::mat4 viewProjection;
+    bool ready = false;
+
+    void destroyTargets() {
+        if (depthTexture != 0) {
+            glDeleteTextures(1, &depthTexture);
+            glDeleteTextures((GLsizei)levelTextures.size(), levelTextures.data());
+            depthTexture = 0;
+            levelTextures.clear();
+            levelSizes.clear();
+        }
+    }
+
+    // Size the copy and the reduction chain to the viewport
+    void resizeTargets(const glm::ivec4& newViewport) {
+        if (depthTexture != 0 && newViewport == viewport) {
+            return;
+        }
+        destroyTargets();
+        viewport = newViewport;
+
+        // Created on the culler's own unit so the shapes' texture binding is untouched
+        glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_UNIT);
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, viewport.z, viewport.w);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glm::ivec2 size(viewport.z, viewport.w);
+        texelScale = 1;
+        while (size.x > HIZ_READBACK_WIDTH && size.x > 1 && size.y > 1) {
+            size = size / 2;
+            texelScale *= 2;
+            GLuint texture = 0;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, size.x, size.y);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            levelTextures.push_back(texture);
+            levelSizes.push_back(size);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)size.x * size.y * sizeof(float), nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // Coarsest-level texel holding a viewport pixel (the last row and column of every
+    // level also cover the odd pixels left over by the halving)
+    static int getTexel(float pixel, int scale, int size) {
+        return glm::clamp((int)floor(pixel / scale), 0, size - 1);
+    }
+
+    // Move the captured depths into the current view. Each corner of the captured texel
+    // grid (background included) is unprojected at the farthest depth of the texels
+    // sharing it, with the view it was captured from, so neighbouring footprints meet
+    // without cracks and stretch across depth edges at the far side's depth. Each texel's
+    // footprint covers the texels of the current view between its reprojected corners
+    // with its farthest corner depth; texels that receive several keep the farthest. A
+    // texel only keeps that depth if footprints cover all of its pixel centers: where part
+    // of it lies outside the old view, it goes to the far plane. Footprints larger than
+    // MAX_FOOTPRINT texels across or crossing the eye plane are dropped, which also only
+    // leaves texels farther.
+    void reproject() {
+        const int MAX_FOOTPRINT = 8;
+        const glm::ivec2 capturedSize = captured.size;
+        const glm::vec2 viewportSize(captured.viewport.z, captured.viewport.w);
+        pyramidSizes.assign(1, capturedSize);
+        pyramid.resize(1);
+        vector<float>& level = pyramid[0];
+        if (captured.viewProjection == viewProjection) {
+            level = capturedDepth;
+        } else {
+            const int pixelsX = captured.viewport.z, pixelsY = captured.viewport.w;
+            level.assign(capturedDepth.size(), -1.0f);
+            coveredPixels.assign((size_t)pixelsX * pixelsY, 0);
+            glm::mat4 reprojection = viewProjection * glm::inverse(captured.viewProjection);
+            auto project = [&](glm::vec2 pixel, float depth, glm::vec3& ndc) {
+                pixel = glm::min(pixel, viewportSize);
+                glm::vec4 clip = reprojection * glm::vec4(pixel / viewportSize * 2.0f - 1.0f, depth * 2.0f - 1.0f, 1.0f);
+                if (clip.w <= 0.0f) {
+                    return false;
+                }
+                ndc = glm::vec3(clip) / clip.w;
+                return true;
+            };
+            const int cornersX = capturedSize.x + 1;
+            reprojectedCorners.resize((size_t)cornersX * (capturedSize.y + 1));
+            for (int y = 0; y <= capturedSize.y; ++y) {
+                for (int x = 0; x <= capturedSize.x; ++x) {
+                    float depth = 0.0f;
+                    for (int texelY = max(y - 1, 0); texelY <= min(y, capturedSize.y - 1); ++texelY) {
+                        for (int texelX = max(x - 1, 0); texelX <= min(x, capturedSize.x - 1); ++texelX) {
+                            depth = max(depth, capturedDepth[texelY * capturedSize.x + texelX]);
+                        }
+                    }
+                    glm::vec3 ndc;
+                    bool inFront = project(glm::vec2(x, y) * (float)captured.texelScale, min(depth, 1.0f), ndc);
+                    reprojectedCorners[(size_t)y * cornersX + x] = glm::vec4(ndc, inFront ? 1.0f : 0.0f);
+                }
+            }
+            for (int y = 0; y < capturedSize.y; ++y) {
+                for (int x = 0; x < capturedSize.x; ++x) {
+                    glm::vec2 low(numeric_limits<float>::max()), high(-numeric_limits<float>::max());
+                    float farthest = -1.0f;
+                    bool behind = false;
+                    for (int corner = 0; corner < 4; ++corner) {
+                        const glm::vec4& ndc = reprojectedCorners[(size_t)(y + (corner >> 1)) * cornersX + x + (corner & 1)];
+                        behind = behind || ndc.w == 0.0f;
+                        low = glm::min(low, glm::vec2(ndc.x, ndc.y));
+                        high = glm::max(high, glm::vec2(ndc.x, ndc.y));
+                        farthest = max(farthest, ndc.z);
+                    }
+                    if (behind || low.x > 1.0f || low.y > 1.0f || high.x < -1.0f || high.y < -1.0f) {
+                        continue;
+                    }
+                    int x0 = getTexel((low.x * 0.5f + 0.5f) * viewportSize.x, captured.texelScale, capturedSize.x);
+                    int x1 = getTexel((high.x * 0.5f + 0.5f) * viewportSize.x, captured.texelScale, capturedSize.x);
+                    int y0 = getTexel((low.y * 0.5f + 0.5f) * viewportSize.y, captured.texelScale, capturedSize.y);
+                    int y1 = getTexel((high.y * 0.5f + 0.5f) * viewportSize.y, captured.texelScale, capturedSize.y);
+                    if (x1 - x0 >= MAX_FOOTPRINT || y1 - y0 >= MAX_FOOTPRINT) {
+                        continue;
+                    }
+                    float reprojected = min(farthest, 1.0f) * 0.5f + 0.5f;
+                    for (int targetY = y0; targetY <= y1; ++targetY) {
+                        for (int targetX = x0; targetX <= x1; ++targetX) {
+                            float& target = level[targetY * capturedSize.x + targetX];
+                            target = max(target, reprojected);
+                        }
+                    }
+
+                    // Pixel centers inside the footprint [low, high)
+                    int pixelX0 = max((int)ceil((low.x * 0.5f + 0.5f) * viewportSize.x - 0.5f), 0);
+                    int pixelX1 = min((int)ceil((high.x * 0.5f + 0.5f) * viewportSize.x - 0.5f), pixelsX);
+                    int pixelY0 = max((int)ceil((low.y * 0.5f + 0.5f) * viewportSize.y - 0.5f), 0);
+                    int pixelY1 = min((int)ceil((high.y * 0.5f + 0.5f) * viewportSize.y - 0.5f), pixelsY);
+                    for (int pixelY = pixelY0; pixelY < pixelY1; ++pixelY) {
+                        for (int pixelX = pixelX0; pixelX < pixelX1; ++pixelX) {
+                            coveredPixels[(size_t)pixelY * pixelsX + pixelX] = 1;
+                        }
+                    }
+                }
+            }
+            for (int pixelY = 0; pixelY < pixelsY; ++pixelY) {
+                for (int pixelX = 0; pixelX < pixelsX; ++pixelX) {
+                    if (!coveredPixels[(size_t)pixelY * pixelsX + pixelX]) {
+                        level[getTexel((float)pixelY, captured.texelScale, capturedSize.y) * capturedSize.x +
+                              getTexel((float)pixelX, captured.texelScale, capturedSize.x)] = 1.0f;
+                    }
+                }
+            }
+            for (float& depth : level) {
+                if (depth < 0.0f) {
+                    depth = 1.0f;
+                }
+            }
+        }
+
+        // Max pyramid down to a single texel, folding odd rows and columns into the last one
+        while (pyramidSizes.back().x > 1 || pyramidSizes.back().y > 1) {
+            glm::ivec2 source = pyramidSizes.back();
+            glm::ivec2 size = glm::max(source / 2, glm::ivec2(1));
+            vector<float> next((size_t)size.x * size.y, 0.0f);
+            const vector<float>& previous = pyramid.back();
+            for (int y = 0; y < source.y; ++y) {
+                for (int x = 0; x < source.x; ++x) {
+                    float& target = next[min(y / 2, size.y - 1) * size.x + min(x / 2, size.x - 1)];
+                    target = max(target, previous[y * source.x + x]);
+                }
+            }
+            pyramid.push_back(move(next));
+            pyramidSizes.push_back(size);
+        }
+    }
+
+public:
+    OcclusionCuller() = default;
+
+    ~OcclusionCuller() {
+        destroyTargets();
+        if (framebuffer != 0) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteVertexArrays(1, &vao);
+            glDeleteBuffers(1, &pixelBuffer);
+        }
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+        }
+    }
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    void create() {
+        glGenFramebuffers(1, &framebuffer);
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &pixelBuffer);
+    }
+
+    // Forget the captured depth (the scene changed under it)
+    void reset() {
+        hasCapture = false;
+        ready = false;
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    // Collect the readback if it has arrived and reproject it into this frame's view;
+    // returns whether this frame can be tested (never waits for the GPU)
+    bool prepare(const glm::mat4& currentViewProjection) {
+        ready = false;
+        if (fence != nullptr && glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) != GL_TIMEOUT_EXPIRED) {
+            glDeleteSync(fence);
+            fence = nullptr;
+
+            size_t count = (size_t)pending.size.x * pending.size.y;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+            const float* data = static_cast<const float*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * sizeof(float), GL_MAP_READ_BIT));
+            if (data != nullptr) {
+                capturedDepth.assign(data, data + count);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                captured = pending;
+                hasCapture = true;
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        if (!hasCapture) {
+            return false;
+        }
+        viewProjection = currentViewProjection;
+        reproject();
+        ready = true;
+        return true;
+    }
+
+    // Reduce the depth of the frame just drawn (viewport of the read framebuffer) and
+    // start reading the coarsest level back. Skipped while an earlier readback is pending.
+    void capture(const glm::mat4& frameViewProjection, const glm::ivec4& frameViewport, const ShaderProgram& downsample,
+                 GLint readFramebuffer) {
+        if (fence != nullptr || frameViewport.z < 2 || frameViewport.w < 2) {
+            return;
+        }
+        resizeTargets(frameViewport);
+        if (levelTextures.empty()) {
+            return;
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport.x, viewport.y, viewport.z, viewport.w);
+
+        // Each pass reads the previous level and keeps the farthest depth of its footprint
+        downsample.use();
+        glBindVertexArray(vao);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glDisable(GL_DEPTH_TEST);
+        for (size_t level = 0; level < levelTextures.size(); ++level) {
+            glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : levelTextures[level - 1]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, levelTextures[level], 0);
+            glViewport(0, 0, levelSizes[level].x, levelSizes[level].y);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glEnable(GL_DEPTH_TEST);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+
+        // Asynchronous readback into the pixel buffer; prepare() collects it
+        glm::ivec2 size = levelSizes.back();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+        glReadPixels(0, 0, size.x, size.y, GL_RED, GL_FLOAT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pending.size = size;
+        pending.viewProjection = frameViewProjection;
+        pending.viewport = viewport;
+        pending.texelScale = texelScale;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, readFramebuffer);
+        glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+    }
+
+    bool isReady() const { return ready; }
+
+    // Whether a box is certainly hidden behind the prepared depth (safe to call from
+    // several threads once prepare() returned true)
+    bool isOccluded(const AABB& box) const {
+        glm::vec2 minPixel(numeric_limits<float>::max());
+        glm::vec2 maxPixel(-numeric_limits<float>::max());
+        float nearest = 1.0f;
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                            (corner & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            if (clip.w <= 1e-4f) {
+                return false;  // crosses the camera plane
+            }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            glm::vec2 pixel = (glm::vec2(ndc) * 0.5f + 0.5f) * glm::vec2(captured.viewport.z, captured.viewport.w);
+            minPixel = glm::min(minPixel, pixel);
+            maxPixel = glm::max(maxPixel, pixel);
+            nearest = min(nearest, ndc.z * 0.5f + 0.5f);
+        }
+        if (nearest <= 0.0f) {
+            return false;
+        }
+
+        int x0 = getTexel(minPixel.x, captured.texelScale, captured.size.x);
+        int x1 = getTexel(maxPixel.x, captured.texelScale, captured.size.x);
+        int y0 = getTexel(minPixel.y, captured.texelScale, captured.size.y);
+        int y1 = getTexel(maxPixel.y, captured.texelScale, captured.size.y);
+
+        // Coarsest level where the rectangle spans at most 4x4 texels
+        size_t level = 0;
+        while (level + 1 < pyramid.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3)) {
+            ++level;
+        }
+        glm::ivec2 size = pyramidSizes[level];
+        const vector<float>& depths = pyramid[level];
+        for (int y = min(y0 >> level, size.y - 1); y <= min(y1 >> level, size.y - 1); ++y) {
+            for (int x = min(x0 >> level, size.x - 1); x <= min(x1 >> level, size.x - 1); ++x) {
+                if (nearest <= depths[y * size.x + x]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// ************** ENHANCEMENT: Software Occlusion Rasterizer **************
+// A CPU alternative to the Hi-Z culler: it needs no readback and uses this frame's view.
+// Shapes marked as occluders (shapes that fill their bounds, such as large cubes) are
+// drawn as their boxes under the model matrix into a small depth buffer, and candidates
+// are tested against it before submission. Triangles are set up per occluder on the job
+// system, binned to tiles, and each tile is rasterized by one worker, a row of pixels at
+// a time in SIMD registers (AVX2 or SSE2, scalar otherwise). Coverage and depth are
+// sampled at pixel centers; a candidate's rectangle is grown by a pixel so a box peeking
+// past an occluder's silhouette still passes. Occluders reaching in front of the near
+// plane are skipped, as are candidates crossing it.
+const int SOFTWARE_OCCLUSION_WIDTH = 256;
+const int SOFTWARE_OCCLUSION_HEIGHT = 128;
+const int SOFTWARE_OCCLUSION_TILE_SIZE = 32;  // a multiple of the widest vector (8 floats)
+
+class SoftwareOcclusion {
+public:
+    // A box in local space under a model matrix
+    struct Occluder {
+        AABB bounds;
+        glm::mat4 model;
+    };
+
+    // Box faces as corner indices (bit 0 x, bit 1 y, bit 2 z), counterclockwise from outside
+    static constexpr int BOX_FACES[6][4] = { { 1, 3, 7, 5 }, { 0, 4, 6, 2 }, { 2, 6, 7, 3 },
+                                             { 0, 1, 5, 4 }, { 4, 5, 7, 6 }, { 0, 2, 3, 1 } };
+
+    // Window coordinates of a box corner (depth in [0, 1]); false when it lies behind the
+    // near plane
+    static bool projectCorner(const glm::mat4& toClip, const AABB& box, int corner, glm::vec3& window) {
+        glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                        (corner & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = toClip * glm::vec4(point, 1.0f);
+        if (clip.w <= 0.0f || clip.z < -clip.w) {
+            return false;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        window = glm::vec3((ndc.x * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_WIDTH, (ndc.y * 0.5f + 0.5f) * SOFTWARE_OCCLUSION_HEIGHT,
+                           ndc.z * 0.5f + 0.5f);
+        return true;
+    }
+
+private:
+    static const int TILES_X = SOFTWARE_OCCLUSION_WIDTH / SOFTWARE_OCCLUSION_TILE_SIZE;
+    static const int TILES_Y = SOFTWARE_OCCLUSION_HEIGHT / SOFTWARE_OCCLUSION_TILE_SIZE;
+    static const int TRIANGLES_PER_OCCLUDER = 12;
+
+    // Edge functions a x + b y + c (non-negative inside), the depth plane in the same form,
+    // the vertex depth range (nearly edge-on triangles extrapolate far out of it) and the
+    // pixel bounds (inclusive)
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        float depthMin, depthMax;
+        int minX, minY, maxX, maxY;
+    };
+
+    vector<float> depth;  // rows from the bottom like the viewport
+    float tileMaxDepth[TILES_X * TILES_Y];
+    vector<Triangle> triangles;         // TRIANGLES_PER_OCCLUDER slots per occluder
+    vector<int> occluderTriangleCounts;  // slots used by each occluder
+    vector<vector<uint32_t>> bins;       // triangles overlapping each tile
+    glm::mat4 viewProjection;
+    size_t triangleCount = 0;
+
+    // Front-facing, on-screen triangles of one occluder; returns how many were written
+    static int setupOccluder(const Occluder& occluder, const glm::mat4& viewProjection, Triangle* out) {
+        glm::mat4 toClip = viewProjection * occluder.model;
+        glm::vec3 corners[8];
+        for (int corner = 0; corner < 8; ++corner) {
+            if (!projectCorner(toClip, occluder.bounds, corner, corners[corner])) {
+                return 0;
+            }
+        }
+
+        // A mirroring model matrix turns the faces inside out
+        bool mirrored = glm::determinant(glm::mat3(occluder.model)) < 0.0f;
+        int count = 0;
+        for (const auto& face : BOX_FACES) {
+            for (int half = 0; half < 2; ++half) {
+                glm::vec3 v[3] = { corners[face[0]], corners[face[half + 1]], corners[face[half + 2]] };
+                if (mirrored) {
+                    swap(v[1], v[2]);
+                }
+                float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+                if (area <= 0.0f) {
+                    continue;  // back-facing or edge-on
+                }
+
+                Triangle& triangle = out[count];
+                glm::vec2 low = glm::min(glm::min(glm::vec2(v[0]), glm::vec2(v[1])), glm::vec2(v[2]));
+                glm::vec2 high = glm::max(glm::max(glm::vec2(v[0]), glm::vec2(v[1])), glm::vec2(v[2]));
+                triangle.minX = max(0, (int)floor(max(low.x, -1.0f)));
+                triangle.minY = max(0, (int)floor(max(low.y, -1.0f)));
+                triangle.maxX = min(SOFTWARE_OCCLUSION_WIDTH - 1, (int)floor(min(high.x, (float)SOFTWARE_OCCLUSION_WIDTH)));
+                triangle.maxY = min(SOFTWARE_OCCLUSION_HEIGHT - 1, (int)floor(min(high.y, (float)SOFTWARE_OCCLUSION_HEIGHT)));
+                if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+                    continue;
+                }
+
+                // Edge k runs from v[k] to v[k + 1]; the barycentric weight of a vertex is
+                // the opposite edge's function over the area
+                for (int k = 0; k < 3; ++k) {
+                    const glm::vec3& from = v[k];
+                    const glm::vec3& to = v[(k + 1) % 3];
+                    triangle.edgeA[k] = from.y - to.y;
+                    triangle.edgeB[k] = to.x - from.x;
+                    triangle.edgeC[k] = -(triangle.edgeA[k] * from.x + triangle.edgeB[k] * from.y);
+                }
+
+                // Depth gradient from differences to the first vertex: depths crowd near 1,
+                // and weighting them directly cancels badly on thin triangles
+                float rise1 = v[1].z - v[0].z, rise2 = v[2].z - v[0].z;
+                triangle.depthA = (triangle.edgeA[2] * rise1 + triangle.edgeA[0] * rise2) / area;
+                triangle.depthB = (triangle.edgeB[2] * rise1 + triangle.edgeB[0] * rise2) / area;
+                triangle.depthC = v[0].z - triangle.depthA * v[0].x - triangle.depthB * v[0].y;
+                triangle.depthMin = min(min(v[0].z, v[1].z), v[2].z);
+                triangle.depthMax = max(max(v[0].z, v[1].z), v[2].z);
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // Keep the nearer depth for the pixels of row y in [x0, x1] that the triangle covers.
+    // Vector loops start at an aligned pixel; tiles are whole vectors wide, so the extra
+    // pixels stay in the tile and fail the edge tests.
+    static void rasterizeRow(const Triangle& triangle, float* row, int y, int x0, int x1) {
+        float py = y + 0.5f;
+        float rowEdge[3];
+        for (int k = 0; k < 3; ++k) {
+            rowEdge[k] = triangle.edgeB[k] * py + triangle.edgeC[k];
+        }
+        float rowDepth = triangle.depthB * py + triangle.depthC;
+        int x = x0;
+#if defined(SIMD_AVX2)
+        x &= ~7;
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const __m256 edgeA[3] = { _mm256_set1_ps(triangle.edgeA[0]), _mm256_set1_ps(triangle.edgeA[1]), _mm256_set1_ps(triangle.edgeA[2]) };
+        const __m256 edgeRow[3] = { _mm256_set1_ps(rowEdge[0]), _mm256_set1_ps(rowEdge[1]), _mm256_set1_ps(rowEdge[2]) };
+        const __m256 depthA = _mm256_set1_ps(triangle.depthA), depthRow = _mm256_set1_ps(rowDepth);
+        const __m256 depthMin = _mm256_set1_ps(triangle.depthMin), depthMax = _mm256_set1_ps(triangle.depthMax);
+        for (; x <= x1; x += 8) {
+            __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+            __m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(edgeA[0], px), edgeRow[0]), zero, _CMP_GE_OQ);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(edgeA[1], px), edgeRow[1]), zero, _CMP_GE_OQ));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(edgeA[2], px), edgeRow[2]), zero, _CMP_GE_OQ));
+            __m256 z = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(depthA, px), depthRow), depthMin), depthMax);
+            __m256 old = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+        }
+#elif defined(SIMD_SSE2)
+        x &= ~3;
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 edgeA[3] = { _mm_set1_ps(triangle.edgeA[0]), _mm_set1_ps(triangle.edgeA[1]), _mm_set1_ps(triangle.edgeA[2]) };
+        const __m128 edgeRow[3] = { _mm_set1_ps(rowEdge[0]), _mm_set1_ps(rowEdge[1]), _mm_set1_ps(rowEdge[2]) };
+        const __m128 depthA = _mm_set1_ps(triangle.depthA), depthRow = _mm_set1_ps(rowDepth);
+        const __m128 depthMin = _mm_set1_ps(triangle.depthMin), depthMax = _mm_set1_ps(triangle.depthMax);
+        for (; x <= x1; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], px), edgeRow[0]), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], px), edgeRow[1]), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], px), edgeRow[2]), zero));
+            __m128 z = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(depthA, px), depthRow), depthMin), depthMax);
+            __m128 old = _mm_loadu_ps(row + x);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, z)), _mm_andnot_ps(inside, old)));
+        }
+#endif
+        for (; x <= x1; ++x) {
+            float px = x + 0.5f;
+            if (triangle.edgeA[0] * px + rowEdge[0] >= 0.0f && triangle.edgeA[1] * px + rowEdge[1] >= 0.0f &&
+                triangle.edgeA[2] * px + rowEdge[2] >= 0.0f) {
+                row[x] = min(row[x], min(max(triangle.depthA * px + rowDepth, triangle.depthMin), triangle.depthMax));
+            }
+        }
+    }
+
+    // Clear one tile, draw its binned triangles and record its farthest depth
+    void rasterizeTile(int tile) {
+        int tileX = (tile % TILES_X) * SOFTWARE_OCCLUSION_TILE_SIZE;
+        int tileY = (tile / TILES_X) * SOFTWARE_OCCLUSION_TILE_SIZE;
+        int lastX = tileX + SOFTWARE_OCCLUSION_TILE_SIZE - 1, lastY = tileY + SOFTWARE_OCCLUSION_TILE_SIZE - 1;
+        for (int y = tileY; y <= lastY; ++y) {
+            fill_n(&depth[(size_t)y * SOFTWARE_OCCLUSION_WIDTH + tileX], SOFTWARE_OCCLUSION_TILE_SIZE, 1.0f);
+        }
+        for (uint32_t index : bins[tile]) {
+            const Triangle& triangle = triangles[index];
+            int x0 = max(triangle.minX, tileX), x1 = min(triangle.maxX, lastX);
+            for (int y = max(triangle.minY, tileY); y <= min(triangle.maxY, lastY); ++y) {
+                rasterizeRow(triangle, &depth[(size_t)y * SOFTWARE_OCCLUSION_WIDTH], y, x0, x1);
+            }
+        }
+        float farthest = 0.0f;
+        for (int y = tileY; y <= lastY; ++y) {
+            const float* row = &depth[(size_t)y * SOFTWARE_OCCLUSION_WIDTH];
+            farthest = max(farthest, *max_element(row + tileX, row + lastX + 1));
+        }
+        tileMaxDepth[tile] = farthest;
+    }
+
+    // Whether any pixel of row[x0..x1] is at or behind the given depth
+    static bool rowReaches(const float* row, int x0, int x1, float nearest) {
+        int x = x0;
+#if defined(SIMD_AVX2)
+        const __m256 limit = _mm256_set1_ps(nearest);
+        for (; x + 7 <= x1; x += 8) {
+            if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + x), limit, _CMP_GE_OQ)) != 0) {
+                return true;
+            }
+        }
+#elif defined(SIMD_SSE2)
+        const __m128 limit = _mm_set1_ps(nearest);
+        for (; x + 3 <= x1; x += 4) {
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), limit)) != 0) {
+                return true;
+            }
+        }
+#endif
+        for (; x <= x1; ++x) {
+            if (row[x] >= nearest) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    SoftwareOcclusion() : depth((size_t)SOFTWARE_OCCLUSION_WIDTH * SOFTWARE_OCCLUSION_HEIGHT, 1.0f), bins(TILES_X * TILES_Y) {
+        fill_n(tileMaxDepth, TILES_X * TILES_Y, 1.0f);
+    }
+
+    // Draw the occluders as seen through viewProjection, replacing the previous contents
+    void render(const vector<Occluder>& occluders, const glm::mat4& currentViewProjection) {
+        JobSystem& jobs = JobSystem::instance();
+        viewProjection = currentViewProjection;
+        triangles.resize(occluders.size() * TRIANGLES_PER_OCCLUDER);
+        occluderTriangleCounts.resize(occluders.size());
+        jobs.parallelFor(occluders.size(), 64, [this, &occluders](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) {
+                occluderTriangleCounts[i] = setupOccluder(occluders[i], viewProjection, &triangles[i * TRIANGLES_PER_OCCLUDER]);
+            }
+        });
+
+        // Bin in occluder order; a triangle lands in every tile its bounds overlap
+        for (auto& bin : bins) {
+            bin.clear();
+        }
+        triangleCount = 0;
+        for (size_t i = 0; i < occluders.size(); ++i) {
+            for (int k = 0; k < occluderTriangleCounts[i]; ++k) {
+                uint32_t index = (uint32_t)(i * TRIANGLES_PER_OCCLUDER + k);
+                const Triangle& triangle = triangles[index];
+                for (int tileY = triangle.minY / SOFTWARE_OCCLUSION_TILE_SIZE; tileY <= triangle.maxY / SOFTWARE_OCCLUSION_TILE_SIZE; ++tileY) {
+                    for (int tileX = triangle.minX / SOFTWARE_OCCLUSION_TILE_SIZE; tileX <= triangle.maxX / SOFTWARE_OCCLUSION_TILE_SIZE; ++tileX) {
+                        bins[tileY * TILES_X + tileX].push_back(index);
+                    }
+                }
+                ++triangleCount;
+            }
+        }
+
+        jobs.parallelFor(TILES_X * TILES_Y, 1, [this](size_t begin, size_t end, unsigned) {
+            for (size_t tile = begin; tile < end; ++tile) {
+                rasterizeTile((int)tile);
+            }
+        });
+    }
+
+    // Whether a box is certainly hidden behind the occluders (safe to call from several
+    // threads after render())
+    bool isOccluded(const AABB& box) const {
+        glm::vec2 low(numeric_limits<float>::max()), high(-numeric_limits<float>::max());
+        float nearest = 1.0f;
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 window;
+            if (!projectCorner(viewProjection, box, corner, window)) {
+                return false;
+            }
+            low = glm::min(low, glm::vec2(window));
+            high = glm::max(high, glm::vec2(window));
+            nearest = min(nearest, window.z);
+        }
+
+        // Pixels the box touches, grown by one
+        int x0 = max(0, (int)floor(max(low.x, -2.0f)) - 1);
+        int y0 = max(0, (int)floor(max(low.y, -2.0f)) - 1);
+        int x1 = min(SOFTWARE_OCCLUSION_WIDTH - 1, (int)floor(min(high.x, (float)SOFTWARE_OCCLUSION_WIDTH)) + 1);
+        int y1 = min(SOFTWARE_OCCLUSION_HEIGHT - 1, (int)floor(min(high.y, (float)SOFTWARE_OCCLUSION_HEIGHT)) + 1);
+        if (x0 > x1 || y0 > y1) {
+            return false;
+        }
+
+        // Whole tiles nearer than the box are skipped without reading their pixels
+        for (int tileY = y0 / SOFTWARE_OCCLUSION_TILE_SIZE; tileY <= y1 / SOFTWARE_OCCLUSION_TILE_SIZE; ++tileY) {
+            for (int tileX = x0 / SOFTWARE_OCCLUSION_TILE_SIZE; tileX <= x1 / SOFTWARE_OCCLUSION_TILE_SIZE; ++tileX) {
+                if (nearest > tileMaxDepth[tileY * TILES_X + tileX]) {
+                    continue;
+                }
+                int firstX = max(x0, tileX * SOFTWARE_OCCLUSION_TILE_SIZE);
+                int lastX = min(x1, (tileX + 1) * SOFTWARE_OCCLUSION_TILE_SIZE - 1);
+                for (int y = max(y0, tileY * SOFTWARE_OCCLUSION_TILE_SIZE); y <= min(y1, (tileY + 1) * SOFTWARE_OCCLUSION_TILE_SIZE - 1); ++y) {
+                    if (rowReaches(&depth[(size_t)y * SOFTWARE_OCCLUSION_WIDTH], firstX, lastX, nearest)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    const vector<float>& getDepth() const { return depth; }
+    size_t getTriangleCount() const { return triangleCount; }  // front-facing, on screen, last render
+};
+
+// ************** ENHANCEMENT: Scene Class **************
+// Scene management class
+class Scene {
+private:
+    // Store shapes and lights using smart pointers
+    vector<shared_ptr<Shape>> shapes;
+    vector<shared_ptr<Light>> lights;
+    
+    // Shader programs with reflected uniforms
+    ShaderProgram shaderProgram;
+    ShaderProgram lightShaderProgram;
+
+    // Uniform handles resolved once after linking
+    ShapeUniforms shapeUniforms;
+    ShapeUniforms lampUniforms;
+
+    // Camera and lighting state shared by every draw, uploaded once per frame
+    StreamingBuffer frameUniformBuffer;
+
+    // Point lights and their per-cluster lists, rebuilt and streamed every frame
+    StreamingBuffer pointLightBuffer;
+    StreamingBuffer lightClusterBuffer;
+    LightClusterGrid lightClusters;
+    vector<PointLight> pointLights;
+    bool clusteredLightingEnabled = true;
+    ClusterStatistics clusterStatistics;
+
+    // Per-object colors and UV scales referenced by material index
+    MaterialTable materials;
+
+    // Instanced path: shapes grouped by geometry and texture, one draw per batch
+    ShaderProgram instancedShaderProgram;
+    vector<unique_ptr<MeshInstanceBatch>> batches;
+    vector<size_t> shapeBatchIndices;  // level 0 batch of each entry in shapes; finer levels follow it
+    bool batchesDirty = true;
+    bool instancingEnabled = true;
+
+    // Frustum culling: world bounds per shape, indexed by a BVH rebuilt when shapes are added
+    BoundingVolumeHierarchy shapeHierarchy;
+    vector<AABB> shapeBounds;
+    vector<uint32_t> visibleShapes;
+    vector<uint32_t> visibleLights;
+    bool hierarchyDirty = true;
+    bool cullingEnabled = true;
+    CullingStatistics cullingStatistics;
+
+    // Levels of detail are picked per visible shape after culling (level 0 when disabled)
+    bool lodEnabled = true;
+
+    // Multi-draw-indirect path: all meshes in one arena, one multi-draw per texture
+    ShaderProgram multiDrawShaderProgram;
+    MeshArena meshArena;
+    IndirectDrawList indirectDraws;
+    vector<uint32_t> multiDrawOrder;
+    bool arenaDirty = true;
+    bool multiDrawEnabled = false;
+
+    // Every draw of the frame goes through one state-sorted queue
+    RenderQueue renderQueue;
+    RenderStatistics renderStatistics;
+
+    // Optional depth prepass: visible shapes are drawn depth-only first, then shaded with
+    // GL_EQUAL so each pixel runs the lighting shader once. Without it the opaque pass is
+    // ordered front to back instead. Shaded fragments are counted either way.
+    ShaderProgram depthShaderProgram;
+    ShaderProgram depthInstancedShaderProgram;
+    ShaderProgram depthMultiDrawShaderProgram;
+    ShapeUniforms depthUniforms;
+    vector<pair<float, uint32_t>> visibleDepthOrder;
+    bool depthPrepassEnabled = false;
+    FragmentCounter shadedFragments;
+
+    // Deferred path: the shape vertex shaders write the G-buffer through a geometry-only
+    // fragment shader, then one full-screen triangle lights it into the target framebuffer
+    ShaderProgram deferredShaderProgram;
+    ShaderProgram deferredInstancedShaderProgram;
+    ShaderProgram deferredMultiDrawShaderProgram;
+    ShaderProgram lightingShaderProgram;
+    ShapeUniforms deferredShapeUniforms;
+    ShapeUniforms lightingUniforms;
+    Uniform<glm::mat4> inverseViewProjectionUniform;
+    GBuffer gBuffer;
+    MeshHandle fullscreenTriangle;
+    GLint targetFramebuffer = 0;  // framebuffer bound when the frame started
+    glm::mat4 inverseViewProjection;
+    bool deferredEnabled = false;
+
+    // Cached shadow maps, rendered by a position-only program from level 0 meshes so
+    // level-of-detail switches never invalidate them
+    ShaderProgram shadowShaderProgram;
+    ShapeUniforms shadowShapeUniforms;
+    Uniform<glm::mat4> shadowViewProjectionUniform;
+    Uniform<glm::vec4> shadowLightUniform;
+    StreamingBuffer shadowUniformBuffer;
+    ShadowCache shadows;
+    vector<AABB> changedChunkBounds;  // old and new bounds of the shapes each chunk moved
+    glm::vec3 sceneLightPositions[2];  // filler and key light of the current frame
+    int sceneLightCount = 0;
+    bool shadowCastersReset = true;  // shapes were added or regenerated: render every map
+    bool shadowsEnabled = true;
+    ShadowStatistics shadowStatistics;
+
+    // Occlusion culling of the frustum survivors against the previous frame's depth
+    ShaderProgram hiZShaderProgram;
+    OcclusionCuller occlusion;
+    bool occlusionEnabled = false;
+
+    // Occlusion culling against the occluder shapes, rasterized on the CPU in this frame's view
+    SoftwareOcclusion softwareOcclusion;
+    vector<SoftwareOcclusion::Occluder> occluders;
+    bool softwareOcclusionEnabled = false;
+
+    // Per-frame CPU work runs in chunks on the job system; the render thread only
+    // uploads the recorded data and replays the queue
+    static const size_t SHAPE_CHUNK_SIZE = 1024;
+    static const size_t PARALLEL_HIERARCHY_MINIMUM = 4096;  // below this the whole BVH is one job
+    vector<uint8_t> shapeVisibility;  // 1 when the shape passed culling this frame
+    vector<size_t> chunkVisibleCounts;
+    vector<vector<int32_t>> cullStacks;  // BVH traversal stack per worker
+    vector<size_t> workerBoxTests;
+
+    // GL-side work that must precede the parallel phases: regroup batches and rebuild the
+    // arena after a shape regenerated its geometry (a regenerated mesh is a new mesh)
+    void prepareResources() {
+        for (auto& shape : shapes) {
+            if (shape->consumeGeometryChanged()) {
+                batchesDirty = true;
+                arenaDirty = true;
+                shadowCastersReset = true;
+            }
+        }
+        if (multiDrawEnabled) {
+            if (arenaDirty) {
+                vector<MeshHandle> sceneMeshes;
+                for (auto& shape : shapes) {
+                    for (int level = 0; level < shape->getLodCount(); ++level) {
+                        sceneMeshes.push_back(shape->getLodMesh(level));
+                    }
+                }
+                meshArena.build(sceneMeshes);
+                indirectDraws.attach(meshArena);
+                arenaDirty = false;
+            }
+        } else if (instancingEnabled && batchesDirty) {
+            rebuildBatches();
+        }
+    }
+
+    // Collect the shapes and lights inside the view frustum for this frame
+    void cullScene(const glm::mat4& viewProjection) {
+        auto start = chrono::steady_clock::now();
+        JobSystem& jobs = JobSystem::instance();
+        size_t shapeCount = shapes.size();
+
+        // Rebuild the model matrices of edited transforms, then refresh the world bounds of
+        // the shapes that moved (all of them before a rebuild); each chunk reports whether
+        // it changed anything, and where, for the shadow cache
+        TransformStore::instance().update();
+        if (hierarchyDirty) {
+            shapeBounds.resize(shapeCount);
+            shadowCastersReset = true;
+        }
+        changedChunkBounds.assign((shapeCount + SHAPE_CHUNK_SIZE - 1) / SHAPE_CHUNK_SIZE, AABB());
+        atomic<bool> moved{ false };
+        jobs.parallelFor(shapeCount, SHAPE_CHUNK_SIZE, [this, &moved](size_t begin, size_t end, unsigned) {
+            bool chunkMoved = false;
+            AABB& changed = changedChunkBounds[begin / SHAPE_CHUNK_SIZE];
+            for (size_t i = begin; i < end; ++i) {
+                if (shapes[i]->consumeBoundsChanged() || hierarchyDirty) {
+                    if (!hierarchyDirty) {
+                        changed.expand(shapeBounds[i]);
+                    }
+                    shapeBounds[i] = shapes[i]->getWorldBounds();
+                    changed.expand(shapeBounds[i]);
+                    chunkMoved = true;
+                }
+            }
+            if (chunkMoved) {
+                moved = true;
+            }
+        });
+
+        // Rebuild after structural changes (serially), otherwise split the hierarchy into
+        // subtrees that are refit and culled in parallel
+        unsigned int threadCount = jobs.getThreadCount();
+        bool rebuilt = hierarchyDirty;
+        if (hierarchyDirty) {
+            shapeHierarchy.build(shapeBounds);
+            hierarchyDirty = false;
+        }
+        shapeHierarchy.partition(shapeCount >= PARALLEL_HIERARCHY_MINIMUM ? threadCount * 4 : 1);
+        if (moved && !rebuilt) {
+            shapeHierarchy.setObjectBounds(shapeBounds);
+            jobs.parallelFor(shapeHierarchy.getSubtreeCount(), 1, [this](size_t begin, size_t end, unsigned) {
+                for (size_t i = begin; i < end; ++i) {
+                    shapeHierarchy.refitSubtree(i);
+                }
+            });
+            shapeHierarchy.refitUpper();
+        }
+
+        // Each subtree flags its visible shapes
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        shapeVisibility.assign(shapeCount, cullingEnabled ? 0 : 1);
+        size_t boxTests = 0;
+        if (cullingEnabled) {
+            cullStacks.resize(threadCount);
+            workerBoxTests.assign(threadCount, 0);
+            jobs.parallelFor(shapeHierarchy.getSubtreeCount(), 1, [this, &frustum](size_t begin, size_t end, unsigned worker) {
+                for (size_t i = begin; i < end; ++i) {
+                    workerBoxTests[worker] += shapeHierarchy.cullSubtree(i, frustum, cullStacks[worker], shapeVisibility.data());
+                }
+            });
+            for (size_t tests : workerBoxTests) {
+                boxTests += tests;
+            }
+        }
+
+        // Drop the survivors hidden behind the previous frame's depth, reprojected into this view
+        size_t occluded = 0;
+        if (cullingEnabled && occlusionEnabled && occlusion.isReady()) {
+            atomic<size_t> hidden{ 0 };
+            jobs.parallelFor(shapeCount, SHAPE_CHUNK_SIZE, [this, &hidden](size_t begin, size_t end, unsigned) {
+                size_t count = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    if (shapeVisibility[i] && occlusion.isOccluded(shapeBounds[i])) {
+                        shapeVisibility[i] = 0;
+                        ++count;
+                    }
+                }
+                hidden += count;
+            });
+            occluded = hidden;
+        }
+
+        // Then against this frame's visible occluders
+        size_t softwareOccluded = 0;
+        size_t occluderTriangles = 0;
+        if (cullingEnabled && softwareOcclusionEnabled) {
+            ProfileScope scope("SoftwareOcclusion");
+            occluders.clear();
+            for (size_t i = 0; i < shapeCount; ++i) {
+                if (shapeVisibility[i] && shapes[i]->isOccluder()) {
+                    occluders.push_back({ shapes[i]->getLocalBounds(), shapes[i]->getModelMatrix() });
+                }
+            }
+            softwareOcclusion.render(occluders, viewProjection);
+            occluderTriangles = softwareOcclusion.getTriangleCount();
+
+            atomic<size_t> hidden{ 0 };
+            jobs.parallelFor(shapeCount, SHAPE_CHUNK_SIZE, [this, &hidden](size_t begin, size_t end, unsigned) {
+                size_t count = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    if (shapeVisibility[i] && softwareOcclusion.isOccluded(shapeBounds[i])) {
+                        shapeVisibility[i] = 0;
+                        ++count;
+                    }
+                }
+                hidden += count;
+            });
+            softwareOccluded = hidden;
+        }
+
+        // Compact the flags in index order (count per chunk, prefix sum, scatter), which
+        // keeps insertion order so culling never changes how overlapping shapes resolve
+        size_t chunkCount = (shapeCount + SHAPE_CHUNK_SIZE - 1) / SHAPE_CHUNK_SIZE;
+        chunkVisibleCounts.assign(chunkCount + 1, 0);
+        jobs.parallelFor(shapeCount, SHAPE_CHUNK_SIZE, [this](size_t begin, size_t end, unsigned) {
+            size_t count = 0;
+            for (size_t i = begin; i < end; ++i) {
+                count += shapeVisibility[i];
+            }
+            chunkVisibleCounts[begin / SHAPE_CHUNK_SIZE + 1] = count;
+        });
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            chunkVisibleCounts[chunk + 1] += chunkVisibleCounts[chunk];
+        }
+        visibleShapes.resize(chunkVisibleCounts[chunkCount]);
+        jobs.parallelFor(shapeCount, SHAPE_CHUNK_SIZE, [this](size_t begin, size_t end, unsigned) {
+            size_t next = chunkVisibleCounts[begin / SHAPE_CHUNK_SIZE];
+            for (size_t i = begin; i < end; ++i) {
+                if (shapeVisibility[i]) {
+                    visibleShapes[next++] = (uint32_t)i;
+                }
+            }
+        });
+
+        // Lamps are few and move every frame, so they are tested directly
+        visibleLights.clear();
+        for (size_t i = 0; i < lights.size(); ++i) {
+            if (!cullingEnabled || frustum.intersects(lights[i]->getWorldBounds())) {
+                visibleLights.push_back((uint32_t)i);
+            }
+        }
+
+        cullingStatistics.visibleShapes = visibleShapes.size();
+        cullingStatistics.culledShapes = shapes.size() - visibleShapes.size();
+        cullingStatistics.occludedShapes = occluded;
+        cullingStatistics.softwareOccludedShapes = softwareOccluded;
+        cullingStatistics.occluderTriangles = occluderTriangles;
+        cullingStatistics.visibleLights = visibleLights.size();
+        cullingStatistics.culledLights = lights.size() - visibleLights.size();
+        cullingStatistics.boxTests = boxTests + (cullingEnabled ? lights.size() : 0);
+        cullingStatistics.cullMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Assign the point lights to the clusters of the current viewport and stream the grid
+    void buildLightClusters(const glm::mat4& view, const glm::mat4& projection, int width, int height) {
+        lightClusters.build(pointLights, view, projection, width, height, clusteredLightingEnabled, clusterStatistics);
+
+        unsigned char* lightData = static_cast<unsigned char*>(pointLightBuffer.beginWrite());
+        memcpy(lightData, &lightClusters.getHeader(), sizeof(PointLightHeader));
+        memcpy(lightData + sizeof(PointLightHeader), pointLights.data(), pointLights.size() * sizeof(PointLight));
+        pointLightBuffer.bindRange(POINT_LIGHT_STORAGE_BINDING);
+
+        const vector<uint32_t>& clusterData = lightClusters.getData();
+        memcpy(lightClusterBuffer.beginWrite(), clusterData.data(), clusterData.size() * sizeof(uint32_t));
+        lightClusterBuffer.bindRange(LIGHT_CLUSTER_STORAGE_BINDING);
+    }
+
+    // Aim the cached maps at this frame's lights and view, render the ones that went stale,
+    // then bind the shadow block and maps for the lighting shaders. Cube slot 0 is the
+    // filler light and slots 1-3 the first point lights, as the GLSL lighting expects.
+    void updateShadows(const glm::mat4& view, const glm::mat4& projection, const GLint viewport[4]) {
+        auto start = chrono::steady_clock::now();
+        shadowStatistics = ShadowStatistics();
+
+        if (shadowsEnabled) {
+            // The key light shines from its position toward the origin
+            bool hasKey = sceneLightCount > 1 && glm::length(sceneLightPositions[1]) > 0.0f;
+            shadows.setCascades(view, projection, hasKey ? -glm::normalize(sceneLightPositions[1]) : glm::vec3(0.0f, -1.0f, 0.0f), hasKey);
+            shadows.setCubeLight(0, sceneLightPositions[0], sceneLightCount > 0 ? FILLER_SHADOW_RANGE : 0.0f);
+            for (int slot = 1; slot < MAX_SHADOW_CUBES; ++slot) {
+                if ((size_t)slot <= pointLights.size()) {
+                    shadows.setCubeLight(slot, glm::vec3(pointLights[slot - 1].position), pointLights[slot - 1].position.w);
+                } else {
+                    shadows.setCubeLight(slot, glm::vec3(0.0f), 0.0f);
+                }
+            }
+
+            // Shapes added or regenerated stale every map; moved shapes only the maps they touch
+            if (shadowCastersReset) {
+                shadows.invalidateAll();
+                shadowCastersReset = false;
+            } else {
+                for (const AABB& changed : changedChunkBounds) {
+                    if (changed.min.x <= changed.max.x) {
+                        shadows.invalidate(changed);
+                    }
+                }
+            }
+
+            // Casters are drawn one by one at level 0; only stale maps get here
+            shadowShaderProgram.use();
+            shadows.render([this](const glm::mat4& viewProjection, const glm::vec4& light) {
+                shadowViewProjectionUniform.set(viewProjection);
+                shadowLightUniform.set(light);
+                Frustum frustum = Frustum::fromMatrix(viewProjection);
+                size_t draws = 0;
+                for (size_t i = 0; i < shapes.size(); ++i) {
+                    if (!frustum.intersects(shapeBounds[i])) {
+                        continue;
+                    }
+                    const GpuMesh& mesh = *shapes[i]->getLodMesh(0);
+                    glBindVertexArray(mesh.vao);
+                    shadowShapeUniforms.model.set(shapes[i]->getModelMatrix());
+                    if (mesh.indexCount > 0) {
+                        glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, 0);
+                    } else {
+                        glDrawArrays(GL_TRIANGLES, 0, mesh.vertexCount);
+                    }
+                    ++draws;
+                }
+                return draws;
+            }, shadowStatistics);
+            glBindVertexArray(0);
+
+            // Back to the frame's own target
+            glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        }
+
+        ShadowUniforms* uniforms = static_cast<ShadowUniforms*>(shadowUniformBuffer.beginWrite());
+        shadows.fillUniforms(*uniforms, shadowsEnabled);
+        shadowUniformBuffer.bindRange(SHADOW_UNIFORMS_BINDING);
+        shadows.bindTextures();
+        shadowStatistics.updateMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Choose each visible shape's level of detail from the projected size of its bounds,
+    // and count the triangles the frame draws
+    void selectLevelsOfDetail(const glm::mat4& viewProjection, float projectionScaleY) {
+        atomic<size_t> triangles{ 0 };
+        JobSystem::instance().parallelFor(visibleShapes.size(), SHAPE_CHUNK_SIZE,
+            [this, &viewProjection, projectionScaleY, &triangles](size_t begin, size_t end, unsigned) {
+                size_t chunkTriangles = 0;
+                for (size_t k = begin; k < end; ++k) {
+                    uint32_t i = visibleShapes[k];
+                    Shape& shape = *shapes[i];
+                    if (!lodEnabled) {
+                        shape.setLod(0);
+                    } else if (shape.getLodCount() > 1) {
+                        const AABB& bounds = shapeBounds[i];
+                        shape.updateLod(getProjectedScreenSize(viewProjection, projectionScaleY, bounds.getCenter(),
+                                                               glm::length(bounds.getExtents())));
+                    }
+                    chunkTriangles += shape.getIndicesCount() / 3;
+                }
+                triangles += chunkTriangles;
+            });
+        cullingStatistics.visibleTriangles = triangles;
+    }
+
+    // Group shapes into batches keyed by geometry and texture, one batch per level of detail
+    void rebuildBatches() {
+        batches.clear();
+        shapeBatchIndices.clear();
+
+        unordered_map<string, size_t> batchByKey;
+        for (auto& shape : shapes) {
+            shape->consumeGeometryChanged();
+            string key = shape->getGeometryKey() + "|" + to_string(shape->getTextureId());
+            auto it = batchByKey.find(key);
+            if (it == batchByKey.end()) {
+                it = batchByKey.emplace(key, batches.size()).first;
+                for (int level = 0; level < shape->getLodCount(); ++level) {
+                    batches.push_back(make_unique<MeshInstanceBatch>(shape, shape->getLodMesh(level)));
+                }
+            }
+            shapeBatchIndices.push_back(it->second);
+        }
+        batchesDirty = false;
+    }
+
+    // Queue one draw per visible shape; queue slots are filled in parallel chunks
+    // (the prepass twins take the first half of the slots)
+    void recordPerObject(const glm::mat4& view) {
+        size_t count = visibleShapes.size();
+        size_t first = renderQueue.allocate(depthPrepassEnabled ? count * 2 : count);
+        size_t colorFirst = depthPrepassEnabled ? first + count : first;
+        const ShaderProgram* program = deferredEnabled ? &deferredShaderProgram : &shaderProgram;
+        const ShapeUniforms* uniforms = deferredEnabled ? &deferredShapeUniforms : &shapeUniforms;
+        JobSystem::instance().parallelFor(count, SHAPE_CHUNK_SIZE,
+            [this, &view, first, colorFirst, program, uniforms](size_t begin, size_t end, unsigned) {
+                for (size_t k = begin; k < end; ++k) {
+                    uint32_t i = visibleShapes[k];
+                    const Shape& shape = *shapes[i];
+                    DrawItem item = { program, uniforms, shape.getVAO(), shape.getTextureId(),
+                                      shape.getMesh().get(), shape.getMesh()->indexType, 0, 0, 0,
+                                      shape.getModelMatrix(), shape.getNormalMatrix(), shape.getMaterialIndex() };
+                    float depth = getViewDepth(view, shapeBounds[i]);
+                    if (depthPrepassEnabled) {
+                        renderQueue.set(first + k, RENDER_PASS_DEPTH, makeDepthItem(item, &depthShaderProgram, &depthUniforms), depth);
+                    }
+                    renderQueue.set(colorFirst + k, RENDER_PASS_OPAQUE, item, depth);
+                }
+            });
+    }
+
+    // Depth-only twin of a shape draw for the prepass: same geometry, no texture
+    static DrawItem makeDepthItem(DrawItem item, const ShaderProgram* program, const ShapeUniforms* uniforms) {
+        item.program = program;
+        item.uniforms = uniforms;
+        item.texture = 0;
+        return item;
+    }
+
+    // Visible shapes sorted nearest first, for the paths whose order is fixed before the
+    // queue sorts (instances within a batch, commands within a multi-draw)
+    void sortVisibleFrontToBack(const glm::mat4& view) {
+        visibleDepthOrder.resize(visibleShapes.size());
+        JobSystem::instance().parallelFor(visibleShapes.size(), SHAPE_CHUNK_SIZE, [this, &view](size_t begin, size_t end, unsigned) {
+            for (size_t k = begin; k < end; ++k) {
+                visibleDepthOrder[k] = { getViewDepth(view, shapeBounds[visibleShapes[k]]), visibleShapes[k] };
+            }
+        });
+        sort(visibleDepthOrder.begin(), visibleDepthOrder.end());
+    }
+
+    // Queue every visible shape through the batch of its level, one glDrawElementsInstanced
+    // per batch (the instance data is uploaded by replayCommands)
+    void recordInstanced(const glm::mat4& view) {
+        for (auto& batch : batches) {
+            batch->clear();
+        }
+        auto addInstance = [this](uint32_t i) {
+            batches[shapeBatchIndices[i] + shapes[i]->getLod()]->addInstance(shapes[i]->getModelMatrix(), shapes[i]->getNormalMatrix(), shapes[i]->getMaterialIndex());
+        };
+        if (depthPrepassEnabled) {
+            for (uint32_t i : visibleShapes) {
+                addInstance(i);
+            }
+        } else {
+            sortVisibleFrontToBack(view);
+            for (const auto& entry : visibleDepthOrder) {
+                addInstance(entry.second);
+            }
+        }
+
+        // Every prepass draw is queued ahead of the shaded ones
+        for (RenderPass pass : { RENDER_PASS_DEPTH, RENDER_PASS_OPAQUE }) {
+            if (pass == RENDER_PASS_DEPTH && !depthPrepassEnabled) {
+                continue;
+            }
+            for (auto& batch : batches) {
+                if (batch->getInstanceCount() == 0) {
+                    continue;
+                }
+                DrawItem item = { deferredEnabled ? &deferredInstancedShaderProgram : &instancedShaderProgram, nullptr,
+                                  batch->getVAO(), batch->getTextureId(),
+                                  &batch->getMesh(), batch->getMesh().indexType,
+                                  (GLsizei)batch->getInstanceCount(), 0, 0,
+                                  glm::mat4(1.0f), glm::mat3(1.0f), 0 };
+                if (pass == RENDER_PASS_DEPTH) {
+                    item = makeDepthItem(item, &depthInstancedShaderProgram, nullptr);
+                }
+                renderQueue.submit(pass, item, getViewDepth(view, batch->getPrototype().getWorldBounds()));
+            }
+        }
+    }
+
+    // Queue the visible shapes as one glMultiDrawElementsIndirect per texture
+    // (the commands are uploaded by replayCommands)
+    void recordMultiDraw(const glm::mat4& view) {
+        // Group commands by texture so each group is one contiguous multi-draw (front to
+        // back within a group when there is no prepass)
+        if (depthPrepassEnabled) {
+            multiDrawOrder.assign(visibleShapes.begin(), visibleShapes.end());
+        } else {
+            sortVisibleFrontToBack(view);
+            multiDrawOrder.resize(visibleDepthOrder.size());
+            for (size_t k = 0; k < visibleDepthOrder.size(); ++k) {
+                multiDrawOrder[k] = visibleDepthOrder[k].second;
+            }
+        }
+        stable_sort(multiDrawOrder.begin(), multiDrawOrder.end(), [this](uint32_t a, uint32_t b) {
+            return shapes[a]->getTextureId() < shapes[b]->getTextureId();
+        });
+
+        indirectDraws.resize(multiDrawOrder.size());
+        JobSystem::instance().parallelFor(multiDrawOrder.size(), SHAPE_CHUNK_SIZE, [this](size_t begin, size_t end, unsigned) {
+            for (size_t k = begin; k < end; ++k) {
+                uint32_t i = multiDrawOrder[k];
+                const Shape& shape = *shapes[i];
+                indirectDraws.set(k, meshArena.getRange(shape.getMesh().get()), shape.getModelMatrix(), shape.getNormalMatrix(), shape.getMaterialIndex());
+            }
+        });
+        if (indirectDraws.size() == 0) {
+            return;
+        }
+
+        // The prepass draws every command in one multi-draw ahead of the shaded groups
+        if (depthPrepassEnabled) {
+            DrawItem item = { &depthMultiDrawShaderProgram, nullptr, indirectDraws.getVAO(), 0,
+                              nullptr, indirectDraws.getIndexType(), 0, (GLsizei)multiDrawOrder.size(), 0,
+                              glm::mat4(1.0f), glm::mat3(1.0f), 0 };
+            renderQueue.submit(RENDER_PASS_DEPTH, item, 0.0f);
+        }
+
+        size_t groupStart = 0;
+        for (size_t i = 1; i <= multiDrawOrder.size(); ++i) {
+            GLuint texture = shapes[multiDrawOrder[groupStart]]->getTextureId();
+            if (i < multiDrawOrder.size() && shapes[multiDrawOrder[i]]->getTextureId() == texture) {
+                continue;
+            }
+            DrawItem item = { deferredEnabled ? &deferredMultiDrawShaderProgram : &multiDrawShaderProgram, nullptr,
+                              indirectDraws.getVAO(), texture,
+                              nullptr, indirectDraws.getIndexType(), 0, (GLsizei)(i - groupStart), groupStart,
+                              glm::mat4(1.0f), glm::mat3(1.0f), 0 };
+            renderQueue.submit(RENDER_PASS_OPAQUE, item, 0.0f);
+            groupStart = i;
+        }
+    }
+
+    // Build the frame's command list: the depth prepass when enabled, visible shapes,
+    // either batched by shared geometry, multi-drawn or one draw per shape, the lighting
+    // pass in deferred mode, then the visible lamps
+    void recordCommands(const glm::mat4& view) {
+        renderQueue.clear();
+        renderQueue.setFrontToBack(!depthPrepassEnabled);
+        if (multiDrawEnabled) {
+            recordMultiDraw(view);
+        } else if (instancingEnabled) {
+            recordInstanced(view);
+        } else {
+            recordPerObject(view);
+        }
+
+        if (deferredEnabled) {
+            DrawItem item = { &lightingShaderProgram, &lightingUniforms, fullscreenTriangle->vao, 0,
+                              fullscreenTriangle.get(), fullscreenTriangle->indexType, 0, 0, 0,
+                              glm::mat4(1.0f), glm::mat3(1.0f), -1 };
+            renderQueue.submit(RENDER_PASS_LIGHTING, item, 0.0f);
+        }
+
+        for (uint32_t i : visibleLights) {
+            const Light& light = *lights[i];
+            DrawItem item = { &lightShaderProgram, &lampUniforms, light.getVAO(), 0,
+                              light.getMesh().get(), light.getMesh()->indexType, 0, 0, 0,
+                              light.getModelMatrix(), glm::mat3(1.0f), -1 };
+            renderQueue.submit(RENDER_PASS_LAMPS, item, getViewDepth(view, light.getWorldBounds()));
+        }
+    }
+
+    // Upload what the recorded commands read, then sort and draw with redundant binds skipped
+    void replayCommands() {
+        if (multiDrawEnabled) {
+            if (indirectDraws.size() > 0) {
+                indirectDraws.upload();
+            }
+        } else if (instancingEnabled) {
+            for (auto& batch : batches) {
+                batch->upload();
+            }
+        }
+
+        // In deferred mode opaque shapes fill the G-buffer; the lighting pass then writes
+        // color and copies the G-buffer depth into the target so the lamps are still depth
+        // tested. After a prepass the opaque pass only shades the depth it laid down.
+        if (deferredEnabled) {
+            gBuffer.bind();
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+        renderQueue.execute(renderStatistics, [this](RenderPass pass) {
+            if (pass != RENDER_PASS_OPAQUE) {
+                shadedFragments.end();
+            }
+            if (pass == RENDER_PASS_DEPTH) {
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            } else if (pass == RENDER_PASS_OPAQUE) {
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                if (depthPrepassEnabled) {
+                    glDepthFunc(GL_EQUAL);
+                    glDepthMask(GL_FALSE);
+                }
+                shadedFragments.begin();
+            } else if (pass == RENDER_PASS_LIGHTING) {
+                glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+                gBuffer.bindTextures();
+                lightingShaderProgram.use();
+                inverseViewProjectionUniform.set(inverseViewProjection);
+                glDepthMask(GL_TRUE);
+                glDepthFunc(GL_ALWAYS);
+            } else {
+                glDepthMask(GL_TRUE);
+                glDepthFunc(GL_LESS);
+            }
+        });
+        shadedFragments.endFrame();
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        if (deferredEnabled) {
+            glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+        }
+    }
+
+    // Distance of a bounds center in front of the camera
+    static float getViewDepth(const glm::mat4& view, const AABB& bounds) {
+        return -(view * glm::vec4(bounds.getCenter(), 1.0f)).z;
+    }
+    
+public:
+    Scene() {}
+    
+    // Initialize the scene and create shaders
+    bool initialize(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource, 
+                   const GLchar* lightVertexShaderSource, const GLchar* lightFragmentShaderSource,
+                   const GLchar* instancedVertexShaderSource, const GLchar* multiDrawVertexShaderSource,
+                   const GLchar* deferredFragmentShaderSource, const GLchar* lightingVertexShaderSource,
+                   const GLchar* lightingFragmentShaderSource, const GLchar* shadowVertexShaderSource,
+                   const GLchar* shadowFragmentShaderSource, const GLchar* depthFragmentShaderSource,
+                   const GLchar* hiZVertexShaderSource, const GLchar* hiZFragmentShaderSource) {
+        // Create shader programs
+        if (!createShaderProgram(vertexShaderSource, fragmentShaderSource, shaderProgram)) {
+            cerr << "Failed to create shader program for shapes" << endl;
+            return false;
+        }
+        
+        if (!createShaderProgram(lightVertexShaderSource, lightFragmentShaderSource, lightShaderProgram)) {
+            cerr << "Failed to create shader program for lights" << endl;
+            return false;
+        }
+        
+        // Instanced shapes share the shape fragment shader
+        if (!createShaderProgram(instancedVertexShaderSource, fragmentShaderSource, instancedShaderProgram)) {
+            cerr << "Failed to create instanced shader program for shapes" << endl;
+            return false;
+        }
+        
+        // Multi-draw shapes read their per-object data from a storage buffer
+        if (!createShaderProgram(multiDrawVertexShaderSource, fragmentShaderSource, multiDrawShaderProgram)) {
+            cerr << "Failed to create multi-draw shader program for shapes" << endl;
+            return false;
+        }
+        
+        // Deferred geometry programs pair each shape vertex shader with the G-buffer output
+        if (!createShaderProgram(vertexShaderSource, deferredFragmentShaderSource, deferredShaderProgram)
+            || !createShaderProgram(instancedVertexShaderSource, deferredFragmentShaderSource, deferredInstancedShaderProgram)
+            || !createShaderProgram(multiDrawVertexShaderSource, deferredFragmentShaderSource, deferredMultiDrawShaderProgram)) {
+            cerr << "Failed to create deferred shader programs for shapes" << endl;
+            return false;
+        }
+        if (!createShaderProgram(lightingVertexShaderSource, lightingFragmentShaderSource, lightingShaderProgram)) {
+            cerr << "Failed to create deferred lighting shader program" << endl;
+            return false;
+        }
+        if (!createShaderProgram(shadowVertexShaderSource, shadowFragmentShaderSource, shadowShaderProgram)) {
+            cerr << "Failed to create shadow map shader program" << endl;
+            return false;
+        }
+
+        // Depth prepass programs: single draws use the position-only lamp vertex shader
+        if (!createShaderProgram(lightVertexShaderSource, depthFragmentShaderSource, depthShaderProgram)
+            || !createShaderProgram(instancedVertexShaderSource, depthFragmentShaderSource, depthInstancedShaderProgram)
+            || !createShaderProgram(multiDrawVertexShaderSource, depthFragmentShaderSource, depthMultiDrawShaderProgram)) {
+            cerr << "Failed to create depth prepass shader programs" << endl;
+            return false;
+        }
+        if (!createShaderProgram(hiZVertexShaderSource, hiZFragmentShaderSource, hiZShaderProgram)) {
+            cerr << "Failed to create Hi-Z shader program" << endl;
+            return false;
+        }
+        
+        // Resolve uniform handles once so rendering never looks uniforms up by name
+        shapeUniforms.resolve(shaderProgram);
+        lampUniforms.resolve(lightShaderProgram);
+        deferredShapeUniforms.resolve(deferredShaderProgram);
+        lightingUniforms.resolve(lightingShaderProgram);
+        inverseViewProjectionUniform = lightingShaderProgram.getUniform<glm::mat4>("inverseViewProjection");
+        shadowShapeUniforms.resolve(shadowShaderProgram);
+        depthUniforms.resolve(depthShaderProgram);
+        shadowViewProjectionUniform = shadowShaderProgram.getUniform<glm::mat4>("shadowViewProjection");
+        shadowLightUniform = shadowShaderProgram.getUniform<glm::vec4>("shadowLight");
+        
+        // Create the triple-buffered frame block and the material table
+        if (!frameUniformBuffer.create(GL_UNIFORM_BUFFER, sizeof(FrameUniforms))) {
+            cerr << "Failed to create frame uniform buffer" << endl;
+            return false;
+        }
+        if (!pointLightBuffer.create(GL_SHADER_STORAGE_BUFFER, sizeof(PointLightHeader) + MAX_POINT_LIGHTS * sizeof(PointLight))
+            || !lightClusterBuffer.create(GL_SHADER_STORAGE_BUFFER, CLUSTER_BUFFER_ENTRIES * sizeof(uint32_t))) {
+            cerr << "Failed to create light cluster buffers" << endl;
+            return false;
+        }
+        if (!shadowUniformBuffer.create(GL_UNIFORM_BUFFER, sizeof(ShadowUniforms)) || !shadows.create()) {
+            cerr << "Failed to create shadow maps" << endl;
+            return false;
+        }
+        materials.create();
+        shadedFragments.create();
+        occlusion.create();
+        
+        // Set texture unit for fragment shader
+        shaderProgram.use();
+        shaderProgram.getUniform<int>("uTexture").set(0);
+        instancedShaderProgram.use();
+        instancedShaderProgram.getUniform<int>("uTexture").set(0);
+        multiDrawShaderProgram.use();
+        multiDrawShaderProgram.getUniform<int>("uTexture").set(0);
+        for (ShaderProgram* program : { &deferredShaderProgram, &deferredInstancedShaderProgram, &deferredMultiDrawShaderProgram }) {
+            program->use();
+            program->getUniform<int>("uTexture").set(0);
+        }
+        lightingShaderProgram.use();
+        lightingShaderProgram.getUniform<int>("gBufferAlbedo").set(GBUFFER_TEXTURE_UNIT);
+        lightingShaderProgram.getUniform<int>("gBufferNormal").set(GBUFFER_TEXTURE_UNIT + 1);
+        lightingShaderProgram.getUniform<int>("gBufferDepth").set(GBUFFER_TEXTURE_UNIT + 2);
+
+        // Every lighting program samples the cascades and the cube maps
+        for (ShaderProgram* program : { &shaderProgram, &instancedShaderProgram, &multiDrawShaderProgram, &lightingShaderProgram }) {
+            program->use();
+            program->getUniform<int>("cascadeShadowMap").set(SHADOW_TEXTURE_UNIT);
+            program->getUniform<int>("cubeShadowMaps").set(SHADOW_TEXTURE_UNIT + 1);
+        }
+        hiZShaderProgram.use();
+        hiZShaderProgram.getUniform<int>("sourceDepth").set(HIZ_TEXTURE_UNIT);
+
+        // The lighting pass draws one triangle that covers the whole viewport
+        const vector<float> triangle = {
+            -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+             3.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 2.0f, 0.0f,
+            -1.0f,  3.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 2.0f
+        };
+        fullscreenTriangle = make_shared<GpuMesh>(triangle, vector<unsigned int>());
+        
+        return true;
+    }
+    
+    // Add shapes and lights to the scene
+    void addShape(shared_ptr<Shape> shape) {
+        shape->setMaterialIndex(materials.acquire(shape->getColor(), shape->getUVScale()));
+        shapes.push_back(shape);
+        batchesDirty = true;
+        hierarchyDirty = true;
+        arenaDirty = true;
+    }
+    
+    void addLight(shared_ptr<Light> light) {
+        lights.push_back(light);
+    }
+
+    // Remove every shape and light (benchmarks rebuild the scene between configurations)
+    void clear() {
+        shapes.clear();
+        lights.clear();
+        materials.clear();
+        batchesDirty = true;
+        hierarchyDirty = true;
+        arenaDirty = true;
+        shadowCastersReset = true;
+        occlusion.reset();
+    }
+    
+    // Render the scene
+    void render(const glm::mat4& view, const glm::mat4& projection) {
+        // Swap in any textures that finished decoding since the last frame
+        {
+            ProfileScope scope("TextureUpload", true);
+            TextureManager::instance().update();
+        }
+
+        // Enable depth testing
+        glEnable(GL_DEPTH_TEST);
+        
+        // Clear the color and depth buffers
+        {
+            ProfileScope scope("Clear", true);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        
+        // Get camera position from camera object
+        const glm::vec3 cameraPosition = gCamera.Position;
+
+        // Light clusters and the G-buffer follow the viewport size
+        GLint viewport[4] = { 0, 0, 1, 1 };
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        
+        // Only proceed if we have at least one light
+        if (!lights.empty()) {
+            {
+                ProfileScope scope("FrameSetup");
+
+                // Write camera and light state into this frame's region of the uniform ring
+                // (beginWrite waits for the GPU if it still reads this region)
+                FrameUniforms* frame = static_cast<FrameUniforms*>(frameUniformBuffer.beginWrite());
+                frame->view = view;
+                frame->projection = projection;
+                frame->viewPosition = glm::vec4(cameraPosition, 1.0f);
+            
+                // Scene-wide lights fill the frame block (light 0 is the filler light and light 1
+                // the key light; unused slots stay black), lights with a range become point lights
+                int lightCount = 0;
+                pointLights.clear();
+                sceneLightCount = 0;
+                for (auto& light : lights) {
+                    if (light->getRange() > 0.0f) {
+                        if (pointLights.size() < (size_t)MAX_POINT_LIGHTS) {
+                            pointLights.push_back({ glm::vec4(light->getPosition(), light->getRange()),
+                                                    glm::vec4(light->getLightColor(), light->getIntensity()) });
+                        }
+                    } else if (lightCount < MAX_FRAME_LIGHTS) {
+                        if (lightCount < 2) {
+                            sceneLightPositions[sceneLightCount++] = light->getPosition();
+                        }
+                        frame->lights[lightCount].position = glm::vec4(light->getPosition(), 1.0f);
+                        frame->lights[lightCount].color = glm::vec4(light->getLightColor(), light->getIntensity());
+                        ++lightCount;
+                    }
+                }
+                for (int i = lightCount; i < MAX_FRAME_LIGHTS; ++i) {
+                    frame->lights[i].position = glm::vec4(0.0f);
+                    frame->lights[i].color = glm::vec4(0.0f);
+                }
+                frame->lightCount = lightCount;
+                frame->flipTextureV = TextureManager::instance().isFlipOnLoad() ? 0 : 1;
+                frameUniformBuffer.bindRange(FRAME_UNIFORMS_BINDING);
+            
+                // Re-resolve materials for shapes whose color or UV scale changed, then upload once
+                for (auto& shape : shapes) {
+                    if (shape->getMaterialIndex() < 0) {
+                        shape->setMaterialIndex(materials.acquire(shape->getColor(), shape->getUVScale()));
+                    }
+                }
+                materials.upload();
+                prepareResources();
+
+                // Deferred mode falls back to forward if the G-buffer cannot be created
+                glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFramebuffer);
+                if (deferredEnabled) {
+                    inverseViewProjection = glm::inverse(projection * view);
+                    deferredEnabled = gBuffer.resize(viewport[2], viewport[3]);
+                    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+                }
+            }
+
+            // Bring the previous frame's depth into this view for occlusion culling
+            if (occlusionEnabled && cullingEnabled) {
+                ProfileScope scope("OcclusionSetup");
+                if (hierarchyDirty) {
+                    occlusion.reset();
+                }
+                occlusion.prepare(projection * view);
+            }
+
+            // Submit only what the camera can see
+            {
+                ProfileScope scope("Culling");
+                cullScene(projection * view);
+            }
+
+            // Draw distant shapes at coarser levels of detail
+            {
+                ProfileScope scope("LodSelection");
+                selectLevelsOfDetail(projection * view, projection[1][1]);
+            }
+
+            // List the point lights touching each cluster of the view frustum
+            {
+                ProfileScope scope("ClusterBuild");
+                buildLightClusters(view, projection, viewport[2], viewport[3]);
+            }
+
+            // Render the shadow maps whose light, cascade or casters changed
+            {
+                ProfileScope scope("ShadowUpdate", true);
+                updateShadows(view, projection, viewport);
+            }
+            
+            // Record the frame's command list on the job system
+            {
+                ProfileScope scope("QueueBuild");
+                recordCommands(view);
+            }
+
+            // Upload instance and command data, then replay the sorted queue
+            {
+                ProfileScope scope("Submit");
+                replayCommands();
+            }
+
+            // Reduce this frame's depth for the next frame's occlusion tests
+            if (occlusionEnabled && cullingEnabled) {
+                ProfileScope scope("HiZBuild", true);
+                occlusion.capture(projection * view, glm::ivec4(viewport[0], viewport[1], viewport[2], viewport[3]),
+                                  hiZShaderProgram, targetFramebuffer);
+            }
+            
+            // Fence the region so it is not rewritten while the GPU still reads it
+            // (a fence flushes the frame, which software rasterizers execute right here)
+            {
+                ProfileScope scope("FrameFence");
+                frameUniformBuffer.endFrame();
+                pointLightBuffer.endFrame();
+                lightClusterBuffer.endFrame();
+                shadowUniformBuffer.endFrame();
+            }
+        }
+    }
+    
+    // Create a shader program and reflect its uniforms
+    bool createShaderProgram(const char* vertexShaderSource, const char* fragmentShaderSource, ShaderProgram& program) {
+        // Error reporting variables
+        int success = 0;
+        char infoLog[512];
+
+        // Create shader program object
+        GLuint programId = glCreateProgram();
+
+        // Create vertex and fragment shader objects
+        GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+        GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+        // On failure release every object created here (deleting the program detaches its shaders)
+        auto fail = [&]() {
+            glDeleteShader(vertexShaderId);
+            glDeleteShader(fragmentShaderId);
+            glDeleteProgram(programId);
+            return false;
+        };
+
+        // Set shader source code
+        glShaderSource(vertexShaderId, 1, &vertexShaderSource, NULL);
+        glShaderSource(fragmentShaderId, 1, &fragmentShaderSource, NULL);
+
+        // Compile the vertex shader
+        glCompileShader(vertexShaderId);
+
+        // Check for vertex shader compilation errors
+        glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
+            cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
+            return fail();
+        }
+
+        // Compile the fragment shader
+        glCompileShader(fragmentShaderId);
+
+        // Check for fragment shader compilation errors
+        glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
+            cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
+            return fail();
+        }
+
+        // Shaders compiled, attach to shader program object
+        glAttachShader(programId, vertexShaderId);
+        glAttachShader(programId, fragmentShaderId);
+
+        // Link the program object
+        glLinkProgram(programId);
+
+        // Check for linking errors
+        glGetProgramiv(programId, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+            cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
+            return fail();
+        }
+
+        // Detach and delete shader objects after linking
+        glDetachShader(programId, vertexShaderId);
+        glDetachShader(programId, fragmentShaderId);
+        glDeleteShader(vertexShaderId);
+        glDeleteShader(fragmentShaderId);
+
+        // Hand the linked program over for uniform reflection
+        program.adopt(programId);
+
+        return true;
+    }
+    
+    // Access lights for modifying properties
+    Light* getLight(int index) {
+        if (index >= 0 && index < lights.size()) {
+            return lights[index].get();
+        }
+        return nullptr;
+    }
+    
+    int getLightCount() const { return lights.size(); }
+
+    // Access shapes for modifying properties
+    Shape* getShape(int index) {
+        if (index >= 0 && static_cast<size_t>(index) < shapes.size()) {
+            return shapes[index].get();
+        }
+        return nullptr;
+    }
+
+    int getShapeCount() const { return shapes.size(); }
+
+    // CPU half of a frame without drawing: update, cull and record (used by --bench-jobs)
+    void prepareFrame(const glm::mat4& view, const glm::mat4& projection) {
+        prepareResources();
+        cullScene(projection * view);
+        selectLevelsOfDetail(projection * view, projection[1][1]);
+        recordCommands(view);
+    }
+
+    // Toggle between instanced batches and per-shape draw calls
+    void setInstancingEnabled(bool enabled) { instancingEnabled = enabled; }
+    bool isInstancingEnabled() const { return instancingEnabled; }
+    size_t getBatchCount() const { return batches.size(); }
+
+    // Toggle frustum culling; statistics describe the most recent frame
+    void setCullingEnabled(bool enabled) { cullingEnabled = enabled; }
+    bool isCullingEnabled() const { return cullingEnabled; }
+
+    // Toggle occlusion culling (applies only while frustum culling is on)
+    void setOcclusionCullingEnabled(bool enabled) {
+        if (enabled != occlusionEnabled) {
+            occlusion.reset();
+        }
+        occlusionEnabled = enabled;
+    }
+    bool isOcclusionCullingEnabled() const { return occlusionEnabled; }
+
+    // Cull against the shapes marked as occluders (see Shape::setOccluder; applies only
+    // while frustum culling is on)
+    void setSoftwareOcclusionEnabled(bool enabled) { softwareOcclusionEnabled = enabled; }
+    bool isSoftwareOcclusionEnabled() const { return softwareOcclusionEnabled; }
+    const CullingStatistics& getCullingStatistics() const { return cullingStatistics; }
+
+    // Toggle clustered point lights (off lists every point light in one cluster, so each
+    // fragment shades them all); statistics describe the most recent frame
+    void setClusteredLightingEnabled(bool enabled) { clusteredLightingEnabled = enabled; }
+    bool isClusteredLightingEnabled() const { return clusteredLightingEnabled; }
+    const ClusterStatistics& getClusterStatistics() const { return clusterStatistics; }
+
+    // Toggle deferred shading (G-buffer plus one lighting pass) against forward shading
+    void setDeferredEnabled(bool enabled) { deferredEnabled = enabled; }
+    bool isDeferredEnabled() const { return deferredEnabled; }
+    size_t getGBufferBytes() const { return gBuffer.getBytes(); }
+
+    // Toggle the depth prepass (off orders the opaque pass front to back instead). The
+    // shaded fragment count covers the opaque pass of a frame a few frames back.
+    void setDepthPrepassEnabled(bool enabled) { depthPrepassEnabled = enabled; }
+    bool isDepthPrepassEnabled() const { return depthPrepassEnabled; }
+    GLuint64 getShadedFragments() const { return shadedFragments.getLastCount(); }
+    bool isCountingFragmentInvocations() const { return shadedFragments.isCountingInvocations(); }
+
+    // Toggle shadows, and their caching (off renders every map every frame); statistics
+    // describe the most recent frame
+    void setShadowsEnabled(bool enabled) { shadowsEnabled = enabled; }
+    bool isShadowsEnabled() const { return shadowsEnabled; }
+    void setShadowCachingEnabled(bool enabled) { shadows.setCachingEnabled(enabled); }
+    const ShadowStatistics& getShadowStatistics() const { return shadowStatistics; }
+
+    // Toggle level-of-detail selection (off draws every shape at full tessellation)
+    void setLodEnabled(bool enabled) { lodEnabled = enabled; }
+    bool isLodEnabled() const { return lodEnabled; }
+
+    // Toggle GPU-driven submission (takes precedence over instancing when enabled)
+    void setMultiDrawEnabled(bool enabled) { multiDrawEnabled = enabled; }
+    bool isMultiDrawEnabled() const { return multiDrawEnabled; }
+
+    // Toggle state sorting of the render queue; statistics describe the most recent frame
+    void setStateSortingEnabled(bool enabled) { renderQueue.setSortingEnabled(enabled); }
+    const RenderStatistics& getRenderStatistics() const { return renderStatistics; }
+};
+
+// Parameters of the synthetic scene built on top of the default scene
+struct SceneConfig {
+    int cubeCount = 0;     // extra cubes laid out in a square grid
+    int lightCount = 2;    // total lights, including the filler and key lights
+    float lightRange = 3.0f;  // range of the extra point lights
+    int textureCount = 2;  // distinct generated textures shared round-robin by the cubes
+    int textureSize = 64;  // width and height of each generated texture
+    bool textureFiles = false;        // write the textures as TGA files and load them like images
+    bool compressedTextures = false;  // load those files as cooked BC1 mip chains (implies textureFiles)
+    int subdivisions = 1;  // quads per cube face edge; raise for a vertex-bound scene
+    string shapeType = "cube";  // grid shape: cube, sphere, cylinder, cone, torus, plane, mixed or mesh
+    string meshPath;       // mesh file drawn by the "mesh" shape type
+    int segments = 64;     // level 0 tessellation of the round primitives and planes
+    VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT;
+};
+
+// Options for --headless runs
+struct HeadlessOptions {
+    SceneConfig scene;
+    int frameCount = 300;
+    int width = 1280;
+    int height = 720;
+    string mode = "instanced";  // per-object, instanced or multi-draw
+    bool culling = true;
+    bool lod = true;
+    bool clusteredLighting = true;
+    bool deferred = false;  // G-buffer plus one lighting pass instead of forward shading
+    bool shadows = true;
+    bool shadowCaching = true;  // off renders every shadow map every frame
+    bool depthPrepass = false;
+    bool occlusion = false;  // Hi-Z occlusion culling on top of frustum culling
+    bool softwareOcclusion = false;  // cull against the grid cubes rasterized on the CPU
+    bool staticCamera = false;  // keep the default camera instead of flying the orbit path
+    string outputPath = "frames.csv";  // .json writes JSON, anything else CSV
+    string capturePath;  // optional PPM of the last frame
+};
+
+// Function prototypes
+bool Initialize(int, char* [], GLFWwindow** window);
+void ResizeWindow(GLFWwindow* window, int width, int height);
+void ProcessInput(GLFWwindow* window);
+void MousePositionCallback(GLFWwindow* window, double xpos, double ypos);
+void MouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void BuildScene(Scene& scene);
+struct SceneConfig;
+void BuildScene(Scene& scene, const SceneConfig& config);
+struct HeadlessOptions;
+bool ParseHeadlessOptions(int argc, char* argv[], HeadlessOptions& options);
+int RunHeadlessBenchmark(const HeadlessOptions& options);
+void RunGeometryBenchmark(int cubeCount);
+void RunFlipBenchmark();
+void RunCullingBenchmark(int cubeCount);
+void RunRenderQueueBenchmark(int cubeCount);
+void RunSubmissionBenchmark(int cubeCount);
+void RunJobBenchmark(int cubeCount);
+void RunTransformBenchmark(int transformCount);
+bool RunVertexFormatTest(int vertexCount);
+bool RunLodTest();
+bool RunSoftwareOcclusionTest(int sceneCount);
+void RunMeshLoadBenchmark(int triangleCount);
+void RunIndexOrderBenchmark();
+void RunDeferredBenchmark(int frameCount);
+bool RunOcclusionBenchmark(int frameCount);
+
+// Shader source code
+// Vertex shader source code for shape rendering
+const GLchar* vertex_shader_source = GLSL(440,
+    layout(location = 0) in vec3 position;
+    layout(location = 1) in vec3 normal;
+    layout(location = 2) in vec2 textureCoordinate;
+
+    out vec3 vertexNormal;
+    out vec3 vertexFragmentPos;
+    out vec2 vertexTextureCoordinate;
+    flat out int vertexMaterialIndex;
+
+    // Per-frame block shared with the fragment and lamp shaders (see FrameUniforms)
+    struct FrameLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std140, binding = 0) uniform FrameUniforms {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPosition;
+        FrameLight lights[8];
+        int lightCount;
+        int flipTextureV;
+    };
+
+    // The normal matrix (inverse transpose of the model matrix) is computed once per
+    // object on the CPU, see TransformStore
+    uniform mat4 model;
+    uniform mat3 normalMatrix;
+    uniform int materialIndex;
+
+    // Positions must match bit for bit across programs for the GL_EQUAL depth test after
+    // the depth prepass
+    invariant gl_Position;
+
+    void main()
+    {
+        gl_Position = projection * view * model * vec4(position, 1.0f);
+        vertexFragmentPos = vec3(model * vec4(position, 1.0f));
+        vertexNormal = normalMatrix * normal;
+        vertexTextureCoordinate = textureCoordinate;
+        vertexMaterialIndex = materialIndex;
+    }
+);
+
+// Vertex shader source code for instanced shape rendering (model, normal matrix and material per instance)
+const GLchar* instanced_vertex_shader_source = GLSL(440,
+    layout(location = 0) in vec3 position;
+    layout(location = 1) in vec3 normal;
+    layout(location = 2) in vec2 textureCoordinate;
+    layout(location = 3) in mat4 instanceModel;
+    layout(location = 7) in int instanceMaterialIndex;
+    layout(location = 8) in mat3 instanceNormalMatrix;
+
+    out vec3 vertexNormal;
+    out vec3 vertexFragmentPos;
+    out vec2 vertexTextureCoordinate;
+    flat out int vertexMaterialIndex;
+
+    struct FrameLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std140, binding = 0) uniform FrameUniforms {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPosition;
+        FrameLight lights[8];
+        int lightCount;
+        int flipTextureV;
+    };
+
+    // Positions must match bit for bit across programs for the GL_EQUAL depth test after
+    // the depth prepass
+    invariant gl_Position;
+
+    void main()
+    {
+        gl_Position = projection * view * instanceModel * vec4(position, 1.0f);
+        vertexFragmentPos = vec3(instanceModel * vec4(position, 1.0f));
+        vertexNormal = instanceNormalMatrix * normal;
+        vertexTextureCoordinate = textureCoordinate;
+        vertexMaterialIndex = instanceMaterialIndex;
+    }
+);
+
+// Vertex shader for multi-draw-indirect shapes: per-object data from a storage buffer
+const GLchar* multi_draw_vertex_shader_source = GLSL(440,
+    layout(location = 0) in vec3 position;
+    layout(location = 1) in vec3 normal;
+    layout(location = 2) in vec2 textureCoordinate;
+    layout(location = 3) in uint drawIndex;
+
+    out vec3 vertexNormal;
+    out vec3 vertexFragmentPos;
+    out vec2 vertexTextureCoordinate;
+    flat out int vertexMaterialIndex;
+
+    struct FrameLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std140, binding = 0) uniform FrameUniforms {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPosition;
+        FrameLight lights[8];
+        int lightCount;
+        int flipTextureV;
+    };
+
+    // Per-object data indexed by the draw index (see ObjectData)
+    struct ObjectData {
+        mat4 model;
+        mat3 normalMatrix;
+        int materialIndex;
+    };
+    layout(std430, binding = 2) readonly buffer ObjectBuffer {
+        ObjectData objects[];
+    };
+
+    // Positions must match bit for bit across programs for the GL_EQUAL depth test after
+    // the depth prepass
+    invariant gl_Position;
+
+    void main()
+    {
+        mat4 model = objects[drawIndex].model;
+        gl_Position = projection * view * model * vec4(position, 1.0f);
+        vertexFragmentPos = vec3(model * vec4(position, 1.0f));
+        vertexNormal = objects[drawIndex].normalMatrix * normal;
+        vertexTextureCoordinate = textureCoordinate;
+        vertexMaterialIndex = objects[drawIndex].materialIndex;
+    }
+);
+
+// Fragment shader source code for shape rendering
+const GLchar* fragment_shader_source = GLSL(440,
+    in vec3 vertexFragmentPos;
+    in vec3 vertexNormal;
+    in vec2 vertexTextureCoordinate;
+    flat in int vertexMaterialIndex;
+
+    out vec4 fragmentColor;
+
+    struct FrameLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std140, binding = 0) uniform FrameUniforms {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPosition;
+        FrameLight lights[8];
+        int lightCount;
+        int flipTextureV;
+    };
+
+    // Material table indexed per object (see Material)
+    struct Material {
+        vec4 color;
+        vec4 uvScale;
+    };
+    layout(std430, binding = 1) readonly buffer MaterialBuffer {
+        Material materials[];
+    };
+
+    // Point lights and the light lists of the cluster grid (see LightClusterGrid)
+    struct PointLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std430, binding = 3) readonly buffer PointLightBuffer {
+        ivec4 clusterGrid;
+        vec4 clusterTileSize;
+        vec4 clusterDepthSlicing;
+        PointLight pointLights[];
+    };
+    layout(std430, binding = 4) readonly buffer LightClusterBuffer {
+        uint clusterLights[];
+    };
+
+    // Cached shadow maps (see ShadowCache)
+    layout(std140, binding = 5) uniform ShadowUniforms {
+        mat4 cascadeMatrices[3];
+        vec4 cascadeSplits;
+        vec4 shadowCubes[4];
+        int shadowsEnabled;
+    };
+    uniform sampler2DArrayShadow cascadeShadowMap;
+    uniform samplerCubeArrayShadow cubeShadowMaps;
+
+    // Fraction of the key light reaching a point, from the cascade covering its view depth
+    float getCascadeShadow(vec3 position, vec3 normal, float viewDepth)
+    {
+        int cascade = 0;
+        while (cascade < int(cascadeSplits.w) && viewDepth > cascadeSplits[cascade]) {
+            ++cascade;
+        }
+        if (shadowsEnabled == 0 || cascade >= int(cascadeSplits.w)) {
+            return 1.0;
+        }
+        vec4 shadowPosition = cascadeMatrices[cascade] * vec4(position + normal * 0.02, 1.0);
+        vec3 coordinate = shadowPosition.xyz / shadowPosition.w * 0.5 + 0.5;
+        return texture(cascadeShadowMap, vec4(coordinate.xy, float(cascade), coordinate.z));
+    }
+
+    // Fraction of a cube-shadowed light reaching a point (slot 0 is the filler light)
+    float getCubeShadow(int slot, vec3 position, vec3 normal)
+    {
+        if (shadowsEnabled == 0 || shadowCubes[slot].w <= 0.0) {
+            return 1.0;
+        }
+        vec3 fromLight = position + normal * 0.02 - shadowCubes[slot].xyz;
+        return texture(cubeShadowMaps, vec4(fromLight, float(slot)), length(fromLight) / shadowCubes[slot].w - 0.002);
+    }
+
+    uniform sampler2D uTexture;
+
+    void main()
+    {
+        // Filler light is lights[0] and key light is lights[1]
+        vec3 lightColor = lights[0].color.rgb;
+        vec3 keyLightColor = lights[1].color.rgb;
+        vec3 lightPos = lights[0].position.xyz;
+        vec3 keyLightPos = lights[1].position.xyz;
+        vec2 uvScale = materials[vertexMaterialIndex].uvScale.xy;
+
+        // Calculate Ambient
+        float FillerStrength = 0.4f;
+        float keyStrength = 0.1f;
+        vec3 Filler = FillerStrength * lightColor;
+        vec3 key = keyStrength * keyLightColor;
+
+        // Calculate Diffuse lighting
+        vec3 norm = normalize(vertexNormal);
+        vec3 lightDirection = normalize(lightPos - vertexFragmentPos);
+        vec3 keyLightDirection = normalize(keyLightPos - vertexFragmentPos);
+
+        float impact = max(dot(norm, lightDirection), 0.0);
+        float keyImpact = max(dot(norm, keyLightDirection), 0.0);
+
+        vec3 diffuse = impact * lightColor;
+        vec3 keyDiffuse = keyImpact * keyLightColor;
+
+        // Calculate Specular lighting
+        float specularIntensity = 0.4f;
+        float highlightSize = 16.0f;
+        vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos);
+        vec3 reflectDir = reflect(-lightDirection, norm);
+
+        // Calculate specular component
+        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+        vec3 specular = specularIntensity * specularComponent * lightColor;
+        vec3 keySpecular = specularIntensity * specularComponent * keyLightColor;
+
+        // Point lights listed in this fragment's cluster, faded out smoothly at their range
+        float viewDepth = -(view * vec4(vertexFragmentPos, 1.0)).z;
+        float slice = clusterDepthSlicing.z != 0.0 ? log(max(viewDepth, 1.0e-4)) * clusterDepthSlicing.x + clusterDepthSlicing.y
+                                                   : viewDepth * clusterDepthSlicing.x + clusterDepthSlicing.y;
+        ivec3 cluster = clamp(ivec3(ivec2(gl_FragCoord.xy / clusterTileSize.xy), int(slice)), ivec3(0), clusterGrid.xyz - 1);
+        uint clusterIndex = uint((cluster.z * clusterGrid.y + cluster.y) * clusterGrid.x + cluster.x);
+        uint firstLight = clusterLights[2u * clusterIndex];
+        uint clusterLightCount = clusterLights[2u * clusterIndex + 1u];
+        vec3 pointLighting = vec3(0.0);
+        for (uint k = 0u; k < clusterLightCount; ++k) {
+            uint lightIndex = clusterLights[firstLight + k];
+            PointLight pointLight = pointLights[lightIndex];
+            vec3 toLight = pointLight.position.xyz - vertexFragmentPos;
+            float distance = length(toLight);
+            float window = clamp(1.0 - pow(distance / pointLight.position.w, 4.0), 0.0, 1.0);
+            float attenuation = window * window / (distance * distance + 1.0);
+            vec3 pointDirection = toLight / max(distance, 1.0e-4);
+            float pointImpact = max(dot(norm, pointDirection), 0.0);
+            float pointSpecular = pow(max(dot(viewDir, reflect(-pointDirection, norm)), 0.0), highlightSize);
+            float pointShadow = lightIndex < 3u ? getCubeShadow(int(lightIndex) + 1, vertexFragmentPos, norm) : 1.0;
+            pointLighting += pointShadow * attenuation * pointLight.color.w * pointLight.color.rgb * (pointImpact + specularIntensity * pointSpecular);
+        }
+
+        // Texture holds the color to be used for all three components.
+        // Unflipped images are sampled upside down instead, which is exact under GL_REPEAT.
+        vec2 textureCoordinate = vertexTextureCoordinate * uvScale;
+        if (flipTextureV != 0) {
+            textureCoordinate.y = 1.0 - textureCoordinate.y;
+        }
+        vec4 textureColor = texture(uTexture, textureCoordinate);
+
+        // Shadows of the filler light (cube slot 0) and the key light (cascades)
+        float fillerShadow = getCubeShadow(0, vertexFragmentPos, norm);
+        float keyShadow = getCascadeShadow(vertexFragmentPos, norm, viewDepth);
+
+        // Calculate Phong lighting result
+        vec3 phong = (Filler + key + fillerShadow * (diffuse + specular) + keyShadow * keyDiffuse + pointLighting) * textureColor.xyz;
+
+        fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+    }
+);
+
+// Fragment shader for the deferred geometry pass: albedo and an octahedral normal into the G-buffer
+const GLchar* deferred_geometry_fragment_shader_source = GLSL(440,
+    in vec3 vertexFragmentPos;
+    in vec3 vertexNormal;
+    in vec2 vertexTextureCoordinate;
+    flat in int vertexMaterialIndex;
+
+    layout(location = 0) out vec4 gBufferAlbedo;
+    layout(location = 1) out vec2 gBufferNormal;
+
+    struct FrameLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std140, binding = 0) uniform FrameUniforms {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPosition;
+        FrameLight lights[8];
+        int lightCount;
+        int flipTextureV;
+    };
+
+    struct Material {
+        vec4 color;
+        vec4 uvScale;
+    };
+    layout(std430, binding = 1) readonly buffer MaterialBuffer {
+        Material materials[];
+    };
+
+    uniform sampler2D uTexture;
+
+    void main()
+    {
+        vec2 textureCoordinate = vertexTextureCoordinate * materials[vertexMaterialIndex].uvScale.xy;
+        if (flipTextureV != 0) {
+            textureCoordinate.y = 1.0 - textureCoordinate.y;
+        }
+        gBufferAlbedo = vec4(texture(uTexture, textureCoordinate).rgb, 1.0);
+
+        // Project the unit normal onto the octahedron |x| + |y| + |z| = 1 and fold the
+        // lower half over the upper one, leaving two coordinates in [0, 1]
+        vec3 norm = normalize(vertexNormal);
+        norm /= abs(norm.x) + abs(norm.y) + abs(norm.z);
+        vec2 folded = norm.xy;
+        if (norm.z < 0.0) {
+            folded = (1.0 - abs(norm.yx)) * vec2(norm.x >= 0.0 ? 1.0 : -1.0, norm.y >= 0.0 ? 1.0 : -1.0);
+        }
+        gBufferNormal = folded * 0.5 + 0.5;
+    }
+);
+
+// Vertex shader for the deferred lighting pass (one triangle covering the viewport)
+const GLchar* deferred_lighting_vertex_shader_source = GLSL(440,
+    layout(location = 0) in vec3 position;
+
+    void main()
+    {
+        gl_Position = vec4(position.xy, 0.0, 1.0);
+    }
+);
+
+// Fragment shader for the deferred lighting pass: the shape lighting applied to the G-buffer
+const GLchar* deferred_lighting_fragment_shader_source = GLSL(440,
+    out vec4 fragmentColor;
+
+    struct FrameLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std140, binding = 0) uniform FrameUniforms {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPosition;
+        FrameLight lights[8];
+        int lightCount;
+        int flipTextureV;
+    };
+
+    struct PointLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std430, binding = 3) readonly buffer PointLightBuffer {
+        ivec4 clusterGrid;
+        vec4 clusterTileSize;
+        vec4 clusterDepthSlicing;
+        PointLight pointLights[];
+    };
+    layout(std430, binding = 4) readonly buffer LightClusterBuffer {
+        uint clusterLights[];
+    };
+
+    // Cached shadow maps (see ShadowCache)
+    layout(std140, binding = 5) uniform ShadowUniforms {
+        mat4 cascadeMatrices[3];
+        vec4 cascadeSplits;
+        vec4 shadowCubes[4];
+        int shadowsEnabled;
+    };
+    uniform sampler2DArrayShadow cascadeShadowMap;
+    uniform samplerCubeArrayShadow cubeShadowMaps;
+
+    // Fraction of the key light reaching a point, from the cascade covering its view depth
+    float getCascadeShadow(vec3 position, vec3 normal, float viewDepth)
+    {
+        int cascade = 0;
+        while (cascade < int(cascadeSplits.w) && viewDepth > cascadeSplits[cascade]) {
+            ++cascade;
+        }
+        if (shadowsEnabled == 0 || cascade >= int(cascadeSplits.w)) {
+            return 1.0;
+        }
+        vec4 shadowPosition = cascadeMatrices[cascade] * vec4(position + normal * 0.02, 1.0);
+        vec3 coordinate = shadowPosition.xyz / shadowPosition.w * 0.5 + 0.5;
+        return texture(cascadeShadowMap, vec4(coordinate.xy, float(cascade), coordinate.z));
+    }
+
+    // Fraction of a cube-shadowed light reaching a point (slot 0 is the filler light)
+    float getCubeShadow(int slot, vec3 position, vec3 normal)
+    {
+        if (shadowsEnabled == 0 || shadowCubes[slot].w <= 0.0) {
+            return 1.0;
+        }
+        vec3 fromLight = position + normal * 0.02 - shadowCubes[slot].xyz;
+        return texture(cubeShadowMaps, vec4(fromLight, float(slot)), length(fromLight) / shadowCubes[slot].w - 0.002);
+    }
+
+    uniform sampler2D gBufferAlbedo;
+    uniform sampler2D gBufferNormal;
+    uniform sampler2D gBufferDepth;
+    uniform mat4 inverseViewProjection;
+
+    void main()
+    {
+        // Pixels no shape covered keep the cleared background
+        ivec2 pixel = ivec2(gl_FragCoord.xy);
+        float depth = texelFetch(gBufferDepth, pixel, 0).r;
+        if (depth >= 1.0) {
+            discard;
+        }
+        gl_FragDepth = depth;
+
+        // World position from the window position and depth
+        vec3 ndc = vec3(gl_FragCoord.xy / vec2(textureSize(gBufferDepth, 0)), depth) * 2.0 - 1.0;
+        vec4 world = inverseViewProjection * vec4(ndc, 1.0);
+        vec3 fragmentPos = world.xyz / world.w;
+
+        // Unfold the octahedral normal
+        vec2 folded = texelFetch(gBufferNormal, pixel, 0).rg * 2.0 - 1.0;
+        vec3 norm = vec3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+        float fold = clamp(-norm.z, 0.0, 1.0);
+        norm.x += norm.x >= 0.0 ? -fold : fold;
+        norm.y += norm.y >= 0.0 ? -fold : fold;
+        norm = normalize(norm);
+
+        vec3 textureColor = texelFetch(gBufferAlbedo, pixel, 0).rgb;
+
+        // Filler light is lights[0] and key light is lights[1]
+        vec3 lightColor = lights[0].color.rgb;
+        vec3 keyLightColor = lights[1].color.rgb;
+        vec3 lightPos = lights[0].position.xyz;
+        vec3 keyLightPos = lights[1].position.xyz;
+
+        // Calculate Ambient
+        float FillerStrength = 0.4f;
+        float keyStrength = 0.1f;
+        vec3 Filler = FillerStrength * lightColor;
+        vec3 key = keyStrength * keyLightColor;
+
+        // Calculate Diffuse lighting
+        vec3 lightDirection = normalize(lightPos - fragmentPos);
+        vec3 keyLightDirection = normalize(keyLightPos - fragmentPos);
+
+        float impact = max(dot(norm, lightDirection), 0.0);
+        float keyImpact = max(dot(norm, keyLightDirection), 0.0);
+
+        vec3 diffuse = impact * lightColor;
+        vec3 keyDiffuse = keyImpact * keyLightColor;
+
+        // Calculate Specular lighting
+        float specularIntensity = 0.4f;
+        float highlightSize = 16.0f;
+        vec3 viewDir = normalize(viewPosition.xyz - fragmentPos);
+        vec3 reflectDir = reflect(-lightDirection, norm);
+
+        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+        vec3 specular = specularIntensity * specularComponent * lightColor;
+
+        // Point lights listed in this pixel's cluster, faded out smoothly at their range
+        float viewDepth = -(view * vec4(fragmentPos, 1.0)).z;
+        float slice = clusterDepthSlicing.z != 0.0 ? log(max(viewDepth, 1.0e-4)) * clusterDepthSlicing.x + clusterDepthSlicing.y
+                                                   : viewDepth * clusterDepthSlicing.x + clusterDepthSlicing.y;
+        ivec3 cluster = clamp(ivec3(ivec2(gl_FragCoord.xy / clusterTileSize.xy), int(slice)), ivec3(0), clusterGrid.xyz - 1);
+        uint clusterIndex = uint((cluster.z * clusterGrid.y + cluster.y) * clusterGrid.x + cluster.x);
+        uint firstLight = clusterLights[2u * clusterIndex];
+        uint clusterLightCount = clusterLights[2u * clusterIndex + 1u];
+        vec3 pointLighting = vec3(0.0);
+        for (uint k = 0u; k < clusterLightCount; ++k) {
+            uint lightIndex = clusterLights[firstLight + k];
+            PointLight pointLight = pointLights[lightIndex];
+            vec3 toLight = pointLight.position.xyz - fragmentPos;
+            float distance = length(toLight);
+            float window = clamp(1.0 - pow(distance / pointLight.position.w, 4.0), 0.0, 1.0);
+            float attenuation = window * window / (distance * distance + 1.0);
+            vec3 pointDirection = toLight / max(distance, 1.0e-4);
+            float pointImpact = max(dot(norm, pointDirection), 0.0);
+            float pointSpecular = pow(max(dot(viewDir, reflect(-pointDirection, norm)), 0.0), highlightSize);
+            float pointShadow = lightIndex < 3u ? getCubeShadow(int(lightIndex) + 1, fragmentPos, norm) : 1.0;
+            pointLighting += pointShadow * attenuation * pointLight.color.w * pointLight.color.rgb * (pointImpact + specularIntensity * pointSpecular);
+        }
+
+        float fillerShadow = getCubeShadow(0, fragmentPos, norm);
+        float keyShadow = getCascadeShadow(fragmentPos, norm, viewDepth);
+
+        vec3 phong = (Filler + key + fillerShadow * (diffuse + specular) + keyShadow * keyDiffuse + pointLighting) * textureColor;
+        fragmentColor = vec4(phong, 1.0);
+    }
+);
+
+// Shadow map shaders: casters in light space; cube faces store the distance to the light
+const GLchar* shadow_vertex_shader_source = GLSL(440,
+    layout(location = 0) in vec3 position;
+
+    out vec3 vertexFragmentPos;
+
+    uniform mat4 model;
+    uniform mat4 shadowViewProjection;
+
+    void main()
+    {
+        vec4 worldPosition = model * vec4(position, 1.0f);
+        vertexFragmentPos = worldPosition.xyz;
+        gl_Position = shadowViewProjection * worldPosition;
+    }
+);
+
+const GLchar* shadow_fragment_shader_source = GLSL(440,
+    in vec3 vertexFragmentPos;
+
+    // xyz light position and w range for cube faces, zero for cascades
+    uniform vec4 shadowLight;
+
+    void main()
+    {
+        gl_FragDepth = shadowLight.w > 0.0 ? length(vertexFragmentPos - shadowLight.xyz) / shadowLight.w : gl_FragCoord.z;
+    }
+);
+
+// Fragment shader for the depth prepass: depth only, paired with the lamp vertex shader
+// (positions only) for single draws and with the shape vertex shaders for batches
+const GLchar* depth_prepass_fragment_shader_source = GLSL(440,
+    void main()
+    {
+    }
+);
+
+// Hi-Z reduction shaders: one triangle covering the target, each texel keeping the
+// farthest depth of its 2x2 footprint in the source level
+const GLchar* hiz_vertex_shader_source = GLSL(440,
+    void main()
+    {
+        vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+    }
+);
+
+const GLchar* hiz_downsample_fragment_shader_source = GLSL(440,
+    layout(location = 0) out float farthestDepth;
+
+    uniform sampler2D sourceDepth;
+
+    void main()
+    {
+        ivec2 sourceSize = textureSize(sourceDepth, 0);
+        ivec2 texel = ivec2(gl_FragCoord.xy);
+        ivec2 first = texel * 2;
+        ivec2 last = first + 1;
+
+        // The last row and column also cover the odd texel left over by the halving
+        if (texel.x == sourceSize.x / 2 - 1) {
+            last.x = sourceSize.x - 1;
+        }
+        if (texel.y == sourceSize.y / 2 - 1) {
+            last.y = sourceSize.y - 1;
+        }
+
+        float depth = 0.0;
+        for (int y = first.y; y <= last.y; ++y) {
+            for (int x = first.x; x <= last.x; ++x) {
+                depth = max(depth, texelFetch(sourceDepth, ivec2(x, y), 0).r);
+            }
+        }
+        farthestDepth = depth;
+    }
+);
+
+// Light Shader Source Code
+const GLchar* lampVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position;
+
+    struct FrameLight {
+        vec4 position;
+        vec4 color;
+    };
+    layout(std140, binding = 0) uniform FrameUniforms {
+        mat4 view;
+        mat4 projection;
+        vec4 viewPosition;
+        FrameLight lights[8];
+        int lightCount;
+        int flipTextureV;
+    };
+
+    uniform mat4 model;
+
+    // Positions must match bit for bit across programs for the GL_EQUAL depth test after
+    // the depth prepass
+    invariant gl_Position;
+
+    void main()
+    {
+        gl_Position = projection * view * model * vec4(position, 1.0f);
+    }
+);
+
+// Light Fragment Shader Source Code
+const GLchar* lampFragmentShaderSource = GLSL(440,
+    out vec4 fragmentColor;
+
+    void main()
+    {
+        fragmentColor = vec4(1.0f);
+    }
+);
+
+// Create a scene instance
+Scene scene;
+
+// Main function
+int main(int argc, char* argv[])
+{
+    // Optional benchmark: --bench-flip (CPU only, needs no window)
+    if (argc > 1 && string(argv[1]) == "--bench-flip") {
+        RunFlipBenchmark();
+        return EXIT_SUCCESS;
+    }
+
+    // Optional benchmark: --bench-transforms [count] (CPU only, needs no window)
+    if (argc > 1 && string(argv[1]) == "--bench-transforms") {
+        RunTransformBenchmark(argc > 2 ? atoi(argv[2]) : 100000);
+        return EXIT_SUCCESS;
+    }
+
+    // Optional benchmark: --bench-index-order (CPU only, needs no window)
+    if (argc > 1 && string(argv[1]) == "--bench-index-order") {
+        RunIndexOrderBenchmark();
+        return EXIT_SUCCESS;
+    }
+
+    // Optional test: --test-vertex-format [count] (CPU only, fails on excess quantization error)
+    if (argc > 1 && string(argv[1]) == "--test-vertex-format") {
+        return RunVertexFormatTest(argc > 2 ? atoi(argv[2]) : 1000000) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Optional test: --test-lod (CPU only, fails on a wrong level chain or selection)
+    if (argc > 1 && string(argv[1]) == "--test-lod") {
+        return RunLodTest() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Optional test: --test-software-occlusion [scenes] (CPU only, fails when the tiled SIMD
+    // rasterizer disagrees with a brute-force reference)
+    if (argc > 1 && string(argv[1]) == "--test-software-occlusion") {
+        return RunSoftwareOcclusionTest(argc > 2 ? max(1, atoi(argv[2])) : 20) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Check if initialized correctly
+    if (!Initialize(argc, argv, &gWindow))
+        return EXIT_FAILURE;
+
+    // Initialize the scene with shader programs
+    if (!scene.initialize(vertex_shader_source, fragment_shader_source, 
+                         lampVertexShaderSource, lampFragmentShaderSource,
+                         instanced_vertex_shader_source, multi_draw_vertex_shader_source,
+                         deferred_geometry_fragment_shader_source, deferred_lighting_vertex_shader_source,
+                         deferred_lighting_fragment_shader_source, shadow_vertex_shader_source,
+                         shadow_fragment_shader_source, depth_prepass_fragment_shader_source,
+                         hiz_vertex_shader_source, hiz_downsample_fragment_shader_source)) {
+        cerr << "Failed to initialize scene" << endl;
+        return EXIT_FAILURE;
+    }
+
+    // Optional: --threads <n> sizes the job system (default: one thread per hardware thread)
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (string(argv[i]) == "--threads") {
+            JobSystem::instance().setThreadCount((unsigned int)max(1, atoi(argv[i + 1])));
+        }
+    }
+
+    // Optional profiling: --profile prints scope statistics every two seconds,
+    // --trace <file> writes the first 120 frames as a Chrome trace
+    Profiler& profiler = Profiler::instance();
+    bool printProfile = false;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--profile") {
+            profiler.setEnabled(true);
+            printProfile = true;
+        } else if (string(argv[i]) == "--trace" && i + 1 < argc) {
+            profiler.setEnabled(true);
+            profiler.startTrace(120, argv[++i]);
+        }
+    }
+
+    // Headless mode: render a synthetic scene offscreen and write per-frame timings
+    HeadlessOptions headlessOptions;
+    if (ParseHeadlessOptions(argc, argv, headlessOptions)) {
+        exit(RunHeadlessBenchmark(headlessOptions));
+    }
+
+    // Optional benchmark: --bench-geometry [cube count]
+    if (argc > 1 && string(argv[1]) == "--bench-geometry") {
+        RunGeometryBenchmark(argc > 2 ? atoi(argv[2]) : 10000);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Optional benchmark: --bench-culling [cube count]
+    if (argc > 1 && string(argv[1]) == "--bench-culling") {
+        RunCullingBenchmark(argc > 2 ? atoi(argv[2]) : 10000);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Optional benchmark: --bench-render-queue [cube count]
+    if (argc > 1 && string(argv[1]) == "--bench-render-queue") {
+        RunRenderQueueBenchmark(argc > 2 ? atoi(argv[2]) : 2000);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Optional benchmark: --bench-submission [cube count]
+    if (argc > 1 && string(argv[1]) == "--bench-submission") {
+        RunSubmissionBenchmark(argc > 2 ? atoi(argv[2]) : 10000);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Optional benchmark: --bench-jobs [cube count]
+    if (argc > 1 && string(argv[1]) == "--bench-jobs") {
+        RunJobBenchmark(argc > 2 ? atoi(argv[2]) : 100000);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Optional benchmark: --bench-mesh-load [triangle count]
+    if (argc > 1 && string(argv[1]) == "--bench-mesh-load") {
+        RunMeshLoadBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Optional benchmark: --bench-deferred [frames per configuration]
+    if (argc > 1 && string(argv[1]) == "--bench-deferred") {
+        RunDeferredBenchmark(argc > 2 ? max(1, atoi(argv[2])) : 10);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Optional benchmark: --bench-occlusion [frames per configuration]
+    if (argc > 1 && string(argv[1]) == "--bench-occlusion") {
+        exit(RunOcclusionBenchmark(argc > 2 ? max(1, atoi(argv[2])) : 30) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // Optional: --no-image-flip leaves images as decoded and flips texture coordinates instead,
+    // --compressed-textures loads images as cooked BC1/BC3 mip chains through texture caches
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--no-image-flip") {
+            TextureManager::instance().setFlipOnLoad(false);
+        } else if (string(argv[i]) == "--compressed-textures") {
+            TextureManager::instance().setCompressionEnabled(true);
+        }
+    }
+
+    // Build the scene with objects
+    BuildScene(scene);
+    double lastProfileReport = glfwGetTime();
+
+    // Rendering loop
+    while (!glfwWindowShouldClose(gWindow))
+    {
+        profiler.beginFrame();
+
+        // Set the background color of the window
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+        float currentFrame = glfwGetTime();
+        gDeltaTime = currentFrame - gLastFrame;
+        gLastFrame = currentFrame;
+
+        // Process user input
+        {
+            ProfileScope scope("ProcessInput");
+            ProcessInput(gWindow);
+        }
+
+        // Create view matrix from camera
+        glm::mat4 view = gCamera.GetViewMatrix();
+
+        // Create perspective or orthographic projection matrix
+        glm::mat4 projection;
+        if (!perspective)
+        {
+            // Perspective projection (default)
+            projection = glm::perspective(glm::radians(gCamera.Zoom), 
+                                         (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 
+                                          0.1f, 100.0f);
+        }
+        else
+        {
+            // Orthographic projection
+            projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+        }
+
+        // Render the scene
+#ifndef NDEBUG
+        // Uniform handles are resolved at initialization, so a frame must not look up any names
+        const unsigned int lookupsBeforeRender = ShaderProgram::getNameLookupCount();
+#endif
+        {
+            ProfileScope scope("Scene::render", true);
+            scene.render(view, projection);
+        }
+#ifndef NDEBUG
+        if (ShaderProgram::getNameLookupCount() != lookupsBeforeRender) {
+            cerr << "Uniform name lookups during render: "
+                 << ShaderProgram::getNameLookupCount() - lookupsBeforeRender << endl;
+        }
+#endif
+
+        // Swap front and back buffers
+        {
+            ProfileScope scope("SwapBuffers", true);
+            glfwSwapBuffers(gWindow);
+        }
+        glfwPollEvents();
+        profiler.endFrame();
+
+        // Frame times in the title bar, full scope tree on stdout
+        if (profiler.isEnabled() && currentFrame - lastProfileReport >= 2.0) {
+            Profiler::Statistics cpu, gpu;
+            if (profiler.getStatistics("Frame", cpu, gpu)) {
+                ostringstream title;
+                title << WINDOW_TITLE << fixed << setprecision(2)
+                      << " | cpu " << cpu.average << " ms (p99 " << cpu.p99 << ")"
+                      << " | gpu " << gpu.average << " ms (p99 " << gpu.p99 << ")";
+                glfwSetWindowTitle(gWindow, title.str().c_str());
+            }
+            if (printProfile) {
+                profiler.printReport(cout);
+            }
+            lastProfileReport = currentFrame;
+        }
+    }
+
+    // Exit with success
+    exit(EXIT_SUCCESS);
+}
+
+// Build the scene with objects
+void BuildScene(Scene& scene)
+{
+    // Create a cube with texture
+    auto cube1 = make_shared<Cube>(
+        1.0f,                           // Size
+        glm::vec3(0.0f, 0.0f, 0.0f),    // Position
+        glm::vec3(1.0f, 1.0f, 1.0f),    // Scale
+        glm::vec3(1.0f, 1.0f, 1.0f),    // Color
+        "textures/wood.jpg",            // Texture path (adjust as needed)
+        glm::vec2(1.0f, 1.0f)           // UV scale
+    );
+    
+    // Create another cube with different size and position
+    auto cube2 = make_shared<Cube>(
+        1.5f,                           // Size
+        glm::vec3(2.5f, 0.0f, 0.0f),    // Position
+        glm::vec3(1.0f, 1.0f, 1.0f),    // Scale
+        glm::vec3(1.0f, 1.0f, 1.0f),    // Color
+        "textures/brick.jpg",           // Texture path (adjust as needed)
+        glm::vec2(1.0f, 1.0f)           // UV scale
+    );
+    
+    // Both cubes are solid, so they can hide what is behind them
+    cube1->setOccluder(true);
+    cube2->setOccluder(true);
+
+    // Add cubes to the scene
+    scene.addShape(cube1);
+    scene.addShape(cube2);
+    
+    // Create lights
+    auto fillerLight = make_shared<Light>(
+        glm::vec3(2.5f, 5.0f, -0.8f),   // Position
+        glm::vec3(1.0f, 1.0f, 1.0f),    // Color (white)
+        0.2f,                           // Size
+        0.8f                            // Intensity
+    );
+    
+    auto keyLight = make_shared<Light>(
+        glm::vec3(-1.5f, 4.0f, -3.6f),  // Position
+        glm::vec3(0.0f, 0.0f, 1.0f),    // Color (blue)
+        0.1f,                           // Size
+        0.5f                            // Intensity
+    );
+    
+    // Add lights to the scene
+    scene.addLight(fillerLight);
+    scene.addLight(keyLight);
+}
+
+// One shape of the synthetic grid, each fitting a unit cell; "mixed" cycles through every primitive
+shared_ptr<Shape> MakeGridShape(const SceneConfig& config, int index, const glm::vec3& position, const string& texture)
+{
+    static const char* const mixedTypes[] = { "cube", "sphere", "cylinder", "cone", "torus", "plane" };
+    string type = config.shapeType == "mixed" ? mixedTypes[index % 6] : config.shapeType;
+    const glm::vec3 scale(1.0f);
+    const glm::vec3 color(1.0f);
+    const glm::vec2 uvScale(1.0f);
+    if (type == "sphere") {
+        return make_shared<Sphere>(0.5f, position, scale, color, texture, uvScale, config.segments);
+    } else if (type == "cylinder") {
+        return make_shared<Cylinder>(0.5f, 1.0f, position, scale, color, texture, uvScale, config.segments);
+    } else if (type == "cone") {
+        return make_shared<Cone>(0.5f, 1.0f, position, scale, color, texture, uvScale, config.segments);
+    } else if (type == "torus") {
+        return make_shared<Torus>(0.35f, 0.15f, position, scale, color, texture, uvScale, config.segments);
+    } else if (type == "plane") {
+        return make_shared<Plane>(1.0f, 1.0f, position, scale, color, texture, uvScale, config.segments);
+    } else if (type == "mesh") {
+        // Imported meshes keep their own units; each is scaled to fit the cell
+        auto shape = make_shared<MeshShape>(config.meshPath, position, scale, color, texture, uvScale);
+        glm::vec3 size = shape->getMesh()->bounds.max - shape->getMesh()->bounds.min;
+        shape->setScale(glm::vec3(1.0f / max(max(size.x, size.y), max(size.z, 1.0e-6f))));
+        return shape;
+    }
+    return make_shared<Cube>(1.0f, position, scale, color, texture, uvScale, config.subdivisions);
+}
+
+// Write RGBA rows (bottom row first) as an uncompressed 32-bit TGA, which stb_image reads
+bool WriteTga(const string& path, int width, int height, const vector<unsigned char>& rgba)
+{
+    ofstream file(path, ios::binary | ios::trunc);
+    if (!file) {
+        return false;
+    }
+    const unsigned char header[18] = { 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                       (unsigned char)(width & 0xFF), (unsigned char)(width >> 8),
+                                       (unsigned char)(height & 0xFF), (unsigned char)(height >> 8), 32, 8 };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    // TGA stores BGRA
+    vector<unsigned char> bgra(rgba);
+    for (size_t i = 0; i + 3 < bgra.size(); i += 4) {
+        swap(bgra[i], bgra[i + 2]);
+    }
+    file.write(reinterpret_cast<const char*>(bgra.data()), bgra.size());
+    return (bool)file;
+}
+
+// Build the default scene plus a synthetic grid of shapes, extra lights and generated textures
+void BuildScene(Scene& scene, const SceneConfig& config)
+{
+    GeometryCache::instance().setVertexFormat(config.vertexFormat);
+    TextureManager::instance().setCompressionEnabled(config.compressedTextures);
+    BuildScene(scene);
+
+    // Checkerboards with a distinct tint per texture, registered under synthetic keys or
+    // written once as image files that shapes load by path
+    vector<string> textureKeys;
+    for (int k = 0; k < config.textureCount; ++k) {
+        const int size = config.textureSize;
+        const int square = max(1, size / 8);
+        glm::vec3 tint(0.5f + 0.5f * sin(k * 1.7f), 0.5f + 0.5f * sin(k * 2.3f + 2.0f), 0.5f + 0.5f * sin(k * 2.9f + 4.0f));
+        vector<unsigned char> pixels(size * size * 4);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                float shade = ((x / square + y / square) % 2 == 0) ? 1.0f : 0.35f;
+                unsigned char* pixel = &pixels[(y * size + x) * 4];
+                pixel[0] = (unsigned char)(255 * tint.r * shade);
+                pixel[1] = (unsigned char)(255 * tint.g * shade);
+                pixel[2] = (unsigned char)(255 * tint.b * shade);
+                pixel[3] = 255;
+            }
+        }
+        if (config.textureFiles) {
+            // Existing files are kept so their texture caches stay valid across runs
+            string path = "headless_checker_" + to_string(k) + "_" + to_string(size) + ".tga";
+            struct stat existing;
+            if (stat(path.c_str(), &existing) != 0 && !WriteTga(path, size, size, pixels)) {
+                cerr << "Failed to write " << path << endl;
+            }
+            textureKeys.push_back(path);
+        } else {
+            string key = "synthetic/checker_" + to_string(k);
+            TextureManager::instance().create(key, size, size, pixels);
+            textureKeys.push_back(key);
+        }
+    }
+
+    // Shapes on a grid in the XZ plane, centered below the default scene
+    int side = max(1, (int)ceil(sqrt((double)config.cubeCount)));
+    for (int i = 0; i < config.cubeCount; ++i) {
+        glm::vec3 position((i % side - side / 2) * 2.0f, -2.0f, (i / side - side / 2) * 2.0f);
+        string texture = textureKeys.empty() ? "" : textureKeys[i % textureKeys.size()];
+        scene.addShape(MakeGridShape(config, i, position, texture));
+    }
+
+    // Extra point lights spread over the grid just above the shapes, in varied colors
+    for (int i = 2; i < config.lightCount; ++i) {
+        float angle = i * 2.39996f;
+        float radius = side * sqrt((float)i / config.lightCount);
+        glm::vec3 color(0.6f + 0.4f * sin(i * 0.9f), 0.6f + 0.4f * sin(i * 1.3f + 2.0f), 0.6f + 0.4f * sin(i * 1.7f + 4.0f));
+        scene.addLight(make_shared<Light>(glm::vec3(cos(angle) * radius, -0.75f, sin(angle) * radius),
+                                          color, 0.1f, 1.5f, config.lightRange));
+    }
+}
+
+// ************** ENHANCEMENT: Headless Benchmark Harness **************
+// Measurements for one rendered frame
+struct FrameRecord {
+    int frame;
+    double cpuMs;
+    double gpuMs;
+    RenderStatistics render;
+    CullingStatistics culling;
+    ClusterStatistics clusters;
+    ShadowStatistics shadows;
+    GLuint64 shadedFragments;  // opaque pass, as measured a few frames earlier
+};
+
+// Parse --headless and its options; returns false when headless mode was not requested
+bool ParseHeadlessOptions(int argc, char* argv[], HeadlessOptions& options)
+{
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        string argument = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (argument == "--headless") {
+            headless = true;
+        } else if (argument == "--cubes" && hasValue) {
+            options.scene.cubeCount = atoi(argv[++i]);
+        } else if (argument == "--lights" && hasValue) {
+            options.scene.lightCount = atoi(argv[++i]);
+        } else if (argument == "--light-range" && hasValue) {
+            options.scene.lightRange = (float)atof(argv[++i]);
+        } else if (argument == "--textures" && hasValue) {
+            options.scene.textureCount = atoi(argv[++i]);
+        } else if (argument == "--texture-size" && hasValue) {
+            options.scene.textureSize = max(8, atoi(argv[++i]));
+        } else if (argument == "--texture-files") {
+            options.scene.textureFiles = true;
+        } else if (argument == "--compressed-textures") {
+            options.scene.textureFiles = true;
+            options.scene.compressedTextures = true;
+        } else if (argument == "--subdivisions" && hasValue) {
+            options.scene.subdivisions = atoi(argv[++i]);
+        } else if (argument == "--shapes" && hasValue) {
+            options.scene.shapeType = argv[++i];
+        } else if (argument == "--mesh" && hasValue) {
+            options.scene.shapeType = "mesh";
+            options.scene.meshPath = argv[++i];
+        } else if (argument == "--segments" && hasValue) {
+            options.scene.segments = max(1, atoi(argv[++i]));
+        } else if (argument == "--compact-vertices") {
+            options.scene.vertexFormat = VERTEX_FORMAT_COMPACT;
+        } else if (argument == "--frames" && hasValue) {
+            options.frameCount = max(1, atoi(argv[++i]));
+        } else if (argument == "--size" && hasValue) {
+            sscanf(argv[++i], "%dx%d", &options.width, &options.height);
+        } else if (argument == "--mode" && hasValue) {
+            options.mode = argv[++i];
+        } else if (argument == "--out" && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (argument == "--capture" && hasValue) {
+            options.capturePath = argv[++i];
+        } else if (argument == "--no-culling") {
+            options.culling = false;
+        } else if (argument == "--no-lod") {
+            options.lod = false;
+        } else if (argument == "--no-clustering") {
+            options.clusteredLighting = false;
+        } else if (argument == "--deferred") {
+            options.deferred = true;
+        } else if (argument == "--no-shadows") {
+            options.shadows = false;
+        } else if (argument == "--no-shadow-cache") {
+            options.shadowCaching = false;
+        } else if (argument == "--depth-prepass") {
+            options.depthPrepass = true;
+        } else if (argument == "--occlusion") {
+            options.occlusion = true;
+        } else if (argument == "--software-occlusion") {
+            options.softwareOcclusion = true;
+        } else if (argument == "--static-camera") {
+            options.staticCamera = true;
+        }
+    }
+    return headless;
+}
+
+// Write the frame records as CSV, or as JSON when the path ends in .json
+bool WriteFrameRecords(const HeadlessOptions& options, const vector<FrameRecord>& records)
+{
+    ofstream file(options.outputPath);
+    if (!file) {
+        cerr << "Failed to open " << options.outputPath << endl;
+        return false;
+    }
+    file << fixed << setprecision(4);
+
+    bool json = options.outputPath.size() >= 5 && options.outputPath.compare(options.outputPath.size() - 5, 5, ".json") == 0;
+    if (json) {
+        file << "{\n  \"config\": { \"cubes\": " << options.scene.cubeCount << ", \"lights\": " << options.scene.lightCount
+             << ", \"textures\": " << options.scene.textureCount << ", \"frames\": " << options.frameCount
+             << ", \"width\": " << options.width << ", \"height\": " << options.height
+             << ", \"mode\": \"" << options.mode << "\", \"culling\": " << (options.culling ? "true" : "false")
+             << ", \"renderer\": \"" << (options.deferred ? "deferred" : "forward") << "\""
+             << ", \"shadows\": " << (options.shadows ? "true" : "false")
+             << ", \"depth_prepass\": " << (options.depthPrepass ? "true" : "false")
+             << ", \"occlusion\": " << (options.occlusion ? "true" : "false")
+             << ", \"software_occlusion\": " << (options.softwareOcclusion ? "true" : "false") << " },\n";
+        file << "  \"frames\": [\n";
+        for (size_t i = 0; i < records.size(); ++i) {
+            const FrameRecord& record = records[i];
+            file << "    { \"frame\": " << record.frame << ", \"cpu_ms\": " << record.cpuMs << ", \"gpu_ms\": " << record.gpuMs
+                 << ", \"draw_calls\": " << record.render.drawCalls << ", \"program_binds\": " << record.render.programBinds
+                 << ", \"texture_binds\": " << record.render.textureBinds << ", \"vao_binds\": " << record.render.vaoBinds
+                 << ", \"visible_shapes\": " << record.culling.visibleShapes << ", \"culled_shapes\": " << record.culling.culledShapes
+                 << ", \"occluded_shapes\": " << record.culling.occludedShapes
+                 << ", \"software_occluded\": " << record.culling.softwareOccludedShapes
+                 << ", \"occluder_triangles\": " << record.culling.occluderTriangles
+                 << ", \"triangles\": " << record.culling.visibleTriangles << ", \"cluster_ms\": " << record.clusters.buildMilliseconds
+                 << ", \"light_indices\": " << record.clusters.lightIndices
+                 << ", \"shadow_rendered\": " << record.shadows.rendered << ", \"shadow_skipped\": " << record.shadows.skipped
+                 << ", \"shaded_fragments\": " << record.shadedFragments << " }" << (i + 1 < records.size() ? "," : "") << "\n";
+        }
+        file << "  ]\n}\n";
+    } else {
+        file << "frame,cpu_ms,gpu_ms,draw_calls,program_binds,texture_binds,vao_binds,state_changes,visible_shapes,culled_shapes,occluded_shapes,software_occluded,occluder_triangles,triangles,cluster_ms,light_indices,shadow_rendered,shadow_skipped,shaded_fragments\n";
+        for (const FrameRecord& record : records) {
+            size_t stateChanges = record.render.programBinds + record.render.textureBinds + record.render.vaoBinds;
+            file << record.frame << ',' << record.cpuMs << ',' << record.gpuMs << ',' << record.render.drawCalls << ','
+                 << record.render.programBinds << ',' << record.render.textureBinds << ',' << record.render.vaoBinds << ','
+                 << stateChanges << ',' << record.culling.visibleShapes << ',' << record.culling.culledShapes << ','
+                 << record.culling.occludedShapes << ',' << record.culling.softwareOccludedShapes << ','
+                 << record.culling.occluderTriangles << ','
+                 << record.culling.visibleTriangles << ',' << record.clusters.buildMilliseconds << ','
+                 << record.clusters.lightIndices << ',' << record.shadows.rendered << ',' << record.shadows.skipped << ','
+                 << record.shadedFragments << '\n';
+        }
+    }
+    return true;
+}
+
+// Save the bound framebuffer as a binary PPM
+void CaptureFramebuffer(const string& path, int width, int height)
+{
+    vector<unsigned char> pixels((size_t)width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    // GL rows start at the bottom, PPM rows at the top
+    flipImageVertically(pixels.data(), width, height, 3);
+
+    ofstream file(path, ios::binary);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+}
+
+// Render the synthetic scene into an offscreen framebuffer along a scripted camera path
+int RunHeadlessBenchmark(const HeadlessOptions& options)
+{
+    auto loadStart = chrono::steady_clock::now();
+    BuildScene(scene, options.scene);
+    TextureManager::instance().finishPending();
+    glFinish();
+    double loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+
+    scene.setCullingEnabled(options.culling);
+    scene.setOcclusionCullingEnabled(options.occlusion);
+    scene.setSoftwareOcclusionEnabled(options.softwareOcclusion);
+    if (options.softwareOcclusion) {
+        // Every cube of the grid occludes; other shapes ignore the flag
+        for (int i = 0; i < scene.getShapeCount(); ++i) {
+            scene.getShape(i)->setOccluder(true);
+        }
+    }
+    scene.setLodEnabled(options.lod);
+    scene.setClusteredLightingEnabled(options.clusteredLighting);
+    scene.setDeferredEnabled(options.deferred);
+    scene.setShadowsEnabled(options.shadows);
+    scene.setShadowCachingEnabled(options.shadowCaching);
+    scene.setDepthPrepassEnabled(options.depthPrepass);
+    scene.setMultiDrawEnabled(options.mode == "multi-draw");
+    scene.setInstancingEnabled(options.mode != "per-object");
+    glfwSwapInterval(0);
+
+    // Offscreen color and depth targets
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = { 0, 0 };
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.width, options.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, options.width, options.height);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        cerr << "Offscreen framebuffer is incomplete" << endl;
+        return EXIT_FAILURE;
+    }
+    glViewport(0, 0, options.width, options.height);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // Timer queries are read a few frames late so the CPU never waits on the GPU
+    const int QUERY_LATENCY = 3;
+    GLuint queries[QUERY_LATENCY + 1];
+    glGenQueries(QUERY_LATENCY + 1, queries);
+
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom),
+                                            (GLfloat)options.width / (GLfloat)options.height, 0.1f, 100.0f);
+
+    // Orbit that keeps the whole grid in view
+    int side = max(1, (int)ceil(sqrt((double)options.scene.cubeCount)));
+    float radius = max(8.0f, side * 1.5f);
+    glm::vec3 center(1.25f, 0.0f, 0.0f);
+
+    // One untimed frame absorbs first-use costs (shader compilation, buffer creation)
+    scene.render(gCamera.GetViewMatrix(), projection);
+    glFinish();
+
+    vector<FrameRecord> records(options.frameCount);
+    auto readQuery = [&](int frame) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[frame % (QUERY_LATENCY + 1)], GL_QUERY_RESULT, &elapsed);
+        records[frame].gpuMs = elapsed / 1.0e6;
+    };
+
+    for (int frame = 0; frame < options.frameCount; ++frame) {
+        auto start = chrono::steady_clock::now();
+
+        glm::mat4 view;
+        if (options.staticCamera) {
+            view = gCamera.GetViewMatrix();
+        } else {
+            float angle = glm::radians(360.0f) * frame / options.frameCount;
+            gCamera.Position = center + glm::vec3(cos(angle) * radius, radius * 0.5f, sin(angle) * radius);
+            view = glm::lookAt(gCamera.Position, center, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+
+        Profiler::instance().beginFrame();
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % (QUERY_LATENCY + 1)]);
+        scene.render(view, projection);
+        glEndQuery(GL_TIME_ELAPSED);
+        Profiler::instance().endFrame();
+        records[frame].cpuMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        // Submit the frame as a buffer swap would
+        glFlush();
+
+        records[frame].frame = frame;
+        records[frame].render = scene.getRenderStatistics();
+        records[frame].culling = scene.getCullingStatistics();
+        records[frame].clusters = scene.getClusterStatistics();
+        records[frame].shadows = scene.getShadowStatistics();
+        records[frame].shadedFragments = scene.getShadedFragments();
+
+        if (frame >= QUERY_LATENCY) {
+            readQuery(frame - QUERY_LATENCY);
+        }
+    }
+    for (int frame = max(0, options.frameCount - QUERY_LATENCY); frame < options.frameCount; ++frame) {
+        readQuery(frame);
+    }
+
+    if (!options.capturePath.empty()) {
+        CaptureFramebuffer(options.capturePath, options.width, options.height);
+    }
+
+    glDeleteQueries(QUERY_LATENCY + 1, queries);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(2, renderbuffers);
+    glDeleteFramebuffers(1, &framebuffer);
+
+    if (!WriteFrameRecords(options, records)) {
+        return EXIT_FAILURE;
+    }
+
+    // Summary of the run
+    double cpuTotal = 0.0, gpuTotal = 0.0, cpuMax = 0.0, gpuMax = 0.0, clusterTotal = 0.0, clusterMax = 0.0;
+    double shadowRendered = 0.0, shadowSkipped = 0.0, shadowTotal = 0.0, shadowMax = 0.0;
+    double visibleTotal = 0.0, occludedTotal = 0.0, softwareOccludedTotal = 0.0, drawTotal = 0.0;
+    for (const FrameRecord& record : records) {
+        visibleTotal += record.culling.visibleShapes;
+        occludedTotal += record.culling.occludedShapes;
+        softwareOccludedTotal += record.culling.softwareOccludedShapes;
+        drawTotal += record.render.drawCalls;
+        shadowRendered += record.shadows.rendered;
+        shadowSkipped += record.shadows.skipped;
+        shadowTotal += record.shadows.updateMilliseconds;
+        shadowMax = max(shadowMax, record.shadows.updateMilliseconds);
+        clusterTotal += record.clusters.buildMilliseconds;
+        clusterMax = max(clusterMax, record.clusters.buildMilliseconds);
+        cpuTotal += record.cpuMs;
+        gpuTotal += record.gpuMs;
+        cpuMax = max(cpuMax, record.cpuMs);
+        gpuMax = max(gpuMax, record.gpuMs);
+    }
+    const FrameRecord& last = records.back();
+    cout << "Headless run: " << options.scene.cubeCount << " " << options.scene.shapeType << " shapes, " << options.scene.lightCount << " lights, "
+         << options.scene.textureCount << " textures, " << options.frameCount << " frames, mode " << options.mode
+         << ", " << (scene.isDeferredEnabled() ? "deferred" : "forward") << endl;
+    cout << fixed << setprecision(3)
+         << "cpu_ms avg " << cpuTotal / records.size() << " max " << cpuMax
+         << " | gpu_ms avg " << gpuTotal / records.size() << " max " << gpuMax
+         << " | draws " << last.render.drawCalls
+         << " | state changes " << last.render.programBinds + last.render.textureBinds + last.render.vaoBinds
+         << " | triangles " << last.culling.visibleTriangles
+         << " | mesh bytes " << GpuMesh::liveBytes << " | gbuffer bytes " << scene.getGBufferBytes() << endl;
+    cout << "point lights " << last.clusters.pointLights << " (" << last.clusters.visibleLights << " in view)"
+         << " | clusters " << (options.clusteredLighting ? CLUSTER_COUNT : 1) << " | light indices " << last.clusters.lightIndices
+         << " max per cluster " << last.clusters.maxClusterLights
+         << " | cluster_ms avg " << clusterTotal / records.size() << " max " << clusterMax << endl;
+    cout << "shadow maps " << last.shadows.shadowMaps << " | rendered avg " << shadowRendered / records.size()
+         << " skipped avg " << shadowSkipped / records.size() << " | caster draws " << last.shadows.casterDraws
+         << " | shadow_ms avg " << shadowTotal / records.size() << " max " << shadowMax << endl;
+    cout << "depth prepass " << (scene.isDepthPrepassEnabled() ? "on" : "off") << " | shaded fragments " << last.shadedFragments
+         << " (" << (scene.isCountingFragmentInvocations() ? "fragment shader invocations" : "samples passed") << ")"
+         << " | per pixel " << (double)last.shadedFragments / ((double)options.width * options.height) << endl;
+    cout << "occlusion culling " << (scene.isOcclusionCullingEnabled() ? "on" : "off") << " | visible shapes avg " << visibleTotal / records.size()
+         << " | occluded avg " << occludedTotal / records.size() << " | draws avg " << drawTotal / records.size() << endl;
+    cout << "software occlusion " << (scene.isSoftwareOcclusionEnabled() ? "on" : "off") << " | occluded avg "
+         << softwareOccludedTotal / records.size() << " | occluder triangles " << last.culling.occluderTriangles << endl;
+    TextureLoadStatistics textures = TextureManager::instance().getStatistics();
+    cout << "scene load ms " << loadMs << " | textures " << (TextureManager::instance().isCompressionEnabled() ? "bc" : "raw")
+         << " decoded " << textures.decoded << " cooked " << textures.cooked << " cached " << textures.cacheHits
+         << " | decode_ms " << textures.decodeMs << " cook_ms " << textures.cookMs << " cache_ms " << textures.cacheMs
+         << " upload_ms " << textures.uploadMs << " | texture bytes " << Texture::liveBytes << endl;
+    cout << "Wrote " << options.outputPath << endl;
+    if (Profiler::instance().isEnabled()) {
+        Profiler::instance().printReport(cout);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Measure cube construction time and GPU memory with and without the geometry cache
+void RunGeometryBenchmark(int cubeCount)
+{
+    GeometryCache& cache = GeometryCache::instance();
+
+    cout << "Geometry benchmark: " << cubeCount << " cubes" << endl;
+    cout << "mode        construct_ms  uploads  gpu_bytes" << endl;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        // Pass 0 is the uncached baseline (one mesh per cube), pass 1 uses the cache
+        bool cached = (pass == 1);
+        cache.setEnabled(cached);
+        cache.resetStatistics();
+
+        vector<shared_ptr<Cube>> cubes;
+        cubes.reserve(cubeCount);
+
+        glFinish();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < cubeCount; ++i) {
+            // Varying sizes would have needed distinct meshes before scale was baked into the model matrix
+            cubes.push_back(make_shared<Cube>(0.5f + (i % 8) * 0.25f, glm::vec3((float)(i % 100), 0.0f, (float)(i / 100))));
+        }
+        glFinish();
+        double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        cout << left << setw(10) << (cached ? "cached" : "uncached") << right
+             << fixed << setprecision(2) << setw(14) << elapsedMs
+             << setw(9) << cache.getUploadCount() << setw(11) << GpuMesh::liveBytes << endl;
+    }
+
+    cache.setEnabled(true);
+}
+
+// Render a large grid of cubes around the camera with and without frustum culling
+void RunCullingBenchmark(int cubeCount)
+{
+    BuildScene(scene);
+    int side = max(1, (int)ceil(sqrt((double)cubeCount)));
+    for (int i = 0; i < cubeCount; ++i) {
+        glm::vec3 position((i % side - side / 2) * 2.0f, 0.0f, (i / side - side / 2) * 2.0f);
+        scene.addShape(make_shared<Cube>(1.0f, position, glm::vec3(1.0f), glm::vec3(0.6f, 0.6f, 0.6f)));
+    }
+
+    glm::mat4 view = gCamera.GetViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom),
+                                            (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    const int frameCount = 100;
+
+    cout << "Culling benchmark: " << cubeCount << " cubes, " << frameCount << " frames" << endl;
+    cout << "mode      frame_ms   cull_ms  visible   culled  box_tests" << endl;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        bool culling = (pass == 1);
+        scene.setCullingEnabled(culling);
+
+        // Warm up once so the hierarchy build is not timed
+        scene.render(view, projection);
+        glFinish();
+
+        double cullMs = 0.0;
+        auto start = chrono::steady_clock::now();
+        for (int frame = 0; frame < frameCount; ++frame) {
+            scene.render(view, projection);
+            cullMs += scene.getCullingStatistics().cullMilliseconds;
+        }
+        glFinish();
+        double frameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frameCount;
+
+        const CullingStatistics& statistics = scene.getCullingStatistics();
+        cout << left << setw(8) << (culling ? "culled" : "all") << right
+             << fixed << setprecision(3) << setw(10) << frameMs << setw(10) << cullMs / frameCount
+             << setw(9) << statistics.visibleShapes << setw(9) << statistics.culledShapes
+             << setw(11) << statistics.boxTests << endl;
+    }
+}
+
+// Count state changes per frame for per-object draws in submission order versus state-sorted
+void RunRenderQueueBenchmark(int cubeCount)
+{
+    BuildScene(scene);
+
+    // Interleave textures so consecutive shapes never share state in submission order
+    const char* texturePaths[] = { "textures/wood.jpg", "textures/brick.jpg", "" };
+    int side = max(1, (int)ceil(sqrt((double)cubeCount)));
+    for (int i = 0; i < cubeCount; ++i) {
+        glm::vec3 position((i % side) * 0.5f - 2.0f, -1.0f, (i / side) * 0.5f - 2.0f);
+        scene.addShape(make_shared<Cube>(0.25f, position, glm::vec3(1.0f), glm::vec3(1.0f), texturePaths[i % 3]));
+    }
+    TextureManager::instance().finishPending();
+
+    glm::mat4 view = gCamera.GetViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom),
+                                            (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    const int frameCount = 50;
+
+    // Per-object draws show the effect of sorting; batches already group by state
+    scene.setInstancingEnabled(false);
+    scene.setCullingEnabled(false);
+
+    cout << "Render queue benchmark: " << cubeCount << " cubes, " << frameCount << " frames" << endl;
+    cout << "mode       frame_ms  draws  programs  textures   vaos" << endl;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        bool sorted = (pass == 1);
+        scene.setStateSortingEnabled(sorted);
+        scene.render(view, projection);
+        glFinish();
+
+        auto start = chrono::steady_clock::now();
+        for (int frame = 0; frame < frameCount; ++frame) {
+            scene.render(view, projection);
+        }
+        glFinish();
+        double frameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frameCount;
+
+        const RenderStatistics& statistics = scene.getRenderStatistics();
+        cout << left << setw(9) << (sorted ? "sorted" : "unsorted") << right
+             << fixed << setprecision(3) << setw(10) << frameMs << setw(7) << statistics.drawCalls
+             << setw(10) << statistics.programBinds << setw(10) << statistics.textureBinds
+             << setw(7) << statistics.vaoBinds << endl;
+    }
+
+    scene.setStateSortingEnabled(true);
+}
+
+// Compare CPU submission cost of per-object draws, instanced batches and multi-draw-indirect
+void RunSubmissionBenchmark(int cubeCount)
+{
+    BuildScene(scene);
+    const char* texturePaths[] = { "textures/wood.jpg", "textures/brick.jpg" };
+    int side = max(1, (int)ceil(sqrt((double)cubeCount)));
+    for (int i = 0; i < cubeCount; ++i) {
+        glm::vec3 position((i % side) * 0.5f - 2.0f, -1.0f, (i / side) * 0.5f - 2.0f);
+        scene.addShape(make_shared<Cube>(0.25f, position, glm::vec3(1.0f), glm::vec3(1.0f), texturePaths[i % 2]));
+    }
+    TextureManager::instance().finishPending();
+
+    glm::mat4 view = gCamera.GetViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom),
+                                            (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    const int frameCount = 50;
+    scene.setCullingEnabled(false);
+
+    cout << "Submission benchmark: " << cubeCount << " cubes, " << frameCount << " frames" << endl;
+    cout << "mode          cpu_ms  frame_ms  draws" << endl;
+
+    const char* modeNames[] = { "per-object", "instanced", "multi-draw" };
+    for (int mode = 0; mode < 3; ++mode) {
+        scene.setInstancingEnabled(mode == 1);
+        scene.setMultiDrawEnabled(mode == 2);
+        scene.render(view, projection);
+        glFinish();
+
+        // CPU time covers building and submitting the frame; frame time includes the GPU
+        double cpuMs = 0.0;
+        auto start = chrono::steady_clock::now();
+        for (int frame = 0; frame < frameCount; ++frame) {
+            auto submitStart = chrono::steady_clock::now();
+            scene.render(view, projection);
+            cpuMs += chrono::duration<double, milli>(chrono::steady_clock::now() - submitStart).count();
+        }
+        glFinish();
+        double frameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frameCount;
+
+        cout << left << setw(12) << modeNames[mode] << right
+             << fixed << setprecision(3) << setw(8) << cpuMs / frameCount << setw(10) << frameMs
+             << setw(7) << scene.getRenderStatistics().drawCalls << endl;
+    }
+
+    scene.setMultiDrawEnabled(false);
+    scene.setInstancingEnabled(true);
+}
+
+// Time the CPU half of a frame (transforms, bounds, culling and command recording) with
+// every shape moving, on 1, 2, 4 and 8 job system threads
+void RunJobBenchmark(int cubeCount)
+{
+    BuildScene(scene);
+    const char* texturePaths[] = { "textures/wood.jpg", "textures/brick.jpg" };
+    int side = max(1, (int)ceil(sqrt((double)cubeCount)));
+    for (int i = 0; i < cubeCount; ++i) {
+        glm::vec3 position((i % side - side / 2) * 2.0f, 0.0f, (i / side - side / 2) * 2.0f);
+        scene.addShape(make_shared<Cube>(1.0f, position, glm::vec3(1.0f), glm::vec3(0.6f, 0.6f, 0.6f), texturePaths[i % 2]));
+    }
+    TextureManager::instance().finishPending();
+
+    glm::mat4 view = gCamera.GetViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom),
+                                            (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    const int frameCount = 30;
+    const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+    JobSystem& jobs = JobSystem::instance();
+    unsigned int defaultThreads = jobs.getThreadCount();
+
+    cout << "Job system benchmark: " << scene.getShapeCount() << " shapes, " << frameCount << " frames, "
+         << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << "mode         threads  prepare_ms  speedup  visible" << endl;
+
+    const char* modeNames[] = { "per-object", "instanced", "multi-draw" };
+    for (int mode = 0; mode < 3; ++mode) {
+        scene.setInstancingEnabled(mode == 1);
+        scene.setMultiDrawEnabled(mode == 2);
+        double baselineMs = 0.0;
+        for (unsigned int threadCount : threadCounts) {
+            jobs.setThreadCount(threadCount);
+            scene.prepareFrame(view, projection);
+
+            double prepareMs = 0.0;
+            for (int frame = 0; frame < frameCount; ++frame) {
+                // Move every shape in place so each frame refreshes all transforms and refits
+                for (int i = 0; i < scene.getShapeCount(); ++i) {
+                    Shape* shape = scene.getShape(i);
+                    shape->setPosition(shape->getPosition());
+                }
+                auto start = chrono::steady_clock::now();
+                scene.prepareFrame(view, projection);
+                prepareMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            }
+            prepareMs /= frameCount;
+            if (threadCount == 1) {
+                baselineMs = prepareMs;
+            }
+
+            cout << left << setw(12) << modeNames[mode] << right
+                 << setw(8) << threadCount << fixed << setprecision(3) << setw(12) << prepareMs
+                 << setw(8) << setprecision(2) << baselineMs / prepareMs << "x"
+                 << setw(9) << scene.getCullingStatistics().visibleShapes << endl;
+        }
+    }
+
+    jobs.setThreadCount(defaultThreads);
+    scene.setMultiDrawEnabled(false);
+    scene.setInstancingEnabled(true);
+}
+
+// Compare rebuilding per-object glm matrices with the TransformStore's dirty-only SIMD
+// pass, for all entries dirty and for a tenth of them, then time edits in a hierarchy
+// of groups; matrices are checked against glm
+void RunTransformBenchmark(int transformCount)
+{
+    TransformStore& store = TransformStore::instance();
+    vector<TransformHandle> handles;
+    vector<glm::vec3> positions, scales;
+    vector<glm::quat> rotations;
+    for (int i = 0; i < transformCount; ++i) {
+        positions.push_back(glm::vec3((float)(i % 317), (float)(i % 13), (float)(i / 317)));
+        rotations.push_back(glm::angleAxis(i * 0.01f, glm::normalize(glm::vec3(1.0f, (float)(i % 7), 2.0f))));
+        scales.push_back(glm::vec3(1.0f + (i % 5) * 0.25f, 1.0f + (i % 3) * 0.5f, 1.0f));
+        handles.push_back(store.create(positions[i], rotations[i], scales[i]));
+    }
+    store.update();
+
+    // Per-object baseline: translate, rotate and scale, then invert for the normal matrix
+    auto referenceModel = [&](int i) {
+        return glm::translate(glm::mat4(1.0f), positions[i]) * glm::mat4_cast(rotations[i]) * glm::scale(glm::mat4(1.0f), scales[i]);
+    };
+    auto matrixError = [](const glm::mat4& model, const glm::mat3& normal, const glm::mat4& reference) {
+        glm::mat3 referenceNormal = glm::transpose(glm::inverse(glm::mat3(reference)));
+        float error = 0.0f;
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                error = max(error, fabs(model[column][row] - reference[column][row]));
+                if (column < 3 && row < 3) {
+                    error = max(error, fabs(normal[column][row] - referenceNormal[column][row]));
+                }
+            }
+        }
+        return error;
+    };
+
+    float maxError = 0.0f;
+    for (int i = 0; i < transformCount; ++i) {
+        maxError = max(maxError, matrixError(store.getWorldMatrix(handles[i]), store.getNormalMatrix(handles[i]), referenceModel(i)));
+    }
+
+    const int repeatCount = 20;
+    vector<glm::mat4> models(transformCount);
+    vector<glm::mat3> normals(transformCount);
+    cout << "Transform benchmark: " << transformCount << " transforms, " << repeatCount << " repeats, "
+         << JobSystem::instance().getThreadCount() << " job threads, max error " << scientific << maxError << endl;
+    cout << "dirty     glm_ms  store_ms  speedup" << endl;
+
+    for (int stride : { 1, 10 }) {
+        double glmMs = 0.0;
+        double storeMs = 0.0;
+        for (int repeat = 0; repeat < repeatCount; ++repeat) {
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < transformCount; i += stride) {
+                models[i] = referenceModel(i);
+                normals[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+            }
+            glmMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+            for (int i = 0; i < transformCount; i += stride) {
+                store.setPosition(handles[i], positions[i]);
+            }
+            start = chrono::steady_clock::now();
+            store.update();
+            storeMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        }
+
+        cout << setw(4) << 100 / stride << "%" << fixed << setprecision(3) << setw(11) << glmMs / repeatCount
+             << setw(10) << storeMs / repeatCount << setw(8) << setprecision(2) << glmMs / storeMs << "x" << endl;
+    }
+
+    // Hierarchy: the same transforms as children of groups of 100, each group rotated and offset
+    const int groupSize = 100;
+    vector<unique_ptr<SceneNode>> groups;
+    for (int i = 0; i < transformCount; ++i) {
+        if (i % groupSize == 0) {
+            float angle = (float)groups.size() * 0.1f;
+            groups.push_back(make_unique<SceneNode>(glm::vec3(0.0f, (float)groups.size(), 0.0f),
+                                                    glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(2.0f)));
+        }
+        store.setParent(handles[i], groups.back()->getHandle());
+    }
+    store.update();
+
+    maxError = 0.0f;
+    for (int i = 0; i < transformCount; ++i) {
+        glm::mat4 groupModel = groups[i / groupSize]->getWorldMatrix();
+        maxError = max(maxError, matrixError(store.getWorldMatrix(handles[i]), store.getNormalMatrix(handles[i]), groupModel * referenceModel(i)));
+    }
+
+    cout << endl << "Hierarchy: " << groups.size() << " groups of " << groupSize << ", max error " << scientific << maxError << endl;
+    cout << "edit          updated  update_ms" << endl;
+    const char* editNames[] = { "none", "one leaf", "one group", "all groups" };
+    for (int edit = 0; edit < 4; ++edit) {
+        double updateMs = 0.0;
+        for (int repeat = 0; repeat < repeatCount; ++repeat) {
+            if (edit == 1) {
+                store.setPosition(handles[0], positions[0]);
+            } else if (edit == 2) {
+                groups[0]->setPosition(groups[0]->getPosition());
+            } else if (edit == 3) {
+                for (auto& group : groups) {
+                    group->setPosition(group->getPosition());
+                }
+            }
+            auto start = chrono::steady_clock::now();
+            store.update();
+            updateMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        }
+        cout << left << setw(12) << editNames[edit] << right << setw(9) << store.getLastUpdateCount()
+             << fixed << setprecision(3) << setw(11) << updateMs / repeatCount << endl;
+    }
+
+    for (TransformHandle handle : handles) {
+        store.release(handle);
+    }
+}
+
+// Round-trip synthetic vertices through the compact vertex layout and check the
+// quantization error against the bounds of each encoding; returns false on failure
+bool RunVertexFormatTest(int vertexCount)
+{
+    const VertexLayout& floatLayout = VertexLayout::get(VERTEX_FORMAT_FLOAT);
+    const VertexLayout& compactLayout = VertexLayout::get(VERTEX_FORMAT_COMPACT);
+
+    // Deterministic LCG in [0, 1)
+    uint32_t state = 12345;
+    auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+
+    // Positions spanning 1e-3 to 1e3, unit normals, UVs including both ends of [0, 1]
+    vector<float> vertices;
+    vertices.reserve(vertexCount * FLOAT_VERTEX_COMPONENTS);
+    for (int i = 0; i < vertexCount; ++i) {
+        float magnitude = pow(10.0f, next() * 6.0f - 3.0f);
+        glm::vec3 position = (glm::vec3(next(), next(), next()) * 2.0f - 1.0f) * magnitude;
+        glm::vec3 normal = glm::normalize(glm::vec3(next(), next(), next()) * 2.0f - 0.999f);
+        glm::vec2 uv = i % 64 == 0 ? glm::vec2((float)(i / 64 % 2)) : glm::vec2(next(), next());
+        vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y });
+    }
+
+    cout << "Vertex format test: " << vertexCount << " vertices" << endl;
+    cout << "format   bytes/vertex  encode_ms  decode_ms" << endl;
+    vector<float> decoded;
+    for (const VertexLayout* layout : { &floatLayout, &compactLayout }) {
+        auto start = chrono::steady_clock::now();
+        vector<uint8_t> bytes = layout->encode(vertices);
+        double encodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        start = chrono::steady_clock::now();
+        decoded = layout->decode(bytes.data(), vertexCount);
+        double decodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        cout << left << setw(9) << (layout == &compactLayout ? "compact" : "float") << right
+             << setw(12) << layout->getStride() << fixed << setprecision(3) << setw(11) << encodeMs << setw(11) << decodeMs << endl;
+    }
+
+    // Half floats keep 10 mantissa bits down to 2^-14; smaller values may flush to zero.
+    // A snorm10 component is off by at most half of 1/511, which bounds the angle by
+    // asin(sqrt(3) / 1022); unorm16 is off by at most half of 1/65535.
+    const float POSITION_RELATIVE_BOUND = 1.0f / 1024.0f;
+    const float POSITION_ABSOLUTE_BOUND = 1.0f / 16384.0f;
+    const float NORMAL_DEGREES_BOUND = (float)glm::degrees(asin(sqrt(3.0) / 1022.0));
+    const float UV_BOUND = 0.5f / 65535.0f + 1.0e-7f;
+
+    float positionRelative = 0.0f, positionAbsolute = 0.0f, normalDegrees = 0.0f, uvError = 0.0f;
+    for (int i = 0; i < vertexCount; ++i) {
+        const float* original = &vertices[i * FLOAT_VERTEX_COMPONENTS];
+        const float* restored = &decoded[i * FLOAT_VERTEX_COMPONENTS];
+        for (int k = 0; k < 3; ++k) {
+            float error = fabs(restored[k] - original[k]);
+            if (fabs(original[k]) >= POSITION_ABSOLUTE_BOUND) {
+                positionRelative = max(positionRelative, error / fabs(original[k]));
+            } else {
+                positionAbsolute = max(positionAbsolute, error);
+            }
+        }
+        // atan2 of the cross and dot products stays accurate for tiny angles, unlike acos
+        glm::vec3 normal(restored[3], restored[4], restored[5]);
+        glm::vec3 reference(original[3], original[4], original[5]);
+        float angle = atan2(glm::length(glm::cross(normal, reference)), glm::dot(normal, reference));
+        normalDegrees = max(normalDegrees, (float)glm::degrees(angle));
+        uvError = max(uvError, max(fabs(restored[6] - original[6]), fabs(restored[7] - original[7])));
+    }
+
+    bool passed = positionRelative <= POSITION_RELATIVE_BOUND && positionAbsolute <= POSITION_ABSOLUTE_BOUND
+               && normalDegrees <= NORMAL_DEGREES_BOUND && uvError <= UV_BOUND;
+    cout << scientific << setprecision(2)
+         << "position max relative error " << positionRelative << " (bound " << POSITION_RELATIVE_BOUND << "), "
+         << "max absolute error below 2^-14 " << positionAbsolute << " (bound " << POSITION_ABSOLUTE_BOUND << ")" << endl
+         << "normal max angle " << normalDegrees << " deg (bound " << NORMAL_DEGREES_BOUND << ")" << endl
+         << "uv max error " << uvError << " (bound " << UV_BOUND << ")" << endl
+         << (passed ? "PASS" : "FAIL") << endl;
+    return passed;
+}
+
+// Check the level-of-detail chains of the procedural primitives and the level selection
+// on the CPU (no GL context): triangle counts, index ranges and winding of every level,
+// then thresholds, hysteresis and projected sizes; returns false on failure
+bool RunLodTest()
+{
+    struct Primitive {
+        const char* name;
+        vector<int> segments;
+        function<void(int, vector<float>&, vector<unsigned int>&)> build;
+        function<size_t(int)> expectedTriangles;
+        function<float(int)> edgesAcross;
+    };
+    const float thickness = 0.15f / 0.35f;
+    const Primitive primitives[] = {
+        { "sphere", makeLodSegments(64, MIN_ROUND_SEGMENTS),
+          [](int n, vector<float>& v, vector<unsigned int>& i) { Sphere::buildVertices(n, n / 2, v); Sphere::buildIndices(n, n / 2, i); },
+          [](int n) { return (size_t)n * (n - 2); }, [](int n) { return n / glm::pi<float>(); } },
+        { "cylinder", makeLodSegments(64, MIN_ROUND_SEGMENTS),
+          [](int n, vector<float>& v, vector<unsigned int>& i) { Cylinder::buildVertices(n, v); Cylinder::buildIndices(n, i); },
+          [](int n) { return (size_t)4 * n; }, [](int n) { return n / glm::pi<float>(); } },
+        { "cone", makeLodSegments(64, MIN_ROUND_SEGMENTS),
+          [](int n, vector<float>& v, vector<unsigned int>& i) { Cone::buildVertices(n, v); Cone::buildIndices(n, i); },
+          [](int n) { return (size_t)2 * n; }, [](int n) { return n / glm::pi<float>(); } },
+        { "torus", makeLodSegments(64, MIN_ROUND_SEGMENTS),
+          [thickness](int n, vector<float>& v, vector<unsigned int>& i) { Torus::buildVertices(n, n / 2, thickness, v); Torus::buildIndices(n, n / 2, i); },
+          [](int n) { return (size_t)n * n; }, [](int n) { return n / glm::pi<float>(); } },
+        { "plane", makeLodSegments(16, 1),
+          [](int n, vector<float>& v, vector<unsigned int>& i) { Plane::buildVertices(n, v); Plane::buildIndices(n, i); },
+          [](int n) { return (size_t)2 * n * n; }, [](int n) { return (float)n; } },
+    };
+
+    // Every level: expected triangle count, indices in range, faces wound towards their
+    // vertex normals, fewer triangles than the level before, a cheap coarsest level
+    const size_t COARSEST_TRIANGLE_BOUND = 64;
+    bool passed = true;
+    cout << "LOD test" << endl;
+    cout << "primitive  level  segments  triangles  expected  vertices  inward_faces" << endl;
+    for (const Primitive& primitive : primitives) {
+        size_t previousTriangles = numeric_limits<size_t>::max();
+        for (size_t level = 0; level < primitive.segments.size(); ++level) {
+            int segments = primitive.segments[level];
+            vector<float> vertices;
+            vector<unsigned int> indices;
+            primitive.build(segments, vertices, indices);
+            size_t vertexCount = vertices.size() / FLOAT_VERTEX_COMPONENTS;
+            size_t triangles = indices.size() / 3;
+
+            size_t inwardFaces = 0;
+            bool inRange = indices.size() % 3 == 0;
+            for (size_t t = 0; inRange && t < triangles; ++t) {
+                const float* corner[3];
+                glm::vec3 normalSum(0.0f);
+                for (int k = 0; k < 3; ++k) {
+                    inRange = inRange && indices[t * 3 + k] < vertexCount;
+                    corner[k] = &vertices[min<size_t>(indices[t * 3 + k], vertexCount - 1) * FLOAT_VERTEX_COMPONENTS];
+                    normalSum += glm::vec3(corner[k][3], corner[k][4], corner[k][5]);
+                }
+                glm::vec3 a(corner[0][0], corner[0][1], corner[0][2]);
+                glm::vec3 face = glm::cross(glm::vec3(corner[1][0], corner[1][1], corner[1][2]) - a,
+                                            glm::vec3(corner[2][0], corner[2][1], corner[2][2]) - a);
+                if (glm::dot(face, normalSum) <= 0.0f) {
+                    ++inwardFaces;
+                }
+            }
+
+            size_t expected = primitive.expectedTriangles(segments);
+            bool levelPassed = inRange && triangles == expected && inwardFaces == 0 && triangles < previousTriangles
+                            && (level + 1 < primitive.segments.size() || triangles <= COARSEST_TRIANGLE_BOUND);
+            passed = passed && levelPassed;
+            previousTriangles = triangles;
+            cout << left << setw(11) << primitive.name << right << setw(5) << level << setw(10) << segments
+                 << setw(11) << triangles << setw(10) << expected << setw(10) << vertexCount << setw(14) << inwardFaces
+                 << (levelPassed ? "" : "  FAIL") << endl;
+        }
+    }
+
+    // Projected size of a sphere against its closed form, perspective and orthographic
+    const float radius = 0.5f;
+    const float fieldOfView = glm::radians(45.0f);
+    glm::mat4 perspectiveProjection = glm::perspective(fieldOfView, 16.0f / 9.0f, 0.1f, 100.0f);
+    glm::mat4 orthographicProjection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+    float sizeError = 0.0f;
+    for (float distance : { 1.0f, 7.5f, 60.0f }) {
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, distance), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        float expected = radius / (distance * tan(fieldOfView * 0.5f));
+        float measured = getProjectedScreenSize(perspectiveProjection * view, perspectiveProjection[1][1], glm::vec3(0.0f), radius);
+        sizeError = max(sizeError, fabs(measured - expected) / expected);
+        measured = getProjectedScreenSize(orthographicProjection * view, orthographicProjection[1][1], glm::vec3(0.0f), radius);
+        sizeError = max(sizeError, fabs(measured - radius / 5.0f) / (radius / 5.0f));
+    }
+    bool sizePassed = sizeError < 1.0e-4f;
+    passed = passed && sizePassed;
+    cout << scientific << setprecision(2) << "projected size max relative error " << sizeError
+         << (sizePassed ? "" : "  FAIL") << endl << defaultfloat;
+
+    // Thresholds descend to 0 on the coarsest level. Without history the level is the
+    // coarsest whose edges fit; finer levels are taken at once and coarser ones only
+    // below the hysteresis margin.
+    for (const Primitive& primitive : primitives) {
+        vector<float> edgesAcross;
+        for (int segments : primitive.segments) {
+            edgesAcross.push_back(primitive.edgesAcross(segments));
+        }
+        vector<float> screenSizes = makeLodScreenSizes(edgesAcross);
+        int last = (int)screenSizes.size() - 1;
+        bool selectionPassed = screenSizes[last] == 0.0f && selectLod(screenSizes, 10.0f, last) == 0
+                            && selectLod(screenSizes, 0.0f, 0) == last;
+        for (int level = 0; level < last; ++level) {
+            float threshold = screenSizes[level];
+            selectionPassed = selectionPassed && threshold > screenSizes[level + 1]
+                && selectLod(screenSizes, threshold * 1.01f, last) == level
+                && selectLod(screenSizes, threshold * 0.99f, last) == level + 1
+                && selectLod(screenSizes, threshold * 0.99f, level) == level
+                && selectLod(screenSizes, threshold * LOD_HYSTERESIS * 0.99f, level) == level + 1;
+        }
+
+        // Sweep the sphere away from the camera and back: levels change monotonically
+        // and the drawn level never shows edges longer than LOD_EDGE_SCREEN_FRACTION
+        int lod = 0;
+        float longestEdge = 0.0f;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int step = 0; step <= 400; ++step) {
+                float distance = pow(10.0f, (pass == 0 ? step : 400 - step) / 100.0f);
+                float screenSize = radius / (distance * tan(fieldOfView * 0.5f));
+                int next = selectLod(screenSizes, screenSize, lod);
+                selectionPassed = selectionPassed && (pass == 0 ? next >= lod : next <= lod);
+                lod = next;
+                if (lod > 0) {
+                    longestEdge = max(longestEdge, screenSize / edgesAcross[lod]);
+                }
+            }
+        }
+        selectionPassed = selectionPassed && lod == 0 && longestEdge <= LOD_EDGE_SCREEN_FRACTION;
+        passed = passed && selectionPassed;
+
+        cout << left << setw(11) << primitive.name << right << "selection " << (selectionPassed ? "ok" : "FAIL")
+             << ", level from distance (radius " << radius << ", 45 deg):";
+        for (int level = 1; level <= last; ++level) {
+            cout << " " << level << "@" << fixed << setprecision(1)
+                 << radius / (screenSizes[level - 1] * tan(fieldOfView * 0.5f)) << defaultfloat;
+        }
+        cout << endl;
+    }
+
+    cout << (passed ? "PASS" : "FAIL") << endl;
+    return passed;
+}
+
+// Check the tiled SIMD software occlusion buffer against a brute-force reference on
+// random scenes: the reference tests every pixel center against every face of every
+// occluder (either winding, no binning or culling of back faces) and every occludee
+// against every pixel of its grown rectangle. Positions are only exact to rounding, so
+// the reference bounds each pixel between its depth with faces shrunk and grown by
+// EDGE_TOLERANCE pixels, and allows the depth change over that distance on the steepest
+// face covering it (thin faces reaching far off screen are steep). The fast depths must
+// lie in those bounds and its visibility answers must match wherever they decide them.
+bool RunSoftwareOcclusionTest(int sceneCount)
+{
+    const int width = SOFTWARE_OCCLUSION_WIDTH, height = SOFTWARE_OCCLUSION_HEIGHT;
+    const int OCCLUDEE_COUNT = 400;
+    const float EDGE_TOLERANCE = 1.0e-3f;
+    const float DEPTH_TOLERANCE = 1.0e-5f;
+
+    uint32_t state = 7;
+    auto random = [&state](float low, float high) {
+        state = state * 1664525u + 1013904223u;
+        return low + (high - low) * ((state >> 8) / 16777216.0f);
+    };
+
+    // Reference rasterization of one occluder: window corners, then both triangles of
+    // every face at every pixel center, depth from barycentric weights. nearDepth takes
+    // faces grown by the tolerance, farDepth faces shrunk by it, slack the depth change
+    // over the tolerance.
+    auto referenceOccluder = [&](const SoftwareOcclusion::Occluder& occluder, const glm::mat4& viewProjection,
+                                 vector<float>& nearDepth, vector<float>& farDepth, vector<float>& slack) {
+        glm::mat4 toClip = viewProjection * occluder.model;
+        glm::vec3 corners[8];
+        for (int corner = 0; corner < 8; ++corner) {
+            if (!SoftwareOcclusion::projectCorner(toClip, occluder.bounds, corner, corners[corner])) {
+                return;
+            }
+        }
+        auto edge = [](const glm::vec3& from, const glm::vec3& to, float x, float y) {
+            return (to.x - from.x) * (y - from.y) - (to.y - from.y) * (x - from.x);
+        };
+        for (const auto& face : SoftwareOcclusion::BOX_FACES) {
+            for (int half = 0; half < 2; ++half) {
+                glm::vec3 v[3] = { corners[face[0]], corners[face[half + 1]], corners[face[half + 2]] };
+                float area = edge(v[0], v[1], v[2].x, v[2].y);
+                if (area == 0.0f) {
+                    continue;
+                }
+                float sign = area > 0.0f ? 1.0f : -1.0f;
+                float gradientX = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+                float gradientY = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+                float faceSlack = DEPTH_TOLERANCE + EDGE_TOLERANCE * (fabs(gradientX) + fabs(gradientY));
+                float lengths[3];
+                for (int k = 0; k < 3; ++k) {
+                    lengths[k] = glm::length(glm::vec2(v[(k + 2) % 3]) - glm::vec2(v[(k + 1) % 3]));
+                }
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; ++x) {
+                        float px = x + 0.5f, py = y + 0.5f;
+                        float weights[3], nearestEdge = numeric_limits<float>::max();
+                        for (int k = 0; k < 3; ++k) {
+                            float opposite = edge(v[(k + 1) % 3], v[(k + 2) % 3], px, py);
+                            weights[k] = opposite / area;
+                            nearestEdge = min(nearestEdge, sign * opposite / lengths[k]);  // distance inside
+                        }
+                        if (nearestEdge < -EDGE_TOLERANCE) {
+                            continue;
+                        }
+                        float z = glm::clamp(weights[0] * v[0].z + weights[1] * v[1].z + weights[2] * v[2].z,
+                                             min(min(v[0].z, v[1].z), v[2].z), max(max(v[0].z, v[1].z), v[2].z));
+                        size_t pixel = (size_t)y * width + x;
+                        nearDepth[pixel] = min(nearDepth[pixel], z);
+                        slack[pixel] = max(slack[pixel], faceSlack);
+                        if (nearestEdge > EDGE_TOLERANCE) {
+                            farDepth[pixel] = min(farDepth[pixel], z);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    cout << "Software occlusion test: " << width << "x" << height << ", tiles of " << SOFTWARE_OCCLUSION_TILE_SIZE
+         << ", " << sceneCount << " scenes, " << OCCLUDEE_COUNT << " occludees each, "
+#if defined(SIMD_AVX2)
+         << "AVX2"
+#elif defined(SIMD_SSE2)
+         << "SSE2"
+#else
+         << "scalar"
+#endif
+         << endl;
+    cout << "scene  occluders  triangles  covered  edge_pixels  depth_errors  occluded  reference  undecided  disagreements" << endl;
+
+    bool passed = true;
+    SoftwareOcclusion buffer;
+    for (int sceneIndex = 0; sceneIndex < sceneCount; ++sceneIndex) {
+        // Camera orbiting the origin; occluders are rotated boxes, some mirrored and some
+        // reaching past the near plane or off screen
+        float angle = random(0.0f, 6.2832f);
+        glm::vec3 eye(cos(angle) * 12.0f, random(0.5f, 5.0f), sin(angle) * 12.0f);
+        glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f)
+                                 * glm::lookAt(eye, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        vector<SoftwareOcclusion::Occluder> occluders(1 + sceneIndex * 3 % 48);
+        for (auto& occluder : occluders) {
+            occluder.bounds.min = glm::vec3(-0.5f);
+            occluder.bounds.max = glm::vec3(0.5f);
+            glm::vec3 axis = glm::normalize(glm::vec3(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f)) + glm::vec3(0.0f, 0.01f, 0.0f));
+            glm::vec3 scale(random(0.3f, 4.0f), random(0.3f, 4.0f), random(0.3f, 4.0f));
+            if (random(0.0f, 1.0f) < 0.15f) {
+                scale.x = -scale.x;
+            }
+            glm::vec3 position = random(0.0f, 1.0f) < 0.1f ? eye * random(0.8f, 1.1f)
+                                                           : glm::vec3(random(-8.0f, 8.0f), random(-1.0f, 3.0f), random(-8.0f, 8.0f));
+            occluder.model = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), position), random(0.0f, 6.2832f), axis), scale);
+        }
 
-        // Detach and delete shader objects after linking
-        glDetachShader(programId, vertexShaderId);
-        glDetachShader(programId, fragmentShaderId);
-        glDeleteShader(vertexShaderId);
-        glDeleteShader(fragmentShaderId);
+        buffer.render(occluders, viewProjection);
+        vector<float> nearDepth((size_t)width * height, 1.0f), farDepth((size_t)width * height, 1.0f);
+        vector<float> slack((size_t)width * height, DEPTH_TOLERANCE);
+        for (const auto& occluder : occluders) {
+            referenceOccluder(occluder, viewProjection, nearDepth, farDepth, slack);
+        }
 
-        return true;
-    }
-    
-    // Access lights for modifying properties
-    Light* getLight(int index) {
-        if (index >= 0 && index < lights.size()) {
-            return lights[index].get();
+        const vector<float>& depth = buffer.getDepth();
+        size_t covered = 0, edgePixels = 0, depthErrors = 0;
+        for (size_t i = 0; i < depth.size(); ++i) {
+            covered += farDepth[i] < 1.0f;
+            edgePixels += nearDepth[i] != farDepth[i];
+            depthErrors += depth[i] < nearDepth[i] - slack[i] || depth[i] > farDepth[i] + slack[i];
         }
-        return nullptr;
-    }
-    
-    int getLightCount() const { return lights.size(); }
-};
 
-// Function prototypes
-bool Initialize(int, char* [], GLFWwindow** window);
-void ResizeWindow(GLFWwindow* window, int width, int height);
-void ProcessInput(GLFWwindow* window);
-void MousePositionCallback(GLFWwindow* window, double xpos, double ypos);
-void MouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
-void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-void BuildScene(Scene& scene);
+        // Occludees of every size, many hidden behind or inside occluders
+        size_t occluded = 0, referenceOccluded = 0, undecided = 0, disagreements = 0;
+        for (int k = 0; k < OCCLUDEE_COUNT; ++k) {
+            AABB box;
+            glm::vec3 center(random(-10.0f, 10.0f), random(-1.0f, 3.0f), random(-10.0f, 10.0f));
+            glm::vec3 extents(random(0.02f, 1.0f), random(0.02f, 1.0f), random(0.02f, 1.0f));
+            box.min = center - extents;
+            box.max = center + extents;
+            bool fast = buffer.isOccluded(box);
 
-// Shader source code
-// Vertex shader source code for shape rendering
-const GLchar* vertex_shader_source = GLSL(440,
-    layout(location = 0) in vec3 position;
-    layout(location = 1) in vec3 normal;
-    layout(location = 2) in vec2 textureCoordinate;
+            // Reference: the nearest corner against every pixel of the grown rectangle;
+            // certainly hidden if every pixel is nearer even with shrunk faces, certainly
+            // visible if some pixel is at or behind it even with grown faces
+            bool inFront = true;
+            glm::vec2 low(numeric_limits<float>::max()), high(-numeric_limits<float>::max());
+            float nearest = 1.0f;
+            for (int corner = 0; corner < 8 && inFront; ++corner) {
+                glm::vec3 window;
+                inFront = SoftwareOcclusion::projectCorner(viewProjection, box, corner, window);
+                low = glm::min(low, glm::vec2(window));
+                high = glm::max(high, glm::vec2(window));
+                nearest = min(nearest, window.z);
+            }
+            bool certainlyHidden = false, certainlyVisible = true;
+            if (inFront) {
+                int x0 = max(0, (int)floor(max(low.x, -2.0f)) - 1), x1 = min(width - 1, (int)floor(min(high.x, (float)width)) + 1);
+                int y0 = max(0, (int)floor(max(low.y, -2.0f)) - 1), y1 = min(height - 1, (int)floor(min(high.y, (float)height)) + 1);
+                if (x0 <= x1 && y0 <= y1) {
+                    certainlyHidden = true;
+                    certainlyVisible = false;
+                    for (int y = y0; y <= y1; ++y) {
+                        for (int x = x0; x <= x1; ++x) {
+                            size_t pixel = (size_t)y * width + x;
+                            certainlyHidden = certainlyHidden && farDepth[pixel] < nearest - slack[pixel];
+                            certainlyVisible = certainlyVisible || nearDepth[pixel] >= nearest + slack[pixel];
+                        }
+                    }
+                }
+            }
+            occluded += fast;
+            referenceOccluded += certainlyHidden;
+            undecided += !certainlyHidden && !certainlyVisible;
+            disagreements += (fast && certainlyVisible) || (!fast && certainlyHidden);
+        }
 
-    out vec3 vertexNormal;
-    out vec3 vertexFragmentPos;
-    out vec2 vertexTextureCoordinate;
+        bool scenePassed = depthErrors == 0 && disagreements == 0;
+        passed = passed && scenePassed;
+        cout << setw(5) << sceneIndex << setw(11) << occluders.size() << setw(11) << buffer.getTriangleCount()
+             << setw(9) << covered << setw(13) << edgePixels << setw(14) << depthErrors << setw(10) << occluded
+             << setw(11) << referenceOccluded << setw(11) << undecided << setw(15) << disagreements
+             << (scenePassed ? "" : "  FAIL") << endl;
+    }
 
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    cout << (passed ? "PASS" : "FAIL") << endl;
+    return passed;
+}
 
-    void main()
-    {
-        gl_Position = projection * view * model * vec4(position, 1.0f);
-        vertexFragmentPos = vec3(model * vec4(position, 1.0f));
-        vertexNormal = mat3(transpose(inverse(model))) * normal;
-        vertexTextureCoordinate = textureCoordinate;
+// Compare forward and deferred frame time across point light counts and depth complexity
+// in a 640x360 viewport. Each layer is a wall of cubes covering the view; layers are added
+// back to front and drawn instanced in that order, so forward shading lights every layer
+// of every pixel while deferred shading lights each pixel once.
+void RunDeferredBenchmark(int frameCount)
+{
+    const int width = 640, height = 360;
+    const int layerCounts[] = { 1, 4, 8 };
+    const int lightCounts[] = { 0, 64, 256, 512 };
+    const int columns = 16, rows = 10;
+    const float layerSpacing = 1.5f;
+
+    vector<unsigned char> pixels(64 * 64 * 4);
+    for (int y = 0; y < 64; ++y) {
+        for (int x = 0; x < 64; ++x) {
+            unsigned char shade = ((x / 8 + y / 8) % 2 == 0) ? 230 : 90;
+            unsigned char* pixel = &pixels[(y * 64 + x) * 4];
+            pixel[0] = pixel[1] = pixel[2] = shade;
+            pixel[3] = 255;
+        }
     }
-);
+    TextureManager::instance().create("synthetic/deferred_checker", 64, 64, pixels);
 
-// Fragment shader source code for shape rendering
-const GLchar* fragment_shader_source = GLSL(440,
-    in vec3 vertexFragmentPos;
-    in vec3 vertexNormal;
-    in vec2 vertexTextureCoordinate;
+    gCamera.Position = glm::vec3(0.0f, 0.0f, 8.0f);
+    glm::mat4 view = glm::lookAt(gCamera.Position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)width / (GLfloat)height, 0.1f, 100.0f);
+    glViewport(0, 0, width, height);
 
-    out vec4 fragmentColor;
+    // Frame time including the GPU, averaged over frameCount frames after a warm-up frame
+    auto measure = [&](bool deferred) {
+        scene.setDeferredEnabled(deferred);
+        scene.render(view, projection);
+        glFinish();
+        auto start = chrono::steady_clock::now();
+        for (int frame = 0; frame < frameCount; ++frame) {
+            scene.render(view, projection);
+        }
+        glFinish();
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frameCount;
+    };
 
-    uniform vec3 objectColor;
-    uniform vec3 lightColor;
-    uniform vec3 keyLightColor;
-    uniform vec3 lightPos;
-    uniform vec3 keyLightPos;
-    uniform vec3 viewPosition;
+    cout << "Deferred benchmark: " << columns << "x" << rows << " cube walls, " << width << "x" << height
+         << ", " << frameCount << " frames" << endl;
+    cout << "layers  lights  forward_ms  deferred_ms  speedup" << endl;
 
-    uniform sampler2D uTexture;
-    uniform vec2 uvScale;
+    for (int layers : layerCounts) {
+        scene.clear();
+        scene.addLight(make_shared<Light>(glm::vec3(2.5f, 5.0f, 4.0f), glm::vec3(1.0f), 0.2f, 0.8f));
+        scene.addLight(make_shared<Light>(glm::vec3(-1.5f, 4.0f, 3.0f), glm::vec3(0.0f, 0.0f, 1.0f), 0.1f, 0.5f));
+        for (int layer = layers - 1; layer >= 0; --layer) {
+            for (int i = 0; i < columns * rows; ++i) {
+                glm::vec3 position(i % columns - (columns - 1) * 0.5f, i / columns - (rows - 1) * 0.5f, -layer * layerSpacing);
+                scene.addShape(make_shared<Cube>(1.0f, position, glm::vec3(1.0f), glm::vec3(1.0f), "synthetic/deferred_checker"));
+            }
+        }
 
-    void main()
-    {
-        // Calculate Ambient
-        float FillerStrength = 0.4f;
-        float keyStrength = 0.1f;
-        vec3 Filler = FillerStrength * lightColor;
-        vec3 key = keyStrength * keyLightColor;
+        // Lights are added between measurements, spread through the whole stack of walls
+        int addedLights = 0;
+        for (int lightCount : lightCounts) {
+            for (; addedLights < lightCount; ++addedLights) {
+                float u = fmod(addedLights * 0.618034f, 1.0f);
+                float v = fmod(addedLights * 0.754878f, 1.0f);
+                float w = fmod(addedLights * 0.569840f, 1.0f);
+                glm::vec3 position((u - 0.5f) * columns, (v - 0.5f) * rows, 1.0f - w * layers * layerSpacing);
+                glm::vec3 color(0.6f + 0.4f * sin(addedLights * 0.9f), 0.6f + 0.4f * sin(addedLights * 1.3f + 2.0f),
+                                0.6f + 0.4f * sin(addedLights * 1.7f + 4.0f));
+                scene.addLight(make_shared<Light>(position, color, 0.05f, 1.5f, 2.0f));
+            }
 
-        // Calculate Diffuse lighting
-        vec3 norm = normalize(vertexNormal);
-        vec3 lightDirection = normalize(lightPos - vertexFragmentPos);
-        vec3 keyLightDirection = normalize(keyLightPos - vertexFragmentPos);
+            double forwardMs = measure(false);
+            double deferredMs = measure(true);
+            cout << setw(6) << layers << setw(8) << lightCount
+                 << fixed << setprecision(3) << setw(12) << forwardMs << setw(13) << deferredMs
+                 << setprecision(2) << setw(8) << forwardMs / deferredMs << "x" << endl;
+        }
+    }
+    cout << "G-buffer bytes " << scene.getGBufferBytes() << endl;
 
-        float impact = max(dot(norm, lightDirection), 0.0);
-        float keyImpact = max(dot(norm, keyLightDirection), 0.0);
+    scene.setDeferredEnabled(false);
+    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+}
 
-        vec3 diffuse = impact * lightColor;
-        vec3 keyDiffuse = keyImpact * keyLightColor;
+// Compare draws and frame time without occlusion culling, with the Hi-Z culler and with
+// the software rasterizer (buildings as occluders) on a city block grid in a 640x360
+// viewport. A camera at street level walks down the middle street, so the buildings on
+// either side hide most of the props behind and inside them. Each run starts with a
+// warm-up frame so the Hi-Z culler has a depth capture to test against. An untimed
+// second pass reads every frame back; the benchmark fails if a culled frame differs
+// from the unculled one.
+bool RunOcclusionBenchmark(int frameCount)
+{
+    const int width = 640, height = 360;
+    const int blocks = 10;
+    const float blockSize = 8.0f, streetWidth = 4.0f, pitch = blockSize + streetWidth;
+    const int propsInside = 24, propsOutside = 16;
 
-        // Calculate Specular lighting
-        float specularIntensity = 0.4f;
-        float highlightSize = 16.0f;
-        vec3 viewDir = normalize(viewPosition - vertexFragmentPos);
-        vec3 reflectDir = reflect(-lightDirection, norm);
+    vector<unsigned char> pixels(64 * 64 * 4);
+    for (int y = 0; y < 64; ++y) {
+        for (int x = 0; x < 64; ++x) {
+            unsigned char shade = (x % 16 < 12 && y % 16 < 10) ? 200 : 70;
+            unsigned char* pixel = &pixels[(y * 64 + x) * 4];
+            pixel[0] = pixel[1] = pixel[2] = shade;
+            pixel[3] = 255;
+        }
+    }
+    TextureManager::instance().create("synthetic/occlusion_facade", 64, 64, pixels);
 
-        // Calculate specular component
-        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-        vec3 specular = specularIntensity * specularComponent * lightColor;
-        vec3 keySpecular = specularIntensity * specularComponent * keyLightColor;
+    scene.clear();
+    scene.addLight(make_shared<Light>(glm::vec3(20.0f, 40.0f, 30.0f), glm::vec3(1.0f), 0.2f, 0.8f));
+    scene.addLight(make_shared<Light>(glm::vec3(-30.0f, 25.0f, -20.0f), glm::vec3(0.6f, 0.7f, 1.0f), 0.1f, 0.5f));
 
-        // Texture holds the color to be used for all three components
-        vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+    // Deterministic pseudo-random heights and prop placement
+    uint32_t state = 2024;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+    float extent = (blocks - 1) * pitch * 0.5f;
+    for (int row = 0; row < blocks; ++row) {
+        for (int column = 0; column < blocks; ++column) {
+            glm::vec3 center(column * pitch - extent, 0.0f, row * pitch - extent);
+            float buildingHeight = 6.0f + 14.0f * random();
+            auto building = make_shared<Cube>(1.0f, center + glm::vec3(0.0f, buildingHeight * 0.5f, 0.0f),
+                                              glm::vec3(blockSize, buildingHeight, blockSize), glm::vec3(0.8f),
+                                              "synthetic/occlusion_facade");
+            building->setOccluder(true);
+            scene.addShape(building);
 
-        // Calculate Phong lighting result
-        vec3 phong = (Filler + key + diffuse + keyDiffuse + specular) * textureColor.xyz;
+            // Furniture inside the building, hidden by its walls from every street
+            for (int i = 0; i < propsInside; ++i) {
+                glm::vec3 offset((random() - 0.5f) * (blockSize - 2.0f), 0.5f + random() * (buildingHeight - 1.5f),
+                                 (random() - 0.5f) * (blockSize - 2.0f));
+                scene.addShape(make_shared<Cube>(0.6f, center + offset, glm::vec3(1.0f), glm::vec3(0.9f, 0.6f, 0.4f),
+                                                 "synthetic/occlusion_facade"));
+            }
 
-        fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+            // Street furniture along the block's edges
+            for (int i = 0; i < propsOutside; ++i) {
+                float along = (random() - 0.5f) * blockSize;
+                float across = blockSize * 0.5f + 0.6f;
+                glm::vec3 offsets[4] = { glm::vec3(along, 0.4f, across), glm::vec3(along, 0.4f, -across),
+                                         glm::vec3(across, 0.4f, along), glm::vec3(-across, 0.4f, along) };
+                scene.addShape(make_shared<Sphere>(0.4f, center + offsets[i % 4], glm::vec3(1.0f), glm::vec3(0.3f, 0.7f, 0.4f),
+                                                   "synthetic/occlusion_facade", glm::vec2(1.0f), 16));
+            }
+        }
     }
-);
 
-// Light Shader Source Code
-const GLchar* lampVertexShaderSource = GLSL(440,
-    layout(location = 0) in vec3 position;
+    // Street level, down the street between the two middle columns of blocks
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), (GLfloat)width / (GLfloat)height, 0.1f, 300.0f);
+    auto viewAt = [&](int frame) {
+        float t = frameCount > 1 ? (float)frame / (frameCount - 1) : 0.0f;
+        glm::vec3 eye(sin(t * 6.0f) * 0.5f, 1.7f, extent + 6.0f - t * pitch * 2.0f);
+        gCamera.Position = eye;
+        return glm::lookAt(eye, eye + glm::vec3(sin(t * 3.0f) * 0.25f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    };
+    glViewport(0, 0, width, height);
 
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    struct Result {
+        double frameMs = 0.0, draws = 0.0, visible = 0.0, occluded = 0.0;
+        vector<vector<unsigned char>> frames;
+    };
+    const char* modeNames[3] = { "off", "hi-z", "software" };
+    auto measure = [&](int mode) {
+        Result result;
+        scene.setOcclusionCullingEnabled(mode == 1);
+        scene.setSoftwareOcclusionEnabled(mode == 2);
+        scene.render(viewAt(0), projection);
+        glFinish();
+        auto start = chrono::steady_clock::now();
+        for (int frame = 0; frame < frameCount; ++frame) {
+            scene.render(viewAt(frame), projection);
+            result.draws += scene.getRenderStatistics().drawCalls;
+            result.visible += scene.getCullingStatistics().visibleShapes;
+            result.occluded += scene.getCullingStatistics().occludedShapes + scene.getCullingStatistics().softwareOccludedShapes;
+        }
+        glFinish();
+        result.frameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frameCount;
+        result.draws /= frameCount;
+        result.visible /= frameCount;
+        result.occluded /= frameCount;
 
-    void main()
-    {
-        gl_Position = projection * view * model * vec4(position, 1.0f);
-    }
-);
+        scene.render(viewAt(0), projection);
+        result.frames.resize(frameCount);
+        for (int frame = 0; frame < frameCount; ++frame) {
+            scene.render(viewAt(frame), projection);
+            result.frames[frame].resize(width * height * 4);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, result.frames[frame].data());
+        }
+        return result;
+    };
 
-// Light Fragment Shader Source Code
-const GLchar* lampFragmentShaderSource = GLSL(440,
-    out vec4 fragmentColor;
+    // Per-object draws, so draw calls follow visible shapes; shadows would add the same
+    // cost to both runs
+    bool shadowsWereEnabled = scene.isShadowsEnabled();
+    scene.setShadowsEnabled(false);
+    scene.setInstancingEnabled(false);
+    scene.setMultiDrawEnabled(false);
 
-    void main()
-    {
-        fragmentColor = vec4(1.0f);
+    size_t shapeCount = (size_t)blocks * blocks * (1 + propsInside + propsOutside);
+    cout << "Occlusion benchmark: " << blocks << "x" << blocks << " city blocks, " << shapeCount << " shapes, "
+         << width << "x" << height << ", " << frameCount << " frames" << endl;
+    cout << "occlusion  visible  occluded    draws  frame_ms" << endl;
+
+    Result results[3];
+    for (int mode = 0; mode < 3; ++mode) {
+        results[mode] = measure(mode);
+        cout << left << setw(9) << modeNames[mode] << right << fixed << setprecision(1)
+             << setw(9) << results[mode].visible << setw(10) << results[mode].occluded
+             << setw(9) << results[mode].draws << setprecision(3) << setw(10) << results[mode].frameMs << endl;
     }
-);
 
-// Create a scene instance
-Scene scene;
+    // Culling must be conservative: anything culled was hidden, so the images match
+    bool passed = true;
+    for (int mode = 1; mode < 3; ++mode) {
+        size_t differing = 0;
+        int differingFrames = 0;
+        for (int frame = 0; frame < frameCount; ++frame) {
+            const vector<unsigned char>& expected = results[0].frames[frame];
+            const vector<unsigned char>& actual = results[mode].frames[frame];
+            size_t before = differing;
+            for (size_t i = 0; i < expected.size(); i += 4) {
+                for (int channel = 0; channel < 3; ++channel) {
+                    if (abs(expected[i + channel] - actual[i + channel]) > 8) {
+                        ++differing;
+                        break;
+                    }
+                }
+            }
+            differingFrames += differing > before;
+        }
+        passed = passed && differing == 0;
+        cout << fixed << setprecision(2) << modeNames[mode] << ": draw reduction "
+             << results[0].draws / max(1.0, results[mode].draws) << "x, frame time "
+             << results[0].frameMs / results[mode].frameMs << "x, pixels differing " << differing << " in "
+             << differingFrames << " frames" << endl;
+    }
+    cout << (passed ? "PASS" : "FAIL") << endl;
 
-// Main function
-int main(int argc, char* argv[])
+    scene.setOcclusionCullingEnabled(false);
+    scene.setSoftwareOcclusionEnabled(false);
+    scene.setInstancingEnabled(true);
+    scene.setShadowsEnabled(shadowsWereEnabled);
+    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    return passed;
+}
+
+// Import a generated OBJ of about triangleCount triangles cold (no cache), then load it
+// warm from the mapped cache, in both vertex formats; each load ends with glFinish so
+// the upload is complete. The OS page cache holds both files in every run.
+void RunMeshLoadBenchmark(int triangleCount)
 {
-    // Check if initialized correctly
-    if (!Initialize(argc, argv, &gWindow))
-        return EXIT_FAILURE;
+    const string path = "mesh_load_benchmark.obj";
+    const int WARM_RUNS = 3;
 
-    // Initialize the scene with shader programs
-    if (!scene.initialize(vertex_shader_source, fragment_shader_source, 
-                         lampVertexShaderSource, lampFragmentShaderSource)) {
-        cerr << "Failed to initialize scene" << endl;
-        return EXIT_FAILURE;
+    // Height field grid with positions, UVs and normals, one corner index per vertex
+    int side = max(2, (int)ceil(sqrt(triangleCount / 2.0)) + 1);
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            cerr << "Failed to write " << path << endl;
+            return;
+        }
+        for (int row = 0; row < side; ++row) {
+            for (int column = 0; column < side; ++column) {
+                float x = (float)column / (side - 1), z = (float)row / (side - 1);
+                float height = 0.05f * sin(x * 25.0f) * cos(z * 19.0f);
+                glm::vec3 normal = glm::normalize(glm::vec3(-1.25f * cos(x * 25.0f) * cos(z * 19.0f), 1.0f,
+                                                            0.95f * sin(x * 25.0f) * sin(z * 19.0f)));
+                fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n", x - 0.5f, height, z - 0.5f, x, z,
+                        normal.x, normal.y, normal.z);
+            }
+        }
+        for (int row = 0; row + 1 < side; ++row) {
+            for (int column = 0; column + 1 < side; ++column) {
+                int a = row * side + column + 1, b = a + 1, c = a + side, d = c + 1;
+                fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                        a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+            }
+        }
+        fclose(file);
     }
+    struct stat source;
+    stat(path.c_str(), &source);
 
-    // Build the scene with objects
-    BuildScene(scene);
+    cout << "Mesh load benchmark: " << 2 * (side - 1) * (side - 1) << " triangles, " << side * side << " vertices, OBJ "
+         << fixed << setprecision(1) << source.st_size / 1048576.0 << " MB" << endl;
+    cout << "format   start  import_ms  optimize_ms  encode_write_ms  map_ms  upload_ms  total_ms  cache_mb" << endl;
 
-    // Rendering loop
-    while (!glfwWindowShouldClose(gWindow))
-    {
-        // Set the background color of the window
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    for (VertexFormat format : { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_COMPACT }) {
+        string cachePath = getMeshCachePath(path, format);
+        remove(cachePath.c_str());
 
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
-        gLastFrame = currentFrame;
+        for (int run = 0; run <= WARM_RUNS; ++run) {
+            MeshLoadReport report;
+            auto start = chrono::steady_clock::now();
+            MeshHandle mesh = loadMeshFile(path, format, true, &report);
+            glFinish();
+            double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            if (!mesh) {
+                break;
+            }
 
-        // Process user input
-        ProcessInput(gWindow);
+            struct stat cache;
+            double cacheMb = stat(cachePath.c_str(), &cache) == 0 ? cache.st_size / 1048576.0 : 0.0;
+            cout << left << setw(9) << (format == VERTEX_FORMAT_COMPACT ? "compact" : "float") << setw(5)
+                 << (report.fromCache ? "warm" : "cold") << right << fixed << setprecision(2)
+                 << setw(11) << report.importMs << setw(13) << report.optimizeMs << setw(17) << report.cacheWriteMs
+                 << setw(8) << report.mapMs << setw(11) << report.uploadMs << setw(10) << totalMs
+                 << setw(10) << setprecision(1) << cacheMb << endl;
+        }
+        remove(cachePath.c_str());
+    }
+    remove(path.c_str());
+}
 
-        // Create view matrix from camera
-        glm::mat4 view = gCamera.GetViewMatrix();
+// Report ACMR before and after optimizeIndexOrder for generated grids, flat and wrapped
+// into a sphere: rows in generation order (as the shape generators emit them) and the
+// same triangles shuffled
+void RunIndexOrderBenchmark()
+{
+    cout << "Index order benchmark: FIFO cache of " << FIFO_CACHE_SIZE << " vertices" << endl;
+    cout << "mesh                triangles  acmr_before  vertex_cache  after  clusters  optimize_ms" << endl;
+    for (int side : { 16, 128, 255 }) {
+        for (int variant = 0; variant < 4; ++variant) {
+            bool sphere = variant >= 2;
+            bool shuffled = variant % 2 == 1;
 
-        // Create perspective or orthographic projection matrix
-        glm::mat4 projection;
-        if (!perspective)
-        {
-            // Perspective projection (default)
-            projection = glm::perspective(glm::radians(gCamera.Zoom), 
-                                         (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 
-                                          0.1f, 100.0f);
-        }
-        else
-        {
-            // Orthographic projection
-            projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
-        }
+            // side x side quads, in the XY plane facing +Z or around the unit sphere
+            vector<float> vertices;
+            for (int y = 0; y <= side; ++y) {
+                for (int x = 0; x <= side; ++x) {
+                    float u = (float)x / side, v = (float)y / side;
+                    glm::vec3 position(u - 0.5f, v - 0.5f, 0.0f), normal(0.0f, 0.0f, 1.0f);
+                    if (sphere) {
+                        float theta = v * glm::pi<float>(), phi = u * 2.0f * glm::pi<float>();
+                        normal = glm::vec3(cos(phi) * sin(theta), cos(theta), -sin(phi) * sin(theta));
+                        position = normal * 0.5f;
+                    }
+                    vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z, u, v });
+                }
+            }
+            vector<unsigned int> indices;
+            unsigned int edge = side + 1;
+            for (unsigned int y = 0; y < (unsigned int)side; ++y) {
+                for (unsigned int x = 0; x < (unsigned int)side; ++x) {
+                    unsigned int first = y * edge + x;
+                    indices.insert(indices.end(), { first, first + 1, first + edge + 1, first + edge + 1, first + edge, first });
+                }
+            }
+            if (shuffled) {
+                // Deterministic Fisher-Yates over whole triangles
+                uint32_t state = 12345;
+                for (size_t t = indices.size() / 3 - 1; t > 0; --t) {
+                    state = state * 1664525u + 1013904223u;
+                    size_t other = state % (t + 1);
+                    for (int k = 0; k < 3; ++k) {
+                        swap(indices[t * 3 + k], indices[other * 3 + k]);
+                    }
+                }
+            }
 
-        // Render the scene
-        scene.render(view, projection);
+            auto start = chrono::steady_clock::now();
+            IndexOrderReport report = optimizeIndexOrder(indices, vertices);
+            double optimizeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-        // Swap front and back buffers
-        glfwSwapBuffers(gWindow);
-        glfwPollEvents();
+            string name = (sphere ? "sphere " : "grid ") + to_string(side) + (shuffled ? " shuffled" : "");
+            cout << left << setw(20) << name << right << setw(9) << indices.size() / 3 << fixed << setprecision(3)
+                 << setw(13) << report.acmrBefore << setw(14) << report.acmrVertexCache << setw(7) << report.acmrAfter
+                 << setw(10) << report.clusterCount << setw(13) << optimizeMs << endl;
+        }
     }
-
-    // Exit with success
-    exit(EXIT_SUCCESS);
 }
 
-// Build the scene with objects
-void BuildScene(Scene& scene)
+// Compare the original byte loop with the vectorized row swap over a range of image sizes
+void RunFlipBenchmark()
 {
-    // Create a cube with texture
-    auto cube1 = make_shared<Cube>(
-        1.0f,                           // Size
-        glm::vec3(0.0f, 0.0f, 0.0f),    // Position
-        glm::vec3(1.0f, 1.0f, 1.0f),    // Scale
-        glm::vec3(1.0f, 1.0f, 1.0f),    // Color
-        "textures/wood.jpg",            // Texture path (adjust as needed)
-        glm::vec2(1.0f, 1.0f)           // UV scale
-    );
-    
-    // Create another cube with different size and position
-    auto cube2 = make_shared<Cube>(
-        1.5f,                           // Size
-        glm::vec3(2.5f, 0.0f, 0.0f),    // Position
-        glm::vec3(1.0f, 1.0f, 1.0f),    // Scale
-        glm::vec3(1.0f, 1.0f, 1.0f),    // Color
-        "textures/brick.jpg",           // Texture path (adjust as needed)
-        glm::vec2(1.0f, 1.0f)           // UV scale
-    );
-    
-    // Add cubes to the scene
-    scene.addShape(cube1);
-    scene.addShape(cube2);
-    
-    // Create lights
-    auto fillerLight = make_shared<Light>(
-        glm::vec3(2.5f, 5.0f, -0.8f),   // Position
-        glm::vec3(1.0f, 1.0f, 1.0f),    // Color (white)
-        0.2f,                           // Size
-        0.8f                            // Intensity
-    );
-    
-    auto keyLight = make_shared<Light>(
-        glm::vec3(-1.5f, 4.0f, -3.6f),  // Position
-        glm::vec3(0.0f, 0.0f, 1.0f),    // Color (blue)
-        0.1f,                           // Size
-        0.5f                            // Intensity
-    );
-    
-    // Add lights to the scene
-    scene.addLight(fillerLight);
-    scene.addLight(keyLight);
+#if defined(SIMD_AVX2)
+    const char* kernel = "AVX2";
+#elif defined(SIMD_SSE2)
+    const char* kernel = "SSE2";
+#else
+    const char* kernel = "scalar";
+#endif
+    cout << "Flip benchmark (" << kernel << " row swap)" << endl;
+    cout << "size   channels   scalar_ms     simd_ms  speedup  simd_GB/s" << endl;
+
+    for (int size = 256; size <= 8192; size *= 2) {
+        for (int channels = 3; channels <= 4; ++channels) {
+            size_t bytes = static_cast<size_t>(size) * size * channels;
+            vector<unsigned char> reference(bytes);
+            for (size_t i = 0; i < bytes; ++i) {
+                reference[i] = static_cast<unsigned char>(i * 2654435761u >> 24);
+            }
+            vector<unsigned char> image = reference;
+
+            // Best of several runs; fewer for the large sizes so the benchmark stays short
+            int runs = max(1, (64 * 1024 * 1024) / static_cast<int>(min(bytes, (size_t)64 * 1024 * 1024)));
+            runs = min(runs, 20);
+            double scalarMs = 1e30;
+            double simdMs = 1e30;
+            for (int run = 0; run < runs; ++run) {
+                auto start = chrono::steady_clock::now();
+                flipImageVerticallyScalar(reference.data(), size, size, channels);
+                scalarMs = min(scalarMs, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+                start = chrono::steady_clock::now();
+                flipImageVertically(image.data(), size, size, channels);
+                simdMs = min(simdMs, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            }
+
+            if (image != reference) {
+                cerr << "Flip mismatch at " << size << "x" << size << "x" << channels << endl;
+                exit(EXIT_FAILURE);
+            }
+
+            // Each flip reads and writes every byte once
+            double gigabytesPerSecond = (2.0 * bytes / 1e9) / (simdMs / 1000.0);
+            cout << left << setw(7) << size << right << setw(9) << channels
+                 << fixed << setprecision(3) << setw(12) << scalarMs << setw(12) << simdMs
+                 << setprecision(1) << setw(8) << scalarMs / simdMs << "x" << setw(11) << gigabytesPerSecond << endl;
+        }
+    }
 }
 
 bool Initialize(int argc, char* argv[], GLFWwindow** window)
@@ -929,6 +10370,17 @@ bool Initialize(int argc, char* argv[], GLFWwindow** window)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+    // Headless runs use an invisible window; --egl requests an EGL context (e.g. Mesa llvmpipe)
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--headless") {
+            headless = true;
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        } else if (string(argv[i]) == "--egl") {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        }
+    }
+
     // Create the window using constants for parameters
     *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
 
@@ -945,7 +10397,9 @@ bool Initialize(int argc, char* argv[], GLFWwindow** window)
     glfwSetCursorPosCallback(*window, MousePositionCallback);
     glfwSetScrollCallback(*window, MouseScrollCallback);
     glfwSetMouseButtonCallback(*window, MouseButtonCallback);
-    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!headless) {
+        glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
     // Initialize GLEW
     glewExperimental = GL_TRUE;
@@ -1004,7 +10458,11 @@ void ProcessInput(GLFWwindow* window)
             pos.y -= 0.05f;
         if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
             pos.y += 0.05f;
-        fillerLight->setPosition(pos);
+
+        // Only an actual move dirties the light's node
+        if (pos != fillerLight->getPosition()) {
+            fillerLight->setPosition(pos);
+        }
     }
 
     // Get key light (index 1)
@@ -1053,6 +10511,54 @@ void ProcessInput(GLFWwindow* window)
         perspective = false;
     if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
         perspective = true;
+
+    // Toggle instanced batches versus one draw call per shape
+    if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS)
+        scene.setInstancingEnabled(true);
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
+        scene.setInstancingEnabled(false);
+
+    // Toggle multi-draw-indirect submission
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
+        scene.setMultiDrawEnabled(true);
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
+        scene.setMultiDrawEnabled(false);
+
+    // Toggle frustum culling
+    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
+        scene.setCullingEnabled(true);
+    if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
+        scene.setCullingEnabled(false);
+
+    // Toggle deferred versus forward shading
+    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+        scene.setDeferredEnabled(true);
+    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
+        scene.setDeferredEnabled(false);
+
+    // Toggle shadow maps
+    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+        scene.setShadowsEnabled(true);
+    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS)
+        scene.setShadowsEnabled(false);
+
+    // Toggle occlusion culling
+    if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS)
+        scene.setOcclusionCullingEnabled(true);
+    if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS)
+        scene.setOcclusionCullingEnabled(false);
+
+    // Toggle software occlusion culling against the occluder shapes
+    if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS)
+        scene.setSoftwareOcclusionEnabled(true);
+    if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS)
+        scene.setSoftwareOcclusionEnabled(false);
+
+    // Toggle the depth (Z) prepass
+    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
+        scene.setDepthPrepassEnabled(true);
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+        scene.setDepthPrepassEnabled(false);
 }
 
 void ResizeWindow(GLFWwindow* window, int width, int height)